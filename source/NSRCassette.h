@@ -0,0 +1,208 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRCassette.h
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ One request and the response it got, as kept in an <NSRCassette>.
+ */
+@interface NSRCassetteInteraction : NSObject
+
+/**
+ HTTP method of the request.
+ */
+@property (nonatomic, strong) NSString *httpMethod;
+
+/**
+ Full URL of the request, query string included.
+ */
+@property (nonatomic, strong) NSURL *URL;
+
+/**
+ Headers the request was sent with.
+ */
+@property (nonatomic, strong) NSDictionary *requestHeaders;
+
+/**
+ Body the request was sent with. Streamed (multipart) bodies are read again from a fresh stream once the request is done.
+ 
+ `nil` for requests without one, and for a body longer than the cassette's <NSRCassette maximumRecordedBodyLength>.
+ */
+@property (nonatomic, strong) NSData *requestBody;
+
+/**
+ Status code of the response. `0` if the request failed without one.
+ */
+@property (nonatomic) NSInteger statusCode;
+
+/**
+ Headers of the response.
+ */
+@property (nonatomic, strong) NSDictionary *responseHeaders;
+
+/**
+ Body of the response, exactly as NSRails received it.
+ 
+ `nil` if it wasn't kept: event streams (`text/event-stream`) are never recorded, and neither is a body longer than the cassette's <NSRCassette maximumRecordedBodyLength> (see <responseBodyDropped>).
+ */
+@property (nonatomic, strong) NSData *responseBody;
+
+/**
+ `YES` if the response had a body, but it was too long to record.
+ 
+ Such an interaction can't be replayed - a request that matches it fails with `NSURLErrorResourceUnavailable`, rather than getting the status with an empty body. So does one whose `Content-Length` header says there should be a body, but that has none.
+ */
+@property (nonatomic) BOOL responseBodyDropped;
+
+/**
+ Error the request failed with (a timeout, say), if it never got a complete response.
+ */
+@property (nonatomic, strong) NSError *error;
+
+/**
+ When the request went out, in seconds since the first request recorded on the cassette.
+ */
+@property (nonatomic) NSTimeInterval offset;
+
+/**
+ Seconds between the request going out and its response headers coming in.
+ */
+@property (nonatomic) NSTimeInterval responseTime;
+
+/**
+ Seconds between the request going out and the last of its response coming in.
+ */
+@property (nonatomic) NSTimeInterval duration;
+
+@end
+
+/**
+ Records the HTTP traffic of requests, and plays it back later in place of the network.
+ 
+ Set a cassette as a config's <NSRConfig cassette>, and every request made with that config goes through it. While <recording>, requests go out as usual and each one is added to <interactions> along with its response and timing. Otherwise, no request is sent: the response recorded for it is handed back instead, after the same amount of time it originally took (scaled by <timeScale>).
+ 
+ Replayed bodies are the exact bytes that were recorded, so parsing and decoding take as long as they did with the real thing. This makes cassettes good for benchmarking against production-shaped traffic offline:
+ 
+    NSRCassette *cassette = [[NSRCassette alloc] init];
+    [[NSRConfig defaultConfig] setCassette:cassette];
+    
+    [Post remoteAll:nil];
+    [cassette writeToFile:path error:nil];
+    
+    //later
+    cassette = [NSRCassette cassetteWithContentsOfFile:path error:nil];
+    cassette.timeScale = 0.5;
+    [[NSRConfig defaultConfig] setCassette:cassette];
+    
+    [Post remoteAll:nil]; //same response, in half the time
+ 
+ Requests are matched to interactions by HTTP method and URL. Interactions with the same method and URL are played back in the order they were recorded, each once (see <repeatsInteractions>). A request with nothing left to match fails with `NSURLErrorResourceUnavailable`.
+ */
+@interface NSRCassette : NSObject
+
+/**
+ Loads a cassette saved with <writeToFile:error:>, ready to replay.
+ 
+ @param path Path of the cassette file.
+ @param error Out parameter set if the file couldn't be read or isn't a cassette.
+ @return The loaded cassette, or `nil` if there was an error.
+ */
++ (instancetype) cassetteWithContentsOfFile:(NSString *)path error:(NSError **)error;
+
+/**
+ Loads a cassette from data returned by <dataRepresentation>, ready to replay.
+ 
+ @param data Cassette data.
+ @param error Out parameter set if the data isn't a cassette.
+ @return The loaded cassette, or `nil` if there was an error.
+ */
++ (instancetype) cassetteWithData:(NSData *)data error:(NSError **)error;
+
+/**
+ Whether requests are sent over the network and recorded (`YES`) or answered from <interactions> (`NO`).
+ 
+ **Default:** `YES` for a new, empty cassette; `NO` for a loaded one.
+ */
+@property (nonatomic) BOOL recording;
+
+/**
+ How long replayed responses take, as a multiple of the time they took when recorded.
+ 
+ `1` replays with the original timing, `0` answers as soon as the request is made.
+ 
+ **Default:** `1`.
+ */
+@property (nonatomic) double timeScale;
+
+/**
+ When `YES`, a request whose matching interactions have all been played gets the last of them again, instead of failing.
+ 
+ **Default:** `NO`.
+ */
+@property (nonatomic) BOOL repeatsInteractions;
+
+/**
+ Longest body that's recorded, in bytes. A longer response body stops being buffered once it passes this, and its interaction is recorded without one (and with <NSRCassetteInteraction responseBodyDropped> set), so streamed downloads don't pile up in memory. The request itself still gets the whole body, but replaying that interaction fails. Request bodies past this length aren't recorded either.
+ 
+ Responses from event streams (such as an <NSRSubscription>'s) never have their body recorded, since they don't end.
+ 
+ `0` records bodies of any length.
+ 
+ **Default:** 8 MB.
+ */
+@property (nonatomic) NSUInteger maximumRecordedBodyLength;
+
+/**
+ Everything recorded (or loaded) so far, in the order the requests went out. Array of NSRCassetteInteraction objects.
+ */
+@property (nonatomic, readonly) NSArray *interactions;
+
+/**
+ Marks every interaction as unplayed, so the cassette can be replayed again from the start.
+ */
+- (void) rewind;
+
+/**
+ The cassette as JSON, with bodies Base64-encoded.
+ 
+ @return JSON data that <cassetteWithData:error:> can load.
+ */
+- (NSData *) dataRepresentation;
+
+/**
+ Saves the cassette to a file.
+ 
+ @param path Path of the file to write.
+ @param error Out parameter set if the file couldn't be written.
+ @return Whether the file was written.
+ */
+- (BOOL) writeToFile:(NSString *)path error:(NSError **)error;
+
+@end
@@ -0,0 +1,664 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRCassette.m
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import "NSRCassette.h"
+#import "NSRRequest.h"
+#import "NSRMultipartBody.h"
+
+@interface NSRRequest (private)
+
++ (NSString *) base64EncodingOfData:(NSData *)data;
++ (NSData *) dataByDecodingBase64String:(NSString *)string;
+
+@end
+
+static inline NSTimeInterval NSRNow(void)
+{
+    //monotonic, unlike NSDate
+    return [NSProcessInfo processInfo].systemUptime;
+}
+
+@interface NSRCassette (private)
+
+- (NSRCassetteInteraction *) interactionForRequest:(NSURLRequest *)request;
+- (NSError *) unmatchedErrorForRequest:(NSURLRequest *)request;
+- (NSError *) missingBodyErrorForRequest:(NSURLRequest *)request;
+- (NSData *) recordedBodyOfUpload:(NSRMultipartBody *)uploadBody;
+- (void) recordRequest:(NSURLRequest *)request body:(NSData *)body response:(NSURLResponse *)response data:(NSData *)data dropped:(BOOL)dropped error:(NSError *)error start:(NSTimeInterval)start firstByte:(NSTimeInterval)firstByte end:(NSTimeInterval)end;
+
+- (NSData *) sendSynchronousRequest:(NSURLRequest *)request uploadBody:(NSRMultipartBody *)uploadBody returningResponse:(NSURLResponse **)response error:(NSError **)error;
+- (id) connectionWithRequest:(NSURLRequest *)request uploadBody:(NSRMultipartBody *)uploadBody delegate:(id<NSURLConnectionDataDelegate>)delegate;
+
+@end
+
+@interface NSRCassetteInteraction (private)
+
+- (id) initWithDictionary:(NSDictionary *)dict;
+- (NSDictionary *) dictionaryRepresentation;
+- (NSHTTPURLResponse *) HTTPResponse;
+- (BOOL) isMissingResponseBody;
+
+@end
+
+//stands in for the NSURLConnection of an asynchronous request. while recording, it wraps the real connection and
+//listens in on its delegate callbacks - while replaying, it makes those callbacks itself, with the recorded response
+
+@interface NSRCassetteConnection : NSObject <NSURLConnectionDataDelegate>
+
+- (id) initWithCassette:(NSRCassette *)cassette request:(NSURLRequest *)request uploadBody:(NSRMultipartBody *)uploadBody delegate:(id<NSURLConnectionDataDelegate>)delegate;
+
+- (void) setDelegateQueue:(NSOperationQueue *)queue;
+- (void) start;
+- (void) cancel;
+
+@end
+
+@implementation NSRCassetteInteraction
+
+- (id) initWithDictionary:(NSDictionary *)dict
+{
+    if ((self = [super init]))
+    {
+        NSDictionary *request = dict[@"request"];
+        NSDictionary *response = dict[@"response"];
+        NSDictionary *error = dict[@"error"];
+        
+        if (![request isKindOfClass:[NSDictionary class]] || ![request[@"url"] isKindOfClass:[NSString class]]) {
+            return nil;
+        }
+        
+        self.httpMethod = request[@"method"];
+        self.URL = [NSURL URLWithString:request[@"url"]];
+        self.requestHeaders = request[@"headers"];
+        if (request[@"body"]) {
+            self.requestBody = [NSRRequest dataByDecodingBase64String:request[@"body"]];
+        }
+        
+        if ([response isKindOfClass:[NSDictionary class]])
+        {
+            self.statusCode = [response[@"status"] integerValue];
+            self.responseHeaders = response[@"headers"];
+            if (response[@"body"]) {
+                self.responseBody = [NSRRequest dataByDecodingBase64String:response[@"body"]];
+            }
+            self.responseBodyDropped = [response[@"body_dropped"] boolValue];
+        }
+        
+        if ([error isKindOfClass:[NSDictionary class]])
+        {
+            self.error = [NSError errorWithDomain:error[@"domain"]
+                                             code:[error[@"code"] integerValue]
+                                         userInfo:(error[@"description"] ? @{NSLocalizedDescriptionKey:error[@"description"]} : nil)];
+        }
+        
+        self.offset = [dict[@"offset"] doubleValue];
+        self.responseTime = [dict[@"response_time"] doubleValue];
+        self.duration = [dict[@"duration"] doubleValue];
+    }
+    return self;
+}
+
+- (NSDictionary *) dictionaryRepresentation
+{
+    NSMutableDictionary *request = [NSMutableDictionary dictionary];
+    request[@"method"] = self.httpMethod;
+    request[@"url"] = [self.URL absoluteString];
+    request[@"headers"] = self.requestHeaders ?: @{};
+    if (self.requestBody) {
+        request[@"body"] = [NSRRequest base64EncodingOfData:self.requestBody];
+    }
+    
+    NSMutableDictionary *dict = [NSMutableDictionary dictionary];
+    dict[@"request"] = request;
+    dict[@"offset"] = @(self.offset);
+    dict[@"response_time"] = @(self.responseTime);
+    dict[@"duration"] = @(self.duration);
+    
+    if (self.statusCode)
+    {
+        NSMutableDictionary *response = [NSMutableDictionary dictionary];
+        response[@"status"] = @(self.statusCode);
+        response[@"headers"] = self.responseHeaders ?: @{};
+        if (self.responseBody) {
+            response[@"body"] = [NSRRequest base64EncodingOfData:self.responseBody];
+        }
+        if (self.responseBodyDropped) {
+            response[@"body_dropped"] = @YES;
+        }
+        dict[@"response"] = response;
+    }
+    
+    if (self.error)
+    {
+        dict[@"error"] = @{@"domain":self.error.domain,
+                           @"code":@(self.error.code),
+                           @"description":[self.error localizedDescription] ?: @""};
+    }
+    
+    return dict;
+}
+
+- (NSHTTPURLResponse *) HTTPResponse
+{
+    if (!self.statusCode) {
+        return nil;
+    }
+    return [[NSHTTPURLResponse alloc] initWithURL:self.URL statusCode:self.statusCode HTTPVersion:@"HTTP/1.1" headerFields:self.responseHeaders];
+}
+
+//replaying these as the status with an empty body would look like a real (empty) response
+- (BOOL) isMissingResponseBody
+{
+    if (!self.statusCode || self.error || self.responseBody.length > 0) {
+        return NO;
+    }
+    if (self.responseBodyDropped) {
+        return YES;
+    }
+    
+    //written by hand, say - the headers still say how much there should be
+    return (![self.httpMethod isEqualToString:@"HEAD"] && [[self HTTPResponse] expectedContentLength] > 0);
+}
+
+@end
+
+@implementation NSRCassette
+{
+    NSMutableArray *interactions;
+    NSMutableIndexSet *played;
+    
+    NSTimeInterval firstRequest;
+}
+
+- (id) init
+{
+    if ((self = [super init]))
+    {
+        interactions = [[NSMutableArray alloc] init];
+        played = [[NSMutableIndexSet alloc] init];
+        
+        self.recording = YES;
+        self.timeScale = 1;
+        self.maximumRecordedBodyLength = 8 * 1024 * 1024;
+    }
+    return self;
+}
+
++ (instancetype) cassetteWithData:(NSData *)data error:(NSError **)error
+{
+    NSDictionary *dict = [NSJSONSerialization JSONObjectWithData:data options:0 error:error];
+    if (!dict) {
+        return nil;
+    }
+    
+    NSArray *recorded = ([dict isKindOfClass:[NSDictionary class]] ? dict[@"interactions"] : nil);
+    if (![recorded isKindOfClass:[NSArray class]])
+    {
+        if (error) {
+            *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadCorruptFileError userInfo:@{NSLocalizedDescriptionKey:@"Not an NSRails cassette."}];
+        }
+        return nil;
+    }
+    
+    NSRCassette *cassette = [[self alloc] init];
+    cassette.recording = NO;
+    
+    for (NSDictionary *interactionDict in recorded)
+    {
+        NSRCassetteInteraction *interaction = ([interactionDict isKindOfClass:[NSDictionary class]] ? [[NSRCassetteInteraction alloc] initWithDictionary:interactionDict] : nil);
+        if (!interaction)
+        {
+            if (error) {
+                *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadCorruptFileError userInfo:@{NSLocalizedDescriptionKey:@"Cassette has a malformed interaction."}];
+            }
+            return nil;
+        }
+        [cassette->interactions addObject:interaction];
+    }
+    
+    return cassette;
+}
+
++ (instancetype) cassetteWithContentsOfFile:(NSString *)path error:(NSError **)error
+{
+    NSData *data = [NSData dataWithContentsOfFile:path options:0 error:error];
+    if (!data) {
+        return nil;
+    }
+    return [self cassetteWithData:data error:error];
+}
+
+- (NSArray *) interactions
+{
+    @synchronized(self) {
+        return [interactions copy];
+    }
+}
+
+- (void) rewind
+{
+    @synchronized(self) {
+        [played removeAllIndexes];
+    }
+}
+
+- (NSData *) dataRepresentation
+{
+    NSArray *all = [self interactions];
+    
+    NSMutableArray *dicts = [NSMutableArray arrayWithCapacity:all.count];
+    for (NSRCassetteInteraction *interaction in all) {
+        [dicts addObject:[interaction dictionaryRepresentation]];
+    }
+    
+    return [NSJSONSerialization dataWithJSONObject:@{@"version":@1, @"interactions":dicts} options:NSJSONWritingPrettyPrinted error:nil];
+}
+
+- (BOOL) writeToFile:(NSString *)path error:(NSError **)error
+{
+    return [[self dataRepresentation] writeToFile:path options:NSDataWritingAtomic error:error];
+}
+
+#pragma mark - Recording
+
+//reads a copy of a streamed (multipart) request body, once it's been sent - the request's own stream is the connection's
+//to read. nil if it's over the limit
+- (NSData *) recordedBodyOfUpload:(NSRMultipartBody *)uploadBody
+{
+    if (!uploadBody) {
+        return nil;
+    }
+    
+    NSInputStream *stream = [uploadBody inputStream];
+    NSUInteger limit = self.maximumRecordedBodyLength;
+    NSMutableData *body = [NSMutableData data];
+    uint8_t buffer[16 * 1024];
+    NSInteger read;
+    
+    [stream open];
+    while ((read = [stream read:buffer maxLength:sizeof(buffer)]) > 0)
+    {
+        [body appendBytes:buffer length:read];
+        if (limit && body.length > limit)
+        {
+            body = nil;
+            break;
+        }
+    }
+    [stream close];
+    
+    return (read < 0 ? nil : body);
+}
+
+//`dropped` is for a response body that was there but not kept (data is nil then)
+- (void) recordRequest:(NSURLRequest *)request body:(NSData *)body response:(NSURLResponse *)response data:(NSData *)data dropped:(BOOL)dropped error:(NSError *)error start:(NSTimeInterval)start firstByte:(NSTimeInterval)firstByte end:(NSTimeInterval)end
+{
+    NSRCassetteInteraction *interaction = [[NSRCassetteInteraction alloc] init];
+    interaction.httpMethod = request.HTTPMethod;
+    interaction.URL = request.URL;
+    interaction.requestHeaders = request.allHTTPHeaderFields;
+    
+    NSData *requestBody = (body ?: request.HTTPBody);
+    if (!self.maximumRecordedBodyLength || requestBody.length <= self.maximumRecordedBodyLength) {
+        interaction.requestBody = requestBody;
+    }
+    
+    if ([response isKindOfClass:[NSHTTPURLResponse class]])
+    {
+        interaction.statusCode = [(NSHTTPURLResponse *)response statusCode];
+        interaction.responseHeaders = [(NSHTTPURLResponse *)response allHeaderFields];
+        if (!error)
+        {
+            if (self.maximumRecordedBodyLength && data.length > self.maximumRecordedBodyLength) {
+                dropped = YES;
+            }
+            else {
+                interaction.responseBody = data;
+            }
+            interaction.responseBodyDropped = dropped;
+        }
+    }
+    interaction.error = error;
+    
+    interaction.responseTime = (firstByte ?: end) - start;
+    interaction.duration = end - start;
+    
+    @synchronized(self)
+    {
+        if (!firstRequest) {
+            firstRequest = start;
+        }
+        interaction.offset = start - firstRequest;
+        
+        //kept in the order requests went out, which isn't necessarily the order they finished in
+        NSUInteger index = interactions.count;
+        while (index > 0 && [interactions[index - 1] offset] > interaction.offset) {
+            index--;
+        }
+        [interactions insertObject:interaction atIndex:index];
+    }
+}
+
+#pragma mark - Replaying
+
+- (NSRCassetteInteraction *) interactionForRequest:(NSURLRequest *)request
+{
+    NSString *url = [request.URL absoluteString];
+    
+    @synchronized(self)
+    {
+        NSRCassetteInteraction *last = nil;
+        
+        for (NSUInteger i = 0; i < interactions.count; i++)
+        {
+            NSRCassetteInteraction *interaction = interactions[i];
+            if (![interaction.httpMethod isEqualToString:request.HTTPMethod] || ![[interaction.URL absoluteString] isEqualToString:url]) {
+                continue;
+            }
+            
+            if (![played containsIndex:i])
+            {
+                [played addIndex:i];
+                return interaction;
+            }
+            last = interaction;
+        }
+        
+        return (self.repeatsInteractions ? last : nil);
+    }
+}
+
+- (NSError *) unmatchedErrorForRequest:(NSURLRequest *)request
+{
+    NSString *description = [NSString stringWithFormat:@"No recorded response left on the cassette for %@ %@.", request.HTTPMethod, [request.URL absoluteString]];
+    return [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorResourceUnavailable userInfo:@{NSLocalizedDescriptionKey:description}];
+}
+
+- (NSError *) missingBodyErrorForRequest:(NSURLRequest *)request
+{
+    NSString *description = [NSString stringWithFormat:@"The response recorded for %@ %@ is missing its body (it was longer than the cassette's maximumRecordedBodyLength), so it can't be replayed.", request.HTTPMethod, [request.URL absoluteString]];
+    return [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorResourceUnavailable userInfo:@{NSLocalizedDescriptionKey:description}];
+}
+
+#pragma mark - Transport
+
+//these are where NSRRequest hands off to the network when its config has a cassette
+
+//uploadBody is where the request's HTTPBodyStream came from, if it has one, so that body can be recorded too
+- (NSData *) sendSynchronousRequest:(NSURLRequest *)request uploadBody:(NSRMultipartBody *)uploadBody returningResponse:(NSURLResponse **)responseOut error:(NSError **)errorOut
+{
+    if (self.recording)
+    {
+        NSURLResponse *response = nil;
+        NSError *error = nil;
+        
+        NSTimeInterval start = NSRNow();
+        NSData *data = [NSURLConnection sendSynchronousRequest:request returningResponse:&response error:&error];
+        NSTimeInterval end = NSRNow();
+        
+        //the synchronous API doesn't say when the headers came in
+        [self recordRequest:request body:[self recordedBodyOfUpload:uploadBody] response:response data:data dropped:NO error:error start:start firstByte:0 end:end];
+        
+        if (responseOut) {
+            *responseOut = response;
+        }
+        if (errorOut) {
+            *errorOut = error;
+        }
+        return data;
+    }
+    
+    NSRCassetteInteraction *interaction = [self interactionForRequest:request];
+    if (!interaction || [interaction isMissingResponseBody])
+    {
+        if (errorOut) {
+            *errorOut = (interaction ? [self missingBodyErrorForRequest:request] : [self unmatchedErrorForRequest:request]);
+        }
+        return nil;
+    }
+    
+    if (interaction.duration * self.timeScale > 0) {
+        [NSThread sleepForTimeInterval:interaction.duration * self.timeScale];
+    }
+    
+    if (responseOut) {
+        *responseOut = [interaction HTTPResponse];
+    }
+    if (errorOut) {
+        *errorOut = interaction.error;
+    }
+    return (interaction.error ? nil : (interaction.responseBody ?: [NSData data]));
+}
+
+- (id) connectionWithRequest:(NSURLRequest *)request uploadBody:(NSRMultipartBody *)uploadBody delegate:(id<NSURLConnectionDataDelegate>)delegate
+{
+    return [[NSRCassetteConnection alloc] initWithCassette:self request:request uploadBody:uploadBody delegate:delegate];
+}
+
+@end
+
+@implementation NSRCassetteConnection
+{
+    NSRCassette *cassette;
+    NSURLRequest *request;
+    NSRMultipartBody *uploadBody;
+    id<NSURLConnectionDataDelegate> delegate;
+    NSOperationQueue *delegateQueue;
+    
+    //recording
+    NSURLConnection *connection;
+    NSURLResponse *response;
+    NSMutableData *data;
+    BOOL dropsBody;
+    NSTimeInterval start, firstByte;
+    
+    //replaying
+    BOOL cancelled;
+}
+
+- (id) initWithCassette:(NSRCassette *)aCassette request:(NSURLRequest *)aRequest uploadBody:(NSRMultipartBody *)anUploadBody delegate:(id<NSURLConnectionDataDelegate>)aDelegate
+{
+    if ((self = [super init]))
+    {
+        cassette = aCassette;
+        request = aRequest;
+        uploadBody = anUploadBody;
+        delegate = aDelegate;
+        
+        if (cassette.recording) {
+            connection = [[NSURLConnection alloc] initWithRequest:request delegate:self startImmediately:NO];
+        }
+    }
+    return self;
+}
+
+- (void) setDelegateQueue:(NSOperationQueue *)queue
+{
+    delegateQueue = queue;
+    [connection setDelegateQueue:queue];
+}
+
+- (void) start
+{
+    if (connection)
+    {
+        start = NSRNow();
+        [connection start];
+        return;
+    }
+    
+    //matched when it goes out (not when it was made), so the cassette is played back in the order requests are sent
+    NSRCassetteInteraction *interaction = [cassette interactionForRequest:request];
+    double scale = cassette.timeScale;
+    
+    NSOperationQueue *queue = delegateQueue ?: [NSOperationQueue mainQueue];
+    NSURLConnection *me = (NSURLConnection *)self;
+    
+    void (^deliver)(NSTimeInterval, void (^)(void)) = ^(NSTimeInterval delay, void (^callback)(void))
+    {
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(MAX(delay, 0) * scale * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            [queue addOperationWithBlock:^{
+                if (!cancelled) {
+                    callback();
+                }
+            }];
+        });
+    };
+    
+    if (!interaction || [interaction isMissingResponseBody])
+    {
+        NSError *error = (interaction ? [cassette missingBodyErrorForRequest:request] : [cassette unmatchedErrorForRequest:request]);
+        deliver(0, ^{
+            [delegate connection:me didFailWithError:error];
+        });
+        return;
+    }
+    
+    NSHTTPURLResponse *recordedResponse = [interaction HTTPResponse];
+    if (!recordedResponse)
+    {
+        deliver(interaction.duration, ^{
+            [delegate connection:me didFailWithError:interaction.error];
+        });
+        return;
+    }
+    
+    //the body is only scheduled once the headers have been handed over, so the two can't swap places on a concurrent queue
+    deliver(interaction.responseTime, ^{
+        [delegate connection:me didReceiveResponse:recordedResponse];
+        
+        deliver(interaction.duration - interaction.responseTime, ^{
+            if (interaction.error)
+            {
+                [delegate connection:me didFailWithError:interaction.error];
+                return;
+            }
+            
+            if (interaction.responseBody.length > 0) {
+                [delegate connection:me didReceiveData:interaction.responseBody];
+            }
+            
+            //the delegate may have cancelled from didReceiveData:
+            if (!cancelled) {
+                [delegate connectionDidFinishLoading:me];
+            }
+        });
+    });
+}
+
+- (void) cancel
+{
+    cancelled = YES;
+    [connection cancel];
+}
+
+#pragma mark - NSURLConnectionDataDelegate
+
+//the delegate is handed this wrapper (it's what the request or subscription holds on to), never the real connection inside it
+
+- (void) connection:(NSURLConnection *)aConnection didReceiveResponse:(NSURLResponse *)aResponse
+{
+    firstByte = NSRNow();
+    response = aResponse;
+    
+    //an event stream never finishes, so there's no point keeping what's come in so far
+    dropsBody = [[aResponse MIMEType] isEqualToString:@"text/event-stream"];
+    data = (dropsBody ? nil : [NSMutableData data]);
+    
+    [delegate connection:(NSURLConnection *)self didReceiveResponse:aResponse];
+}
+
+- (void) connection:(NSURLConnection *)aConnection didReceiveData:(NSData *)someData
+{
+    if (!dropsBody)
+    {
+        [data appendData:someData];
+        
+        //too long to record - stop holding on to it for the rest of the download
+        NSUInteger limit = cassette.maximumRecordedBodyLength;
+        if (limit && data.length > limit)
+        {
+            dropsBody = YES;
+            data = nil;
+        }
+    }
+    
+    [delegate connection:(NSURLConnection *)self didReceiveData:someData];
+}
+
+- (void) connectionDidFinishLoading:(NSURLConnection *)aConnection
+{
+    NSTimeInterval end = NSRNow();
+    
+    //event streams aren't replayable anyway, so theirs doesn't count as dropped
+    BOOL dropped = (dropsBody && ![[response MIMEType] isEqualToString:@"text/event-stream"]);
+    [cassette recordRequest:request body:[cassette recordedBodyOfUpload:uploadBody] response:response data:data dropped:dropped error:nil start:start firstByte:firstByte end:end];
+    [delegate connectionDidFinishLoading:(NSURLConnection *)self];
+}
+
+- (void) connection:(NSURLConnection *)aConnection didFailWithError:(NSError *)error
+{
+    NSTimeInterval end = NSRNow();
+    [cassette recordRequest:request body:[cassette recordedBodyOfUpload:uploadBody] response:response data:nil dropped:NO error:error start:start firstByte:firstByte end:end];
+    [delegate connection:(NSURLConnection *)self didFailWithError:error];
+}
+
+//anything else the connection asks (auth challenges, caching, redirects, new body streams) goes straight to the real delegate,
+//with this wrapper swapped in for the connection
+
+- (BOOL) respondsToSelector:(SEL)aSelector
+{
+    return [super respondsToSelector:aSelector] || [delegate respondsToSelector:aSelector];
+}
+
+- (NSMethodSignature *) methodSignatureForSelector:(SEL)aSelector
+{
+    return [super methodSignatureForSelector:aSelector] ?: [(NSObject *)delegate methodSignatureForSelector:aSelector];
+}
+
+- (void) forwardInvocation:(NSInvocation *)invocation
+{
+    //every delegate method takes the connection first (after self and _cmd)
+    NSMethodSignature *signature = invocation.methodSignature;
+    if (signature.numberOfArguments > 2 && [signature getArgumentTypeAtIndex:2][0] == '@')
+    {
+        __unsafe_unretained id first = nil;
+        [invocation getArgument:&first atIndex:2];
+        if (first == connection)
+        {
+            __unsafe_unretained id me = self;
+            [invocation setArgument:&me atIndex:2];
+        }
+    }
+    
+    [invocation invokeWithTarget:delegate];
+}
+
+@end
@@ -0,0 +1,88 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRCompletionBatcher.m
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import "NSRCompletionBatcher.h"
+
+@implementation NSRCompletionBatcher
+
+//both guarded by the class
+static NSMutableArray *pendingCompletions;
+static BOOL drainScheduled;
+
++ (void) initialize
+{
+    if (self == [NSRCompletionBatcher class])
+    {
+        pendingCompletions = [[NSMutableArray alloc] init];
+    }
+}
+
++ (void) performOnMainThread:(void (^)(void))completion window:(NSTimeInterval)window
+{
+    @synchronized(self)
+    {
+        [pendingCompletions addObject:[completion copy]];
+        
+        if (drainScheduled) {
+            return;
+        }
+        drainScheduled = YES;
+    }
+    
+    //a batch's window is set by whichever completion started it
+    if (window > 0) {
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(window * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{ [self drain]; });
+    }
+    else {
+        dispatch_async(dispatch_get_main_queue(), ^{ [self drain]; });
+    }
+}
+
++ (void) drain
+{
+    NSArray *batch;
+    @synchronized(self)
+    {
+        batch = pendingCompletions;
+        pendingCompletions = [[NSMutableArray alloc] init];
+        drainScheduled = NO;
+    }
+    
+    for (void (^completion)(void) in batch)
+    {
+        //one completion's temporaries shouldn't pile up until the whole batch is done
+        @autoreleasepool
+        {
+            completion();
+        }
+    }
+}
+
+@end
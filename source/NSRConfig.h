@@ -34,6 +34,10 @@
 #import <CoreData/CoreData.h>
 #endif
 
+@class NSRCassette;
+@protocol NSRRequestMetricsObserver;
+@protocol NSRWireCodec;
+
 ////////////////////////////////
 
 /**
@@ -53,6 +57,51 @@ typedef NS_ENUM(NSInteger, NSRRailsVersion) {
     NSRRailsVersion4
 };
 
+/**
+ How much network traffic NSRConfig's <networkLogLevel> lets through to the log.
+ */
+typedef NS_ENUM(NSInteger, NSRNetworkLogLevel) {
+    /**
+     Nothing is logged, and nothing is captured for logging.
+     */
+    NSRNetworkLogLevelNone = 0,
+    
+    /**
+     Only failed responses (server errors and connection errors) are logged.
+     */
+    NSRNetworkLogLevelError,
+    
+    /**
+     HTTP verbs with their outgoing URLs, and response status codes. Bodies are left out.
+     */
+    NSRNetworkLogLevelInfo,
+    
+    /**
+     Everything from `NSRNetworkLogLevelInfo`, plus request and response bodies.
+     */
+    NSRNetworkLogLevelBody
+};
+
+/**
+ How NSRConfig picks which of its <rootURLs> a request goes to.
+ */
+typedef NS_ENUM(NSInteger, NSREndpointSelectionPolicy) {
+    /**
+     Each endpoint in turn.
+     */
+    NSREndpointSelectionRoundRobin = 0,
+    
+    /**
+     The endpoint with the fewest requests in flight from this config.
+     */
+    NSREndpointSelectionLeastOutstandingRequests,
+    
+    /**
+     A random endpoint, weighted towards the ones with the quickest recent round trips.
+     */
+    NSREndpointSelectionLatencyWeighted
+};
+
 /**
  The NSRails configuration class is NSRConfig, a class that stores your Rails app's configuration settings (server URL, etc) for either your app globally or in specific instances. It also supports basic HTTP authentication and very simple OAuth authentication.
  
@@ -104,6 +153,8 @@ typedef NS_ENUM(NSInteger, NSRRailsVersion) {
     In these examples, everything within the blocks will be called using the config context specified, regardless of `<defaultConfig>`. The config for the current context can be retrieved using the `<contextuallyRelevantConfig>` class method.
  
     You can nest several config contexts within each other.
+ 
+    Contexts belong to the thread they're started on. Work on another thread or queue (including completion blocks) won't see them, and a context on another thread won't affect this one. Requests keep the config they were made with, so an async request started in a context finishes with it too.
  */
 
 @interface NSRConfig : NSObject <NSCoding>
@@ -115,9 +166,52 @@ typedef NS_ENUM(NSInteger, NSRRailsVersion) {
 
 /**
  Root URL for your Rails server.
+ 
+ With several <rootURLs>, this is the first of them.
  */
 @property (nonatomic, strong) NSURL *rootURL;
 
+/**
+ Root URLs of several servers (regional endpoints, say) serving the same Rails app, to spread requests across.
+ 
+ Each request goes to one of them, picked by <endpointSelectionPolicy>. An endpoint that fails <endpointFailureThreshold> requests in a row (connection errors and 5xx responses) is taken out of rotation for <endpointEjectionInterval>, then let back in on trial: one request, which puts it back if it succeeds. If every endpoint is out, requests still go to the one due back soonest.
+ 
+ A request that couldn't reach its endpoint is tried again on another one - as are `GET`, `HEAD`, `PUT` and `DELETE` requests that timed out, lost their connection, or got a `502`, `503` or `504`.
+ 
+ Setting this also sets <rootURL> to the first URL, and setting <rootURL> replaces these with just that one. Anything keyed by root URL (sync marks, for instance) uses the first one, so the order should stay the same between launches.
+ 
+ **Default:** `nil`, or <rootURL> on its own if that's set.
+ */
+@property (nonatomic, copy) NSArray *rootURLs;
+
+/**
+ How requests are spread across <rootURLs>.
+ 
+ **Default:** `NSREndpointSelectionRoundRobin`.
+ */
+@property (nonatomic) NSREndpointSelectionPolicy endpointSelectionPolicy;
+
+/**
+ Number of failed requests in a row after which one of the <rootURLs> is taken out of rotation. `0` never takes endpoints out.
+ 
+ **Default:** `3`.
+ */
+@property (nonatomic) NSUInteger endpointFailureThreshold;
+
+/**
+ How long, in seconds, one of the <rootURLs> stays out of rotation before it's tried again.
+ 
+ **Default:** `10`.
+ */
+@property (nonatomic) NSTimeInterval endpointEjectionInterval;
+
+/**
+ The <rootURLs> currently in rotation.
+ 
+ @return Root URLs that haven't been taken out for failing, in the order they were set.
+ */
+- (NSArray *) healthyRootURLs;
+
 /**
  When true, the completion blocks passed into asynchronous `remote` methods will be called on the main thread.
  
@@ -129,6 +223,37 @@ typedef NS_ENUM(NSInteger, NSRRailsVersion) {
  */
 @property (nonatomic) BOOL performsCompletionBlocksOnMainThread;
 
+/**
+ When true (and completion blocks are called on the main thread), completion blocks that come in close together are called one after another in a single pass on the main queue, instead of each getting its own dispatch.
+ 
+ A burst of responses (a sync that fires off many requests, say) then wakes the main thread once per batch rather than once per request. Blocks are still called in the order their requests finished.
+ 
+ How close together is set by <completionCoalescingWindow>.
+ 
+ **Default:** `NO`.
+ */
+@property (nonatomic) BOOL coalescesCompletionBlocks;
+
+/**
+ How long, in seconds, the first completion block of a batch waits for others to join it, when <coalescesCompletionBlocks> is on.
+ 
+ With `0`, a batch is whatever came in before the main queue got around to it - nothing is held back, and completions that come in while the main thread is busy are still called together.
+ 
+ **Default:** `0`.
+ */
+@property (nonatomic) NSTimeInterval completionCoalescingWindow;
+
+/**
+ Queue to call completion blocks on, instead of the main thread or the thread the response came in on.
+ 
+ Takes precedence over <performsCompletionBlocksOnMainThread> (and so <coalescesCompletionBlocks>). A request's own <NSRRequest completionQueue> takes precedence over this. Not archived.
+ 
+ Subscription events are delivered here too - use a serial queue (`maxConcurrentOperationCount` of 1) if they need to be applied in order.
+ 
+ **Default:** `nil`.
+ */
+@property (nonatomic, strong) NSOperationQueue *completionQueue;
+
 /**
  The network activity indicator (gray spinning wheel on the status bar) will automatically turn on and off with requests.
  
@@ -160,6 +285,76 @@ typedef NS_ENUM(NSInteger, NSRRailsVersion) {
  */
 @property (nonatomic) NSTimeInterval timeoutInterval;
 
+/**
+ When true, JSON responses will be parsed into mutable containers (NSMutableDictionary, NSMutableArray).
+ 
+ Only the containers are mutable - strings and numbers inside them are always immutable, so `mutableCopy` any string you need to change.
+ 
+ Immutable containers are smaller and faster to build, so leave this off unless your code (or your `decodeRemoteValue:forRemoteKey:` overrides) mutates the dictionaries and arrays coming in from the server. If only a few properties need it, you can also call `mutableCopy` on those values yourself.
+ 
+ **Default:** `NO`.
+ */
+@property (nonatomic) BOOL returnsMutableContainers;
+
+/**
+ When true, the strings in each response are deduplicated before it's decoded: every dictionary key, and every string value up to <maximumInternedStringLength> characters long, is swapped for one shared instance per response.
+ 
+ A large collection repeats the same keys in every element, and usually a lot of the same values too (statuses, types, tags). Since <NSRRemoteObject remoteAttributes> keeps each element's dictionary alive, so are all those copies. With this on, each distinct string is kept once.
+ 
+ This costs a pass over the parsed response, rebuilding its containers, so it pays off for big responses whose objects stick around.
+ 
+ **Default:** `NO`.
+ */
+@property (nonatomic) BOOL internsResponseStrings;
+
+/**
+ Longest string value (in characters) that's interned when <internsResponseStrings> is on. Keys are interned whatever their length.
+ 
+ **Default:** `64`.
+ */
+@property (nonatomic) NSUInteger maximumInternedStringLength;
+
+/**
+ Most distinct strings interned per response when <internsResponseStrings> is on. Once a response has this many, any new strings in it are left as they are, so a response full of unique values doesn't build a huge table.
+ 
+ **Default:** `4096`.
+ */
+@property (nonatomic) NSUInteger internedStringLimit;
+
+/**
+ When true, applying a remote dictionary to an object (<NSRRemoteObject setPropertiesUsingRemoteDictionary:>, and every `remoteX` method that decodes a response) only sets the properties whose values actually changed, and announces them all at once.
+ 
+ Refreshing objects that are on screen otherwise sets every property again, and anything bound to them over KVO hears about each one - changed or not. With this on, KVO observers only see real changes, and views can instead listen for:
+ 
+ - `NSRRemoteObjectDidChangeNotification`, posted once per object that already existed and had something change. Its `NSRChangedPropertiesKey` is an NSSet of the names of the properties that changed.
+ - `NSRRemoteObjectsDidChangeNotification`, posted once per batch (<NSRRemoteObject objectsWithRemoteDictionaries:>, or merging a delta sync) if anything in it changed. Its object is the class being decoded, `NSRChangedObjectsKey` is an array of the objects that changed, and `NSRInsertedObjectsKey` an array of the ones that were new.
+ 
+ Objects that were just created by the decode (and so can't be observed yet) don't get a notification of their own, only a place in their batch's `NSRInsertedObjectsKey`. Notifications are posted on the thread the decode happens on - the main thread for completion blocks, unless <performsCompletionBlocksOnMainThread> is off.
+ 
+ Values are compared with `isEqual:`. A nested object that's updated in place counts as a change to itself, not to its parent.
+ 
+ **Default:** `NO`.
+ */
+@property (nonatomic) BOOL coalescesChangeNotifications;
+
+/**
+ Format request bodies are sent in and responses are parsed from.
+ 
+ Its `contentType` is sent in the `Accept` header of every request, and as the `Content-Type` of request bodies. Responses that come back as `application/json` anyway (from an action that can't render anything else, for example) are still parsed as JSON.
+ 
+ Set to an <NSRMessagePackCodec> to talk MessagePack instead, or to your own object conforming to <NSRWireCodec>. Codecs that conform to `NSCoding` are archived along with the config; any other codec falls back to JSON when the config is unarchived.
+ 
+ **Default:** An <NSRJSONCodec>.
+ */
+@property (nonatomic, strong) id<NSRWireCodec> codec;
+
+/**
+ Size in bytes past which a response received with <NSRRequest sendAsynchronousStreamingElements:completion:> that isn't a top-level array is spooled to a temporary file rather than kept in memory.
+ 
+ **Default:** `1048576` (1 MB).
+ */
+@property (nonatomic) NSUInteger streamingSpoolThreshold;
+
 
 
 /// =============================================================================================
@@ -205,10 +400,137 @@ typedef NS_ENUM(NSInteger, NSRRailsVersion) {
  If `YES`, NSRails will log HTTP verbs with their outgoing URLs, as well as any any JSON going out/coming in
  and server errors. If `NO`, NSRails will log nothing.
  
+ Shorthand for <networkLogLevel>: setting `YES` is the same as setting `NSRNetworkLogLevelBody`, and `NO` the same as `NSRNetworkLogLevelNone`. Reads `YES` for any level other than `NSRNetworkLogLevelNone`.
+ 
  **Default:** `YES`.
  */
 @property (nonatomic) BOOL networkLogging;
 
+/**
+ How much of each request and response to log.
+ 
+ Logging never happens on the request path: requests only hand off references to what they already have (URL, status code, the body bytes that went over the wire) to a lock-free buffer, and the pretty-printing and `NSLog`ing happen later on a low-priority background queue. At `NSRNetworkLogLevelNone` not even that is done. If the background queue falls far enough behind that the buffer fills up, events are dropped (and the number dropped is logged) rather than slowing down requests.
+ 
+ **Default:** `NSRNetworkLogLevelBody`.
+ */
+@property (nonatomic) NSRNetworkLogLevel networkLogLevel;
+
+/**
+ Fraction of requests (from `0.0` to `1.0`) to log.
+ 
+ The decision is made once per request, so a request and its response are either both logged or both skipped. Failed responses are always logged as long as <networkLogLevel> is at least `NSRNetworkLogLevelError`.
+ 
+ **Default:** `1.0`.
+ */
+@property (nonatomic) float networkLogSampleRate;
+
+/**
+ Maximum number of bytes of each request/response body to log.
+ 
+ Bodies longer than this are cut off (and not pretty-printed). `0` means no limit.
+ 
+ **Default:** `0`.
+ */
+@property (nonatomic) NSUInteger networkLogMaxBodyBytes;
+
+/**
+ If set, called with each formatted log message instead of `NSLog`.
+ 
+ Called on NSRails' background logging queue.
+ */
+@property (nonatomic, copy) void (^networkLogHandler)(NSString *message);
+
+/// =============================================================================================
+/// @name Metrics
+/// =============================================================================================
+
+/**
+ Receives an NSRRequestMetrics (phase timings, byte counts, status) for every request made with this config, once the request has finished.
+ 
+ See <NSRRequestMetricsObserver>.
+ */
+@property (nonatomic, weak) id<NSRRequestMetricsObserver> metricsObserver;
+
+/**
+ When true, every request made with this config is rolled up into per-route counters and latency histograms, available from <requestMetricsByRoute>.
+ 
+ Requests only time their phases when this is on or a <metricsObserver> is set.
+ 
+ **Default:** `NO`.
+ */
+@property (nonatomic) BOOL collectsRequestMetrics;
+
+/**
+ A snapshot of the metrics collected so far while <collectsRequestMetrics> was on.
+ 
+ Keys are the HTTP method and route template, separated by a space (`@"GET posts/:id"`). Values are NSRRouteMetrics objects.
+ 
+ @return Dictionary of NSRRouteMetrics by route.
+ */
+- (NSDictionary *) requestMetricsByRoute;
+
+/**
+ Clears everything collected for <requestMetricsByRoute>.
+ */
+- (void) resetRequestMetrics;
+
+/// =============================================================================================
+/// @name Recording and replaying traffic
+/// =============================================================================================
+
+/**
+ When set, every request made with this config goes through this cassette instead of straight to the network.
+ 
+ A cassette that's recording sends requests as usual and keeps a copy of each request, its response and its timing. One that isn't answers requests with what it recorded, without sending anything. See <NSRCassette>.
+ 
+ Not archived with the config.
+ 
+ **Default:** `nil`.
+ */
+@property (nonatomic, strong) NSRCassette *cassette;
+
+/// =============================================================================================
+/// @name Rate limiting
+/// =============================================================================================
+
+/**
+ Most requests per second this config sends. `0` means no limit.
+ 
+ Requests are paced rather than refused: one that would go over the limit is held back until its turn comes, and requests that were waiting go out in the order they were made.
+ 
+ When a request comes back `429 Too Many Requests`, the rate is halved and nothing is sent for as long as the response's `Retry-After` header asks. The request is then sent again (up to <maximumRateLimitRetries> times) instead of failing. As requests get through, the rate climbs back up to this value.
+ 
+ **Default:** `0`.
+ */
+@property (nonatomic) double requestsPerSecond;
+
+/**
+ How many requests can go out back to back before <requestsPerSecond> pacing kicks in.
+ 
+ **Default:** `1`.
+ */
+@property (nonatomic) NSUInteger requestBurstSize;
+
+/**
+ How many times a request that came back `429` is retried before its error is returned.
+ 
+ Only applies while a rate limit is set, either with <requestsPerSecond> or for the request's route. A request's <NSRRequest deadline> still applies, so a long `Retry-After` may fail it sooner.
+ 
+ **Default:** `3`.
+ */
+@property (nonatomic) NSUInteger maximumRateLimitRetries;
+
+/**
+ Sets a rate limit for a single route, on top of <requestsPerSecond>.
+ 
+ A request on this route has to wait its turn with both limits. A `429` on this route slows down only this route's limit.
+ 
+ @param rate Most requests per second. `0` removes the route's limit.
+ @param burstSize How many requests can go out back to back.
+ @param routeTemplate Route the limit applies to, as in <NSRRequest routeTemplate> (`@"posts/:id"`).
+ */
+- (void) setRequestsPerSecond:(double)rate burstSize:(NSUInteger)burstSize forRoute:(NSString *)routeTemplate;
+
 /// =============================================================================================
 /// @name Authentication
 /// =============================================================================================
@@ -228,6 +550,15 @@ typedef NS_ENUM(NSInteger, NSRRailsVersion) {
  */
 @property (nonatomic, strong) NSString *oAuthToken;
 
+/**
+ Value of the `Authorization` header sent with each request that uses this configuration. (read-only)
+ 
+ Computed once whenever `<basicAuthUsername>`, `<basicAuthPassword>` or `<oAuthToken>` changes, rather than on every request. Basic authentication (`Basic <base64 of user:password>`) takes precedence over OAuth (`OAuth <token>`).
+ 
+ `nil` if no credentials are set.
+ */
+@property (nonatomic, strong, readonly) NSString *authorizationHeader;
+
 /**
  A dictionary of additional HTTP headers to send with each request that uses this configuration.
  */
@@ -247,6 +578,53 @@ typedef NS_ENUM(NSInteger, NSRRailsVersion) {
  */
 @property (nonatomic, strong) NSString *updateMethod;
 
+/**
+ When true, `<NSRRemoteObject remoteUpdateAsync:>` collapses repeated updates to the same record (same class and remoteID) into as few requests as possible.
+ 
+ Updates made within `<remoteUpdateCoalescingWindow>` of each other, or while another update to the record is still in flight, are merged into one request carrying the object's state at the time of the latest call. Every caller's completion block is still called, once the record has no more updates waiting, with the result of that last request.
+ 
+ This is useful if you call `remoteUpdateAsync:` on every edit (after each field changes, for instance) - fewer requests go out, and they can't arrive out of order and leave an older state on the server.
+ 
+ Synchronous updates and `remoteReplace` are never coalesced.
+ 
+ **Default:** `NO`.
+ */
+@property (nonatomic) BOOL coalescesRemoteUpdates;
+
+/**
+ How long, in seconds, a coalesced update waits for more updates to the same record before it's sent.
+ 
+ Only applies when `<coalescesRemoteUpdates>` is on. With `0` there's no window: an update goes out as soon as NSRails gets to it, and is only merged with updates already queued by then, or made while another update to the same record is in flight.
+ 
+ **Default:** `0`.
+ */
+@property (nonatomic) NSTimeInterval remoteUpdateCoalescingWindow;
+
+/**
+ Name of the query parameter `<NSRRemoteObject remoteSyncCollection:error:>` sends its high-water mark in.
+ 
+ Your index action should return only records with an `updated_at` later than this parameter when it's present.
+ 
+ **Default:** `@"updated_since"`.
+ */
+@property (nonatomic, strong) NSString *syncQueryParameter;
+
+/**
+ How long, in seconds, an <NSRSubscription> waits before reconnecting after its event stream ends.
+ 
+ The server can change this for a subscription by sending a `retry:` field. If the connection fails rather than ends (or the server responds with an error), the wait doubles with each failure in a row, up to <maximumSubscriptionRetryInterval>.
+ 
+ **Default:** `3`.
+ */
+@property (nonatomic) NSTimeInterval subscriptionRetryInterval;
+
+/**
+ Longest time, in seconds, an <NSRSubscription> waits before trying to reconnect after repeated failures.
+ 
+ **Default:** `60`.
+ */
+@property (nonatomic) NSTimeInterval maximumSubscriptionRetryInterval;
+
 /**
  Date [format]("https://developer.apple.com/library/mac/#documentation/Cocoa/Conceptual/DataFormatting/Articles/dfDateFormatting10_4.html%23//apple_ref/doc/uid/TP40002369-SW4") used if a property of type NSDate is encountered, to encode and decode NSDate objects.
  
@@ -306,7 +684,7 @@ typedef NS_ENUM(NSInteger, NSRRailsVersion) {
 /**
  Returns the contextually relevant configuration.
  
- This is like `<defaultConfig>`, but will return any configuration currently being used in a `<use>`/`<end>` or `<useIn:>` block before going to the default.
+ This is like `<defaultConfig>`, but will return any configuration currently being used in a `<use>`/`<end>` or `<useIn:>` block on the calling thread before going to the default.
  
  @return The contextually relevant configuration, or default configuration is no explicit context is set.
  */
@@ -319,7 +697,7 @@ typedef NS_ENUM(NSInteger, NSRRailsVersion) {
 /**
  Begins a context block of code to use the receiver as the default config.
  
- Highest config precedence.
+ Highest config precedence. Only applies to the calling thread, until <end> is called on that same thread.
 
  @see end.
  */
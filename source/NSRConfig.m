@@ -29,6 +29,26 @@
  */
 
 #import "NSRConfig.h"
+#import "NSREndpointPool.h"
+#import "NSRRemoteObject.h"
+#import "NSRRequest.h"
+#import "NSRRequestMetrics.h"
+#import "NSRRateLimiter.h"
+#import "NSRWireCodec.h"
+
+#import <pthread.h>
+
+@interface NSRRequest (private)
+
++ (NSString *) base64EncodingOfData:(NSData *)data;
+
+@end
+
+@interface NSRRouteMetrics (private)
+
+- (void) recordMetrics:(NSRRequestMetrics *)metrics;
+
+@end
 
 //NSRConfigStackElement implementation
 
@@ -38,9 +58,12 @@
 
 //the stack will be comprised of this element, whose sole purpose is to point to a config, meaning it can be pushed to the stack multiple times if needed be
 
+//each thread has its own stack (see NSRConfigStack below), so the element can hold its config strongly - a weak load takes a lock,
+//and contextuallyRelevantConfig is hit for every property encoded or decoded
+
 @interface NSRConfigStackElement : NSObject
 
-@property (nonatomic, weak) NSRConfig *config;
+@property (nonatomic, strong) NSRConfig *config;
 
 @end
 
@@ -62,6 +85,25 @@ NSString * const NSRRails4DateFormat =  @"yyyy-MM-dd'T'HH:mm:ss.SSSZ";
 
 @property (nonatomic, strong) NSDateFormatter *dateFormatter;
 
+//remoteModelName/remoteControllerName results by class, since they run through the inflector
+@property (nonatomic, strong) NSMutableDictionary *modelNameCache;
+@property (nonatomic, strong) NSMutableDictionary *controllerNameCache;
+
+//rootURL, resolved to the string relative routes get appended to
+@property (nonatomic, strong) NSString *routeBaseString;
+
+//nil unless there are several rootURLs
+@property (nonatomic, strong) NSREndpointPool *endpointPool;
+
+//NSRRouteMetrics by "METHOD route/:template", while collectsRequestMetrics is on
+@property (nonatomic, strong) NSMutableDictionary *routeMetrics;
+
+//nil unless requestsPerSecond is set
+@property (nonatomic, strong) NSRRateLimiter *rateLimiter;
+
+//NSRRateLimiters by route template
+@property (nonatomic, strong) NSMutableDictionary *routeRateLimiters;
+
 @end
 
 @implementation NSRConfig
@@ -70,12 +112,43 @@ NSString * const NSRRails4DateFormat =  @"yyyy-MM-dd'T'HH:mm:ss.SSSZ";
 #pragma mark Config inits
 
 static NSRConfig *defaultConfig = nil;
-static NSMutableArray *overrideConfigStack = nil;
+
+//use/end only ever touch the calling thread's stack, so there's nothing to lock - and nothing another thread's
+//use/end can change out from under a request or decode in progress here
+static pthread_key_t configStackKey;
+
+//called as a thread exits - whatever's left on its stack was used without a matching end
+static void NSRReleaseConfigStack(void *stack)
+{
+#ifdef DEBUG
+    NSCAssert([(__bridge NSMutableArray *)stack count] == 0, @"NSRails: a thread exited with %lu NSRConfig(s) still in use - every -[NSRConfig use] needs a matching -[NSRConfig end] on the same thread", (unsigned long)[(__bridge NSMutableArray *)stack count]);
+#endif
+    CFRelease(stack);
+}
+
+static NSMutableArray *NSRConfigStack(BOOL create)
+{
+    NSMutableArray *stack = (__bridge NSMutableArray *)pthread_getspecific(configStackKey);
+    if (!stack && create)
+    {
+        stack = [[NSMutableArray alloc] init];
+        pthread_setspecific(configStackKey, CFBridgingRetain(stack));
+    }
+    return stack;
+}
+
++ (void) initialize
+{
+    if (self == [NSRConfig class]) {
+        pthread_key_create(&configStackKey, NSRReleaseConfigStack);
+    }
+}
 
 //purely for testing purposes
+//only clears the calling thread's stack (other threads' use/end are left alone), then replaces the default config
 + (void) resetConfigs
 {
-    [overrideConfigStack removeAllObjects];
+    [NSRConfigStack(NO) removeAllObjects];
     defaultConfig = [[NSRConfig alloc] init];
 }
 
@@ -101,15 +174,31 @@ static NSMutableArray *overrideConfigStack = nil;
     if ((self = [super init]))
     {
         self.dateFormatter = [[NSDateFormatter alloc] init];
+        self.modelNameCache = [[NSMutableDictionary alloc] init];
+        self.controllerNameCache = [[NSMutableDictionary alloc] init];
+        self.routeMetrics = [[NSMutableDictionary alloc] init];
+        self.routeRateLimiters = [[NSMutableDictionary alloc] init];
         
         self.autoinflectsClassNames = YES;
         self.autoinflectsPropertyNames = YES;
         self.ignoresClassPrefixes = YES;
-        self.networkLogging = YES;
+        self.networkLogLevel = NSRNetworkLogLevelBody;
+        self.networkLogSampleRate = 1.0f;
         
         self.succinctErrorMessages = YES;
         self.timeoutInterval = 60.0f;
+        self.codec = [[NSRJSONCodec alloc] init];
+        self.streamingSpoolThreshold = 1024 * 1024;
+        self.maximumInternedStringLength = 64;
+        self.internedStringLimit = 4096;
         self.performsCompletionBlocksOnMainThread = YES;
+        self.syncQueryParameter = @"updated_since";
+        self.subscriptionRetryInterval = 3;
+        self.maximumSubscriptionRetryInterval = 60;
+        self.requestBurstSize = 1;
+        self.maximumRateLimitRetries = 3;
+        self.endpointFailureThreshold = 3;
+        self.endpointEjectionInterval = 10;
         
         [self configureToRailsVersion:NSRRailsVersion4];
     }
@@ -169,13 +258,151 @@ static NSMutableArray *overrideConfigStack = nil;
     return date;
 }
 
+#pragma mark - Routing
+
+- (void) setRootURL:(NSURL *)rootURL
+{
+    _rootURL = rootURL;
+    self.routeBaseString = [NSREndpoint routeBaseStringForURL:rootURL];
+    self.endpointPool = nil;
+}
+
+- (void) setRootURLs:(NSArray *)rootURLs
+{
+    self.rootURL = [rootURLs firstObject];
+    
+    //one URL is just a rootURL - requests only go through the pool when there's a choice to make
+    if (rootURLs.count > 1)
+    {
+        NSREndpointPool *pool = [[NSREndpointPool alloc] initWithURLs:rootURLs];
+        pool.policy = self.endpointSelectionPolicy;
+        pool.failureThreshold = self.endpointFailureThreshold;
+        pool.ejectionInterval = self.endpointEjectionInterval;
+        self.endpointPool = pool;
+    }
+}
+
+- (NSArray *) rootURLs
+{
+    return (self.endpointPool ? self.endpointPool.URLs : (self.rootURL ? @[self.rootURL] : nil));
+}
+
+- (NSArray *) healthyRootURLs
+{
+    return (self.endpointPool ? [self.endpointPool healthyURLs] : self.rootURLs);
+}
+
+- (void) setEndpointSelectionPolicy:(NSREndpointSelectionPolicy)policy
+{
+    _endpointSelectionPolicy = policy;
+    self.endpointPool.policy = policy;
+}
+
+- (void) setEndpointFailureThreshold:(NSUInteger)threshold
+{
+    _endpointFailureThreshold = threshold;
+    self.endpointPool.failureThreshold = threshold;
+}
+
+- (void) setEndpointEjectionInterval:(NSTimeInterval)interval
+{
+    _endpointEjectionInterval = interval;
+    self.endpointPool.ejectionInterval = interval;
+}
+
+- (void) setAutoinflectsClassNames:(BOOL)autoinflectsClassNames
+{
+    _autoinflectsClassNames = autoinflectsClassNames;
+    [self clearRouteCaches];
+}
+
+- (void) setIgnoresClassPrefixes:(BOOL)ignoresClassPrefixes
+{
+    _ignoresClassPrefixes = ignoresClassPrefixes;
+    [self clearRouteCaches];
+}
+
+- (void) clearRouteCaches
+{
+    @synchronized(self.modelNameCache) {
+        [self.modelNameCache removeAllObjects];
+    }
+    @synchronized(self.controllerNameCache) {
+        [self.controllerNameCache removeAllObjects];
+    }
+}
+
+- (NSString *) cachedNameInCache:(NSMutableDictionary *)cache forClass:(Class)class generator:(NSString *(^)(void))generator
+{
+    @synchronized(cache)
+    {
+        id name = cache[(id<NSCopying>)class];
+        if (!name)
+        {
+            name = generator() ?: [NSNull null];
+            cache[(id<NSCopying>)class] = name;
+        }
+        
+        return (name == [NSNull null] ? nil : name);
+    }
+}
+
+- (NSString *) remoteModelNameForClass:(Class)class
+{
+    return [self cachedNameInCache:self.modelNameCache forClass:class generator:^{ return [class remoteModelName]; }];
+}
+
+- (NSString *) remoteControllerNameForClass:(Class)class
+{
+    return [self cachedNameInCache:self.controllerNameCache forClass:class generator:^{ return [class remoteControllerName]; }];
+}
+
+#pragma mark - Authentication
+
+- (void) setBasicAuthUsername:(NSString *)basicAuthUsername
+{
+    _basicAuthUsername = basicAuthUsername;
+    [self updateAuthorizationHeader];
+}
+
+- (void) setBasicAuthPassword:(NSString *)basicAuthPassword
+{
+    _basicAuthPassword = basicAuthPassword;
+    [self updateAuthorizationHeader];
+}
+
+- (void) setOAuthToken:(NSString *)oAuthToken
+{
+    _oAuthToken = oAuthToken;
+    [self updateAuthorizationHeader];
+}
+
+- (void) updateAuthorizationHeader
+{
+    if (self.basicAuthUsername && self.basicAuthPassword)
+    {
+        //auth header encoded in base64
+        NSString *authStr = [NSString stringWithFormat:@"%@:%@", self.basicAuthUsername, self.basicAuthPassword];
+        NSData *authData = [authStr dataUsingEncoding:NSUTF8StringEncoding];
+        _authorizationHeader = [@"Basic " stringByAppendingString:[NSRRequest base64EncodingOfData:authData]];
+    }
+    else if (self.oAuthToken)
+    {
+        _authorizationHeader = [@"OAuth " stringByAppendingString:self.oAuthToken];
+    }
+    else
+    {
+        _authorizationHeader = nil;
+    }
+}
+
 #pragma mark -
 #pragma mark Contextual stuff
 
 + (instancetype) contextuallyRelevantConfig
 {
-    //get the last config on the stack (last in first out)
-    NSRConfig *override = [[overrideConfigStack lastObject] config];
+    //get the last config on this thread's stack (last in first out)
+    NSRConfig *override = [[NSRConfigStack(NO) lastObject] config];
     
     //if stack is nil or empty, this will be nil, signifying that there's no overriding context, so return default
     if (override) {
@@ -187,25 +414,21 @@ static NSMutableArray *overrideConfigStack = nil;
 
 - (void) use
 {
-    static dispatch_once_t onceToken;
-    dispatch_once(&onceToken, ^
-    {
-        overrideConfigStack = [[NSMutableArray alloc] init];
-    });
-    
     // make a new stack element for this config (explained at top of the file) and push it to the stack
-    [overrideConfigStack addObject:[NSRConfigStackElement elementForConfig:self]];
+    [NSRConfigStack(YES) addObject:[NSRConfigStackElement elementForConfig:self]];
 }
 
 - (void) end
 {
+    NSMutableArray *stack = NSRConfigStack(NO);
+    
     //start at the end of the stack
-    for (NSInteger i = overrideConfigStack.count-1; i >= 0; i--)
+    for (NSInteger i = stack.count-1; i >= 0; i--)
     {
-        NSRConfigStackElement *c = overrideConfigStack[i];
+        NSRConfigStackElement *c = stack[i];
         if (c.config == self)
         {
-            [overrideConfigStack removeObjectAtIndex:i];
+            [stack removeObjectAtIndex:i];
             break;
         }
     }
@@ -214,8 +437,112 @@ static NSMutableArray *overrideConfigStack = nil;
 - (void) useIn:(void (^)(void))block
 {
     [self use];
-    block();
-    [self end];
+    @try {
+        block();
+    }
+    @finally {
+        [self end];
+    }
+}
+
+#pragma mark - Logging
+
+- (void) setNetworkLogging:(BOOL)networkLogging
+{
+    self.networkLogLevel = (networkLogging ? NSRNetworkLogLevelBody : NSRNetworkLogLevelNone);
+}
+
+- (BOOL) networkLogging
+{
+    return (self.networkLogLevel != NSRNetworkLogLevelNone);
+}
+
+#pragma mark - Rate limiting
+
+- (void) setRequestsPerSecond:(double)requestsPerSecond
+{
+    _requestsPerSecond = requestsPerSecond;
+    self.rateLimiter = (requestsPerSecond > 0 ? [[NSRRateLimiter alloc] initWithRate:requestsPerSecond burstSize:self.requestBurstSize] : nil);
+}
+
+- (void) setRequestBurstSize:(NSUInteger)requestBurstSize
+{
+    _requestBurstSize = requestBurstSize;
+    self.requestsPerSecond = self.requestsPerSecond;
+}
+
+- (void) setRequestsPerSecond:(double)rate burstSize:(NSUInteger)burstSize forRoute:(NSString *)routeTemplate
+{
+    @synchronized(self.routeRateLimiters)
+    {
+        if (rate > 0) {
+            self.routeRateLimiters[routeTemplate] = [[NSRRateLimiter alloc] initWithRate:rate burstSize:burstSize];
+        }
+        else {
+            [self.routeRateLimiters removeObjectForKey:routeTemplate];
+        }
+    }
+}
+
+//most specific first - that's the one a 429 slows down
+- (NSArray *) rateLimitersForRoute:(NSString *)routeTemplate
+{
+    NSMutableArray *limiters = [NSMutableArray arrayWithCapacity:2];
+    if (routeTemplate)
+    {
+        @synchronized(self.routeRateLimiters)
+        {
+            NSRRateLimiter *routeLimiter = self.routeRateLimiters[routeTemplate];
+            if (routeLimiter) {
+                [limiters addObject:routeLimiter];
+            }
+        }
+    }
+    
+    NSRRateLimiter *limiter = self.rateLimiter;
+    if (limiter) {
+        [limiters addObject:limiter];
+    }
+    return limiters;
+}
+
+#pragma mark - Metrics
+
+- (void) recordRequestMetrics:(NSRRequestMetrics *)metrics
+{
+    NSString *key = [NSString stringWithFormat:@"%@ %@", metrics.httpMethod, metrics.routeTemplate ?: @""];
+    
+    @synchronized(self.routeMetrics)
+    {
+        NSRRouteMetrics *route = self.routeMetrics[key];
+        if (!route)
+        {
+            route = [[NSRRouteMetrics alloc] init];
+            self.routeMetrics[key] = route;
+        }
+        [route recordMetrics:metrics];
+    }
+}
+
+- (NSDictionary *) requestMetricsByRoute
+{
+    @synchronized(self.routeMetrics)
+    {
+        //copies, so the caller's snapshot doesn't keep changing under them
+        NSMutableDictionary *snapshot = [NSMutableDictionary dictionaryWithCapacity:self.routeMetrics.count];
+        [self.routeMetrics enumerateKeysAndObjectsUsingBlock:^(NSString *key, NSRRouteMetrics *route, BOOL *stop) {
+            snapshot[key] = [route copy];
+        }];
+        return snapshot;
+    }
+}
+
+- (void) resetRequestMetrics
+{
+    @synchronized(self.routeMetrics)
+    {
+        [self.routeMetrics removeAllObjects];
+    }
 }
 
 #pragma mark - NSCoding
@@ -225,6 +552,10 @@ static NSMutableArray *overrideConfigStack = nil;
     if (self = [super init])
     {
         self.dateFormatter = [[NSDateFormatter alloc] init];
+        self.modelNameCache = [[NSMutableDictionary alloc] init];
+        self.controllerNameCache = [[NSMutableDictionary alloc] init];
+        self.routeMetrics = [[NSMutableDictionary alloc] init];
+        self.routeRateLimiters = [[aDecoder decodeObjectForKey:@"routeRateLimiters"] mutableCopy] ?: [[NSMutableDictionary alloc] init];
         self.dateFormat = [aDecoder decodeObjectForKey:@"dateFormat"];
         
         self.autoinflectsClassNames = [aDecoder decodeBoolForKey:@"autoinflectsClassNames"];
@@ -233,11 +564,40 @@ static NSMutableArray *overrideConfigStack = nil;
 
         self.succinctErrorMessages = [aDecoder decodeBoolForKey:@"succinctErrorMessages"];
         self.performsCompletionBlocksOnMainThread = [aDecoder decodeBoolForKey:@"performsCompletionBlocksOnMainThread"];
+        self.coalescesCompletionBlocks = [aDecoder decodeBoolForKey:@"coalescesCompletionBlocks"];
+        self.completionCoalescingWindow = [aDecoder decodeDoubleForKey:@"completionCoalescingWindow"];
         self.timeoutInterval = [aDecoder decodeDoubleForKey:@"timeoutInterval"];
+        self.returnsMutableContainers = [aDecoder decodeBoolForKey:@"returnsMutableContainers"];
+        self.internsResponseStrings = [aDecoder decodeBoolForKey:@"internsResponseStrings"];
+        self.coalescesChangeNotifications = [aDecoder decodeBoolForKey:@"coalescesChangeNotifications"];
+        self.maximumInternedStringLength = ([aDecoder containsValueForKey:@"maximumInternedStringLength"] ? [aDecoder decodeIntegerForKey:@"maximumInternedStringLength"] : 64);
+        self.internedStringLimit = ([aDecoder containsValueForKey:@"internedStringLimit"] ? [aDecoder decodeIntegerForKey:@"internedStringLimit"] : 4096);
+        self.codec = [aDecoder decodeObjectForKey:@"codec"] ?: [[NSRJSONCodec alloc] init];
+        self.collectsRequestMetrics = [aDecoder decodeBoolForKey:@"collectsRequestMetrics"];
+        self.coalescesRemoteUpdates = [aDecoder decodeBoolForKey:@"coalescesRemoteUpdates"];
+        self.remoteUpdateCoalescingWindow = [aDecoder decodeDoubleForKey:@"remoteUpdateCoalescingWindow"];
+        self.syncQueryParameter = [aDecoder decodeObjectForKey:@"syncQueryParameter"] ?: @"updated_since";
+        self.subscriptionRetryInterval = ([aDecoder containsValueForKey:@"subscriptionRetryInterval"] ? [aDecoder decodeDoubleForKey:@"subscriptionRetryInterval"] : 3);
+        self.maximumSubscriptionRetryInterval = ([aDecoder containsValueForKey:@"maximumSubscriptionRetryInterval"] ? [aDecoder decodeDoubleForKey:@"maximumSubscriptionRetryInterval"] : 60);
+        self.requestBurstSize = ([aDecoder containsValueForKey:@"requestBurstSize"] ? [aDecoder decodeIntegerForKey:@"requestBurstSize"] : 1);
+        self.requestsPerSecond = [aDecoder decodeDoubleForKey:@"requestsPerSecond"];
+        self.maximumRateLimitRetries = ([aDecoder containsValueForKey:@"maximumRateLimitRetries"] ? [aDecoder decodeIntegerForKey:@"maximumRateLimitRetries"] : 3);
+        self.streamingSpoolThreshold = ([aDecoder containsValueForKey:@"streamingSpoolThreshold"] ? [aDecoder decodeIntegerForKey:@"streamingSpoolThreshold"] : 1024 * 1024);
 
         self.managesNetworkActivityIndicator = [aDecoder decodeBoolForKey:@"managesNetworkActivityIndicator"];
+        
+        self.networkLogLevel = [aDecoder decodeIntegerForKey:@"networkLogLevel"];
+        self.networkLogSampleRate = ([aDecoder containsValueForKey:@"networkLogSampleRate"] ? [aDecoder decodeFloatForKey:@"networkLogSampleRate"] : 1.0f);
+        self.networkLogMaxBodyBytes = [aDecoder decodeIntegerForKey:@"networkLogMaxBodyBytes"];
+
+        self.endpointSelectionPolicy = [aDecoder decodeIntegerForKey:@"endpointSelectionPolicy"];
+        self.endpointFailureThreshold = ([aDecoder containsValueForKey:@"endpointFailureThreshold"] ? [aDecoder decodeIntegerForKey:@"endpointFailureThreshold"] : 3);
+        self.endpointEjectionInterval = ([aDecoder containsValueForKey:@"endpointEjectionInterval"] ? [aDecoder decodeDoubleForKey:@"endpointEjectionInterval"] : 10);
 
         self.rootURL = [aDecoder decodeObjectForKey:@"rootURL"];
+        if ([aDecoder containsValueForKey:@"rootURLs"]) {
+            self.rootURLs = [aDecoder decodeObjectForKey:@"rootURLs"];
+        }
         self.basicAuthUsername = [aDecoder decodeObjectForKey:@"basicAuthUsername"];
         self.basicAuthPassword = [aDecoder decodeObjectForKey:@"basicAuthPassword"];
         
@@ -256,11 +616,46 @@ static NSMutableArray *overrideConfigStack = nil;
     
     [aCoder encodeBool:self.succinctErrorMessages forKey:@"succinctErrorMessages"];
     [aCoder encodeBool:self.performsCompletionBlocksOnMainThread forKey:@"performsCompletionBlocksOnMainThread"];
+    [aCoder encodeBool:self.coalescesCompletionBlocks forKey:@"coalescesCompletionBlocks"];
+    [aCoder encodeDouble:self.completionCoalescingWindow forKey:@"completionCoalescingWindow"];
     [aCoder encodeDouble:self.timeoutInterval forKey:@"timeoutInterval"];
+    [aCoder encodeBool:self.returnsMutableContainers forKey:@"returnsMutableContainers"];
+    [aCoder encodeBool:self.internsResponseStrings forKey:@"internsResponseStrings"];
+    [aCoder encodeBool:self.coalescesChangeNotifications forKey:@"coalescesChangeNotifications"];
+    [aCoder encodeInteger:self.maximumInternedStringLength forKey:@"maximumInternedStringLength"];
+    [aCoder encodeInteger:self.internedStringLimit forKey:@"internedStringLimit"];
+    if ([self.codec conformsToProtocol:@protocol(NSCoding)]) {
+        [aCoder encodeObject:self.codec forKey:@"codec"];
+    }
+    [aCoder encodeBool:self.collectsRequestMetrics forKey:@"collectsRequestMetrics"];
+    [aCoder encodeBool:self.coalescesRemoteUpdates forKey:@"coalescesRemoteUpdates"];
+    [aCoder encodeDouble:self.remoteUpdateCoalescingWindow forKey:@"remoteUpdateCoalescingWindow"];
+    [aCoder encodeObject:self.syncQueryParameter forKey:@"syncQueryParameter"];
+    [aCoder encodeDouble:self.subscriptionRetryInterval forKey:@"subscriptionRetryInterval"];
+    [aCoder encodeDouble:self.maximumSubscriptionRetryInterval forKey:@"maximumSubscriptionRetryInterval"];
+    [aCoder encodeDouble:self.requestsPerSecond forKey:@"requestsPerSecond"];
+    [aCoder encodeInteger:self.requestBurstSize forKey:@"requestBurstSize"];
+    [aCoder encodeInteger:self.maximumRateLimitRetries forKey:@"maximumRateLimitRetries"];
+    @synchronized(self.routeRateLimiters)
+    {
+        [aCoder encodeObject:self.routeRateLimiters forKey:@"routeRateLimiters"];
+    }
+    [aCoder encodeInteger:self.streamingSpoolThreshold forKey:@"streamingSpoolThreshold"];
     
     [aCoder encodeBool:self.managesNetworkActivityIndicator forKey:@"managesNetworkActivityIndicator"];
+    
+    [aCoder encodeInteger:self.networkLogLevel forKey:@"networkLogLevel"];
+    [aCoder encodeFloat:self.networkLogSampleRate forKey:@"networkLogSampleRate"];
+    [aCoder encodeInteger:self.networkLogMaxBodyBytes forKey:@"networkLogMaxBodyBytes"];
+
+    [aCoder encodeInteger:self.endpointSelectionPolicy forKey:@"endpointSelectionPolicy"];
+    [aCoder encodeInteger:self.endpointFailureThreshold forKey:@"endpointFailureThreshold"];
+    [aCoder encodeDouble:self.endpointEjectionInterval forKey:@"endpointEjectionInterval"];
 
     [aCoder encodeObject:self.rootURL forKey:@"rootURL"];
+    if (self.endpointPool) {
+        [aCoder encodeObject:self.rootURLs forKey:@"rootURLs"];
+    }
     [aCoder encodeObject:self.basicAuthUsername forKey:@"basicAuthUsername"];
     [aCoder encodeObject:self.basicAuthPassword forKey:@"basicAuthPassword"];
 
@@ -0,0 +1,81 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSREndpointPool.h
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import <Foundation/Foundation.h>
+#import "NSRConfig.h"
+
+//internal to NSRails - the balancer behind NSRConfig's rootURLs
+
+//one of the root URLs. requests check one out before they go, and check it back in with how it went
+@interface NSREndpoint : NSObject
+
+@property (nonatomic, readonly) NSURL *URL;
+
+//what a relative route is appended to (nil if the URL has a query or fragment, and routes have to be resolved with NSURL)
+@property (nonatomic, readonly) NSString *routeBaseString;
+
++ (NSString *) routeBaseStringForURL:(NSURL *)URL;
+
+@end
+
+//how a checked out endpoint did
+typedef NS_ENUM(NSInteger, NSREndpointOutcome) {
+    NSREndpointSucceeded,
+    NSREndpointFailed,
+    //the request was cancelled before it heard back either way - says nothing about the endpoint's health
+    NSREndpointAbandoned
+};
+
+//picks an endpoint per request by the config's policy, and keeps the unhealthy ones out of rotation:
+//after failureThreshold failures in a row (connection errors and 5xx - 0 turns this off), an endpoint is ejected for ejectionInterval. once
+//that's up it gets a single trial request - success puts it back, failure ejects it again. if everything's ejected, the one
+//due back soonest is used anyway, so requests never fail just for want of an endpoint
+
+@interface NSREndpointPool : NSObject
+
+- (id) initWithURLs:(NSArray *)URLs;
+
+@property (nonatomic, readonly) NSArray *URLs;
+
+@property NSREndpointSelectionPolicy policy;
+@property NSUInteger failureThreshold;
+@property NSTimeInterval ejectionInterval;
+
+//picks an endpoint and counts it as outstanding until it's checked in. `excluding` (may be nil) is skipped if anything else is available.
+//`trial` is set to whether this is an ejected endpoint's trial request, and has to be passed back when it's checked in
+- (NSREndpoint *) checkOutExcluding:(NSREndpoint *)excluding trial:(BOOL *)trial;
+
+//latency is a round trip to feed the latency average, or negative if there isn't one worth counting (a stream, a cancel)
+- (void) checkIn:(NSREndpoint *)endpoint trial:(BOOL)trial latency:(NSTimeInterval)latency outcome:(NSREndpointOutcome)outcome;
+
+//in rotation right now, in the order they were given
+- (NSArray *) healthyURLs;
+
+@end
@@ -0,0 +1,271 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSREndpointPool.m
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import "NSREndpointPool.h"
+
+//weight of the newest round trip in an endpoint's latency average
+static const double NSRLatencySmoothing = 0.3;
+
+static inline NSTimeInterval NSRNow(void)
+{
+    return [NSProcessInfo processInfo].systemUptime;
+}
+
+@interface NSREndpoint ()
+
+@property (nonatomic, strong) NSURL *URL;
+@property (nonatomic, strong) NSString *routeBaseString;
+
+//everything below is guarded by the pool
+@property (nonatomic) NSUInteger outstanding;
+@property (nonatomic) NSUInteger consecutiveFailures;
+
+//0 while in rotation. once it's passed, the endpoint is on trial - only the request checked out as the trial clears trialOutstanding,
+//so a late response to one sent before the ejection can't let a second trial out
+@property (nonatomic) NSTimeInterval ejectedUntil;
+@property (nonatomic) BOOL trialOutstanding;
+
+//0 until the first round trip comes back
+@property (nonatomic) NSTimeInterval averageLatency;
+
+@end
+
+@implementation NSREndpoint
+
++ (NSString *) routeBaseStringForURL:(NSURL *)URL
+{
+    if (!URL || URL.query || URL.fragment) {
+        return nil;
+    }
+    
+    //resolve once what -[NSURL URLWithString:relativeToURL:] would do for a plain relative path
+    //"http://myapp.com" -> "http://myapp.com/", "http://myapp.com/api/" -> "http://myapp.com/api/"
+    NSString *resolved = [[NSURL URLWithString:@"x" relativeToURL:URL] absoluteString];
+    return [resolved substringToIndex:resolved.length-1];
+}
+
+@end
+
+@implementation NSREndpointPool
+{
+    NSArray *endpoints;
+    NSUInteger nextIndex;
+}
+
+- (id) initWithURLs:(NSArray *)URLs
+{
+    if ((self = [super init]))
+    {
+        NSMutableArray *all = [NSMutableArray arrayWithCapacity:URLs.count];
+        for (NSURL *URL in URLs)
+        {
+            NSREndpoint *endpoint = [[NSREndpoint alloc] init];
+            endpoint.URL = URL;
+            endpoint.routeBaseString = [NSREndpoint routeBaseStringForURL:URL];
+            [all addObject:endpoint];
+        }
+        endpoints = all;
+        
+        self.failureThreshold = 3;
+        self.ejectionInterval = 10;
+    }
+    return self;
+}
+
+- (NSArray *) URLs
+{
+    return [endpoints valueForKey:@"URL"];
+}
+
+- (NSArray *) healthyURLs
+{
+    @synchronized(self)
+    {
+        NSMutableArray *URLs = [NSMutableArray arrayWithCapacity:endpoints.count];
+        for (NSREndpoint *endpoint in endpoints)
+        {
+            if (endpoint.ejectedUntil == 0) {
+                [URLs addObject:endpoint.URL];
+            }
+        }
+        return URLs;
+    }
+}
+
+#pragma mark - Choosing
+
+- (BOOL) endpointIsAvailable:(NSREndpoint *)endpoint now:(NSTimeInterval)now
+{
+    if (endpoint.ejectedUntil == 0) {
+        return YES;
+    }
+    
+    //ejection's up - it gets one request at a time until one succeeds
+    return (now >= endpoint.ejectedUntil && !endpoint.trialOutstanding);
+}
+
+- (NSREndpoint *) chooseFrom:(NSArray *)candidates
+{
+    //round robin also decides ties for the other policies, so equally good endpoints share the load
+    NSUInteger start = nextIndex++ % candidates.count;
+    
+    if (self.policy == NSREndpointSelectionLeastOutstandingRequests)
+    {
+        NSREndpoint *best = nil;
+        for (NSUInteger i = 0; i < candidates.count; i++)
+        {
+            NSREndpoint *endpoint = candidates[(start + i) % candidates.count];
+            if (!best || endpoint.outstanding < best.outstanding) {
+                best = endpoint;
+            }
+        }
+        return best;
+    }
+    
+    if (self.policy == NSREndpointSelectionLatencyWeighted)
+    {
+        //random, weighted by the inverse of each one's average round trip. ones without a sample yet are
+        //counted as fast as the fastest, so they get tried
+        NSTimeInterval fastest = 0;
+        for (NSREndpoint *endpoint in candidates)
+        {
+            if (endpoint.averageLatency > 0 && (fastest == 0 || endpoint.averageLatency < fastest)) {
+                fastest = endpoint.averageLatency;
+            }
+        }
+        
+        if (fastest > 0)
+        {
+            double total = 0;
+            for (NSREndpoint *endpoint in candidates) {
+                total += 1.0 / (endpoint.averageLatency ?: fastest);
+            }
+            
+            double pick = total * arc4random_uniform(1 << 24) / (double)(1 << 24);
+            for (NSREndpoint *endpoint in candidates)
+            {
+                pick -= 1.0 / (endpoint.averageLatency ?: fastest);
+                if (pick < 0) {
+                    return endpoint;
+                }
+            }
+            return [candidates lastObject];
+        }
+    }
+    
+    return candidates[start];
+}
+
+- (NSREndpoint *) checkOutExcluding:(NSREndpoint *)excluding trial:(BOOL *)trial
+{
+    @synchronized(self)
+    {
+        NSTimeInterval now = NSRNow();
+        
+        NSMutableArray *candidates = [NSMutableArray arrayWithCapacity:endpoints.count];
+        for (NSREndpoint *endpoint in endpoints)
+        {
+            if (endpoint != excluding && [self endpointIsAvailable:endpoint now:now]) {
+                [candidates addObject:endpoint];
+            }
+        }
+        if (candidates.count == 0 && excluding && [self endpointIsAvailable:excluding now:now]) {
+            [candidates addObject:excluding];
+        }
+        
+        NSREndpoint *chosen = nil;
+        BOOL isTrial = NO;
+        if (candidates.count > 0)
+        {
+            chosen = [self chooseFrom:candidates];
+            if (chosen.ejectedUntil > 0)
+            {
+                chosen.trialOutstanding = YES;
+                isTrial = YES;
+            }
+        }
+        else
+        {
+            //everything's out - better to try the one due back first than to fail without trying
+            for (NSREndpoint *endpoint in endpoints)
+            {
+                if (!chosen || endpoint.ejectedUntil < chosen.ejectedUntil) {
+                    chosen = endpoint;
+                }
+            }
+        }
+        
+        if (trial) {
+            *trial = isTrial;
+        }
+        chosen.outstanding++;
+        return chosen;
+    }
+}
+
+- (void) checkIn:(NSREndpoint *)endpoint trial:(BOOL)trial latency:(NSTimeInterval)latency outcome:(NSREndpointOutcome)outcome
+{
+    if (!endpoint) {
+        return;
+    }
+    
+    @synchronized(self)
+    {
+        if (endpoint.outstanding > 0) {
+            endpoint.outstanding--;
+        }
+        if (trial) {
+            endpoint.trialOutstanding = NO;
+        }
+        
+        //a cancelled trial leaves it ejected, ready for the next one
+        if (outcome == NSREndpointAbandoned) {
+            return;
+        }
+        
+        if (outcome == NSREndpointFailed)
+        {
+            endpoint.consecutiveFailures++;
+            if (self.failureThreshold > 0 && endpoint.consecutiveFailures >= self.failureThreshold) {
+                endpoint.ejectedUntil = NSRNow() + self.ejectionInterval;
+            }
+            return;
+        }
+        
+        endpoint.consecutiveFailures = 0;
+        endpoint.ejectedUntil = 0;
+        
+        if (latency >= 0) {
+            endpoint.averageLatency = (endpoint.averageLatency > 0 ? endpoint.averageLatency + NSRLatencySmoothing * (latency - endpoint.averageLatency) : latency);
+        }
+    }
+}
+
+@end
@@ -0,0 +1,53 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSREventStreamParser.h
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import <Foundation/Foundation.h>
+
+//internal to NSRails - parses the text/event-stream (Server-Sent Events) format behind NSRSubscription
+
+//bytes are fed in as they arrive, in whatever pieces the connection hands over. each event is handed off once the blank
+//line ending it is in. follows the WHATWG parsing rules: comments (heartbeats) are skipped, multiple data lines are joined
+//with newlines, and an event with no data isn't dispatched (though its id still counts)
+
+@interface NSREventStreamParser : NSObject
+
+//name is "message" if the event didn't have one. eventID is the last id seen so far on the stream (nil if none)
+- (id) initWithEventHandler:(void (^)(NSString *name, NSString *data, NSString *eventID))handler;
+
+- (void) appendData:(NSData *)data;
+
+//throws away a partly received event and line (the connection dropped) - the last event id is kept
+- (void) reset;
+
+//last id seen (atomic - NSRSubscription reads it from other threads), and the reconnection time the server asked for with retry: (0 if it hasn't)
+@property (copy) NSString *lastEventID;
+@property (nonatomic, readonly) NSTimeInterval retryInterval;
+
+@end
@@ -0,0 +1,191 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSREventStreamParser.m
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import "NSREventStreamParser.h"
+
+@implementation NSREventStreamParser
+{
+    void (^eventHandler)(NSString *name, NSString *data, NSString *eventID);
+    
+    //bytes of the line being read, and whether the last one ended in a CR (so an LF starting this chunk belongs to it)
+    NSMutableData *line;
+    BOOL skipsLineFeed;
+    BOOL checkedBOM;
+    
+    //the event being built up
+    NSString *eventName;
+    NSMutableString *eventData;
+}
+
+- (id) initWithEventHandler:(void (^)(NSString *name, NSString *data, NSString *eventID))handler
+{
+    if ((self = [super init]))
+    {
+        eventHandler = [handler copy];
+        line = [[NSMutableData alloc] init];
+        eventData = [[NSMutableString alloc] init];
+    }
+    return self;
+}
+
+- (void) reset
+{
+    [line setLength:0];
+    skipsLineFeed = NO;
+    checkedBOM = NO;
+    
+    eventName = nil;
+    [eventData setString:@""];
+}
+
+- (void) appendData:(NSData *)data
+{
+    const unsigned char *bytes = data.bytes;
+    NSUInteger length = data.length;
+    NSUInteger lineStart = 0;
+    
+    for (NSUInteger i = 0; i < length; i++)
+    {
+        unsigned char c = bytes[i];
+        if (c != '\r' && c != '\n') {
+            continue;
+        }
+        
+        if (c == '\n' && skipsLineFeed && i == lineStart)
+        {
+            //second half of a CRLF
+            skipsLineFeed = NO;
+            lineStart = i + 1;
+            continue;
+        }
+        
+        [line appendBytes:bytes + lineStart length:i - lineStart];
+        [self processLine];
+        [line setLength:0];
+        
+        skipsLineFeed = (c == '\r');
+        lineStart = i + 1;
+    }
+    
+    if (lineStart < length)
+    {
+        [line appendBytes:bytes + lineStart length:length - lineStart];
+        skipsLineFeed = NO;
+    }
+}
+
+- (void) processLine
+{
+    const char *bytes = line.bytes;
+    NSUInteger length = line.length;
+    
+    //a byte order mark is allowed at the very start of the stream
+    if (!checkedBOM)
+    {
+        checkedBOM = YES;
+        if (length >= 3 && memcmp(bytes, "\xEF\xBB\xBF", 3) == 0)
+        {
+            bytes += 3;
+            length -= 3;
+        }
+    }
+    
+    if (length == 0)
+    {
+        [self dispatchEvent];
+        return;
+    }
+    
+    //comments - servers send these to keep the connection from idling out
+    if (bytes[0] == ':') {
+        return;
+    }
+    
+    const char *colon = memchr(bytes, ':', length);
+    NSUInteger fieldLength = (colon ? (NSUInteger)(colon - bytes) : length);
+    
+    NSString *value = @"";
+    if (colon)
+    {
+        NSUInteger valueStart = fieldLength + 1;
+        if (valueStart < length && bytes[valueStart] == ' ') {
+            valueStart++;
+        }
+        value = [[NSString alloc] initWithBytes:bytes + valueStart length:length - valueStart encoding:NSUTF8StringEncoding] ?: @"";
+    }
+    
+    NSString *field = [[NSString alloc] initWithBytes:bytes length:fieldLength encoding:NSUTF8StringEncoding];
+    
+    if ([field isEqualToString:@"data"])
+    {
+        [eventData appendString:value];
+        [eventData appendString:@"\n"];
+    }
+    else if ([field isEqualToString:@"event"])
+    {
+        eventName = value;
+    }
+    else if ([field isEqualToString:@"id"])
+    {
+        //ids with a NUL in them are ignored
+        if (!colon || !memchr(colon, '\0', length - fieldLength)) {
+            self.lastEventID = value;
+        }
+    }
+    else if ([field isEqualToString:@"retry"])
+    {
+        NSCharacterSet *nonDigits = [[NSCharacterSet decimalDigitCharacterSet] invertedSet];
+        if (value.length > 0 && [value rangeOfCharacterFromSet:nonDigits].location == NSNotFound) {
+            _retryInterval = [value longLongValue] / 1000.0;
+        }
+    }
+}
+
+- (void) dispatchEvent
+{
+    if (eventData.length == 0)
+    {
+        eventName = nil;
+        return;
+    }
+    
+    //every data line added a newline - the last one isn't part of the data
+    NSString *data = [eventData substringToIndex:eventData.length - 1];
+    NSString *name = (eventName.length > 0 ? eventName : @"message");
+    
+    eventName = nil;
+    [eventData setString:@""];
+    
+    if (eventHandler) {
+        eventHandler(name, data, (self.lastEventID.length > 0 ? self.lastEventID : nil));
+    }
+}
+
+@end
@@ -0,0 +1,62 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRJSONElementStream.h
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import <Foundation/Foundation.h>
+
+@class NSRStringInterner;
+
+//internal to NSRails - incremental receiver behind -[NSRRequest sendAsynchronousStreamingElements:completion:]
+
+//bytes are fed in as they arrive. if the document is a top-level array, each element is cut out and parsed as soon as its
+//last byte is in, so memory stays at one element (plus whatever of the next one has arrived). anything else is a plain
+//document, which is kept in memory up to spoolThreshold bytes and then spooled to a temp file
+
+@interface NSRJSONElementStream : NSObject
+
+- (id) initWithReadingOptions:(NSJSONReadingOptions)options spoolThreshold:(NSUInteger)threshold elementHandler:(void (^)(id element))handler;
+
+//NO (with error set) if an element couldn't be parsed or the spool file couldn't be written - stop feeding it
+- (BOOL) appendData:(NSData *)data error:(NSError **)error;
+
+//call once all data's in. NO (with error set) if it ended partway through - an array that never got its closing ], or an
+//element or string cut off. a response can end cleanly (chunked, or with no Content-Length) and still be missing its tail
+- (BOOL) finishWithError:(NSError **)error;
+
+//call once all data's in. for a plain document, returns its bytes (memory-mapped if it was spooled). nil for an array
+- (NSData *) finishDocument;
+
+//if set, elements have their strings interned before they're handed over - one table for the whole stream
+@property (nonatomic, strong) NSRStringInterner *interner;
+
+@property (nonatomic, readonly) BOOL isArray;
+@property (nonatomic, readonly) NSUInteger elementCount;
+@property (nonatomic, readonly) unsigned long long byteCount;
+
+@end
@@ -0,0 +1,373 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRJSONElementStream.m
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import "NSRJSONElementStream.h"
+#import "NSRStringInterner.h"
+
+typedef NS_ENUM(NSInteger, NSRJSONStreamPhase) {
+    NSRJSONStreamPhaseStart,      //haven't seen anything but whitespace yet
+    NSRJSONStreamPhaseArray,      //inside the top-level array
+    NSRJSONStreamPhaseDocument,   //not an array - just collecting bytes
+    NSRJSONStreamPhaseDone        //past the closing ]
+};
+
+static inline BOOL NSRIsJSONWhitespace(unsigned char c)
+{
+    return (c == ' ' || c == '\n' || c == '\r' || c == '\t');
+}
+
+@implementation NSRJSONElementStream
+{
+    NSJSONReadingOptions readingOptions;
+    NSUInteger spoolThreshold;
+    void (^elementHandler)(id element);
+    
+    NSRJSONStreamPhase phase;
+    
+    //scanner state for the element being cut out
+    BOOL inElement;
+    BOOL scalar;
+    BOOL inString;
+    BOOL escaped;
+    NSUInteger depth;
+    NSMutableData *element;
+    
+    //plain document
+    NSMutableData *document;
+    NSString *spoolPath;
+    NSFileHandle *spoolHandle;
+}
+
+- (id) initWithReadingOptions:(NSJSONReadingOptions)options spoolThreshold:(NSUInteger)threshold elementHandler:(void (^)(id element))handler
+{
+    if ((self = [super init]))
+    {
+        readingOptions = options | NSJSONReadingAllowFragments;
+        spoolThreshold = threshold;
+        elementHandler = [handler copy];
+        element = [[NSMutableData alloc] init];
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    [self removeSpoolFile];
+}
+
+- (BOOL) isArray
+{
+    return (phase == NSRJSONStreamPhaseArray || phase == NSRJSONStreamPhaseDone);
+}
+
+#pragma mark - Array elements
+
+- (BOOL) emitElement:(NSError **)error
+{
+    id parsed = [NSJSONSerialization JSONObjectWithData:element options:readingOptions error:error];
+    
+    //reuse the buffer (and its capacity) for the next element
+    [element setLength:0];
+    inElement = NO;
+    scalar = NO;
+    
+    if (!parsed) {
+        return NO;
+    }
+    
+    if (self.interner) {
+        parsed = [self.interner internObject:parsed mutableContainers:(readingOptions & NSJSONReadingMutableContainers) != 0];
+    }
+    
+    _elementCount++;
+    if (elementHandler) {
+        elementHandler(parsed);
+    }
+    return YES;
+}
+
+- (BOOL) scanArrayBytes:(const unsigned char *)bytes length:(NSUInteger)length error:(NSError **)error
+{
+    //start of the part of this chunk that belongs to the current element - copied out in one go rather than byte by byte
+    NSUInteger segmentStart = 0;
+    
+    for (NSUInteger i = 0; i < length && phase == NSRJSONStreamPhaseArray; i++)
+    {
+        unsigned char c = bytes[i];
+        
+        if (inString)
+        {
+            if (escaped) {
+                escaped = NO;
+            }
+            else if (c == '\\') {
+                escaped = YES;
+            }
+            else if (c == '"')
+            {
+                inString = NO;
+                if (depth == 0)
+                {
+                    //a bare string element
+                    [element appendBytes:bytes + segmentStart length:i + 1 - segmentStart];
+                    if (![self emitElement:error]) {
+                        return NO;
+                    }
+                }
+            }
+            continue;
+        }
+        
+        if (!inElement)
+        {
+            if (NSRIsJSONWhitespace(c) || c == ',') {
+                continue;
+            }
+            if (c == ']')
+            {
+                phase = NSRJSONStreamPhaseDone;
+                continue;
+            }
+            
+            inElement = YES;
+            segmentStart = i;
+        }
+        
+        if (scalar && (c == ',' || c == ']' || NSRIsJSONWhitespace(c)))
+        {
+            //numbers, true/false/null end at whatever comes after them
+            [element appendBytes:bytes + segmentStart length:i - segmentStart];
+            if (![self emitElement:error]) {
+                return NO;
+            }
+            if (c == ']') {
+                phase = NSRJSONStreamPhaseDone;
+            }
+            continue;
+        }
+        
+        switch (c)
+        {
+            case '"':
+                inString = YES;
+                break;
+                
+            case '{':
+            case '[':
+                depth++;
+                break;
+                
+            case '}':
+            case ']':
+                if (depth > 0) {
+                    depth--;
+                }
+                if (depth == 0)
+                {
+                    [element appendBytes:bytes + segmentStart length:i + 1 - segmentStart];
+                    if (![self emitElement:error]) {
+                        return NO;
+                    }
+                }
+                break;
+                
+            default:
+                if (depth == 0) {
+                    scalar = YES;
+                }
+                break;
+        }
+    }
+    
+    //element continues into the next chunk
+    if (inElement) {
+        [element appendBytes:bytes + segmentStart length:length - segmentStart];
+    }
+    
+    return YES;
+}
+
+#pragma mark - Plain documents
+
+- (BOOL) appendDocumentBytes:(const unsigned char *)bytes length:(NSUInteger)length error:(NSError **)error
+{
+    if (!spoolHandle)
+    {
+        if (!document) {
+            document = [[NSMutableData alloc] init];
+        }
+        [document appendBytes:bytes length:length];
+        
+        if (document.length <= spoolThreshold) {
+            return YES;
+        }
+        
+        //past the threshold - move what we have to disk and keep going there
+        CFUUIDRef uuid = CFUUIDCreate(kCFAllocatorDefault);
+        NSString *name = [NSString stringWithFormat:@"nsrails-%@.json", CFBridgingRelease(CFUUIDCreateString(kCFAllocatorDefault, uuid))];
+        CFRelease(uuid);
+        
+        spoolPath = [NSTemporaryDirectory() stringByAppendingPathComponent:name];
+        if (![[NSFileManager defaultManager] createFileAtPath:spoolPath contents:nil attributes:nil])
+        {
+            if (error) {
+                *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileWriteUnknownError userInfo:@{NSFilePathErrorKey:spoolPath}];
+            }
+            spoolPath = nil;
+            return NO;
+        }
+        
+        spoolHandle = [NSFileHandle fileHandleForWritingAtPath:spoolPath];
+        
+        @try
+        {
+            [spoolHandle writeData:document];
+        }
+        @catch (NSException *exception)
+        {
+            if (error) {
+                *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileWriteUnknownError userInfo:@{NSFilePathErrorKey:spoolPath, NSLocalizedDescriptionKey:exception.reason ?: @""}];
+            }
+            return NO;
+        }
+        
+        document = nil;
+        return YES;
+    }
+    
+    @try
+    {
+        [spoolHandle writeData:[NSData dataWithBytesNoCopy:(void *)bytes length:length freeWhenDone:NO]];
+    }
+    @catch (NSException *exception)
+    {
+        //writeData: raises on disk full, etc
+        if (error) {
+            *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileWriteUnknownError userInfo:@{NSFilePathErrorKey:spoolPath, NSLocalizedDescriptionKey:exception.reason ?: @""}];
+        }
+        return NO;
+    }
+    return YES;
+}
+
+- (void) removeSpoolFile
+{
+    [spoolHandle closeFile];
+    spoolHandle = nil;
+    
+    if (spoolPath)
+    {
+        [[NSFileManager defaultManager] removeItemAtPath:spoolPath error:nil];
+        spoolPath = nil;
+    }
+}
+
+#pragma mark - Feeding
+
+- (BOOL) appendData:(NSData *)data error:(NSError **)error
+{
+    const unsigned char *bytes = data.bytes;
+    NSUInteger length = data.length;
+    _byteCount += length;
+    
+    if (phase == NSRJSONStreamPhaseStart)
+    {
+        NSUInteger i = 0;
+        while (i < length && NSRIsJSONWhitespace(bytes[i])) {
+            i++;
+        }
+        if (i == length) {
+            return YES;
+        }
+        
+        if (bytes[i] == '[')
+        {
+            phase = NSRJSONStreamPhaseArray;
+            i++;
+        }
+        else {
+            phase = NSRJSONStreamPhaseDocument;
+        }
+        
+        bytes += i;
+        length -= i;
+    }
+    
+    switch (phase)
+    {
+        case NSRJSONStreamPhaseArray:
+            return [self scanArrayBytes:bytes length:length error:error];
+            
+        case NSRJSONStreamPhaseDocument:
+            return [self appendDocumentBytes:bytes length:length error:error];
+            
+        default:
+            //trailing whitespace after the array
+            return YES;
+    }
+}
+
+- (BOOL) finishWithError:(NSError **)error
+{
+    //a plain document is checked by whoever parses it
+    if (phase != NSRJSONStreamPhaseArray) {
+        return YES;
+    }
+    
+    if (error)
+    {
+        NSString *description = [NSString stringWithFormat:@"The data ended partway through a top-level array, after %lu complete element%@.",
+                                 (unsigned long)_elementCount, (_elementCount == 1 ? @"" : @"s")];
+        *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSPropertyListReadCorruptError userInfo:@{NSLocalizedDescriptionKey:description}];
+    }
+    return NO;
+}
+
+- (NSData *) finishDocument
+{
+    if (phase != NSRJSONStreamPhaseDocument) {
+        return nil;
+    }
+    
+    if (!spoolHandle) {
+        return document;
+    }
+    
+    [spoolHandle closeFile];
+    spoolHandle = nil;
+    
+    //mapped, so the document is paged in by the parser rather than read into memory up front.
+    //the mapping stays valid after the file is unlinked
+    NSData *mapped = [NSData dataWithContentsOfFile:spoolPath options:NSDataReadingMappedAlways error:nil];
+    [self removeSpoolFile];
+    return mapped;
+}
+
+@end
@@ -0,0 +1,182 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRMemoryProfiler.h
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ What one phase of NSRails' work allocated, as returned by <NSRMemoryProfiler phaseStatistics>.
+ 
+ Phases nest (`decode` runs `objectsWithRemoteDictionaries`, which runs `inflection`), and a phase's numbers include those of the phases run inside it.
+ */
+@interface NSRMemoryPhaseStatistics : NSObject
+
+/**
+ The phase's name, or `nil` for the result of <NSRMemoryProfiler measure:>.
+ */
+@property (nonatomic, readonly) NSString *name;
+
+/**
+ Number of times the phase ran.
+ */
+@property (nonatomic, readonly) NSUInteger calls;
+
+/**
+ Number of allocations made by the thread running the phase, or `-1` where they can't be counted (see <NSRMemoryProfiler countsAllocations>).
+ */
+@property (nonatomic, readonly) long long allocations;
+
+/**
+ Bytes requested by those allocations, or `-1` where they can't be counted.
+ */
+@property (nonatomic, readonly) long long allocatedBytes;
+
+/**
+ How much the heap grew over the phase - what it allocated and didn't free (yet). Can be negative.
+ 
+ This is process-wide, so anything other threads allocated or freed at the same time is included.
+ */
+@property (nonatomic, readonly) long long heapGrowth;
+
+/**
+ How much the process' peak resident size went up during the phase. Whatever phases show up here are the ones that set new high-water marks.
+ */
+@property (nonatomic, readonly) long long peakResidentGrowth;
+
+/**
+ The statistics as a dictionary, for reports. Keys are `calls`, `allocations`, `allocated_bytes`, `heap_growth` and `peak_resident_growth`. Allocation figures that couldn't be counted are `NSNull`.
+ 
+ @return Dictionary of numbers.
+ */
+- (NSDictionary *) dictionaryRepresentation;
+
+@end
+
+/**
+ Attributes allocations to what NSRails was doing at the time, so a memory regression in decoding big responses can be pinned to a phase, and caught in tests - no Instruments needed.
+ 
+    [NSRMemoryProfiler startProfiling];
+    
+    NSArray *posts = [Post remoteAll:&error];
+    
+    [NSRMemoryProfiler stopProfiling];
+    NSLog(@"%@", [NSRMemoryProfiler phaseStatistics]);
+ 
+ Phases recorded:
+ 
+ - `encode` - serializing a request body
+ - `parse` - turning response bytes into containers (`jsonResponseFromData:` and the codecs)
+ - `decode` - turning a parsed response into objects
+ - `objectsWithRemoteDictionaries` - decoding collections
+ - `inflection` - camelizing and underscoring names
+ 
+ It also keeps an estimate of how much the objects decoded are holding on to as <NSRRemoteObject remoteAttributes> (see <remoteAttributesBytes>), and while profiling, requests' <NSRRequestMetrics> get their peak resident size filled in.
+ 
+ Phases get heap growth (from `malloc_zone_statistics`, or `mallinfo` on Linux/GNUstep) and peak resident size (from `getrusage`). Allocations aren't counted by default.
+ 
+ To count them too, build NSRails with `NSR_MEMORY_PROFILING` defined (this project's Debug configuration does). On Apple platforms they're then counted per thread, through the private hook malloc stack logging uses. Once profiling starts, the hook sees every allocation in the process until it exits, so don't ship a build with `NSR_MEMORY_PROFILING` in it.
+ 
+ Profiling makes each phase several times slower - the heap size has to be read at both ends - so leave it off outside of tests and investigations. While it's off, each hook costs a single check of a global flag.
+ */
+@interface NSRMemoryProfiler : NSObject
+
+/**
+ Starts recording, discarding anything recorded before.
+ */
++ (void) startProfiling;
+
+/**
+ Stops recording. What's been recorded so far is kept until the next <startProfiling>.
+ */
++ (void) stopProfiling;
+
+/**
+ Whether phases are currently being recorded.
+ 
+ @return `YES` between <startProfiling> and <stopProfiling>.
+ */
++ (BOOL) isProfiling;
+
+/**
+ Whether allocations can be counted in this build.
+ 
+ @return `YES` on Apple platforms when NSRails was built with `NSR_MEMORY_PROFILING`.
+ */
++ (BOOL) countsAllocations;
+
+/**
+ What's been recorded for each phase.
+ 
+ @return Dictionary of NSRMemoryPhaseStatistics by phase name.
+ */
++ (NSDictionary *) phaseStatistics;
+
+/**
+ Number of objects whose <NSRRemoteObject remoteAttributes> were measured while profiling.
+ 
+ Only outermost objects count - a nested object's remoteAttributes are part of its parent's.
+ 
+ @return Number of objects.
+ */
++ (NSUInteger) remoteAttributesCount;
+
+/**
+ Estimated total size of the dictionaries kept as <NSRRemoteObject remoteAttributes> by the objects counted in <remoteAttributesCount>.
+ 
+ This is memory that stays around for as long as the objects do, on top of their properties.
+ 
+ @return Size in bytes.
+ */
++ (unsigned long long) remoteAttributesBytes;
+
+/**
+ The process' peak resident size so far.
+ 
+ @return Size in bytes.
+ */
++ (unsigned long long) peakResidentBytes;
+
+/**
+ Measures a block on the current thread, whether or not profiling is on.
+ 
+ @param block Block to run.
+ @return What it allocated.
+ */
++ (NSRMemoryPhaseStatistics *) measure:(void (^)(void))block;
+
+/**
+ Everything recorded, as a dictionary, for reports (benchmark output, say).
+ 
+ Keys are `counts_allocations`, `peak_resident_bytes`, `remote_attributes` (with `objects` and `bytes`) and `phases` (the <NSRMemoryPhaseStatistics dictionaryRepresentation> of each, by name).
+ 
+ @return Dictionary of numbers.
+ */
++ (NSDictionary *) dictionaryRepresentation;
+
+@end
@@ -0,0 +1,422 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRMemoryProfiler.m
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import "NSRMemoryProfiler.h"
+#import "NSRMemoryProfiling.h"
+
+#import <objc/runtime.h>
+#import <pthread.h>
+#import <sys/resource.h>
+
+#if __APPLE__
+#import <malloc/malloc.h>
+#elif defined(__GLIBC__)
+#import <malloc.h>
+#endif
+
+//counting allocations means hooking libmalloc's private malloc_logger for the rest of the process - fine for this project's
+//debug builds and benchmarks, not for an app that ships. everyone else gets heap and resident size only
+#if __APPLE__ && defined(NSR_MEMORY_PROFILING)
+#define NSR_COUNTS_ALLOCATIONS 1
+#else
+#define NSR_COUNTS_ALLOCATIONS 0
+#endif
+
+volatile BOOL NSRMemoryProfilingActive = NO;
+
+#pragma mark - Allocation counting
+
+typedef struct {
+    unsigned long long allocations;
+    unsigned long long allocatedBytes;
+    NSUInteger attributesDepth;
+} NSRThreadMemory;
+
+//only threads that have been marked have one of these - the hook ignores everything else
+static pthread_key_t threadMemoryKey;
+
+#if NSR_COUNTS_ALLOCATIONS
+
+//libmalloc calls this (if set) on every malloc/calloc/realloc/free - it's what malloc stack logging is built on
+typedef void (NSRMallocLogger)(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t framesToSkip);
+extern NSRMallocLogger *malloc_logger;
+
+#define NSRMallocLogAllocate      2
+#define NSRMallocLogDeallocate    4
+
+static NSRMallocLogger *previousLogger;
+
+//nothing in here may allocate
+static void NSRCountAllocation(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t framesToSkip)
+{
+    if (previousLogger) {
+        previousLogger(type, arg1, arg2, arg3, result, framesToSkip);
+    }
+    
+    if (!(type & NSRMallocLogAllocate)) {
+        return;
+    }
+    
+    NSRThreadMemory *memory = pthread_getspecific(threadMemoryKey);
+    if (memory)
+    {
+        memory->allocations++;
+        
+        //realloc logs as allocate+deallocate, with the old pointer in arg2 and the new size in arg3
+        memory->allocatedBytes += (type & NSRMallocLogDeallocate) ? arg3 : arg2;
+    }
+}
+
+#endif
+
+static NSRThreadMemory *NSRCurrentThreadMemory(void)
+{
+    //the hook goes in the first time anything is measured, and stays in (taking it out again isn't safe with other loggers chained)
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        pthread_key_create(&threadMemoryKey, free);
+#if NSR_COUNTS_ALLOCATIONS
+        previousLogger = malloc_logger;
+        malloc_logger = NSRCountAllocation;
+#endif
+    });
+    
+    NSRThreadMemory *memory = pthread_getspecific(threadMemoryKey);
+    if (!memory)
+    {
+        memory = calloc(1, sizeof(NSRThreadMemory));
+        pthread_setspecific(threadMemoryKey, memory);
+    }
+    return memory;
+}
+
+#pragma mark - Heap and resident size
+
+static long long NSRHeapInUse(void)
+{
+#if __APPLE__
+    malloc_statistics_t stats;
+    malloc_zone_statistics(NULL, &stats);
+    return (long long)stats.size_in_use;
+#elif defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    return (long long)(info.uordblks + info.hblkhd);
+#elif defined(__GLIBC__)
+    //mallinfo's fields are ints, which wrap past 2GB
+    struct mallinfo info = mallinfo();
+    return (long long)(unsigned int)info.uordblks + (unsigned int)info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+long long NSRMemoryPeakResidentBytes(void)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+
+#if __APPLE__
+    return usage.ru_maxrss;
+#else
+    //kilobytes everywhere else
+    return (long long)usage.ru_maxrss * 1024;
+#endif
+}
+
+void NSRMemoryMarkNow(NSRMemoryMark *mark)
+{
+    NSRThreadMemory *memory = NSRCurrentThreadMemory();
+    
+    mark->allocations = memory->allocations;
+    mark->allocatedBytes = memory->allocatedBytes;
+    mark->heapInUse = NSRHeapInUse();
+    mark->peakResident = NSRMemoryPeakResidentBytes();
+}
+
+#pragma mark - Phases
+
+typedef struct {
+    const char *name;
+    NSUInteger calls;
+    unsigned long long allocations;
+    unsigned long long allocatedBytes;
+    long long heapGrowth;
+    long long peakResidentGrowth;
+} NSRPhaseTotals;
+
+static void NSRAddToTotals(NSRPhaseTotals *totals, const NSRMemoryMark *start, const NSRMemoryMark *end)
+{
+    totals->calls++;
+    totals->allocations += end->allocations - start->allocations;
+    totals->allocatedBytes += end->allocatedBytes - start->allocatedBytes;
+    totals->heapGrowth += end->heapInUse - start->heapInUse;
+    totals->peakResidentGrowth += end->peakResident - start->peakResident;
+}
+
+//a fixed table, so recording a phase doesn't allocate (and show up in whatever phase encloses it)
+#define NSRMemoryMaxPhases 16
+
+static pthread_mutex_t phasesLock = PTHREAD_MUTEX_INITIALIZER;
+static NSRPhaseTotals phases[NSRMemoryMaxPhases];
+static NSUInteger phaseCount = 0;
+static NSUInteger attributesCount = 0;
+static unsigned long long attributesBytes = 0;
+
+void NSRMemoryRecordPhase(const char *name, const NSRMemoryMark *start)
+{
+    NSRMemoryMark end;
+    NSRMemoryMarkNow(&end);
+    
+    pthread_mutex_lock(&phasesLock);
+    
+    NSUInteger i = 0;
+    while (i < phaseCount && strcmp(phases[i].name, name) != 0) {
+        i++;
+    }
+    
+    if (i < NSRMemoryMaxPhases)
+    {
+        if (i == phaseCount)
+        {
+            phases[i] = (NSRPhaseTotals){.name = name};
+            phaseCount++;
+        }
+        NSRAddToTotals(&phases[i], start, &end);
+    }
+    
+    pthread_mutex_unlock(&phasesLock);
+}
+
+#pragma mark - remoteAttributes
+
+//an estimate - instance sizes plus payloads, ignoring allocator rounding and tagged pointers. JSON types only
+static unsigned long long NSRFootprint(id object)
+{
+    if (!object || object == [NSNull null]) {
+        return 0;
+    }
+    
+    unsigned long long size = class_getInstanceSize(object_getClass(object));
+    
+    if ([object isKindOfClass:[NSString class]])
+    {
+        size += [object length] * ([object fastestEncoding] == NSUnicodeStringEncoding ? sizeof(unichar) : 1);
+    }
+    else if ([object isKindOfClass:[NSData class]])
+    {
+        size += [object length];
+    }
+    else if ([object isKindOfClass:[NSDictionary class]])
+    {
+        size += [object count] * 2 * sizeof(id);
+        for (id key in object)
+        {
+            size += NSRFootprint(key) + NSRFootprint([object objectForKey:key]);
+        }
+    }
+    else if ([object isKindOfClass:[NSArray class]])
+    {
+        size += [object count] * sizeof(id);
+        for (id element in object)
+        {
+            size += NSRFootprint(element);
+        }
+    }
+    
+    return size;
+}
+
+BOOL NSRMemoryRecordAttributes(NSDictionary *attributes)
+{
+    NSRThreadMemory *memory = NSRCurrentThreadMemory();
+    if (memory->attributesDepth++ == 0)
+    {
+        unsigned long long bytes = NSRFootprint(attributes);
+        
+        pthread_mutex_lock(&phasesLock);
+        attributesCount++;
+        attributesBytes += bytes;
+        pthread_mutex_unlock(&phasesLock);
+    }
+    return YES;
+}
+
+void NSRMemoryAttributesEnd(void)
+{
+    NSRCurrentThreadMemory()->attributesDepth--;
+}
+
+#pragma mark - Statistics
+
+@interface NSRMemoryPhaseStatistics ()
+
+@property (nonatomic, strong) NSString *name;
+@property (nonatomic) NSUInteger calls;
+@property (nonatomic) long long allocations;
+@property (nonatomic) long long allocatedBytes;
+@property (nonatomic) long long heapGrowth;
+@property (nonatomic) long long peakResidentGrowth;
+
++ (instancetype) statisticsWithTotals:(const NSRPhaseTotals *)totals;
+
+@end
+
+@implementation NSRMemoryPhaseStatistics
+
++ (instancetype) statisticsWithTotals:(const NSRPhaseTotals *)totals
+{
+    BOOL counted = [NSRMemoryProfiler countsAllocations];
+    
+    NSRMemoryPhaseStatistics *statistics = [[self alloc] init];
+    statistics.name = (totals->name ? @(totals->name) : nil);
+    statistics.calls = totals->calls;
+    statistics.allocations = (counted ? (long long)totals->allocations : -1);
+    statistics.allocatedBytes = (counted ? (long long)totals->allocatedBytes : -1);
+    statistics.heapGrowth = totals->heapGrowth;
+    statistics.peakResidentGrowth = totals->peakResidentGrowth;
+    return statistics;
+}
+
+- (NSDictionary *) dictionaryRepresentation
+{
+    //null rather than a made up number when we couldn't count
+    return @{@"calls": @(self.calls),
+             @"allocations": (self.allocations < 0 ? [NSNull null] : @(self.allocations)),
+             @"allocated_bytes": (self.allocatedBytes < 0 ? [NSNull null] : @(self.allocatedBytes)),
+             @"heap_growth": @(self.heapGrowth),
+             @"peak_resident_growth": @(self.peakResidentGrowth)};
+}
+
+- (NSString *) description
+{
+    return [NSString stringWithFormat:@"<%@ %@: %lu calls, %lld allocations, %lld bytes allocated, heap %+lld bytes, peak resident %+lld bytes>",
+            NSStringFromClass([self class]), self.name, (unsigned long)self.calls, self.allocations, self.allocatedBytes,
+            self.heapGrowth, self.peakResidentGrowth];
+}
+
+@end
+
+@implementation NSRMemoryProfiler
+
++ (void) startProfiling
+{
+    //so the first phase doesn't pay for setting up the hook
+    NSRCurrentThreadMemory();
+    
+    pthread_mutex_lock(&phasesLock);
+    phaseCount = 0;
+    attributesCount = 0;
+    attributesBytes = 0;
+    pthread_mutex_unlock(&phasesLock);
+    
+    NSRMemoryProfilingActive = YES;
+}
+
++ (void) stopProfiling
+{
+    NSRMemoryProfilingActive = NO;
+}
+
++ (BOOL) isProfiling
+{
+    return NSRMemoryProfilingActive;
+}
+
++ (BOOL) countsAllocations
+{
+    return NSR_COUNTS_ALLOCATIONS;
+}
+
++ (NSDictionary *) phaseStatistics
+{
+    NSRPhaseTotals snapshot[NSRMemoryMaxPhases];
+    
+    pthread_mutex_lock(&phasesLock);
+    NSUInteger count = phaseCount;
+    memcpy(snapshot, phases, count * sizeof(NSRPhaseTotals));
+    pthread_mutex_unlock(&phasesLock);
+    
+    NSMutableDictionary *statistics = [NSMutableDictionary dictionaryWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++)
+    {
+        statistics[@(snapshot[i].name)] = [NSRMemoryPhaseStatistics statisticsWithTotals:&snapshot[i]];
+    }
+    return statistics;
+}
+
++ (NSUInteger) remoteAttributesCount
+{
+    pthread_mutex_lock(&phasesLock);
+    NSUInteger count = attributesCount;
+    pthread_mutex_unlock(&phasesLock);
+    return count;
+}
+
++ (unsigned long long) remoteAttributesBytes
+{
+    pthread_mutex_lock(&phasesLock);
+    unsigned long long bytes = attributesBytes;
+    pthread_mutex_unlock(&phasesLock);
+    return bytes;
+}
+
++ (unsigned long long) peakResidentBytes
+{
+    return (unsigned long long)NSRMemoryPeakResidentBytes();
+}
+
++ (NSRMemoryPhaseStatistics *) measure:(void (^)(void))block
+{
+    NSRMemoryMark start, end;
+    NSRMemoryMarkNow(&start);
+    block();
+    NSRMemoryMarkNow(&end);
+    
+    NSRPhaseTotals totals = {0};
+    NSRAddToTotals(&totals, &start, &end);
+    return [NSRMemoryPhaseStatistics statisticsWithTotals:&totals];
+}
+
++ (NSDictionary *) dictionaryRepresentation
+{
+    NSMutableDictionary *phaseDictionaries = [NSMutableDictionary dictionary];
+    [[self phaseStatistics] enumerateKeysAndObjectsUsingBlock:^(NSString *name, NSRMemoryPhaseStatistics *statistics, BOOL *stop) {
+        phaseDictionaries[name] = [statistics dictionaryRepresentation];
+    }];
+    
+    return @{@"counts_allocations": @([self countsAllocations]),
+             @"peak_resident_bytes": @([self peakResidentBytes]),
+             @"remote_attributes": @{@"objects": @([self remoteAttributesCount]), @"bytes": @([self remoteAttributesBytes])},
+             @"phases": phaseDictionaries};
+}
+
+@end
@@ -0,0 +1,74 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRMemoryProfiling.h
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import <Foundation/Foundation.h>
+
+//internal to NSRails - the hooks NSRRequest and NSRRemoteObject call to attribute allocations to phases for NSRMemoryProfiler
+
+//everything here bails out on a single read of this flag when profiling is off
+extern volatile BOOL NSRMemoryProfilingActive;
+
+typedef struct {
+    unsigned long long allocations;
+    unsigned long long allocatedBytes;
+    long long heapInUse;
+    long long peakResident;
+} NSRMemoryMark;
+
+//where the current thread's allocation counters and the process' heap/peak resident size are at
+void NSRMemoryMarkNow(NSRMemoryMark *mark);
+
+//adds everything since `start` to the phase's totals. `name` must be a string literal
+void NSRMemoryRecordPhase(const char *name, const NSRMemoryMark *start);
+
+//the process' peak resident size so far, in bytes
+long long NSRMemoryPeakResidentBytes(void);
+
+//measures `attributes` as about to be kept as an object's remoteAttributes, if it's the outermost one being decoded on this thread
+//(nested objects keep pieces of the same tree). returns whether NSRMemoryAttributesEnd has to be called
+BOOL NSRMemoryRecordAttributes(NSDictionary *attributes);
+void NSRMemoryAttributesEnd(void);
+
+static inline BOOL NSRMemoryPhaseBegin(NSRMemoryMark *mark)
+{
+    if (!NSRMemoryProfilingActive) {
+        return NO;
+    }
+    NSRMemoryMarkNow(mark);
+    return YES;
+}
+
+#define NSRMemoryPhaseEnd(name, began, mark) \
+    do { if (began) { NSRMemoryRecordPhase((name), &(mark)); } } while (0)
+
+static inline BOOL NSRMemoryAttributesBegin(NSDictionary *attributes)
+{
+    return (NSRMemoryProfilingActive && attributes && NSRMemoryRecordAttributes(attributes));
+}
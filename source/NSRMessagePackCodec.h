@@ -0,0 +1,47 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRMessagePackCodec.h
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import <Foundation/Foundation.h>
+#import <NSRails/NSRWireCodec.h>
+
+/**
+ Codec for [MessagePack](http://msgpack.org), a binary format that's usually a good deal smaller than the same JSON, and faster to parse.
+ 
+ To use it, set one as your config's codec:
+ 
+    [NSRConfig defaultConfig].codec = [[NSRMessagePackCodec alloc] init];
+ 
+ Your Rails app will need to be able to parse and render `application/msgpack` (with the [msgpack-rails](https://github.com/jingweno/msgpack-rails) gem, for example). Requests also accept JSON, so any action that can only render JSON still works.
+ 
+ Strings, numbers, booleans, nil, arrays and maps decode to the same objects NSJSONSerialization would give. On top of that, binary values decode to NSData, and extension types to NSData containing their payload.
+ */
+@interface NSRMessagePackCodec : NSObject <NSRWireCodec, NSCoding>
+
+@end
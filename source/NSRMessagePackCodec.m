@@ -0,0 +1,413 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRMessagePackCodec.m
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import "NSRMessagePackCodec.h"
+
+//deeper than any real response - past this, the input is almost certainly malicious or garbage
+#define NSRMessagePackMaxDepth 512
+
+#pragma mark - Encoding
+
+static void NSRPackHeader(NSMutableData *data, uint8_t type, uint64_t value, int bytes)
+{
+    uint8_t buffer[9];
+    buffer[0] = type;
+    for (int i = 0; i < bytes; i++) {
+        buffer[bytes - i] = (uint8_t)(value >> (8 * i));
+    }
+    [data appendBytes:buffer length:bytes + 1];
+}
+
+//picks the smallest of the 8/16/32-bit length headers, or the fixed one if the type has one and it fits
+static void NSRPackLength(NSMutableData *data, NSUInteger length, uint8_t fixType, NSUInteger fixMax, uint8_t type8, uint8_t type16, uint8_t type32)
+{
+    if (fixType && length <= fixMax) {
+        uint8_t byte = fixType | (uint8_t)length;
+        [data appendBytes:&byte length:1];
+    }
+    else if (type8 && length <= UINT8_MAX) {
+        NSRPackHeader(data, type8, length, 1);
+    }
+    else if (length <= UINT16_MAX) {
+        NSRPackHeader(data, type16, length, 2);
+    }
+    else {
+        NSRPackHeader(data, type32, length, 4);
+    }
+}
+
+static void NSRPackNumber(NSMutableData *data, NSNumber *number)
+{
+    if (CFGetTypeID((__bridge CFTypeRef)number) == CFBooleanGetTypeID())
+    {
+        uint8_t byte = ([number boolValue] ? 0xc3 : 0xc2);
+        [data appendBytes:&byte length:1];
+        return;
+    }
+    
+    char type = [number objCType][0];
+    if (type == 'f')
+    {
+        union { float f; uint32_t i; } value = { [number floatValue] };
+        NSRPackHeader(data, 0xca, value.i, 4);
+    }
+    else if (type == 'd')
+    {
+        union { double d; uint64_t i; } value = { [number doubleValue] };
+        NSRPackHeader(data, 0xcb, value.i, 8);
+    }
+    else if (type == 'Q' || type == 'L' || type == 'I' || [number longLongValue] >= 0)
+    {
+        unsigned long long value = [number unsignedLongLongValue];
+        if (value <= 0x7f) {
+            uint8_t byte = (uint8_t)value;
+            [data appendBytes:&byte length:1];
+        }
+        else if (value <= UINT8_MAX) {
+            NSRPackHeader(data, 0xcc, value, 1);
+        }
+        else if (value <= UINT16_MAX) {
+            NSRPackHeader(data, 0xcd, value, 2);
+        }
+        else if (value <= UINT32_MAX) {
+            NSRPackHeader(data, 0xce, value, 4);
+        }
+        else {
+            NSRPackHeader(data, 0xcf, value, 8);
+        }
+    }
+    else
+    {
+        long long value = [number longLongValue];
+        if (value >= -32) {
+            uint8_t byte = (uint8_t)(int8_t)value;
+            [data appendBytes:&byte length:1];
+        }
+        else if (value >= INT8_MIN) {
+            NSRPackHeader(data, 0xd0, (uint64_t)value, 1);
+        }
+        else if (value >= INT16_MIN) {
+            NSRPackHeader(data, 0xd1, (uint64_t)value, 2);
+        }
+        else if (value >= INT32_MIN) {
+            NSRPackHeader(data, 0xd2, (uint64_t)value, 4);
+        }
+        else {
+            NSRPackHeader(data, 0xd3, (uint64_t)value, 8);
+        }
+    }
+}
+
+static BOOL NSRPackObject(NSMutableData *data, id object)
+{
+    if ([object isKindOfClass:[NSString class]])
+    {
+        NSUInteger length = [object lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+        NSRPackLength(data, length, 0xa0, 31, 0xd9, 0xda, 0xdb);
+        
+        NSUInteger offset = data.length;
+        [data increaseLengthBy:length];
+        [object getBytes:(char *)data.mutableBytes + offset maxLength:length usedLength:NULL encoding:NSUTF8StringEncoding options:0 range:NSMakeRange(0, [object length]) remainingRange:NULL];
+    }
+    else if ([object isKindOfClass:[NSNumber class]])
+    {
+        NSRPackNumber(data, object);
+    }
+    else if ([object isKindOfClass:[NSDictionary class]])
+    {
+        NSRPackLength(data, [object count], 0x80, 15, 0, 0xde, 0xdf);
+        
+        __block BOOL valid = YES;
+        [object enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL *stop) {
+            valid = (NSRPackObject(data, key) && NSRPackObject(data, value));
+            *stop = !valid;
+        }];
+        return valid;
+    }
+    else if ([object isKindOfClass:[NSArray class]])
+    {
+        NSRPackLength(data, [object count], 0x90, 15, 0, 0xdc, 0xdd);
+        
+        for (id element in object)
+        {
+            if (!NSRPackObject(data, element)) {
+                return NO;
+            }
+        }
+    }
+    else if ([object isKindOfClass:[NSNull class]])
+    {
+        uint8_t byte = 0xc0;
+        [data appendBytes:&byte length:1];
+    }
+    else if ([object isKindOfClass:[NSData class]])
+    {
+        NSRPackLength(data, [object length], 0, 0, 0xc4, 0xc5, 0xc6);
+        [data appendData:object];
+    }
+    else
+    {
+        return NO;
+    }
+    
+    return YES;
+}
+
+#pragma mark - Decoding
+
+typedef struct {
+    const uint8_t *bytes;
+    const uint8_t *end;
+    BOOL mutableContainers;
+    NSUInteger depth;
+} NSRUnpacker;
+
+static BOOL NSRUnpackUInt(NSRUnpacker *unpacker, int bytes, uint64_t *value)
+{
+    if (unpacker->end - unpacker->bytes < bytes) {
+        return NO;
+    }
+    
+    uint64_t result = 0;
+    for (int i = 0; i < bytes; i++) {
+        result = (result << 8) | unpacker->bytes[i];
+    }
+    unpacker->bytes += bytes;
+    *value = result;
+    return YES;
+}
+
+static id NSRUnpackObject(NSRUnpacker *unpacker);
+
+static id NSRUnpackString(NSRUnpacker *unpacker, uint64_t length)
+{
+    if ((uint64_t)(unpacker->end - unpacker->bytes) < length) {
+        return nil;
+    }
+    
+    NSString *string = [[NSString alloc] initWithBytes:unpacker->bytes length:(NSUInteger)length encoding:NSUTF8StringEncoding];
+    unpacker->bytes += length;
+    return string;
+}
+
+static id NSRUnpackData(NSRUnpacker *unpacker, uint64_t length)
+{
+    if ((uint64_t)(unpacker->end - unpacker->bytes) < length) {
+        return nil;
+    }
+    
+    NSData *data = [NSData dataWithBytes:unpacker->bytes length:(NSUInteger)length];
+    unpacker->bytes += length;
+    return data;
+}
+
+static id NSRUnpackExtension(NSRUnpacker *unpacker, uint64_t length)
+{
+    uint64_t type;
+    return (NSRUnpackUInt(unpacker, 1, &type) ? NSRUnpackData(unpacker, length) : nil);
+}
+
+static id NSRUnpackArray(NSRUnpacker *unpacker, uint64_t count)
+{
+    //every element takes at least a byte - don't let a bogus count reserve gigabytes up front
+    if ((uint64_t)(unpacker->end - unpacker->bytes) < count || unpacker->depth >= NSRMessagePackMaxDepth) {
+        return nil;
+    }
+    
+    unpacker->depth++;
+    NSMutableArray *array = [[NSMutableArray alloc] initWithCapacity:(NSUInteger)count];
+    for (uint64_t i = 0; i < count; i++)
+    {
+        id element = NSRUnpackObject(unpacker);
+        if (!element) {
+            return nil;
+        }
+        [array addObject:element];
+    }
+    unpacker->depth--;
+    
+    return (unpacker->mutableContainers ? array : [array copy]);
+}
+
+static id NSRUnpackMap(NSRUnpacker *unpacker, uint64_t count)
+{
+    if ((uint64_t)(unpacker->end - unpacker->bytes) / 2 < count || unpacker->depth >= NSRMessagePackMaxDepth) {
+        return nil;
+    }
+    
+    unpacker->depth++;
+    NSMutableDictionary *dictionary = [[NSMutableDictionary alloc] initWithCapacity:(NSUInteger)count];
+    for (uint64_t i = 0; i < count; i++)
+    {
+        id key = NSRUnpackObject(unpacker);
+        id value = (key ? NSRUnpackObject(unpacker) : nil);
+        if (!value || ![key conformsToProtocol:@protocol(NSCopying)]) {
+            return nil;
+        }
+        dictionary[key] = value;
+    }
+    unpacker->depth--;
+    
+    return (unpacker->mutableContainers ? dictionary : [dictionary copy]);
+}
+
+static id NSRUnpackObject(NSRUnpacker *unpacker)
+{
+    if (unpacker->bytes >= unpacker->end) {
+        return nil;
+    }
+    
+    uint8_t type = *unpacker->bytes++;
+    uint64_t value;
+    
+    if (type <= 0x7f) {
+        return @(type);
+    }
+    if (type >= 0xe0) {
+        return @((int8_t)type);
+    }
+    if ((type & 0xf0) == 0x80) {
+        return NSRUnpackMap(unpacker, type & 0x0f);
+    }
+    if ((type & 0xf0) == 0x90) {
+        return NSRUnpackArray(unpacker, type & 0x0f);
+    }
+    if ((type & 0xe0) == 0xa0) {
+        return NSRUnpackString(unpacker, type & 0x1f);
+    }
+    
+    switch (type)
+    {
+        case 0xc0: return [NSNull null];
+        case 0xc2: return @NO;
+        case 0xc3: return @YES;
+            
+        case 0xc4: return (NSRUnpackUInt(unpacker, 1, &value) ? NSRUnpackData(unpacker, value) : nil);
+        case 0xc5: return (NSRUnpackUInt(unpacker, 2, &value) ? NSRUnpackData(unpacker, value) : nil);
+        case 0xc6: return (NSRUnpackUInt(unpacker, 4, &value) ? NSRUnpackData(unpacker, value) : nil);
+            
+        //extensions: the type byte is dropped, only the payload is kept
+        case 0xc7: return (NSRUnpackUInt(unpacker, 1, &value) ? NSRUnpackExtension(unpacker, value) : nil);
+        case 0xc8: return (NSRUnpackUInt(unpacker, 2, &value) ? NSRUnpackExtension(unpacker, value) : nil);
+        case 0xc9: return (NSRUnpackUInt(unpacker, 4, &value) ? NSRUnpackExtension(unpacker, value) : nil);
+        case 0xd4: case 0xd5: case 0xd6: case 0xd7: case 0xd8:
+            return NSRUnpackExtension(unpacker, 1 << (type - 0xd4));
+            
+        case 0xca:
+        {
+            if (!NSRUnpackUInt(unpacker, 4, &value)) {
+                return nil;
+            }
+            union { uint32_t i; float f; } number = { (uint32_t)value };
+            return @(number.f);
+        }
+        case 0xcb:
+        {
+            if (!NSRUnpackUInt(unpacker, 8, &value)) {
+                return nil;
+            }
+            union { uint64_t i; double d; } number = { value };
+            return @(number.d);
+        }
+            
+        case 0xcc: return (NSRUnpackUInt(unpacker, 1, &value) ? @(value) : nil);
+        case 0xcd: return (NSRUnpackUInt(unpacker, 2, &value) ? @(value) : nil);
+        case 0xce: return (NSRUnpackUInt(unpacker, 4, &value) ? @(value) : nil);
+        case 0xcf: return (NSRUnpackUInt(unpacker, 8, &value) ? @(value) : nil);
+            
+        case 0xd0: return (NSRUnpackUInt(unpacker, 1, &value) ? @((int8_t)value) : nil);
+        case 0xd1: return (NSRUnpackUInt(unpacker, 2, &value) ? @((int16_t)value) : nil);
+        case 0xd2: return (NSRUnpackUInt(unpacker, 4, &value) ? @((int32_t)value) : nil);
+        case 0xd3: return (NSRUnpackUInt(unpacker, 8, &value) ? @((int64_t)value) : nil);
+            
+        case 0xd9: return (NSRUnpackUInt(unpacker, 1, &value) ? NSRUnpackString(unpacker, value) : nil);
+        case 0xda: return (NSRUnpackUInt(unpacker, 2, &value) ? NSRUnpackString(unpacker, value) : nil);
+        case 0xdb: return (NSRUnpackUInt(unpacker, 4, &value) ? NSRUnpackString(unpacker, value) : nil);
+            
+        case 0xdc: return (NSRUnpackUInt(unpacker, 2, &value) ? NSRUnpackArray(unpacker, value) : nil);
+        case 0xdd: return (NSRUnpackUInt(unpacker, 4, &value) ? NSRUnpackArray(unpacker, value) : nil);
+        case 0xde: return (NSRUnpackUInt(unpacker, 2, &value) ? NSRUnpackMap(unpacker, value) : nil);
+        case 0xdf: return (NSRUnpackUInt(unpacker, 4, &value) ? NSRUnpackMap(unpacker, value) : nil);
+            
+        //0xc1 is never used
+        default: return nil;
+    }
+}
+
+@implementation NSRMessagePackCodec
+
+- (NSString *) contentType
+{
+    return @"application/msgpack";
+}
+
+- (NSData *) dataWithObject:(id)object error:(NSError **)error
+{
+    NSMutableData *data = [[NSMutableData alloc] init];
+    if (!NSRPackObject(data, object))
+    {
+        if (error) {
+            *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSPropertyListWriteInvalidError userInfo:@{NSLocalizedDescriptionKey:@"Object contains a value that can't be encoded as MessagePack."}];
+        }
+        return nil;
+    }
+    
+    return data;
+}
+
+- (id) objectWithData:(NSData *)data mutableContainers:(BOOL)mutableContainers error:(NSError **)error
+{
+    NSRUnpacker unpacker = { data.bytes, (const uint8_t *)data.bytes + data.length, mutableContainers, 0 };
+    id object = NSRUnpackObject(&unpacker);
+    
+    //anything left over means this wasn't one MessagePack value (an HTML error page, say)
+    if (!object || unpacker.bytes != unpacker.end)
+    {
+        if (error) {
+            *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSPropertyListReadCorruptError userInfo:@{NSLocalizedDescriptionKey:@"Data isn't valid MessagePack."}];
+        }
+        return nil;
+    }
+    
+    return object;
+}
+
+#pragma mark - NSCoding
+
+- (id) initWithCoder:(NSCoder *)aDecoder
+{
+    return [self init];
+}
+
+- (void) encodeWithCoder:(NSCoder *)aCoder
+{
+}
+
+@end
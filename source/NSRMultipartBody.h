@@ -0,0 +1,130 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRMultipartBody.h
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ A `multipart/form-data` request body, streamed from disk rather than loaded into memory.
+ 
+ Set one as an <NSRRequest>'s `body` to upload files along with (or instead of) regular parameters:
+ 
+    NSRMultipartBody *body = [[NSRMultipartBody alloc] init];
+    [body addFieldsFromDictionary:@{@"post":@{@"title":@"Vacation"}}];
+    [body addFileAtURL:photoURL forName:@"post[photo]" error:&e];
+ 
+    NSRRequest *request = [[NSRRequest POST] routeTo:@"posts"];
+    request.body = body;
+ 
+ Files are never read into memory as a whole: each time the body is sent, it's written in small chunks into a bound stream pair as the connection reads from it. The `Content-Length` is worked out up front from the size of each part, so the request isn't sent chunked. If a file has gone or changed size by the time it's sent, the body is cut short and the request fails with that error (in `NSCocoaErrorDomain`), whatever the server made of it.
+ 
+ An asynchronous request starts the body over if a redirect or authentication challenge needs it sent again. A synchronous one can't, since `NSURLConnection` doesn't ask for a new stream without a delegate.
+ 
+ You won't usually need to build one yourself - NSRRemoteObject does it for `remoteCreate`/`remoteUpdate`/`remoteReplace` whenever `<NSRRemoteObject remoteFileAttachments>` returns any files.
+ */
+@interface NSRMultipartBody : NSObject <NSCoding>
+
+/**
+ The boundary separating parts. (read-only)
+ 
+ Random, generated when the body is created.
+ */
+@property (nonatomic, readonly) NSString *boundary;
+
+/**
+ Value for the request's `Content-Type` header, including the boundary. (read-only)
+ */
+@property (nonatomic, readonly) NSString *contentType;
+
+/**
+ Exact size of the body in bytes. (read-only)
+ */
+@property (nonatomic, readonly) unsigned long long contentLength;
+
+/**
+ Adds a plain form field.
+ 
+ @param value Value of the field.
+ @param name Name of the field (eg, `post[title]`).
+ */
+- (void) addValue:(NSString *)value forName:(NSString *)name;
+
+/**
+ Adds a field for every value in a dictionary, with Rails-style nested names.
+ 
+ `@{@"post":@{@"title":@"Hi", @"tags":@[@"a", @"b"]}}` becomes `post[title]`, `post[tags][]` and `post[tags][]`. Numbers are sent as their string values, booleans as `true`/`false`, and `NSNull` as an empty string. Empty arrays and dictionaries can't be expressed as form fields, and are left out.
+ 
+ @param dictionary Dictionary to add, such as an NSRRemoteObject's `remoteDictionaryRepresentationWrapped:YES`.
+ */
+- (void) addFieldsFromDictionary:(NSDictionary *)dictionary;
+
+/**
+ Adds a file part whose contents are streamed from disk when the request is sent.
+ 
+ The file name sent is the last path component of *fileURL*, and the content type is guessed from its extension (falling back to `application/octet-stream`).
+ 
+ @param fileURL File URL of the file to upload.
+ @param name Name of the field (eg, `post[photo]`).
+ @param error Out parameter set if the file can't be read. May be `NULL`.
+ @return `YES` if the part was added.
+ */
+- (BOOL) addFileAtURL:(NSURL *)fileURL forName:(NSString *)name error:(NSError **)error;
+
+/**
+ Adds a file part whose contents are streamed from disk when the request is sent.
+ 
+ @param fileURL File URL of the file to upload.
+ @param name Name of the field (eg, `post[photo]`).
+ @param fileName File name to send to the server.
+ @param contentType MIME type of the file.
+ @param error Out parameter set if the file can't be read. May be `NULL`.
+ @return `YES` if the part was added.
+ */
+- (BOOL) addFileAtURL:(NSURL *)fileURL forName:(NSString *)name fileName:(NSString *)fileName contentType:(NSString *)contentType error:(NSError **)error;
+
+/**
+ Adds a file part from data already in memory.
+ 
+ @param data Contents of the file.
+ @param name Name of the field (eg, `post[photo]`).
+ @param fileName File name to send to the server.
+ @param contentType MIME type of the file.
+ */
+- (void) addData:(NSData *)data forName:(NSString *)name fileName:(NSString *)fileName contentType:(NSString *)contentType;
+
+/**
+ Returns a new stream that produces the encoded body.
+ 
+ A fresh stream is returned each time, so the body can be sent more than once.
+ 
+ @return Stream to use as a request's `HTTPBodyStream`.
+ */
+- (NSInputStream *) inputStream;
+
+@end
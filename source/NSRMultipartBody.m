@@ -0,0 +1,373 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRMultipartBody.m
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import "NSRMultipartBody.h"
+#import <objc/runtime.h>
+
+//size of the bound stream pair's buffer, and of each read from a file part
+#define NSRMultipartChunkSize (64 * 1024)
+
+//one part of the body: its header block (boundary + Content-Disposition etc), then either in-memory data or a file
+@interface NSRMultipartPart : NSObject <NSCoding>
+
+@property (nonatomic, strong) NSData *header;
+@property (nonatomic, strong) NSData *data;
+@property (nonatomic, strong) NSURL *fileURL;
+@property (nonatomic) unsigned long long length;
+
+@end
+
+@implementation NSRMultipartPart
+
+- (unsigned long long) contentLength
+{
+    return self.header.length + self.length + 2; //+ CRLF after the contents
+}
+
+- (id) initWithCoder:(NSCoder *)aDecoder
+{
+    if ((self = [super init]))
+    {
+        self.header = [aDecoder decodeObjectForKey:@"header"];
+        self.data = [aDecoder decodeObjectForKey:@"data"];
+        self.fileURL = [aDecoder decodeObjectForKey:@"fileURL"];
+        self.length = [[aDecoder decodeObjectForKey:@"length"] unsignedLongLongValue];
+    }
+    return self;
+}
+
+- (void) encodeWithCoder:(NSCoder *)aCoder
+{
+    [aCoder encodeObject:self.header forKey:@"header"];
+    [aCoder encodeObject:self.data forKey:@"data"];
+    [aCoder encodeObject:self.fileURL forKey:@"fileURL"];
+    [aCoder encodeObject:@(self.length) forKey:@"length"];
+}
+
+@end
+
+//why one stream from inputStream was cut short, if it was (a file that's gone, or changed size since it was added).
+//hung on the stream itself, so two sends of the same body (or a copy read for a cassette) can't see each other's
+@interface NSRMultipartStreamResult : NSObject
+
+@property (strong) NSError *error;
+
+@end
+
+@implementation NSRMultipartStreamResult
+@end
+
+static char NSRMultipartStreamResultKey;
+
+@interface NSRMultipartBody ()
+
+@property (nonatomic, strong) NSMutableArray *parts;
+
+@end
+
+@implementation NSRMultipartBody
+
+- (id) init
+{
+    if ((self = [super init]))
+    {
+        //CFUUID rather than NSUUID, which is iOS 6 / OS X 10.8
+        CFUUIDRef uuid = CFUUIDCreate(kCFAllocatorDefault);
+        _boundary = [NSString stringWithFormat:@"NSRails-%@", CFBridgingRelease(CFUUIDCreateString(kCFAllocatorDefault, uuid))];
+        CFRelease(uuid);
+        self.parts = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+- (NSString *) contentType
+{
+    return [@"multipart/form-data; boundary=" stringByAppendingString:self.boundary];
+}
+
+- (NSData *) closingBoundary
+{
+    return [[NSString stringWithFormat:@"--%@--\r\n", self.boundary] dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+- (unsigned long long) contentLength
+{
+    unsigned long long length = self.closingBoundary.length;
+    for (NSRMultipartPart *part in self.parts) {
+        length += [part contentLength];
+    }
+    return length;
+}
+
+#pragma mark - Adding parts
+
+static NSString *NSREscapedDispositionValue(NSString *value)
+{
+    //quotes and line breaks would end the header value early
+    value = [value stringByReplacingOccurrencesOfString:@"\"" withString:@"%22"];
+    value = [value stringByReplacingOccurrencesOfString:@"\r" withString:@"%0D"];
+    return [value stringByReplacingOccurrencesOfString:@"\n" withString:@"%0A"];
+}
+
+- (NSData *) headerForName:(NSString *)name fileName:(NSString *)fileName contentType:(NSString *)contentType
+{
+    NSMutableString *header = [NSMutableString stringWithFormat:@"--%@\r\nContent-Disposition: form-data; name=\"%@\"", self.boundary, NSREscapedDispositionValue(name)];
+    if (fileName) {
+        [header appendFormat:@"; filename=\"%@\"", NSREscapedDispositionValue(fileName)];
+    }
+    if (contentType) {
+        [header appendFormat:@"\r\nContent-Type: %@", contentType];
+    }
+    [header appendString:@"\r\n\r\n"];
+    
+    return [header dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+- (void) addValue:(NSString *)value forName:(NSString *)name
+{
+    [self addData:[value dataUsingEncoding:NSUTF8StringEncoding] forName:name fileName:nil contentType:nil];
+}
+
+- (void) addData:(NSData *)data forName:(NSString *)name fileName:(NSString *)fileName contentType:(NSString *)contentType
+{
+    NSRMultipartPart *part = [[NSRMultipartPart alloc] init];
+    part.header = [self headerForName:name fileName:fileName contentType:contentType];
+    part.data = data ?: [NSData data];
+    part.length = part.data.length;
+    [self.parts addObject:part];
+}
+
++ (NSString *) contentTypeForPathExtension:(NSString *)extension
+{
+    static NSDictionary *types;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        types = @{@"jpg":@"image/jpeg", @"jpeg":@"image/jpeg", @"png":@"image/png", @"gif":@"image/gif",
+                  @"heic":@"image/heic", @"tiff":@"image/tiff", @"pdf":@"application/pdf", @"zip":@"application/zip",
+                  @"mp4":@"video/mp4", @"mov":@"video/quicktime", @"m4a":@"audio/mp4", @"mp3":@"audio/mpeg",
+                  @"txt":@"text/plain", @"csv":@"text/csv", @"json":@"application/json"};
+    });
+    
+    return types[extension.lowercaseString] ?: @"application/octet-stream";
+}
+
+- (BOOL) addFileAtURL:(NSURL *)fileURL forName:(NSString *)name error:(NSError **)error
+{
+    return [self addFileAtURL:fileURL forName:name fileName:fileURL.lastPathComponent contentType:[NSRMultipartBody contentTypeForPathExtension:fileURL.pathExtension] error:error];
+}
+
+- (BOOL) addFileAtURL:(NSURL *)fileURL forName:(NSString *)name fileName:(NSString *)fileName contentType:(NSString *)contentType error:(NSError **)error
+{
+    //only the size is needed now - the contents are read while sending
+    NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:fileURL.path error:error];
+    if (!attributes) {
+        return NO;
+    }
+    
+    NSRMultipartPart *part = [[NSRMultipartPart alloc] init];
+    part.header = [self headerForName:name fileName:fileName contentType:contentType];
+    part.fileURL = fileURL;
+    part.length = attributes.fileSize;
+    [self.parts addObject:part];
+    
+    return YES;
+}
+
+static NSString *NSRFormValue(id value)
+{
+    if (value == [NSNull null]) {
+        return @"";
+    }
+    if ([value isKindOfClass:[NSNumber class]] && CFGetTypeID((__bridge CFTypeRef)value) == CFBooleanGetTypeID()) {
+        return ([value boolValue] ? @"true" : @"false");
+    }
+    return [value description];
+}
+
+- (void) addFieldsForValue:(id)value name:(NSString *)name
+{
+    if ([value isKindOfClass:[NSDictionary class]])
+    {
+        for (NSString *key in value) {
+            [self addFieldsForValue:value[key] name:(name ? [NSString stringWithFormat:@"%@[%@]", name, key] : key)];
+        }
+    }
+    else if ([value isKindOfClass:[NSArray class]])
+    {
+        for (id element in value) {
+            [self addFieldsForValue:element name:[name stringByAppendingString:@"[]"]];
+        }
+    }
+    else
+    {
+        [self addValue:NSRFormValue(value) forName:name];
+    }
+}
+
+- (void) addFieldsFromDictionary:(NSDictionary *)dictionary
+{
+    [self addFieldsForValue:dictionary name:nil];
+}
+
+#pragma mark - Streaming
+
+//writes all of data to the stream, blocking while the reader catches up. NO if the reader went away
+static BOOL NSRWriteFully(NSOutputStream *output, const uint8_t *bytes, NSUInteger length)
+{
+    while (length > 0)
+    {
+        NSInteger written = [output write:bytes maxLength:length];
+        if (written <= 0) {
+            return NO;
+        }
+        bytes += written;
+        length -= written;
+    }
+    return YES;
+}
+
+//writes exactly `length` bytes of the file, since that's what the Content-Length was worked out from. NO if the reader went away,
+//or (with fileError set) if the file can't be read or isn't that size anymore
+static BOOL NSRWriteFileContents(NSOutputStream *output, NSURL *fileURL, unsigned long long length, uint8_t *buffer, NSError **fileError)
+{
+    NSInputStream *file = [NSInputStream inputStreamWithURL:fileURL];
+    [file open];
+    
+    unsigned long long remaining = length;
+    NSInteger read = 0;
+    while (remaining > 0 && (read = [file read:buffer maxLength:(NSUInteger)MIN(remaining, NSRMultipartChunkSize)]) > 0)
+    {
+        if (!NSRWriteFully(output, buffer, read))
+        {
+            [file close];
+            return NO;
+        }
+        remaining -= read;
+    }
+    
+    //anything past the expected length means it grew
+    if (remaining == 0) {
+        read = [file read:buffer maxLength:1];
+    }
+    NSError *readError = file.streamError;
+    [file close];
+    
+    if (remaining > 0 || read != 0)
+    {
+        *fileError = readError ?: [NSError errorWithDomain:NSCocoaErrorDomain
+                                                      code:NSFileReadUnknownError
+                                                  userInfo:@{NSFilePathErrorKey:fileURL.path, NSLocalizedDescriptionKey:@"The file changed size after it was added to the body."}];
+        return NO;
+    }
+    return YES;
+}
+
+- (NSInputStream *) inputStream
+{
+    CFReadStreamRef readStream = NULL;
+    CFWriteStreamRef writeStream = NULL;
+    CFStreamCreateBoundPair(kCFAllocatorDefault, &readStream, &writeStream, NSRMultipartChunkSize);
+    
+    NSInputStream *input = CFBridgingRelease(readStream);
+    NSOutputStream *output = CFBridgingRelease(writeStream);
+    
+    NSArray *parts = [self.parts copy];
+    NSData *closingBoundary = self.closingBoundary;
+    
+    //the writer holds on to this rather than the stream, so a stream nobody reads anymore can still go away
+    NSRMultipartStreamResult *result = [[NSRMultipartStreamResult alloc] init];
+    objc_setAssociatedObject(input, &NSRMultipartStreamResultKey, result, OBJC_ASSOCIATION_RETAIN);
+    
+    //the writer blocks whenever the pair's buffer is full, so it gets its own thread from the pool rather than a shared serial queue
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^
+    {
+        [output open];
+        
+        uint8_t *buffer = malloc(NSRMultipartChunkSize);
+        BOOL ok = (buffer != NULL);
+        NSError *fileError = nil;
+        
+        for (NSRMultipartPart *part in parts)
+        {
+            ok = ok && NSRWriteFully(output, part.header.bytes, part.header.length);
+            if (part.fileURL) {
+                ok = ok && NSRWriteFileContents(output, part.fileURL, part.length, buffer, &fileError);
+            }
+            else {
+                ok = ok && NSRWriteFully(output, part.data.bytes, part.data.length);
+            }
+            ok = ok && NSRWriteFully(output, (const uint8_t *)"\r\n", 2);
+            
+            if (!ok) {
+                break;
+            }
+        }
+        
+        if (ok) {
+            NSRWriteFully(output, closingBoundary.bytes, closingBoundary.length);
+        }
+        
+        //recorded before the reader sees the stream end, so it's there by the time the response is
+        if (fileError) {
+            result.error = fileError;
+        }
+        
+        free(buffer);
+        [output close];
+    });
+    
+    return input;
+}
+
+//for NSRRequest, once the response is in - nil if the stream went through whole (or isn't one of ours)
++ (NSError *) errorForStream:(NSInputStream *)stream
+{
+    return (stream ? [objc_getAssociatedObject(stream, &NSRMultipartStreamResultKey) error] : nil);
+}
+
+#pragma mark - NSCoding
+
+- (id) initWithCoder:(NSCoder *)aDecoder
+{
+    if ((self = [super init]))
+    {
+        _boundary = [aDecoder decodeObjectForKey:@"boundary"];
+        self.parts = [[aDecoder decodeObjectForKey:@"parts"] mutableCopy] ?: [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+- (void) encodeWithCoder:(NSCoder *)aCoder
+{
+    [aCoder encodeObject:self.boundary forKey:@"boundary"];
+    [aCoder encodeObject:self.parts forKey:@"parts"];
+}
+
+@end
@@ -0,0 +1,69 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRNetworkLog.h
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import <Foundation/Foundation.h>
+
+@protocol NSRWireCodec;
+
+//internal to NSRails - the pipeline behind NSRConfig's networkLog* settings
+
+//an event only holds references to what was already on hand when the request went out/came in (the HTTP body bytes, URL, etc)
+//nothing is formatted until the background consumer gets to it
+
+@interface NSRNetworkLogEvent : NSObject
+
+@property (nonatomic) BOOL outgoing;
+@property (nonatomic, strong) NSString *httpMethod;
+@property (nonatomic, strong) NSURL *URL;
+@property (nonatomic) NSInteger statusCode;
+@property (nonatomic, strong) NSError *error;
+
+//nil if bodies aren't being logged at this level
+@property (nonatomic, strong) NSData *body;
+@property (nonatomic) NSUInteger maxBodyBytes;
+
+//set when the body is in a format other than JSON - it's decoded with this and shown as JSON
+@property (nonatomic, strong) id<NSRWireCodec> codec;
+
+@property (nonatomic, copy) void (^handler)(NSString *message);
+
+- (NSString *) formattedMessage;
+
+@end
+
+@interface NSRNetworkLog : NSObject
+
+//called on the request path - never blocks and never formats. returns NO if the buffer was full and the event was dropped
++ (BOOL) enqueueEvent:(NSRNetworkLogEvent *)event;
+
+//blocks until everything enqueued before this call has been emitted
++ (void) flush;
+
+@end
@@ -0,0 +1,263 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRNetworkLog.m
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import "NSRNetworkLog.h"
+#import "NSRWireCodec.h"
+
+#import <stdatomic.h>
+
+@implementation NSRNetworkLogEvent
+
+- (NSString *) formattedBody
+{
+    NSData *body = self.body;
+    if (body.length == 0) {
+        return nil;
+    }
+    
+    if (self.codec)
+    {
+        //binary formats aren't readable even in part - decode the whole thing, and cut down what it prints as instead
+        id object = [self.codec objectWithData:body mutableContainers:NO error:nil];
+        if (!object) {
+            return [NSString stringWithFormat:@"(%lu bytes of %@)", (unsigned long)body.length, [self.codec contentType]];
+        }
+        
+        NSString *text;
+        if ([NSJSONSerialization isValidJSONObject:object])
+        {
+            NSData *pretty = [NSJSONSerialization dataWithJSONObject:object options:NSJSONWritingPrettyPrinted error:nil];
+            text = [[NSString alloc] initWithData:pretty encoding:NSUTF8StringEncoding];
+        }
+        else
+        {
+            text = [object description];
+        }
+        
+        if (self.maxBodyBytes > 0 && text.length > self.maxBodyBytes)
+        {
+            NSRange cut = [text rangeOfComposedCharacterSequencesForRange:NSMakeRange(0, self.maxBodyBytes)];
+            return [NSString stringWithFormat:@"%@... (%lu more characters)", [text substringToIndex:cut.length], (unsigned long)(text.length - cut.length)];
+        }
+        return text;
+    }
+    
+    if (self.maxBodyBytes > 0 && body.length > self.maxBodyBytes)
+    {
+        //don't pretty print something we're cutting off anyway - just show the raw prefix
+        const unsigned char *bytes = body.bytes;
+        NSUInteger cut = self.maxBodyBytes;
+        
+        //back up so we don't split a UTF-8 sequence
+        while (cut > 0 && (bytes[cut] & 0xC0) == 0x80) {
+            cut--;
+        }
+        
+        NSString *prefix = [[NSString alloc] initWithBytes:bytes length:cut encoding:NSUTF8StringEncoding] ?: @"";
+        return [NSString stringWithFormat:@"%@... (%lu more bytes)", prefix, (unsigned long)(body.length - cut)];
+    }
+    
+    id json = [NSJSONSerialization JSONObjectWithData:body options:0 error:nil];
+    if (json)
+    {
+        NSData *pretty = [NSJSONSerialization dataWithJSONObject:json options:NSJSONWritingPrettyPrinted error:nil];
+        return [[NSString alloc] initWithData:pretty encoding:NSUTF8StringEncoding];
+    }
+    
+    return [[NSString alloc] initWithData:body encoding:NSUTF8StringEncoding];
+}
+
+- (NSString *) formattedMessage
+{
+    if (self.outgoing)
+    {
+        return [NSString stringWithFormat:@"[NSRails][OUT] ===> %@ to %@ %@", self.httpMethod, [self.URL absoluteString], [self formattedBody] ?: @""];
+    }
+    
+    id detail = self.error ?: [self formattedBody];
+    return [NSString stringWithFormat:@"[NSRails][IN] <=== Code %d %@", (int)self.statusCode, detail ?: @""];
+}
+
+@end
+
+@implementation NSRNetworkLog
+
+#pragma mark - Ring buffer
+
+//bounded multi-producer queue (Vyukov-style): each slot carries a sequence number that says whether it's free for
+//the producer at position `pos` (sequence == pos) or holds an event for the consumer at `pos` (sequence == pos + 1)
+//producers only ever CAS the enqueue position, so logging from many threads never takes a lock
+
+#define NSRNetworkLogCapacity 1024
+
+typedef struct {
+    _Atomic(size_t) sequence;
+    void *event;
+} NSRNetworkLogSlot;
+
+static NSRNetworkLogSlot slots[NSRNetworkLogCapacity];
+static _Atomic(size_t) enqueuePosition;
+static _Atomic(size_t) dequeuePosition;
+
+static atomic_bool drainScheduled;
+static _Atomic(unsigned long) droppedEvents;
+
+static dispatch_queue_t consumerQueue;
+
++ (void) initialize
+{
+    if (self == [NSRNetworkLog class])
+    {
+        for (size_t i = 0; i < NSRNetworkLogCapacity; i++) {
+            atomic_init(&slots[i].sequence, i);
+        }
+        consumerQueue = dispatch_queue_create("com.nsrails.networklog", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(consumerQueue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0));
+    }
+}
+
+static BOOL NSRNetworkLogPush(NSRNetworkLogEvent *event)
+{
+    size_t pos = atomic_load_explicit(&enqueuePosition, memory_order_relaxed);
+    NSRNetworkLogSlot *slot;
+    
+    for (;;)
+    {
+        slot = &slots[pos % NSRNetworkLogCapacity];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&enqueuePosition, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            //full - consumer is a whole buffer behind
+            return NO;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&enqueuePosition, memory_order_relaxed);
+        }
+    }
+    
+    slot->event = (void *)CFBridgingRetain(event);
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+    return YES;
+}
+
+static NSRNetworkLogEvent *NSRNetworkLogPop(void)
+{
+    //single consumer (the serial queue), so no CAS needed on this side
+    size_t pos = atomic_load_explicit(&dequeuePosition, memory_order_relaxed);
+    NSRNetworkLogSlot *slot = &slots[pos % NSRNetworkLogCapacity];
+    
+    size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    if (sequence != pos + 1) {
+        return nil;
+    }
+    
+    NSRNetworkLogEvent *event = CFBridgingRelease(slot->event);
+    slot->event = NULL;
+    
+    atomic_store_explicit(&slot->sequence, pos + NSRNetworkLogCapacity, memory_order_release);
+    atomic_store_explicit(&dequeuePosition, pos + 1, memory_order_relaxed);
+    return event;
+}
+
+#pragma mark - Consumer
+
+static void NSRNetworkLogEmit(NSString *message, void (^handler)(NSString *))
+{
+    if (handler) {
+        handler(message);
+    }
+    else {
+        NSLog(@"%@", message);
+    }
+}
+
+static void NSRNetworkLogDrain(void *context)
+{
+    for (;;)
+    {
+        NSRNetworkLogEvent *event;
+        while ((event = NSRNetworkLogPop()))
+        {
+            @autoreleasepool
+            {
+                unsigned long dropped = atomic_exchange(&droppedEvents, 0);
+                if (dropped > 0) {
+                    NSRNetworkLogEmit([NSString stringWithFormat:@"[NSRails] %lu network log events dropped (logging fell behind)", dropped], event.handler);
+                }
+                
+                NSRNetworkLogEmit([event formattedMessage], event.handler);
+            }
+        }
+        
+        atomic_store(&drainScheduled, false);
+        
+        //a producer may have pushed after our last pop but before it saw the flag cleared - pick that up here
+        if (atomic_load(&enqueuePosition) == atomic_load(&dequeuePosition)) {
+            return;
+        }
+        if (atomic_exchange(&drainScheduled, true)) {
+            //someone else already scheduled another drain
+            return;
+        }
+    }
+}
+
+#pragma mark - Producer
+
++ (BOOL) enqueueEvent:(NSRNetworkLogEvent *)event
+{
+    if (!NSRNetworkLogPush(event))
+    {
+        atomic_fetch_add(&droppedEvents, 1);
+        return NO;
+    }
+    
+    //only the first producer to find the consumer idle needs to wake it
+    if (!atomic_exchange(&drainScheduled, true)) {
+        dispatch_async_f(consumerQueue, NULL, NSRNetworkLogDrain);
+    }
+    return YES;
+}
+
++ (void) flush
+{
+    dispatch_sync(consumerQueue, ^{});
+}
+
+@end
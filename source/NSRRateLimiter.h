@@ -0,0 +1,66 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRRateLimiter.h
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import <Foundation/Foundation.h>
+
+//internal to NSRails - the token bucket behind NSRConfig's requestsPerSecond and per-route limits
+
+//the bucket refills at the current rate up to burstSize tokens, and each request takes one. requests are never turned away:
+//a request that finds the bucket empty takes a token anyway (going into debt) and is told how long to wait, so concurrent
+//callers come out spaced evenly, in the order they asked
+
+//the rate adapts AIMD-style: a 429 halves it (never below an eighth of the maximum) and holds everything back for Retry-After,
+//then every request that gets through creeps it back up towards the maximum
+
+@interface NSRRateLimiter : NSObject <NSCoding>
+
+- (id) initWithRate:(double)rate burstSize:(NSUInteger)burstSize;
+
+@property (nonatomic, readonly) double maximumRate;
+@property (nonatomic, readonly) NSUInteger burstSize;
+
+//what the limiter is pacing at right now - below maximumRate after a 429
+@property (nonatomic, readonly) double currentRate;
+
+//takes a token. returns how long to wait before sending (0 to go right away)
+- (NSTimeInterval) reserve;
+
+//how much longer a 429 is holding everything back. checked again once a reservation's wait is up, since a 429 may have come in meanwhile
+- (NSTimeInterval) remainingHold;
+
+//a 429 came back. pass 0 for retryAfter if the server didn't say, and the hold will be one interval at the new rate
+- (void) throttleWithRetryAfter:(NSTimeInterval)retryAfter;
+
+- (void) recordSuccess;
+
+//Retry-After is either a number of seconds or an HTTP date. 0 if missing or unparseable
++ (NSTimeInterval) retryAfterFromResponse:(NSHTTPURLResponse *)response;
+
+@end
@@ -0,0 +1,157 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRRateLimiter.m
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import "NSRRateLimiter.h"
+
+static inline NSTimeInterval NSRNow(void)
+{
+    //monotonic, unlike NSDate
+    return [NSProcessInfo processInfo].systemUptime;
+}
+
+@implementation NSRRateLimiter
+{
+    double _tokens;
+    NSTimeInterval _lastRefill;
+    NSTimeInterval _heldUntil;
+}
+
+- (id) initWithRate:(double)rate burstSize:(NSUInteger)burstSize
+{
+    if ((self = [super init]))
+    {
+        _maximumRate = rate;
+        _currentRate = rate;
+        _burstSize = MAX(burstSize, 1);
+        
+        _tokens = _burstSize;
+        _lastRefill = NSRNow();
+    }
+    return self;
+}
+
+- (void) refillAt:(NSTimeInterval)now
+{
+    _tokens = MIN((double)_burstSize, _tokens + (now - _lastRefill) * _currentRate);
+    _lastRefill = now;
+}
+
+- (NSTimeInterval) reserve
+{
+    @synchronized(self)
+    {
+        NSTimeInterval now = NSRNow();
+        [self refillAt:now];
+        
+        _tokens -= 1;
+        NSTimeInterval wait = (_tokens < 0 ? -_tokens / _currentRate : 0);
+        return MAX(wait, _heldUntil - now);
+    }
+}
+
+- (NSTimeInterval) remainingHold
+{
+    @synchronized(self)
+    {
+        return MAX(0, _heldUntil - NSRNow());
+    }
+}
+
+- (void) throttleWithRetryAfter:(NSTimeInterval)retryAfter
+{
+    @synchronized(self)
+    {
+        NSTimeInterval now = NSRNow();
+        [self refillAt:now];
+        
+        _currentRate = MAX(_currentRate / 2, _maximumRate / 8);
+        
+        //no burst when the hold lifts - whatever's been waiting goes out at the new rate
+        _tokens = MIN(_tokens, 0);
+        _heldUntil = MAX(_heldUntil, now + (retryAfter > 0 ? retryAfter : 1 / _currentRate));
+    }
+}
+
+- (void) recordSuccess
+{
+    @synchronized(self)
+    {
+        if (_currentRate < _maximumRate)
+        {
+            [self refillAt:NSRNow()];
+            _currentRate = MIN(_maximumRate, _currentRate + _maximumRate / 16);
+        }
+    }
+}
+
++ (NSTimeInterval) retryAfterFromResponse:(NSHTTPURLResponse *)response
+{
+    NSString *value = [response allHeaderFields][@"Retry-After"];
+    if (value.length == 0) {
+        return 0;
+    }
+    
+    NSScanner *scanner = [NSScanner scannerWithString:value];
+    double seconds;
+    if ([scanner scanDouble:&seconds] && [scanner isAtEnd]) {
+        return MAX(0, seconds);
+    }
+    
+    static NSDateFormatter *formatter;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        formatter = [[NSDateFormatter alloc] init];
+        formatter.locale = [[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"];
+        formatter.timeZone = [NSTimeZone timeZoneWithAbbreviation:@"GMT"];
+        formatter.dateFormat = @"EEE',' dd MMM yyyy HH':'mm':'ss 'GMT'";
+    });
+    
+    NSDate *date;
+    @synchronized(formatter)
+    {
+        date = [formatter dateFromString:value];
+    }
+    return MAX(0, [date timeIntervalSinceNow]);
+}
+
+#pragma mark - NSCoding
+
+- (id) initWithCoder:(NSCoder *)aDecoder
+{
+    return [self initWithRate:[aDecoder decodeDoubleForKey:@"maximumRate"] burstSize:[aDecoder decodeIntegerForKey:@"burstSize"]];
+}
+
+- (void) encodeWithCoder:(NSCoder *)aCoder
+{
+    [aCoder encodeDouble:self.maximumRate forKey:@"maximumRate"];
+    [aCoder encodeInteger:self.burstSize forKey:@"burstSize"];
+}
+
+@end
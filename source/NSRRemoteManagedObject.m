@@ -37,6 +37,7 @@ NSString * const NSRCoreDataException = @"NSRCoreDataException";
 
 - (Class) containerClassForRelationProperty:(NSString *)property;
 - (NSNumber *) primitiveRemoteID;
+- (BOOL) isNewToRemoteChanges;
 
 @end
 
@@ -61,6 +62,12 @@ NSString * const NSRCoreDataException = @"NSRCoreDataException";
 
 #pragma mark - Behavior overrides
 
+//an object fetched from the store hasn't had a remote dictionary applied in this process, but it could be bound to a view
+- (BOOL) isNewToRemoteChanges
+{
+    return (self.isInserted && [super isNewToRemoteChanges]);
+}
+
 + (instancetype) objectWithRemoteDictionary:(NSDictionary *)dictionary
 {
     NSRRemoteManagedObject *obj = nil;
@@ -128,9 +135,9 @@ NSString * const NSRCoreDataException = @"NSRCoreDataException";
     return YES;
 }
 
-- (void) remoteFetchAsync:(NSRBasicCompletionBlock)completionBlock
+- (NSRRequestHandle *) remoteFetchAsync:(NSRBasicCompletionBlock)completionBlock
 {
-    [super remoteFetchAsync:
+    return [super remoteFetchAsync:
      ^(NSError *error)
      {
          if (!error) {
@@ -153,9 +160,9 @@ NSString * const NSRCoreDataException = @"NSRCoreDataException";
     return YES;
 }
 
-- (void) remoteCreateAsync:(NSRBasicCompletionBlock)completionBlock
+- (NSRRequestHandle *) remoteCreateAsync:(NSRBasicCompletionBlock)completionBlock
 {
-    [super remoteCreateAsync:
+    return [super remoteCreateAsync:
      ^(NSError *error)
      {
          if (!error) {
@@ -178,9 +185,9 @@ NSString * const NSRCoreDataException = @"NSRCoreDataException";
     return YES;
 }
 
-- (void) remoteUpdateAsync:(NSRBasicCompletionBlock)completionBlock
+- (NSRRequestHandle *) remoteUpdateAsync:(NSRBasicCompletionBlock)completionBlock
 {
-    [super remoteUpdateAsync:
+    return [super remoteUpdateAsync:
      ^(NSError *error)
      {
          if (!error) {
@@ -203,9 +210,9 @@ NSString * const NSRCoreDataException = @"NSRCoreDataException";
     return YES;
 }
 
-- (void) remoteReplaceAsync:(NSRBasicCompletionBlock)completionBlock
+- (NSRRequestHandle *) remoteReplaceAsync:(NSRBasicCompletionBlock)completionBlock
 {
-    [super remoteReplaceAsync:
+    return [super remoteReplaceAsync:
      ^(NSError *error)
      {
          if (!error) {
@@ -229,9 +236,9 @@ NSString * const NSRCoreDataException = @"NSRCoreDataException";
     return YES;
 }
 
-- (void) remoteDestroyAsync:(NSRBasicCompletionBlock)completionBlock
+- (NSRRequestHandle *) remoteDestroyAsync:(NSRBasicCompletionBlock)completionBlock
 {
-    [super remoteDestroyAsync:
+    return [super remoteDestroyAsync:
      ^(NSError *error) 
      {
          if (!error)
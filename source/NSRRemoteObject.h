@@ -33,9 +33,22 @@
 typedef void(^NSRBasicCompletionBlock)(NSError *error);
 typedef void(^NSRFetchAllCompletionBlock)(NSArray *allRemote, NSError *error);
 typedef void(^NSRFetchObjectCompletionBlock)(id object, NSError *error);
+typedef void(^NSRFetchByIDCompletionBlock)(NSDictionary *objectsByID, NSError *error);
 
 @class NSRConfig;
 @class NSRRequest;
+@class NSRRequestHandle;
+@class NSRSubscription;
+@class NSRSubscriptionEvent;
+
+//Notifications (see NSRConfig's coalescesChangeNotifications)
+extern NSString * const NSRRemoteObjectDidChangeNotification;
+extern NSString * const NSRRemoteObjectsDidChangeNotification;
+
+//Keys
+extern NSString * const NSRChangedPropertiesKey;
+extern NSString * const NSRChangedObjectsKey;
+extern NSString * const NSRInsertedObjectsKey;
 
 /*************************************************************************
  *************************************************************************
@@ -168,8 +181,9 @@ typedef void(^NSRFetchObjectCompletionBlock)(id object, NSError *error);
  Asynchronously makes a GET request to `/objects` (where `objects` is the pluralization of receiver's model name.)
  
  @param completionBlock Block to be executed when the request is complete.
+ @return A handle that can be used to cancel the request.
  */
-+ (void) remoteAllAsync:(NSRFetchAllCompletionBlock)completionBlock;
++ (NSRRequestHandle *) remoteAllAsync:(NSRFetchAllCompletionBlock)completionBlock;
 
 /**
  Retrieves an array of all remote objects (as instances of receiver's class.) Each instance’s properties will be set to those returned by Rails.
@@ -178,8 +192,144 @@ typedef void(^NSRFetchObjectCompletionBlock)(id object, NSError *error);
  
  @param parentObject Remote object by which to request the collection from - establishes pattern for resources depending on nesting. Raises an exception if this object's `remoteID` is nil, as it is used to construct the route.
  @param completionBlock Block to be executed when the request is complete.
+ @return A handle that can be used to cancel the request.
+ */
++ (NSRRequestHandle *) remoteAllViaObject:(NSRRemoteObject *)parentObject async:(NSRFetchAllCompletionBlock)completionBlock;
+
+/**
+ Returns an array of all remote objects (as instances of receiver's class), asking the server to sideload the given associations in the same response.
+ 
+ Makes a GET request to `/objects?include=author,comments`, where the association names are the remote keys for the properties in *associations*.
+ 
+ The server can embed the associated records in each object (which is decoded as usual), or sideload them - send each associated record once, under its own root key, and refer to it by ID:
+ 
+     {
+       "posts":   [{"id":1, "author_id":7}, {"id":2, "author_id":7}],
+       "authors": [{"id":7, "name":"dan"}]
+     }
+ 
+ Sideloaded records are decoded once each, and set on every object that refers to them through `x_id` (or `x_ids`, for to-many) keys, for any property that `<nestedClassForProperty:>` returns a class for. The root key each class is looked for under is its pluralized model name.
+ 
+ Request made synchronously. See `<remoteAllIncluding:async:>` for asynchronous operation.
+ 
+ @param associations Names of the properties to ask the server to include.
+ @param error Out parameter used if an error occurs while processing the request. May be `NULL`.
+ @return NSArray of instances of receiver's class, with their included associations set.
+ */
++ (NSArray *) remoteAllIncluding:(NSArray *)associations error:(NSError **)error;
+
+/**
+ Retrieves an array of all remote objects (as instances of receiver's class), asking the server to sideload the given associations in the same response.
+ 
+ Asynchronously makes a GET request to `/objects?include=author,comments`. See <remoteAllIncluding:error:> for how included records are decoded.
+ 
+ @param associations Names of the properties to ask the server to include.
+ @param completionBlock Block to be executed when the request is complete.
+ @return A handle that can be used to cancel the request.
+ */
++ (NSRRequestHandle *) remoteAllIncluding:(NSArray *)associations async:(NSRFetchAllCompletionBlock)completionBlock;
+
+/**
+ Brings a collection of remote objects up to date, fetching only the records that changed since the last sync.
+ 
+ Makes a GET request to `/objects?updated_since=2013-01-01T10:00:00.123Z`, where the time is the latest `updated_at` seen in the previous syncs of this class and route (its "high-water mark"), sent back exactly as the server sent it - so it keeps whatever precision the server uses, even past the config's <NSRConfig dateFormat>. The first sync, one after <resetRemoteSyncMarks>, or one with an empty (or `nil`) *collection* sends no parameter and so gets everything. The parameter name can be changed with <NSRConfig syncQueryParameter>.
+ 
+ The server should return the records with an `updated_at` strictly after the mark. Comparing with `>=` instead is also fine (and safer if its timestamps are coarser than its clock) - records that come back again just update their objects in place.
+ 
+ Each returned record updates the object in *collection* with the same remoteID, or is added as a new object if there's none. Deletions are picked up from tombstones, if the server sends them - either as a `deleted_ids` array next to the records (`{"posts":[...], "deleted_ids":[4, 9]}`), or as records with `"_destroy":true`. Their objects are left out of the returned array.
+ 
+ The mark is saved (in `NSUserDefaults`, per class and per route) only once a sync succeeds, so a failed sync is simply retried from the same point next time.
+ 
+ Request made synchronously. See `<remoteSyncCollection:async:>` for asynchronous operation.
+ 
+ @param collection Objects from previous syncs (or `nil`). Objects in it are updated in place.
+ @param error Out parameter used if an error occurs while processing the request. May be `NULL`.
+ @return The synced collection - objects from *collection* that weren't deleted, in their original order, followed by new objects. `nil` if an error occurred.
+ */
++ (NSArray *) remoteSyncCollection:(NSArray *)collection error:(NSError **)error;
+
+/**
+ Brings a collection of remote objects up to date, fetching only the records that changed since the last sync.
+ 
+ Asynchronously makes a GET request to `/objects?updated_since=...`. See <remoteSyncCollection:error:>.
+ 
+ @param collection Objects from previous syncs (or `nil`). Objects in it are updated in place.
+ @param completionBlock Block to be executed when the request is complete. Passed the synced collection.
+ @return A handle that can be used to cancel the request.
+ */
++ (NSRRequestHandle *) remoteSyncCollection:(NSArray *)collection async:(NSRFetchAllCompletionBlock)completionBlock;
+
+/**
+ Brings a collection of remote objects up to date, constructed with a parent prefix, fetching only the records that changed since the last sync.
+ 
+ Makes a GET request to `/parents/3/objects?updated_since=...`. Each parent's collection has its own high-water mark. See <remoteSyncCollection:error:>.
+ 
+ @param collection Objects from previous syncs (or `nil`). Objects in it are updated in place.
+ @param parentObject Remote object by which to request the collection from. Raises an exception if this object's `remoteID` is nil.
+ @param error Out parameter used if an error occurs while processing the request. May be `NULL`.
+ @return The synced collection, or `nil` if an error occurred.
+ */
++ (NSArray *) remoteSyncCollection:(NSArray *)collection viaObject:(NSRRemoteObject *)parentObject error:(NSError **)error;
+
+/**
+ Brings a collection of remote objects up to date, constructed with a parent prefix, fetching only the records that changed since the last sync.
+ 
+ Asynchronously makes a GET request to `/parents/3/objects?updated_since=...`. See <remoteSyncCollection:error:>.
+ 
+ @param collection Objects from previous syncs (or `nil`). Objects in it are updated in place.
+ @param parentObject Remote object by which to request the collection from. Raises an exception if this object's `remoteID` is nil.
+ @param completionBlock Block to be executed when the request is complete. Passed the synced collection.
+ @return A handle that can be used to cancel the request.
+ */
++ (NSRRequestHandle *) remoteSyncCollection:(NSArray *)collection viaObject:(NSRRemoteObject *)parentObject async:(NSRFetchAllCompletionBlock)completionBlock;
+
+/**
+ Returns the latest `updated_at` seen by syncs of this class's top-level collection (`/objects`), or `nil` if it's never been synced.
+ 
+ @return The high-water mark that the next <remoteSyncCollection:error:> will send.
  */
-+ (void) remoteAllViaObject:(NSRRemoteObject *)parentObject async:(NSRFetchAllCompletionBlock)completionBlock;
++ (NSDate *) remoteSyncMark;
+
+/**
+ Forgets the high-water marks of every route for this class, so the next sync fetches everything.
+ 
+ Call this when throwing away the synced collection (on logout, for instance).
+ */
++ (void) resetRemoteSyncMarks;
+
+/**
+ Retrieves all remote objects (as instances of receiver's class) one at a time as they arrive, without holding the whole response or all the objects in memory at once.
+ 
+ Makes a GET request to `/objects`, like <remoteAllAsync:>, but streams the response (see `-[NSRRequest sendAsynchronousStreamingElements:completion:]`). Useful for very large collections you process and then let go of (exports, syncing into CoreData in batches, etc).
+ 
+ @param objectBlock Block called with each object, in order, as soon as it's been received and decoded. Called on a background queue. If the server doesn't respond with a bare JSON array (eg, it's wrapped in a root key), the response can't be streamed and this is instead called for every object just before *completionBlock*.
+ @param completionBlock Block to be executed when the request is complete.
+ @return A handle that can be used to cancel the request.
+ */
++ (NSRRequestHandle *) remoteAllStreaming:(void (^)(id object))objectBlock async:(NSRBasicCompletionBlock)completionBlock;
+
+/**
+ Retrieves all remote objects (as instances of receiver's class) one at a time as they arrive, constructed with a parent prefix.
+ 
+ Makes a GET request to `/parents/3/objects`, like <remoteAllViaObject:async:>, but streamed like <remoteAllStreaming:async:>.
+ 
+ @param parentObject Remote object by which to request the collection from - establishes pattern for resources depending on nesting. Raises an exception if this object's `remoteID` is nil, as it is used to construct the route.
+ @param objectBlock Block called with each object, in order. See <remoteAllStreaming:async:>.
+ @param completionBlock Block to be executed when the request is complete.
+ @return A handle that can be used to cancel the request.
+ */
++ (NSRRequestHandle *) remoteAllViaObject:(NSRRemoteObject *)parentObject streaming:(void (^)(id object))objectBlock async:(NSRBasicCompletionBlock)completionBlock;
+
+/**
+ Keeps a collection of objects up to date with changes the server pushes, rather than polling for them.
+ 
+ Opens `GET /objects/stream` (see <NSRRequest requestToSubscribeToObjectsOfClass:>) as a Server-Sent Events stream, and applies each create, update and destroy event it receives to *objects*, reconnecting and resuming from the last event if the connection drops. See <NSRSubscription> for the format of the events.
+ 
+ @param objects The objects you already have (from <remoteAll:>, say). Updates are applied to them in place; the subscription's `objects` has creations and destructions applied too.
+ @param handler Block called with every event, after it's been applied. Called on the main thread, unless the config's `performsCompletionBlocksOnMainThread` is off.
+ @return The started subscription. Call `stop` on it when you no longer need updates.
+ */
++ (NSRSubscription *) remoteSubscribeWithObjects:(NSArray *)objects handler:(void (^)(NSRSubscriptionEvent *event))handler;
 
 
 /**
@@ -202,8 +352,59 @@ typedef void(^NSRFetchObjectCompletionBlock)(id object, NSError *error);
   
  @param objectID The ID of the remote object.
  @param completionBlock Block to be executed when the request is complete.
+ @return A handle that can be used to cancel the request.
  */
-+ (void) remoteObjectWithID:(NSNumber *)objectID async:(NSRFetchObjectCompletionBlock)completionBlock;
++ (NSRRequestHandle *) remoteObjectWithID:(NSNumber *)objectID async:(NSRFetchObjectCompletionBlock)completionBlock;
+
+/**
+ Returns instances of receiver's class for each of the remote objects with the given IDs, in one request.
+ 
+ Makes a GET request to `/objects?ids[]=1&ids[]=2` (see `+[NSRRequest requestToFetchObjectsWithIDs:ofClass:]`). Use this instead of calling <remoteObjectWithID:error:> in a loop.
+ 
+ Request made synchronously. See `<remoteObjectsWithIDs:async:>` for asynchronous operation.
+ 
+ @param objectIDs The IDs of the remote objects.
+ @param error Out parameter used if an error occurs while processing the request. May be `NULL`.
+ @return Dictionary of instances of receiver's class, keyed by their remoteIDs. IDs the server didn't return an object for are left out.
+ */
++ (NSDictionary *) remoteObjectsWithIDs:(NSArray *)objectIDs error:(NSError **)error;
+
+/**
+ Retrieves instances of receiver's class for each of the remote objects with the given IDs, in one request.
+ 
+ Asynchronously makes a GET request to `/objects?ids[]=1&ids[]=2`.
+ 
+ @param objectIDs The IDs of the remote objects.
+ @param completionBlock Block to be executed when the request is complete. Passed a dictionary of the objects, keyed by their remoteIDs.
+ @return A handle that can be used to cancel the request.
+ */
++ (NSRRequestHandle *) remoteObjectsWithIDs:(NSArray *)objectIDs async:(NSRFetchByIDCompletionBlock)completionBlock;
+
+/**
+ Returns instances of receiver's class for each of the remote objects with the given IDs, asking the server to sideload the given associations in the same response.
+ 
+ Makes a GET request to `/objects?ids[]=1&ids[]=2&include=author`. See <remoteAllIncluding:error:> for how included records are decoded.
+ 
+ Request made synchronously. See `<remoteObjectsWithIDs:including:async:>` for asynchronous operation.
+ 
+ @param objectIDs The IDs of the remote objects.
+ @param associations Names of the properties to ask the server to include.
+ @param error Out parameter used if an error occurs while processing the request. May be `NULL`.
+ @return Dictionary of instances of receiver's class, keyed by their remoteIDs.
+ */
++ (NSDictionary *) remoteObjectsWithIDs:(NSArray *)objectIDs including:(NSArray *)associations error:(NSError **)error;
+
+/**
+ Retrieves instances of receiver's class for each of the remote objects with the given IDs, asking the server to sideload the given associations in the same response.
+ 
+ Asynchronously makes a GET request to `/objects?ids[]=1&ids[]=2&include=author`. See <remoteAllIncluding:error:> for how included records are decoded.
+ 
+ @param objectIDs The IDs of the remote objects.
+ @param associations Names of the properties to ask the server to include.
+ @param completionBlock Block to be executed when the request is complete. Passed a dictionary of the objects, keyed by their remoteIDs.
+ @return A handle that can be used to cancel the request.
+ */
++ (NSRRequestHandle *) remoteObjectsWithIDs:(NSArray *)objectIDs including:(NSArray *)associations async:(NSRFetchByIDCompletionBlock)completionBlock;
 
 
 
@@ -233,8 +434,9 @@ typedef void(^NSRFetchObjectCompletionBlock)(id object, NSError *error);
  Requires presence of `<remoteID>, or will throw an `NSRNullRemoteIDException`.
  
  @param completionBlock Block to be executed when the request is complete.
+ @return A handle that can be used to cancel the request.
  */
-- (void) remoteFetchAsync:(NSRBasicCompletionBlock)completionBlock;
+- (NSRRequestHandle *) remoteFetchAsync:(NSRBasicCompletionBlock)completionBlock;
 
 
 /**
@@ -262,11 +464,14 @@ typedef void(^NSRFetchObjectCompletionBlock)(id object, NSError *error);
  
  Requires presence of `<remoteID>, or will throw an `NSRNullRemoteIDException`.
  
+ If the relevant config's [`coalescesRemoteUpdates`](../NSRConfig.html#//api/name/coalescesRemoteUpdates) is on, this update may be merged with others to the same record, and *completionBlock* is called with the result of the last of them. Cancelling the returned handle then only stops *completionBlock* from getting that result (it's called with an `NSURLErrorCancelled` error instead) - the update itself still goes out, since it may be carrying other callers' changes too.
+ 
  @param completionBlock Block to be executed when the request is complete.
+ @return A handle that can be used to cancel the request.
  
  @warning No local properties will be set, as (by default) Rails does not return anything for this action. This means that if you update an object with the creation of new nested objects, those nested objects will not locally update with their respective IDs.
  */
-- (void) remoteUpdateAsync:(NSRBasicCompletionBlock)completionBlock;
+- (NSRRequestHandle *) remoteUpdateAsync:(NSRBasicCompletionBlock)completionBlock;
 
 
 /**
@@ -286,8 +491,9 @@ typedef void(^NSRFetchObjectCompletionBlock)(id object, NSError *error);
  Asynchronously sends a `POST` request to `/objects` (where `objects` is the pluralization of receiver's model name), with the receiver's remote dictionary representation as its body.
  
  @param completionBlock Block to be executed when the request is complete.
+ @return A handle that can be used to cancel the request.
  */
-- (void) remoteCreateAsync:(NSRBasicCompletionBlock)completionBlock;
+- (NSRRequestHandle *) remoteCreateAsync:(NSRBasicCompletionBlock)completionBlock;
 
 
 /**
@@ -307,8 +513,9 @@ typedef void(^NSRFetchObjectCompletionBlock)(id object, NSError *error);
  Asynchronously sends a `DELETE` request to `/objects/1` (where `objects` is the pluralization of receiver's model name, and `1` is the receiver's `remoteID`).
   
  @param completionBlock Block to be executed when the request is complete.
+ @return A handle that can be used to cancel the request.
  */
-- (void) remoteDestroyAsync:(NSRBasicCompletionBlock)completionBlock;
+- (NSRRequestHandle *) remoteDestroyAsync:(NSRBasicCompletionBlock)completionBlock;
 
 /**
  "Places" receiver's corresponding remote object.
@@ -338,10 +545,11 @@ typedef void(^NSRFetchObjectCompletionBlock)(id object, NSError *error);
  Requires presence of `<remoteID>, or will throw an `NSRNullRemoteIDException`.
  
  @param completionBlock Block to be executed when the request is complete.
+ @return A handle that can be used to cancel the request.
  
  @warning No local properties will be set, as (by default) Rails does not return anything for this action. This means that if you update an object with the creation of new nested objects, those nested objects will not locally update with their respective IDs.
  */
-- (void) remoteReplaceAsync:(NSRBasicCompletionBlock)completionBlock;
+- (NSRRequestHandle *) remoteReplaceAsync:(NSRBasicCompletionBlock)completionBlock;
 
 
 /// =============================================================================================
@@ -368,6 +576,8 @@ typedef void(^NSRFetchObjectCompletionBlock)(id object, NSError *error);
  Uses the coding methods.
  
  Will set `<remoteAttributes>` to *dictionary*.
+ 
+ If the receiver's config has <NSRConfig coalescesChangeNotifications> on, only properties whose values actually changed are set, and once they all have been, an `NSRRemoteObjectDidChangeNotification` is posted with their names.
 
  @param dictionary Dictionary to be evaluated. 
  */
@@ -393,6 +603,8 @@ typedef void(^NSRFetchObjectCompletionBlock)(id object, NSError *error);
  
  @param remoteDictionaries Array of remote dictionaries to be evaluated.
  
+ May also be a dictionary holding the array under a root key (`{"posts":[...]}`). If that dictionary has other keys besides the receiver's pluralized model name, they're treated as sideloaded records, and wired into the new objects as described in <remoteAllIncluding:error:>.
+ 
  Note that the dictionaries in this array need to be JSON-parasable, meaning all keys are strings and all objects are instances of NSString, NSNumber, NSArray, NSDictionary, or NSNull.
  @return An array of new or existing instances of the receiver's class, with their properties set using the dictionaries in *remoteDictionaries*.
  */
@@ -699,6 +911,25 @@ typedef void(^NSRFetchObjectCompletionBlock)(id object, NSError *error);
  */
 - (BOOL) shouldOnlySendIDKeyForNestedObjectProperty:(NSString *)property;
 
+/**
+ Should return files to upload along with the receiver, keyed by remote attribute name.
+ 
+ The default behavior is to return `nil`. (You don't have to make a call to super here.)
+ 
+ When this returns any files, `remoteCreate`, `remoteUpdate` and `remoteReplace` send the receiver as `multipart/form-data` instead of JSON - the usual attributes become form fields (`post[title]`) and each file becomes a part of its own (`post[photo]`), which is what Rails (Paperclip, CarrierWave, Active Storage) expects for uploads. Files are streamed from disk as the request is sent, so they don't need to fit in memory.
+ 
+     - (NSDictionary *) remoteFileAttachments
+     {
+         if (self.photoPath) {
+             return @{@"photo":[NSURL fileURLWithPath:self.photoPath]};
+         }
+         return nil;
+     }
+ 
+ @return A dictionary of file NSURLs keyed by remote attribute name, or `nil` if there's nothing to upload.
+ */
+- (NSDictionary *) remoteFileAttachments;
+
 /**
  Should return the equivalent Objective-C property for a given remote key.
  
@@ -742,6 +973,8 @@ typedef void(^NSRFetchObjectCompletionBlock)(id object, NSError *error);
  
  The default behavior is to return <NSRConfig's> `contextuallyRelevantConfig`.
  
+ While an object is being encoded or decoded (including every object in a response decoded by <objectsWithRemoteDictionaries:>), this is called at most once per class, and the config it returns is used for all of it.
+ 
  @return A configuration for this class and its members.
  */
 + (NSRConfig *) config;
@@ -30,17 +30,73 @@
 
 #import "NSRails.h"
 #import "NSRRemoteObject.h"
+#import "NSRMemoryProfiling.h"
+#import "NSRTracing.h"
+#import "NSRUpdateCoalescer.h"
 
 #import <objc/runtime.h>
+#import <pthread.h>
+
+NSString * const NSRRemoteObjectDidChangeNotification   = @"NSRRemoteObjectDidChangeNotification";
+NSString * const NSRRemoteObjectsDidChangeNotification  = @"NSRRemoteObjectsDidChangeNotification";
+
+NSString * const NSRChangedPropertiesKey    = @"NSRChangedPropertiesKey";
+NSString * const NSRChangedObjectsKey       = @"NSRChangedObjectsKey";
+NSString * const NSRInsertedObjectsKey      = @"NSRInsertedObjectsKey";
 
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+@interface NSRConfig (private)
+
+- (NSString *) remoteModelNameForClass:(Class)class;
+- (NSString *) remoteControllerNameForClass:(Class)class;
+
+@end
+
+@interface NSRRequest (private)
+
+- (id) sendSynchronous:(NSError **)errorOut decodingWith:(id (^)(id jsonRep))decoder;
+- (NSRRequestHandle *) sendAsynchronous:(NSRHTTPCompletionBlock)block decodingWith:(id (^)(id jsonRep))decoder;
+
+@end
+
 @interface NSRRemoteObject (private)
 
 - (NSDictionary *) remoteDictionaryRepresentationWrapped:(BOOL)wrapped fromNesting:(BOOL)nesting;
 
 - (BOOL) propertyIsTimestamp:(NSString *)property;
+- (BOOL) valueIsArray:(id)value;
+- (Class) containerClassForRelationProperty:(NSString *)property;
+
++ (NSString *) stringByUnderscoringString:(NSString *)string ignoringPrefix:(BOOL)stripPrefix;
++ (NSString *) remoteIncludeParameterForAssociations:(NSArray *)associations;
++ (NSDictionary *) objectsByRemoteIDFromObjects:(NSArray *)objects;
+
++ (NSRRequest *) requestToSyncCollection:(NSArray *)collection viaObject:(NSRRemoteObject *)obj markKey:(NSString **)markKey;
++ (NSArray *) mergeRemoteSync:(id)jsonRep intoCollection:(NSArray *)collection markKey:(NSString *)markKey;
++ (NSDictionary *) remoteSyncMarkForKey:(NSString *)markKey;
+
++ (NSRConfig *) resolvedConfig;
+
+- (BOOL) isNewToRemoteChanges;
+- (void) announceRemoteChanges:(NSSet *)changes wasNew:(BOOL)wasNew;
+
+@end
+
+//objects changed while decoding one batch, announced together once it's done
+@interface NSRChangeBatch : NSObject
+
+@property (nonatomic, strong) NSMutableArray *changed;
+@property (nonatomic, strong) NSMutableArray *inserted;
+
+@end
+
+//records sent alongside the main ones in a response ({"posts":[...], "authors":[...]}), decoded the first time something refers to them
+@interface NSRSideloadedRecords : NSObject
+
+- (id) initWithResponse:(NSDictionary *)response primaryKey:(NSString *)primaryKey;
+- (void) wireAssociationsOfObject:(NSRRemoteObject *)object fromRemoteDictionary:(NSDictionary *)dict;
 
 @end
 
@@ -48,6 +104,11 @@
 
 
 @implementation NSRRemoteObject
+{
+    //set while a remote dictionary is being applied with coalesced change notifications on - decodeRemoteValue: adds to it
+    NSMutableSet *pendingChanges;
+    BOOL appliedRemoteDictionary;
+}
 
 //Need these to be explicit when subclassing from NSManagedObject
 @synthesize remoteID=_remoteID;
@@ -68,6 +129,127 @@
     return [NSRConfig contextuallyRelevantConfig];
 }
 
+#pragma mark - Config resolution
+
+//while an encode or decode is running on this thread, +config is asked once per class and the answer reused for every
+//property and nested object - so an overridden +config isn't called in a loop, and a use/end partway through can't leave
+//half an object encoded with one config and half with another
+
+static pthread_key_t NSRResolvedConfigsKey(void)
+{
+    static pthread_key_t key;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        pthread_key_create(&key, NULL);
+    });
+    return key;
+}
+
+//returns NO if one's already going on this thread - the outermost encode/decode owns it
+static BOOL NSRBeginConfigResolution(void)
+{
+    pthread_key_t key = NSRResolvedConfigsKey();
+    if (pthread_getspecific(key)) {
+        return NO;
+    }
+    
+    pthread_setspecific(key, CFBridgingRetain([[NSMutableDictionary alloc] init]));
+    return YES;
+}
+
+static void NSREndConfigResolution(BOOL began)
+{
+    if (began)
+    {
+        pthread_key_t key = NSRResolvedConfigsKey();
+        CFBridgingRelease(pthread_getspecific(key));
+        pthread_setspecific(key, NULL);
+    }
+}
+
++ (NSRConfig *) resolvedConfig
+{
+    NSMutableDictionary *resolved = (__bridge NSMutableDictionary *)pthread_getspecific(NSRResolvedConfigsKey());
+    if (!resolved) {
+        return [self config];
+    }
+    
+    NSRConfig *config = resolved[(id<NSCopying>)self];
+    if (!config)
+    {
+        config = [self config];
+        resolved[(id<NSCopying>)self] = config;
+    }
+    return config;
+}
+
+#pragma mark - Change notifications
+
+static pthread_key_t NSRChangeBatchKey(void)
+{
+    static pthread_key_t key;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        pthread_key_create(&key, NULL);
+    });
+    return key;
+}
+
+//returns NO if coalescing's off or a batch is already going on this thread - the outermost one announces everything
+static BOOL NSRBeginChangeBatch(Class class)
+{
+    pthread_key_t key = NSRChangeBatchKey();
+    if (pthread_getspecific(key) || ![[class resolvedConfig] coalescesChangeNotifications]) {
+        return NO;
+    }
+    
+    NSRChangeBatch *batch = [[NSRChangeBatch alloc] init];
+    batch.changed = [NSMutableArray array];
+    batch.inserted = [NSMutableArray array];
+    pthread_setspecific(key, CFBridgingRetain(batch));
+    return YES;
+}
+
+static void NSREndChangeBatch(BOOL began, Class class)
+{
+    if (!began) {
+        return;
+    }
+    
+    pthread_key_t key = NSRChangeBatchKey();
+    NSRChangeBatch *batch = CFBridgingRelease(pthread_getspecific(key));
+    pthread_setspecific(key, NULL);
+    
+    if (batch.changed.count > 0 || batch.inserted.count > 0)
+    {
+        [[NSNotificationCenter defaultCenter] postNotificationName:NSRRemoteObjectsDidChangeNotification
+                                                            object:class
+                                                          userInfo:@{NSRChangedObjectsKey: batch.changed, NSRInsertedObjectsKey: batch.inserted}];
+    }
+}
+
+//nobody can be observing an object that's never had a remote dictionary applied (one objectWithRemoteDictionary: just made, say)
+- (BOOL) isNewToRemoteChanges
+{
+    return !appliedRemoteDictionary;
+}
+
+- (void) announceRemoteChanges:(NSSet *)changes wasNew:(BOOL)wasNew
+{
+    NSRChangeBatch *batch = (__bridge NSRChangeBatch *)pthread_getspecific(NSRChangeBatchKey());
+    
+    if (wasNew)
+    {
+        [batch.inserted addObject:self];
+        return;
+    }
+    
+    [batch.changed addObject:self];
+    [[NSNotificationCenter defaultCenter] postNotificationName:NSRRemoteObjectDidChangeNotification
+                                                        object:self
+                                                      userInfo:@{NSRChangedPropertiesKey: changes}];
+}
+
 + (NSString *) remoteModelName
 {
     if (self == [NSRRemoteObject class]) {
@@ -76,9 +258,9 @@
         
     NSString *class = NSStringFromClass(self);
     
-    if ([self config].autoinflectsClassNames)
+    if ([self resolvedConfig].autoinflectsClassNames)
     {
-        return [self stringByUnderscoringString:class ignoringPrefix:[self config].ignoresClassPrefixes];
+        return [self stringByUnderscoringString:class ignoringPrefix:[self resolvedConfig].ignoresClassPrefixes];
     }
     else
     {
@@ -186,6 +368,11 @@
     return NO;
 }
 
+- (NSDictionary *) remoteFileAttachments
+{
+    return nil;
+}
+
 - (Class) nestedClassForProperty:(NSString *)property
 { 
     Class class = [self.class typeClassForProperty:property];
@@ -245,7 +432,7 @@
 
     if ([val isKindOfClass:[NSDate class]])
     {
-        return [[self.class config] stringFromDate:val];
+        return [[self.class resolvedConfig] stringFromDate:val];
     }
 
     return val;
@@ -258,7 +445,7 @@
     }
 
     NSString *property = remoteKey;
-    if ([self.class config].autoinflectsPropertyNames) {
+    if ([self.class resolvedConfig].autoinflectsPropertyNames) {
         property = [self.class stringByCamelizingString:property];
     }
     
@@ -317,7 +504,7 @@
                     //maybe the object is wrapped in a dict like {"post"=>{"something":"something"}}, so check to make sure
                     if (!railsID)
                     {
-                        NSDictionary *innerDict = railsElement[[nestedClass remoteModelName]];
+                        NSDictionary *innerDict = railsElement[[[nestedClass resolvedConfig] remoteModelNameForClass:nestedClass]];
                         if ([railsElement count] == 1 && [innerDict isKindOfClass:[NSDictionary class]]) {
                             railsID = innerDict[@"id"];
                         }
@@ -363,7 +550,7 @@
         }
         else if ([self propertyIsDate:property])
         {
-            decodedObj = [[self.class config] dateFromString:railsObject];
+            decodedObj = [[self.class resolvedConfig] dateFromString:railsObject];
         }
         //otherwise, if not nested or anything, just use what we got (number, string, dictionary, array)
         else
@@ -372,6 +559,15 @@
         }
     }
     
+    //when changes are being coalesced, only values that actually changed go through the setter (and so KVO)
+    if (pendingChanges)
+    {
+        if (decodedObj == previousVal || [decodedObj isEqual:previousVal]) {
+            return;
+        }
+        [pendingChanges addObject:property];
+    }
+    
     [self setValue:decodedObj forKey:property];
 }
 
@@ -417,21 +613,49 @@
         _remoteAttributes = dict;
     }
     
-    //support JSON that comes in like {"post"=>{"something":"something"}}
-    NSDictionary *innerDict = dict[[self.class remoteModelName]];
-    if (dict.count == 1 && [innerDict isKindOfClass:[NSDictionary class]])
+    BOOL measuring = NSRMemoryAttributesBegin(dict);
+    BOOL resolving = NSRBeginConfigResolution();
+    
+    NSMutableSet *previousChanges = pendingChanges;
+    NSMutableSet *changes = nil;
+    BOOL wasNew = [self isNewToRemoteChanges];
+    
+    @try
     {
-        dict = innerDict;
-    }
+        if ([[self.class resolvedConfig] coalescesChangeNotifications]) {
+            changes = pendingChanges = [NSMutableSet set];
+        }
+        
+        //support JSON that comes in like {"post"=>{"something":"something"}}
+        NSDictionary *innerDict = dict[[[self.class resolvedConfig] remoteModelNameForClass:self.class]];
+        if (dict.count == 1 && [innerDict isKindOfClass:[NSDictionary class]])
+        {
+            dict = innerDict;
+        }
         
-    for (NSString *remoteKey in dict)
+        for (NSString *remoteKey in dict)
+        {
+            id remoteObject = dict[remoteKey];
+            if (remoteObject == [NSNull null]) {
+                remoteObject = nil;
+            }
+            
+            [self decodeRemoteValue:remoteObject forRemoteKey:remoteKey];
+        }
+    }
+    @finally
     {
-        id remoteObject = dict[remoteKey];
-        if (remoteObject == [NSNull null]) {
-            remoteObject = nil;
+        pendingChanges = previousChanges;
+        appliedRemoteDictionary = YES;
+        
+        NSREndConfigResolution(resolving);
+        if (measuring) {
+            NSRMemoryAttributesEnd();
         }
-
-        [self decodeRemoteValue:remoteObject forRemoteKey:remoteKey];
+    }
+    
+    if (changes.count > 0) {
+        [self announceRemoteChanges:changes wasNew:wasNew];
     }
 }
 
@@ -442,52 +666,62 @@
 
 - (NSDictionary *) remoteDictionaryRepresentationWrapped:(BOOL)wrapped fromNesting:(BOOL)nesting
 {
-    NSMutableDictionary *dict = [NSMutableDictionary dictionary];
-    
-    for (NSString *objcProperty in [self remoteProperties])
+    BOOL resolving = NSRBeginConfigResolution();
+    @try
     {
-        if (![self shouldSendProperty:objcProperty whenNested:nesting]) {
-            continue;
-        }
+        NSRConfig *config = [self.class resolvedConfig];
+        BOOL inflect = config.autoinflectsPropertyNames;
         
-        NSString *remoteKey = objcProperty;
-        if ([self.class config].autoinflectsPropertyNames) {
-            remoteKey = [self.class stringByUnderscoringString:remoteKey ignoringPrefix:NO];
-        }
+        NSMutableDictionary *dict = [NSMutableDictionary dictionary];
         
-        id remoteRep = [self encodeValueForProperty:objcProperty remoteKey:&remoteKey];
-        if (!remoteRep) {
-            remoteRep = [NSNull null];
+        for (NSString *objcProperty in [self remoteProperties])
+        {
+            if (![self shouldSendProperty:objcProperty whenNested:nesting]) {
+                continue;
+            }
+            
+            NSString *remoteKey = objcProperty;
+            if (inflect) {
+                remoteKey = [self.class stringByUnderscoringString:remoteKey ignoringPrefix:NO];
+            }
+            
+            id remoteRep = [self encodeValueForProperty:objcProperty remoteKey:&remoteKey];
+            if (!remoteRep) {
+                remoteRep = [NSNull null];
+            }
+            
+            BOOL JSONParsable = ([remoteRep isKindOfClass:[NSArray class]] ||
+                                 [remoteRep isKindOfClass:[NSDictionary class]] ||
+                                 [remoteRep isKindOfClass:[NSString class]] ||
+                                 [remoteRep isKindOfClass:[NSNumber class]] ||
+                                 [remoteRep isKindOfClass:[NSNull class]]);
+            
+            if (!JSONParsable)
+            {
+                [NSException raise:NSInvalidArgumentException format:@"Trying to encode property '%@' in class '%@', but the result (%@) was not JSON-encodable. Override -[NSRRemoteObject encodeValueForProperty:remoteKey:] if you want to encode a property that's not NSDictionary, NSArray, NSString, NSNumber, or NSNull. Remember to call super if it doesn't need custom encoding.",objcProperty, self.class, remoteRep];
+            }
+            
+            
+            dict[remoteKey] = remoteRep;
         }
         
-        BOOL JSONParsable = ([remoteRep isKindOfClass:[NSArray class]] ||
-                             [remoteRep isKindOfClass:[NSDictionary class]] ||
-                             [remoteRep isKindOfClass:[NSString class]] ||
-                             [remoteRep isKindOfClass:[NSNumber class]] ||
-                             [remoteRep isKindOfClass:[NSNull class]]);
-        
-        if (!JSONParsable)
+        if (self.remoteDestroyOnNesting)
         {
-            [NSException raise:NSInvalidArgumentException format:@"Trying to encode property '%@' in class '%@', but the result (%@) was not JSON-encodable. Override -[NSRRemoteObject encodeValueForProperty:remoteKey:] if you want to encode a property that's not NSDictionary, NSArray, NSString, NSNumber, or NSNull. Remember to call super if it doesn't need custom encoding.",objcProperty, self.class, remoteRep];
+            dict[@"_destroy"] = @YES;
         }
         
+        if (wrapped) {
+            return @{[config remoteModelNameForClass:self.class]: dict};
+        }
         
-        dict[remoteKey] = remoteRep;
+        return dict;
     }
-    
-    if (self.remoteDestroyOnNesting)
+    @finally
     {
-        dict[@"_destroy"] = @YES;
+        NSREndConfigResolution(resolving);
     }
-    
-    if (wrapped) {
-        return @{[self.class remoteModelName]: dict};
-    }
-    
-    return dict;
 }
 
-
 + (instancetype) objectWithRemoteDictionary:(NSDictionary *)dict
 {
     NSRRemoteObject *obj = [[self alloc] init];
@@ -497,23 +731,33 @@
 
 #pragma mark - Create
 
+//decoding goes through the request (rather than happening after it returns) so it's counted in the request's metrics
+
 - (BOOL) remoteCreate:(NSError **)error
 {
-    NSDictionary *jsonResponse = [[NSRRequest requestToCreateObject:self] sendSynchronous:error];
+    NSDictionary *jsonResponse = [[NSRRequest requestToCreateObject:self] sendSynchronous:error decodingWith:
+                                  ^id (id jsonRep)
+                                  {
+                                      [self setPropertiesUsingRemoteDictionary:jsonRep];
+                                      return jsonRep;
+                                  }];
     
-    [self setPropertiesUsingRemoteDictionary:jsonResponse];
     return !!jsonResponse;
 }
 
-- (void) remoteCreateAsync:(NSRBasicCompletionBlock)completionBlock
+- (NSRRequestHandle *) remoteCreateAsync:(NSRBasicCompletionBlock)completionBlock
 {
-    [[NSRRequest requestToCreateObject:self] sendAsynchronous:
+    return [[NSRRequest requestToCreateObject:self] sendAsynchronous:
      ^(id result, NSError *error) 
      {
-         [self setPropertiesUsingRemoteDictionary:result];
          if (completionBlock) {
              completionBlock(error);
          }
+     }
+     decodingWith:^id (id jsonRep)
+     {
+         [self setPropertiesUsingRemoteDictionary:jsonRep];
+         return jsonRep;
      }];
 }
 
@@ -524,9 +768,19 @@
     return !![[NSRRequest requestToUpdateObject:self] sendSynchronous:error];
 }
 
-- (void) remoteUpdateAsync:(NSRBasicCompletionBlock)completionBlock
+- (NSRRequestHandle *) remoteUpdateAsync:(NSRBasicCompletionBlock)completionBlock
 {
-    [[NSRRequest requestToUpdateObject:self] sendAsynchronous:
+    NSRConfig *config = [self.class resolvedConfig];
+    if (config.coalescesRemoteUpdates)
+    {
+        //body is captured now, so the request carries the state as of this call even if it's sent later
+        return [NSRUpdateCoalescer sendRequest:[NSRRequest requestToUpdateObject:self]
+                                        forKey:[NSRUpdateCoalescer keyForObject:self]
+                                        window:config.remoteUpdateCoalescingWindow
+                                    completion:completionBlock];
+    }
+    
+    return [[NSRRequest requestToUpdateObject:self] sendAsynchronous:
      ^(id result, NSError *error) 
      {
          if (completionBlock) {
@@ -542,9 +796,9 @@
     return !![[NSRRequest requestToReplaceObject:self] sendSynchronous:error];
 }
 
-- (void) remoteReplaceAsync:(NSRBasicCompletionBlock)completionBlock
+- (NSRRequestHandle *) remoteReplaceAsync:(NSRBasicCompletionBlock)completionBlock
 {
-    [[NSRRequest requestToReplaceObject:self] sendAsynchronous:
+    return [[NSRRequest requestToReplaceObject:self] sendAsynchronous:
      ^(id result, NSError *error) 
      {
          if (completionBlock) {
@@ -560,9 +814,9 @@
     return !![[NSRRequest requestToDestroyObject:self] sendSynchronous:error];
 }
 
-- (void) remoteDestroyAsync:(NSRBasicCompletionBlock)completionBlock
+- (NSRRequestHandle *) remoteDestroyAsync:(NSRBasicCompletionBlock)completionBlock
 {
-    [[NSRRequest requestToDestroyObject:self] sendAsynchronous:
+    return [[NSRRequest requestToDestroyObject:self] sendAsynchronous:
      ^(id result, NSError *error) 
      {
          if (completionBlock) {
@@ -575,26 +829,29 @@
 
 - (BOOL) remoteFetch:(NSError **)error
 {
-    NSDictionary *jsonResponse = [[NSRRequest requestToFetchObject:self] sendSynchronous:error];
-    
-    if (jsonResponse) {
-        [self setPropertiesUsingRemoteDictionary:jsonResponse];
-    }
+    NSDictionary *jsonResponse = [[NSRRequest requestToFetchObject:self] sendSynchronous:error decodingWith:
+                                  ^id (id jsonRep)
+                                  {
+                                      [self setPropertiesUsingRemoteDictionary:jsonRep];
+                                      return jsonRep;
+                                  }];
     
     return !!jsonResponse;
 }
 
-- (void) remoteFetchAsync:(NSRBasicCompletionBlock)completionBlock
+- (NSRRequestHandle *) remoteFetchAsync:(NSRBasicCompletionBlock)completionBlock
 {
-    [[NSRRequest requestToFetchObject:self] sendAsynchronous:
+    return [[NSRRequest requestToFetchObject:self] sendAsynchronous:
      ^(id jsonRep, NSError *error) 
      {
-         if (jsonRep) {
-             [self setPropertiesUsingRemoteDictionary:jsonRep];
-         }
          if (completionBlock) {
              completionBlock(error);
          }
+     }
+     decodingWith:^id (id jsonRep)
+     {
+         [self setPropertiesUsingRemoteDictionary:jsonRep];
+         return jsonRep;
      }];
 }
 
@@ -602,27 +859,98 @@
 
 + (instancetype) remoteObjectWithID:(NSNumber *)mID error:(NSError **)error
 {
-    NSDictionary *objData = [[NSRRequest requestToFetchObjectWithID:mID ofClass:self] sendSynchronous:error];
-    
-    return (objData ? [self objectWithRemoteDictionary:objData] : nil);
+    return [[NSRRequest requestToFetchObjectWithID:mID ofClass:self] sendSynchronous:error decodingWith:
+            ^id (id jsonRep)
+            {
+                return [self objectWithRemoteDictionary:jsonRep];
+            }];
 }
 
-+ (void) remoteObjectWithID:(NSNumber *)mID async:(NSRFetchObjectCompletionBlock)completionBlock
++ (NSRRequestHandle *) remoteObjectWithID:(NSNumber *)mID async:(NSRFetchObjectCompletionBlock)completionBlock
 {
-    [[NSRRequest requestToFetchObjectWithID:mID ofClass:self] sendAsynchronous:
-     ^(id jsonRep, NSError *error) 
+    return [[NSRRequest requestToFetchObjectWithID:mID ofClass:self] sendAsynchronous:
+     ^(id obj, NSError *error) 
      {
-         id obj = (jsonRep ? [self objectWithRemoteDictionary:jsonRep] : nil);
          if (completionBlock) {
              completionBlock(obj, error);
          }
+     }
+     decodingWith:^id (id jsonRep)
+     {
+         return [self objectWithRemoteDictionary:jsonRep];
      }];
 }
 
+#pragma mark Get several objects by ID (class-level)
+
++ (NSDictionary *) objectsByRemoteIDFromObjects:(NSArray *)objects
+{
+    NSMutableDictionary *byID = [NSMutableDictionary dictionaryWithCapacity:objects.count];
+    for (NSRRemoteObject *obj in objects)
+    {
+        if (obj.remoteID) {
+            byID[obj.remoteID] = obj;
+        }
+    }
+    return byID;
+}
+
++ (NSDictionary *) remoteObjectsWithIDs:(NSArray *)mIDs error:(NSError **)error
+{
+    return [self remoteObjectsWithIDs:mIDs including:nil error:error];
+}
+
++ (NSRRequestHandle *) remoteObjectsWithIDs:(NSArray *)mIDs async:(NSRFetchByIDCompletionBlock)completionBlock
+{
+    return [self remoteObjectsWithIDs:mIDs including:nil async:completionBlock];
+}
+
++ (NSDictionary *) remoteObjectsWithIDs:(NSArray *)mIDs including:(NSArray *)associations error:(NSError **)error
+{
+    NSRRequest *request = [NSRRequest requestToFetchObjectsWithIDs:mIDs ofClass:self];
+    if (associations.count > 0)
+    {
+        NSMutableDictionary *params = [request.queryParameters mutableCopy];
+        params[@"include"] = [self remoteIncludeParameterForAssociations:associations];
+        request.queryParameters = params;
+    }
+    
+    return [request sendSynchronous:error decodingWith:
+            ^id (id jsonRep)
+            {
+                return [self objectsByRemoteIDFromObjects:[self objectsWithRemoteDictionaries:jsonRep]];
+            }];
+}
+
++ (NSRRequestHandle *) remoteObjectsWithIDs:(NSArray *)mIDs including:(NSArray *)associations async:(NSRFetchByIDCompletionBlock)completionBlock
+{
+    NSRRequest *request = [NSRRequest requestToFetchObjectsWithIDs:mIDs ofClass:self];
+    if (associations.count > 0)
+    {
+        NSMutableDictionary *params = [request.queryParameters mutableCopy];
+        params[@"include"] = [self remoteIncludeParameterForAssociations:associations];
+        request.queryParameters = params;
+    }
+    
+    return [request sendAsynchronous:
+            ^(id objects, NSError *error)
+            {
+                if (completionBlock) {
+                    completionBlock(objects, error);
+                }
+            }
+            decodingWith:^id (id jsonRep)
+            {
+                return [self objectsByRemoteIDFromObjects:[self objectsWithRemoteDictionaries:jsonRep]];
+            }];
+}
+
 #pragma mark Get all objects (class-level)
 
 + (NSArray *) objectsWithRemoteDictionaries:(NSArray *)remoteDictionaries
 {
+    NSRSideloadedRecords *sideloads = nil;
+    
     if ([remoteDictionaries isKindOfClass:[NSDictionary class]])
     {
         //probably has root in front of it - "posts":[{},{}]
@@ -630,23 +958,51 @@
         {
             remoteDictionaries = [(NSDictionary *)remoteDictionaries allValues][0];
         }
+        //or a root plus sideloaded associations - "posts":[{},{}], "authors":[{}]
+        else
+        {
+            NSString *root = [[self resolvedConfig] remoteControllerNameForClass:self];
+            id primary = [(NSDictionary *)remoteDictionaries objectForKey:root];
+            if ([primary isKindOfClass:[NSArray class]])
+            {
+                sideloads = [[NSRSideloadedRecords alloc] initWithResponse:(NSDictionary *)remoteDictionaries primaryKey:root];
+                remoteDictionaries = primary;
+            }
+        }
     }
     
     if (![remoteDictionaries isKindOfClass:[NSArray class]]) {
         return nil;
     }
 
+    uint64_t trace = NSRTraceBegin();
+    NSRMemoryMark memory;
+    BOOL profiling = NSRMemoryPhaseBegin(&memory);
     NSMutableArray *array = [NSMutableArray array];
     
-    for (NSDictionary *dict in remoteDictionaries)
+    //one resolution for the whole batch, rather than one per object
+    BOOL resolving = NSRBeginConfigResolution();
+    BOOL batching = NSRBeginChangeBatch(self);
+    @try
     {
-        if ([dict isKindOfClass:[NSDictionary class]])
+        for (NSDictionary *dict in remoteDictionaries)
         {
-            NSRRemoteObject *obj = [self objectWithRemoteDictionary:dict];
-            [array addObject:obj];
+            if ([dict isKindOfClass:[NSDictionary class]])
+            {
+                NSRRemoteObject *obj = [self objectWithRemoteDictionary:dict];
+                [sideloads wireAssociationsOfObject:obj fromRemoteDictionary:dict];
+                [array addObject:obj];
+            }
         }
     }
+    @finally
+    {
+        NSREndConfigResolution(resolving);
+        NSREndChangeBatch(batching, self);
+    }
     
+    NSRMemoryPhaseEnd("objectsWithRemoteDictionaries", profiling, memory);
+    NSRTraceEnd("objectsWithRemoteDictionaries", "nsrails", trace, @(array.count));
     return array;
 }
 
@@ -657,26 +1013,344 @@
 
 + (NSArray *) remoteAllViaObject:(NSRRemoteObject *)obj error:(NSError **)error
 {
-    id json = [[NSRRequest requestToFetchAllObjectsOfClass:self viaObject:obj] sendSynchronous:error];
-    return [self objectsWithRemoteDictionaries:json];
+    return [[NSRRequest requestToFetchAllObjectsOfClass:self viaObject:obj] sendSynchronous:error decodingWith:
+            ^id (id jsonRep)
+            {
+                return [self objectsWithRemoteDictionaries:jsonRep];
+            }];
 }
 
-+ (void) remoteAllAsync:(NSRFetchAllCompletionBlock)completionBlock
++ (NSRRequestHandle *) remoteAllAsync:(NSRFetchAllCompletionBlock)completionBlock
 {
-    [self remoteAllViaObject:nil async:completionBlock];
+    return [self remoteAllViaObject:nil async:completionBlock];
 }
 
-+ (void) remoteAllViaObject:(NSRRemoteObject *)obj async:(NSRFetchAllCompletionBlock)completionBlock
++ (NSRRequestHandle *) remoteAllViaObject:(NSRRemoteObject *)obj async:(NSRFetchAllCompletionBlock)completionBlock
 {
-    [[NSRRequest requestToFetchAllObjectsOfClass:self viaObject:obj] sendAsynchronous:
-     ^(id result, NSError *error) 
+    return [[NSRRequest requestToFetchAllObjectsOfClass:self viaObject:obj] sendAsynchronous:
+     ^(id objects, NSError *error) 
      {
          if (completionBlock) {
-             completionBlock([self objectsWithRemoteDictionaries:result],error);
+             completionBlock(objects, error);
          }
+     }
+     decodingWith:^id (id jsonRep)
+     {
+         return [self objectsWithRemoteDictionaries:jsonRep];
      }];
 }
 
++ (NSString *) remoteIncludeParameterForAssociations:(NSArray *)associations
+{
+    BOOL inflect = [self resolvedConfig].autoinflectsPropertyNames;
+    
+    NSMutableArray *remoteNames = [NSMutableArray arrayWithCapacity:associations.count];
+    for (NSString *association in associations) {
+        [remoteNames addObject:(inflect ? [self stringByUnderscoringString:association ignoringPrefix:NO] : association)];
+    }
+    
+    return [remoteNames componentsJoinedByString:@","];
+}
+
++ (NSArray *) remoteAllIncluding:(NSArray *)associations error:(NSError **)error
+{
+    NSRRequest *request = [NSRRequest requestToFetchAllObjectsOfClass:self];
+    request.queryParameters = @{@"include":[self remoteIncludeParameterForAssociations:associations]};
+    
+    return [request sendSynchronous:error decodingWith:
+            ^id (id jsonRep)
+            {
+                return [self objectsWithRemoteDictionaries:jsonRep];
+            }];
+}
+
++ (NSRRequestHandle *) remoteAllIncluding:(NSArray *)associations async:(NSRFetchAllCompletionBlock)completionBlock
+{
+    NSRRequest *request = [NSRRequest requestToFetchAllObjectsOfClass:self];
+    request.queryParameters = @{@"include":[self remoteIncludeParameterForAssociations:associations]};
+    
+    return [request sendAsynchronous:
+            ^(id objects, NSError *error)
+            {
+                if (completionBlock) {
+                    completionBlock(objects, error);
+                }
+            }
+            decodingWith:^id (id jsonRep)
+            {
+                return [self objectsWithRemoteDictionaries:jsonRep];
+            }];
+}
+
+#pragma mark Delta sync (class-level)
+
+static NSString * const NSRSyncMarksDefaultsKey = @"NSRailsSyncMarks";
+
+//marks live in the user defaults as {class name: {"root URL route": {"date":date, "updated_at":string}}}
+//the string is the updated_at exactly as the server sent it, so it goes back at the server's precision, not the dateFormat's
++ (NSDictionary *) remoteSyncMarkForKey:(NSString *)markKey
+{
+    @synchronized([NSRRemoteObject class])
+    {
+        id mark = [[NSUserDefaults standardUserDefaults] dictionaryForKey:NSRSyncMarksDefaultsKey][NSStringFromClass(self)][markKey];
+        return ([mark isKindOfClass:[NSDictionary class]] ? mark : nil);
+    }
+}
+
++ (void) setRemoteSyncMark:(NSDictionary *)mark forKey:(NSString *)markKey
+{
+    @synchronized([NSRRemoteObject class])
+    {
+        NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+        NSMutableDictionary *allMarks = [[defaults dictionaryForKey:NSRSyncMarksDefaultsKey] mutableCopy] ?: [NSMutableDictionary dictionary];
+        NSMutableDictionary *classMarks = [allMarks[NSStringFromClass(self)] mutableCopy] ?: [NSMutableDictionary dictionary];
+        
+        classMarks[markKey] = mark;
+        allMarks[NSStringFromClass(self)] = classMarks;
+        [defaults setObject:allMarks forKey:NSRSyncMarksDefaultsKey];
+    }
+}
+
++ (NSDate *) remoteSyncMark
+{
+    NSString *markKey;
+    [self requestToSyncCollection:nil viaObject:nil markKey:&markKey];
+    return [self remoteSyncMarkForKey:markKey][@"date"];
+}
+
++ (void) resetRemoteSyncMarks
+{
+    @synchronized([NSRRemoteObject class])
+    {
+        NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+        NSMutableDictionary *allMarks = [[defaults dictionaryForKey:NSRSyncMarksDefaultsKey] mutableCopy];
+        [allMarks removeObjectForKey:NSStringFromClass(self)];
+        [defaults setObject:allMarks forKey:NSRSyncMarksDefaultsKey];
+    }
+}
+
++ (NSRRequest *) requestToSyncCollection:(NSArray *)collection viaObject:(NSRRemoteObject *)obj markKey:(NSString **)markKey
+{
+    NSRRequest *request = [NSRRequest requestToFetchAllObjectsOfClass:self viaObject:obj];
+    
+    //the full route (not the template) so that each parent's collection has its own mark, and the root URL so servers don't share them
+    *markKey = [NSString stringWithFormat:@"%@ %@", [self resolvedConfig].rootURL.absoluteString, request.route];
+    
+    //the mark outlives the collection (it's in the defaults, the collection is usually just in memory) - with nothing to
+    //bring up to date, only the changes since the mark would be all the caller ends up with
+    NSString *mark = [self remoteSyncMarkForKey:*markKey][@"updated_at"];
+    if (mark && collection.count > 0) {
+        request.queryParameters = @{[self resolvedConfig].syncQueryParameter:mark};
+    }
+    
+    return request;
+}
+
++ (NSArray *) mergeRemoteSync:(id)jsonRep intoCollection:(NSArray *)collection markKey:(NSString *)markKey
+{
+    NSArray *records = jsonRep;
+    NSArray *deletedIDs = nil;
+    
+    if ([jsonRep isKindOfClass:[NSDictionary class]])
+    {
+        deletedIDs = jsonRep[@"deleted_ids"];
+        records = jsonRep[[[self resolvedConfig] remoteControllerNameForClass:self]];
+        
+        //just a root key - "posts":[{},{}]
+        if (!records && [jsonRep count] == 1) {
+            records = [jsonRep allValues][0];
+        }
+    }
+    
+    if (![records isKindOfClass:[NSArray class]]) {
+        records = nil;
+    }
+    if (![deletedIDs isKindOfClass:[NSArray class]]) {
+        deletedIDs = nil;
+    }
+    
+    NSMutableArray *merged = [NSMutableArray arrayWithArray:collection];
+    NSMutableDictionary *existing = [NSMutableDictionary dictionaryWithCapacity:merged.count];
+    for (NSRRemoteObject *obj in merged)
+    {
+        if (obj.remoteID) {
+            existing[[obj.remoteID description]] = obj;
+        }
+    }
+    
+    NSMutableSet *deleted = [NSMutableSet setWithCapacity:deletedIDs.count];
+    for (id remoteID in deletedIDs) {
+        [deleted addObject:[remoteID description]];
+    }
+    
+    NSDictionary *previousMark = [self remoteSyncMarkForKey:markKey];
+    NSDate *mark = previousMark[@"date"];
+    NSString *markString = previousMark[@"updated_at"];
+    
+    BOOL batching = NSRBeginChangeBatch(self);
+    @try
+    {
+        for (NSDictionary *dict in records)
+        {
+            if (![dict isKindOfClass:[NSDictionary class]]) {
+                continue;
+            }
+            
+            //tombstones still count toward the mark - they changed too
+            id updatedAt = (dict[@"updated_at"] ?: dict[@"updatedAt"]);
+            NSDate *updated = ([updatedAt isKindOfClass:[NSString class]] ? [[self resolvedConfig] dateFromString:updatedAt] : nil);
+            if (updated)
+            {
+                //a tie at the dateFormat's precision can still be apart at the server's - same format, so the string breaks it
+                NSComparisonResult order = (mark ? [updated compare:mark] : NSOrderedDescending);
+                if (order == NSOrderedDescending || (order == NSOrderedSame && [updatedAt compare:markString] == NSOrderedDescending))
+                {
+                    mark = updated;
+                    markString = updatedAt;
+                }
+            }
+            
+            NSString *remoteID = [dict[@"id"] description];
+            if ([dict[@"_destroy"] boolValue])
+            {
+                if (remoteID) {
+                    [deleted addObject:remoteID];
+                }
+                continue;
+            }
+            
+            NSRRemoteObject *obj = (remoteID ? existing[remoteID] : nil);
+            if (obj)
+            {
+                [obj setPropertiesUsingRemoteDictionary:dict];
+            }
+            else
+            {
+                obj = [self objectWithRemoteDictionary:dict];
+                [merged addObject:obj];
+                if (remoteID) {
+                    existing[remoteID] = obj;
+                }
+            }
+        }
+    }
+    @finally
+    {
+        NSREndChangeBatch(batching, self);
+    }
+    
+    if (deleted.count > 0)
+    {
+        [merged filterUsingPredicate:[NSPredicate predicateWithBlock:
+                                      ^BOOL (NSRRemoteObject *obj, NSDictionary *bindings)
+                                      {
+                                          return !(obj.remoteID && [deleted containsObject:[obj.remoteID description]]);
+                                      }]];
+    }
+    
+    if (mark && markString) {
+        [self setRemoteSyncMark:@{@"date":mark, @"updated_at":markString} forKey:markKey];
+    }
+    
+    return merged;
+}
+
++ (NSArray *) remoteSyncCollection:(NSArray *)collection error:(NSError **)error
+{
+    return [self remoteSyncCollection:collection viaObject:nil error:error];
+}
+
++ (NSArray *) remoteSyncCollection:(NSArray *)collection viaObject:(NSRRemoteObject *)obj error:(NSError **)error
+{
+    NSString *markKey;
+    NSRRequest *request = [self requestToSyncCollection:collection viaObject:obj markKey:&markKey];
+    
+    NSError *syncError = nil;
+    NSArray *synced = [request sendSynchronous:&syncError decodingWith:
+                       ^id (id jsonRep)
+                       {
+                           return [self mergeRemoteSync:jsonRep intoCollection:collection markKey:markKey];
+                       }];
+    
+    if (error) {
+        *error = syncError;
+    }
+    
+    //an empty response (204) just means nothing changed
+    return (synced ?: (syncError ? nil : (collection ?: @[])));
+}
+
++ (NSRRequestHandle *) remoteSyncCollection:(NSArray *)collection async:(NSRFetchAllCompletionBlock)completionBlock
+{
+    return [self remoteSyncCollection:collection viaObject:nil async:completionBlock];
+}
+
++ (NSRRequestHandle *) remoteSyncCollection:(NSArray *)collection viaObject:(NSRRemoteObject *)obj async:(NSRFetchAllCompletionBlock)completionBlock
+{
+    NSString *markKey;
+    NSRRequest *request = [self requestToSyncCollection:collection viaObject:obj markKey:&markKey];
+    
+    return [request sendAsynchronous:
+            ^(id objects, NSError *error)
+            {
+                if (completionBlock) {
+                    completionBlock((objects ?: (error ? nil : (collection ?: @[]))), error);
+                }
+            }
+            decodingWith:^id (id jsonRep)
+            {
+                return [self mergeRemoteSync:jsonRep intoCollection:collection markKey:markKey];
+            }];
+}
+
++ (NSRRequestHandle *) remoteAllStreaming:(void (^)(id object))objectBlock async:(NSRBasicCompletionBlock)completionBlock
+{
+    return [self remoteAllViaObject:nil streaming:objectBlock async:completionBlock];
+}
+
++ (NSRRequestHandle *) remoteAllViaObject:(NSRRemoteObject *)obj streaming:(void (^)(id object))objectBlock async:(NSRBasicCompletionBlock)completionBlock
+{
+    NSRRequest *request = [NSRRequest requestToFetchAllObjectsOfClass:self viaObject:obj];
+    return [request sendAsynchronousStreamingElements:
+     ^(id element)
+     {
+         if ([element isKindOfClass:[NSDictionary class]] && objectBlock)
+         {
+             @autoreleasepool
+             {
+                 objectBlock([self objectWithRemoteDictionary:element]);
+             }
+         }
+     }
+     completion:^(id result, NSError *error)
+     {
+         //wasn't a bare array, so it came in whole - decoded here, on the completion thread, in the request's config
+         if (result && objectBlock)
+         {
+             [request.config useIn:^
+              {
+                  for (id object in [self objectsWithRemoteDictionaries:result]) {
+                      objectBlock(object);
+                  }
+              }];
+         }
+         if (completionBlock) {
+             completionBlock(error);
+         }
+     }];
+}
+
+#pragma mark - Subscriptions
+
++ (NSRSubscription *) remoteSubscribeWithObjects:(NSArray *)objects handler:(void (^)(NSRSubscriptionEvent *event))handler
+{
+    NSRSubscription *subscription = [[NSRSubscription alloc] initWithRequest:[NSRRequest requestToSubscribeToObjectsOfClass:self] objectClass:self];
+    subscription.objects = objects;
+    subscription.eventHandler = handler;
+    [subscription start];
+    return subscription;
+}
+
 #pragma mark - NSCoding
 
 - (id) initWithCoder:(NSCoder *)aDecoder
@@ -702,6 +1376,9 @@
 
 + (NSString *) stringByCamelizingString:(NSString *)string
 {
+    NSRMemoryMark memory;
+    BOOL profiling = NSRMemoryPhaseBegin(&memory);
+    
     NSMutableString *camelized = [NSMutableString string];
     BOOL capitalizeNext = NO;
     for (int i = 0; i < string.length; i++) {
@@ -731,11 +1408,15 @@
         [camelized replaceCharactersInRange:NSMakeRange(camelized.length - 3, 3) withString:@"IDs"];
     }
     
+    NSRMemoryPhaseEnd("inflection", profiling, memory);
     return camelized;
 }
 
 + (NSString *) stringByUnderscoringString:(NSString *)string ignoringPrefix:(BOOL)stripPrefix
 {
+    NSRMemoryMark memory;
+    BOOL profiling = NSRMemoryPhaseBegin(&memory);
+    
     NSCharacterSet *caps = [NSCharacterSet uppercaseLetterCharacterSet];
     
     NSMutableString *underscored = [NSMutableString string];
@@ -771,8 +1452,129 @@
         }
     }
     
+    NSRMemoryPhaseEnd("inflection", profiling, memory);
     return underscored;
 }
 
 @end
 
+@interface NSRSideloadedRecords ()
+
+@property (nonatomic, strong) NSDictionary *response;
+@property (nonatomic, strong) NSString *primaryKey;
+
+//root key -> {remoteID description -> decoded object}
+@property (nonatomic, strong) NSMutableDictionary *decoded;
+
+@end
+
+@implementation NSRChangeBatch
+@end
+
+@implementation NSRSideloadedRecords
+
+- (id) initWithResponse:(NSDictionary *)response primaryKey:(NSString *)primaryKey
+{
+    if ((self = [super init]))
+    {
+        self.response = response;
+        self.primaryKey = primaryKey;
+        self.decoded = [[NSMutableDictionary alloc] init];
+    }
+    return self;
+}
+
+- (NSDictionary *) recordsOfClass:(Class)class
+{
+    NSString *root = [[class resolvedConfig] remoteControllerNameForClass:class];
+    
+    //the main records aren't sideloads, even if something refers to its own class (parent_id)
+    if ([root isEqualToString:self.primaryKey]) {
+        return nil;
+    }
+    
+    NSMutableDictionary *records = self.decoded[root];
+    if (!records)
+    {
+        records = [[NSMutableDictionary alloc] init];
+        self.decoded[root] = records;
+        
+        id dictionaries = self.response[root];
+        if ([dictionaries isKindOfClass:[NSArray class]])
+        {
+            for (NSDictionary *dict in dictionaries)
+            {
+                if ([dict isKindOfClass:[NSDictionary class]] && dict[@"id"]) {
+                    records[[dict[@"id"] description]] = [class objectWithRemoteDictionary:dict];
+                }
+            }
+        }
+    }
+    
+    return records;
+}
+
+- (void) wireAssociationsOfObject:(NSRRemoteObject *)object fromRemoteDictionary:(NSDictionary *)dict
+{
+    //same unwrapping as setPropertiesUsingRemoteDictionary:
+    NSDictionary *innerDict = dict[[[object.class resolvedConfig] remoteModelNameForClass:object.class]];
+    if (dict.count == 1 && [innerDict isKindOfClass:[NSDictionary class]]) {
+        dict = innerDict;
+    }
+    
+    BOOL inflect = [object.class resolvedConfig].autoinflectsPropertyNames;
+    
+    for (NSString *property in [object remoteProperties])
+    {
+        Class nestedClass = [object nestedClassForProperty:property];
+        if (!nestedClass) {
+            continue;
+        }
+        
+        NSString *remoteKey = (inflect ? [object.class stringByUnderscoringString:property ignoringPrefix:NO] : property);
+        
+        //embedded in full - already decoded
+        if (dict[remoteKey]) {
+            continue;
+        }
+        
+        id singleID = dict[[remoteKey stringByAppendingString:@"_id"]];
+        if (singleID && singleID != [NSNull null])
+        {
+            id associated = [self recordsOfClass:nestedClass][[singleID description]];
+            if (associated) {
+                [object setValue:associated forKey:property];
+            }
+            continue;
+        }
+        
+        NSString *singular = remoteKey;
+        if ([singular hasSuffix:@"ies"]) {
+            singular = [[singular substringToIndex:singular.length-3] stringByAppendingString:@"y"];
+        }
+        else if ([singular hasSuffix:@"s"]) {
+            singular = [singular substringToIndex:singular.length-1];
+        }
+        
+        id manyIDs = dict[[singular stringByAppendingString:@"_ids"]];
+        if ([manyIDs isKindOfClass:[NSArray class]])
+        {
+            NSDictionary *records = [self recordsOfClass:nestedClass];
+            if (!records) {
+                continue;
+            }
+            
+            id collection = [[[object containerClassForRelationProperty:property] alloc] init];
+            for (id remoteID in manyIDs)
+            {
+                id associated = records[[remoteID description]];
+                if (associated) {
+                    [collection addObject:associated];
+                }
+            }
+            [object setValue:collection forKey:property];
+        }
+    }
+}
+
+@end
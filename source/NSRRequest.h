@@ -32,6 +32,8 @@
 
 @class NSRRemoteObject;
 @class NSRConfig;
+@class NSRRequestMetrics;
+@class NSRRequestHandle;
 
 typedef void(^NSRHTTPCompletionBlock)(id jsonRep, NSError *error);
 
@@ -91,6 +93,15 @@ extern NSString * const NSRNullRemoteIDException;
  */
 @property (nonatomic, readonly) NSString *route;
 
+/**
+ The <route> with any remote IDs filled in by the `routeTo` methods replaced with `:id`, Rails-style.
+ 
+ For instance, a request routed to a post with ID 5 nested under a user with ID 3 has the route `users/3/posts/5` and the route template `users/:id/posts/:id`. Useful for grouping requests made to the same endpoint.
+ 
+ Routes set directly with <routeTo:> are used as their own template.
+ */
+@property (nonatomic, readonly) NSString *routeTemplate;
+
 /**
  The HTTP verb with which to make the request.
  
@@ -107,7 +118,13 @@ extern NSString * const NSRNullRemoteIDException;
      //GET to /something?q=search
      id response = [request sendSynchronous:&e];
  
- @warning Doesn't escape anything! Make sure your params are RFC 1808 compliant.
+ Keys and values are percent-escaped when the URL is built, so pass them in unescaped. Values that aren't strings are converted with `description`.
+ 
+ Array values are sent Rails-style, as one `key[]=` parameter per element:
+ 
+     request.queryParameters = @{@"ids":@[@1, @2]};
+ 
+     //GET to /something?ids[]=1&ids[]=2
  */
 @property (nonatomic, strong) NSDictionary *queryParameters;
 
@@ -119,10 +136,37 @@ extern NSString * const NSRNullRemoteIDException;
 /**
  Request body.
  
- Must be a JSON-parsable object (NSArray, NSDictionary, NSString) or will throw an exception.
+ Must be a JSON-parsable object (NSArray, NSDictionary, NSString) or an NSRMultipartBody, or will throw an exception.
+ 
+ An NSRMultipartBody is streamed as the request is sent, with its `Content-Type` and `Content-Length` set for you.
+ 
+ Arrays and dictionaries are encoded with the config's <NSRConfig codec> when the request is sent.
  */
 @property (nonatomic, strong) id body;
 
+/**
+ Absolute time by which the request must have finished, or `nil` for no deadline.
+ 
+ The timeout for each send is the time left until the deadline (or the config's <NSRConfig timeoutInterval>, if that's shorter). An asynchronous request still going when the deadline passes is cancelled like with <NSRRequestHandle cancel>, but finishes with an `NSURLErrorTimedOut` error. A request sent after its deadline has passed fails with that error right away, without going out.
+ 
+ The deadline is absolute, so it carries over when the same request is sent again - retrying a request never gives it more time than it was first given.
+ */
+@property (nonatomic, strong) NSDate *deadline;
+
+/**
+ Queue to call this request's completion block on, or `nil` to go by its config.
+ 
+ Takes precedence over the config's <NSRConfig completionQueue> and <NSRConfig performsCompletionBlocksOnMainThread>.
+ */
+@property (nonatomic, strong) NSOperationQueue *completionQueue;
+
+/**
+ Phase timings, byte counts and status of the last time this request was sent. (read-only)
+ 
+ Only recorded when the request's config has <NSRConfig collectsRequestMetrics> on or a <NSRConfig metricsObserver> set, and only filled in once the request has finished (after its completion block has returned, if asynchronous). `nil` otherwise.
+ */
+@property (nonatomic, readonly) NSRRequestMetrics *metrics;
+
 
 /// =============================================================================================
 /// @name Creating an NSRRequest by HTTP method
@@ -181,6 +225,21 @@ extern NSString * const NSRNullRemoteIDException;
  */
 + (NSRRequest *) requestToFetchObjectWithID:(NSNumber *)remoteID ofClass:(Class)class;
 
+/**
+ Creates and returns an NSRRequest object set to fetch several objects by ID in one request.
+ 
+ `GET` request routed to the given class, with the IDs as `ids[]` query parameters.
+ 
+    GET /posts?ids[]=1&ids[]=2&ids[]=5
+ 
+ Your Rails index action has to handle this parameter (eg, `Post.where(id: params[:ids])` when it's present).
+ 
+ @param remoteIDs Remote IDs of the objects you wish to fetch. Will raise an exception if this is `nil` or empty.
+ @param class Class of the objects you wish to fetch. Must be an NSRRemoteObject subclass.
+ @return An NSRRequest object set to fetch the objects with the specified IDs.
+ */
++ (NSRRequest *) requestToFetchObjectsWithIDs:(NSArray *)remoteIDs ofClass:(Class)class;
+
 /**
  Creates and returns an NSRRequest object set to fetch all objects of a given class.
  
@@ -206,6 +265,18 @@ extern NSString * const NSRNullRemoteIDException;
  */
 + (NSRRequest *) requestToFetchAllObjectsOfClass:(Class)class viaObject:(NSRRemoteObject *)obj;
 
+/**
+ Creates and returns an NSRRequest object set to open a stream of pushed changes to objects of a given class.
+ 
+ `GET` request routed to the given class, the custom method being `stream`. Meant to be opened with an <NSRSubscription>.
+ 
+    GET /posts/stream
+ 
+ @param class Class of the objects you wish to subscribe to. Must be an NSRRemoteObject subclass.
+ @return An NSRRequest object set to open a stream of changes to objects of a given class.
+ */
++ (NSRRequest *) requestToSubscribeToObjectsOfClass:(Class)class;
+
 /**
  Creates and returns an NSRRequest object set to remotely create a given object.
  
@@ -338,6 +409,8 @@ extern NSString * const NSRNullRemoteIDException;
  
  Will convert the object into a JSON-parsable object (an NSDictionary) by calling <NSRRemoteObject>'s `remoteDictionaryRepresentationWrapped:` on it.
  
+ If the object has any `<NSRRemoteObject remoteFileAttachments>`, the body will instead be an NSRMultipartBody holding the same fields plus the files.
+ 
  @param object Object to use as a body to send the request.
  */
 - (void) setBodyToObject:(NSRRemoteObject *)object;
@@ -362,7 +435,27 @@ extern NSString * const NSRNullRemoteIDException;
  Handles Rails errors, as well as basic connection errors.
  
  @param completionBlock Block to be executed when the request is complete.
+ @return A handle that can be used to cancel the request.
+ */
+- (NSRRequestHandle *) sendAsynchronous:(NSRHTTPCompletionBlock)completionBlock;
+
+/**
+ Sends the request asynchronously, streaming the response instead of loading all of it into memory first.
+ 
+ If the response is a top-level JSON array, each element is parsed and passed to *elementBlock* as soon as it has fully arrived, and is not kept around afterwards - so memory use is bounded by the largest element rather than by the size of the response. *completionBlock* is then called with a `nil` response.
+ 
+ Any other response is collected as usual, except that once it grows past <NSRConfig streamingSpoolThreshold> it's spooled to a temporary file instead of being held in memory, and parsed from there. It's then passed to *completionBlock* like <sendAsynchronous:> would.
+ 
+ Error responses (status 400 and up) are never streamed, and are handled like in <sendAsynchronous:>.
+ 
+ Only JSON can be streamed. With any other <NSRConfig codec>, the whole response is loaded and decoded first, and if it's an array its elements are then passed to *elementBlock* one by one, as above.
+ 
+ Cancelling the request stops *elementBlock* from being called for any elements that haven't been handed off yet.
+ 
+ @param elementBlock Block called with each element of a top-level array, in order. Called on a background queue, so the next elements aren't held up by the main thread.
+ @param completionBlock Block to be executed when the request is complete. Called on the main thread if the config's <NSRConfig performsCompletionBlocksOnMainThread> is on.
+ @return A handle that can be used to cancel the request.
  */
-- (void) sendAsynchronous:(NSRHTTPCompletionBlock)completionBlock;
+- (NSRRequestHandle *) sendAsynchronousStreamingElements:(void (^)(id element))elementBlock completion:(NSRHTTPCompletionBlock)completionBlock;
 
 @end
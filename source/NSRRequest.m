@@ -30,6 +30,18 @@
 
 #import <NSRails/NSRails.h>
 #import "NSRRequest.h"
+#import "NSRNetworkLog.h"
+#import "NSRRequestMetrics.h"
+#import "NSRMemoryProfiling.h"
+#import "NSRTracing.h"
+#import "NSRJSONElementStream.h"
+#import "NSRRequestHandle.h"
+#import "NSRStringInterner.h"
+#import "NSRWireCodec.h"
+#import "NSRRateLimiter.h"
+#import "NSRCassette.h"
+#import "NSREndpointPool.h"
+#import "NSRCompletionBatcher.h"
 
 #if TARGET_OS_IPHONE
 #import <UIKit/UIKit.h> //UIKit needed for managing activity indicator
@@ -42,11 +54,81 @@ NSString * const NSRRemoteErrorDomain       = @"NSRRemoteErrorDomain";
 NSString * const NSRMissingURLException     = @"NSRMissingURLException";
 NSString * const NSRNullRemoteIDException   = @"NSRNullRemoteIDException";
 
+@interface NSRConfig (private)
+
+- (NSString *) routeBaseString;
+- (NSString *) remoteControllerNameForClass:(Class)class;
+- (void) recordRequestMetrics:(NSRRequestMetrics *)metrics;
+- (NSArray *) rateLimitersForRoute:(NSString *)routeTemplate;
+- (NSREndpointPool *) endpointPool;
+
+@end
+
+@interface NSRCassette (private)
+
+- (NSData *) sendSynchronousRequest:(NSURLRequest *)request uploadBody:(NSRMultipartBody *)uploadBody returningResponse:(NSURLResponse **)response error:(NSError **)error;
+- (id) connectionWithRequest:(NSURLRequest *)request uploadBody:(NSRMultipartBody *)uploadBody delegate:(id<NSURLConnectionDataDelegate>)delegate;
+
+@end
+
+@interface NSRRequest ()
+
+//whether this request's round trip made the networkLogSampleRate cut
+@property (nonatomic) BOOL logSampled;
+
+//measured every time (they're cheap) and picked up by the metrics if anyone's listening
+@property (nonatomic) NSTimeInterval routingDuration;
+@property (nonatomic) NSTimeInterval bodyEncodingDuration;
+@property (nonatomic) NSTimeInterval serializingDuration;
+
+@end
+
 @interface NSRRequest (private)
 
 - (id) initWithHTTPMethod:(NSString *)method;
 
+- (void) buildRouteToClass:(Class)c remoteID:(NSNumber *)remoteID customMethod:(NSString *)method methodTemplate:(NSString *)methodTemplate;
+- (void) buildRouteToObject:(NSRRemoteObject *)o withCustomMethod:(NSString *)method methodTemplate:(NSString *)methodTemplate ignoreID:(BOOL)ignoreID;
+
+- (NSURL *) URL;
+- (NSURL *) URLForEndpoint:(NSREndpoint *)endpoint;
 - (NSURLRequest *) HTTPRequest;
+- (NSURLRequest *) HTTPRequestToEndpoint:(NSREndpoint *)endpoint;
+
+- (id) sendSynchronous:(NSError **)errorOut decodingWith:(id (^)(id jsonRep))decoder;
+- (NSRRequestHandle *) sendAsynchronous:(NSRHTTPCompletionBlock)block decodingWith:(id (^)(id jsonRep))decoder;
+- (NSError *) deadlineError;
+- (NSTimeInterval) timeoutInterval;
+- (void) scheduleDeadlineForHandle:(NSRRequestHandle *)handle;
+- (void) sendAsynchronous:(NSRHTTPCompletionBlock)block decodingWith:(id (^)(id jsonRep))decoder handle:(NSRRequestHandle *)handle failovers:(NSUInteger)failovers rateLimitRetries:(NSUInteger)rateLimitRetries avoiding:(NSREndpoint *)failedEndpoint;
+
+- (NSTimeInterval) rateLimitDelay;
+- (NSTimeInterval) rateLimitHold;
+- (void) afterRateLimitDelay:(NSTimeInterval)delay perform:(void (^)(void))block;
+- (BOOL) recordRateLimitResponse:(NSHTTPURLResponse *)response;
+
+- (NSREndpoint *) checkOutEndpointAvoiding:(NSREndpoint *)failedEndpoint trial:(BOOL *)trial;
+- (BOOL) checkInEndpoint:(NSREndpoint *)endpoint trial:(BOOL)trial response:(NSHTTPURLResponse *)response error:(NSError *)error latency:(NSTimeInterval)latency;
+- (BOOL) canFailOverAfter:(NSUInteger)failovers;
+
+- (NSData *) sendSynchronousRequest:(NSURLRequest *)request returningResponse:(NSHTTPURLResponse **)response error:(NSError **)error;
+- (id) connectionWithRequest:(NSURLRequest *)request delegate:(id<NSURLConnectionDataDelegate>)delegate;
+
+- (id) decodeResponse:(id)response with:(id (^)(id jsonRep))decoder;
+
+- (NSRRequestMetrics *) beginMetrics;
+- (void) finishMetrics:(NSRRequestMetrics *)metrics;
+
+- (void) logOut:(NSURLRequest *)request;
+- (void) logIn:(NSData *)data response:(NSHTTPURLResponse *)response error:(NSError *)error;
+
+- (id) jsonResponseFromData:(NSData *)data;
+- (id) responseObjectFromData:(NSData *)data MIMEType:(NSString *)MIMEType;
+- (BOOL) codecIsJSON;
+- (NSRStringInterner *) stringInterner;
+- (NSError *) errorForResponse:(id)jsonResponse existingError:(NSError *)existing statusCode:(NSInteger)statusCode;
+- (NSError *) errorForResponse:(id)jsonResponse existingError:(NSError *)existing statusCode:(NSInteger)statusCode bodyStream:(NSInputStream *)bodyStream;
+- (void) performCompletion:(void (^)(void))completion;
 
 - (NSError *) serverErrorForResponse:(id)response statusCode:(NSInteger)statusCode;
 - (NSError *) errorForResponse:(NSHTTPURLResponse *)response existingError:(NSError *)existing jsonResponse:(id)jsonResponse;
@@ -54,26 +136,143 @@ NSString * const NSRNullRemoteIDException   = @"NSRNullRemoteIDException";
 
 @end
 
+@interface NSRMultipartBody (private)
+
++ (NSError *) errorForStream:(NSInputStream *)stream;
+
+@end
+
+@interface NSRRequestHandle (private)
+
+- (id) initWithRequest:(NSRRequest *)request;
+- (BOOL) cancelWithError:(NSError *)error;
+- (void) finish;
+- (NSError *) cancellationError;
+- (void) setCancelHandler:(void (^)(NSError *error))handler;
+
+@end
+
+//NSURLConnection delegate for sendAsynchronous: - collects the response, and lets a cancel finish the request early
+@interface NSRBufferingReceiver : NSObject <NSURLConnectionDataDelegate>
+
+@property (nonatomic, copy) void (^completionHandler)(NSURLResponse *response, NSData *data, NSError *error);
+@property (nonatomic, strong) NSURLResponse *response;
+@property (nonatomic, strong) NSMutableData *data;
+
+//when the headers came in, for the metrics' time to first byte
+@property (nonatomic) NSTimeInterval responded;
+
+//restarted from the top if a redirect or auth challenge means the body has to be sent again
+@property (nonatomic, strong) NSRMultipartBody *uploadBody;
+
+//the copy of it the connection is reading now, which is what an upload error is looked up on
+@property (nonatomic, strong) NSInputStream *bodyStream;
+
+- (void) finishWithError:(NSError *)error;
+
+@end
+
+//NSURLConnection delegate for sendAsynchronousStreamingElements:completion: - feeds an NSRJSONElementStream as data comes in
+@interface NSRStreamingReceiver : NSObject <NSURLConnectionDataDelegate>
+
+@property (nonatomic, strong) NSRRequest *request;
+@property (nonatomic, strong) NSRRequestHandle *handle;
+@property (nonatomic) BOOL finished;
+@property (nonatomic, copy) NSRHTTPCompletionBlock completionBlock;
+@property (nonatomic, strong) NSRJSONElementStream *stream;
+@property (nonatomic, copy) void (^elementHandler)(id element);
+@property (nonatomic, strong) NSHTTPURLResponse *response;
+@property (nonatomic, strong) NSMutableData *bufferedBody;
+@property (nonatomic, strong) NSError *streamError;
+@property (nonatomic, strong) NSREndpoint *endpoint;
+@property (nonatomic) BOOL endpointIsTrial;
+@property (nonatomic, strong) NSRMultipartBody *uploadBody;
+@property (nonatomic, strong) NSInputStream *bodyStream;
+
+@property (nonatomic, strong) NSRRequestMetrics *metrics;
+@property (nonatomic) NSTimeInterval start, queued, sent, responded;
+@property (nonatomic) NSUInteger bytesSent;
+
+@end
+
+static inline NSTimeInterval NSRNow(void)
+{
+    //monotonic, unlike NSDate
+    return [NSProcessInfo processInfo].systemUptime;
+}
+
+static inline NSUInteger NSRBodyLength(NSURLRequest *request)
+{
+    //streamed (multipart) bodies have no HTTPBody, but always carry their length
+    return (request.HTTPBody ? request.HTTPBody.length : (NSUInteger)[[request valueForHTTPHeaderField:@"Content-Length"] longLongValue]);
+}
+
 @implementation NSRRequest
 
 # pragma mark - Convenient routing
 
+//appends a path component in place, joining with exactly one slash (like stringByAppendingPathComponent:)
+static void NSRAppendPathComponent(NSMutableString *path, NSString *component)
+{
+    if (component.length == 0) {
+        return;
+    }
+    
+    BOOL endsWithSlash = [path hasSuffix:@"/"];
+    BOOL startsWithSlash = [component hasPrefix:@"/"];
+    
+    if (path.length > 0 && !endsWithSlash && !startsWithSlash) {
+        [path appendString:@"/"];
+    }
+    else if (endsWithSlash && startsWithSlash) {
+        component = [component substringFromIndex:1];
+    }
+    
+    [path appendString:component];
+}
+
 - (id) routeTo:(NSString *)r
 {
     _route = r;
+    _routeTemplate = r;
     return self;
 }
 
-- (id) routeToClass:(Class)c withCustomMethod:(NSString *)optionalRESTMethod
+- (id) routeToClass:(Class)c remoteID:(NSNumber *)remoteID customMethod:(NSString *)method methodTemplate:(NSString *)methodTemplate
 {
-    self.config = [c config];
+    NSTimeInterval start = NSRNow();
+    [self buildRouteToClass:c remoteID:remoteID customMethod:method methodTemplate:methodTemplate];
+    self.routingDuration = NSRNow() - start;
+    
+    return self;
+}
 
-    NSString *controller = [c remoteControllerName];
-    if (!controller) {
-        return [self routeTo:optionalRESTMethod];
+- (void) buildRouteToClass:(Class)c remoteID:(NSNumber *)remoteID customMethod:(NSString *)method methodTemplate:(NSString *)methodTemplate
+{
+    self.config = [c config];
+    
+    //controller name is cached per class by the config, so from here on it's just filling in the ID and method
+    NSString *controller = [self.config remoteControllerNameForClass:c] ?: @"";
+    
+    NSMutableString *route = [NSMutableString stringWithString:controller];
+    NSMutableString *template = [NSMutableString stringWithString:controller];
+    
+    if (remoteID)
+    {
+        NSRAppendPathComponent(route, remoteID.stringValue);
+        NSRAppendPathComponent(template, @":id");
     }
+    
+    NSRAppendPathComponent(route, method);
+    NSRAppendPathComponent(template, methodTemplate);
+    
+    _route = (route.length > 0 ? route : nil);
+    _routeTemplate = (template.length > 0 ? template : nil);
+}
 
-    return [self routeTo:[controller stringByAppendingPathComponent:optionalRESTMethod]];
+- (id) routeToClass:(Class)c withCustomMethod:(NSString *)optionalRESTMethod
+{
+    return [self routeToClass:c remoteID:nil customMethod:optionalRESTMethod methodTemplate:optionalRESTMethod];
 }
 
 - (id) routeToClass:(Class)c
@@ -81,17 +280,19 @@ NSString * const NSRNullRemoteIDException   = @"NSRNullRemoteIDException";
     return [self routeToClass:c withCustomMethod:nil];
 }
 
-- (id) routeToObject:(NSRRemoteObject *)o withCustomMethod:(NSString *)method ignoreID:(BOOL)ignoreID
+- (id) routeToObject:(NSRRemoteObject *)o withCustomMethod:(NSString *)method methodTemplate:(NSString *)methodTemplate ignoreID:(BOOL)ignoreID
 {
-    self.config = [o.class config];
-    
-    //prepend the ID: action -> 1/action
-    if (o.remoteID && !ignoreID) {
-        method = [[o.remoteID stringValue] stringByAppendingPathComponent:method];
-    }
+    NSTimeInterval start = NSRNow();
+    [self buildRouteToObject:o withCustomMethod:method methodTemplate:methodTemplate ignoreID:ignoreID];
+    self.routingDuration = NSRNow() - start;
     
-    //prepend the classname: 1/action -> class/1/action
-    [self routeToClass:[o class] withCustomMethod:method];
+    return self;
+}
+
+- (void) buildRouteToObject:(NSRRemoteObject *)o withCustomMethod:(NSString *)method methodTemplate:(NSString *)methodTemplate ignoreID:(BOOL)ignoreID
+{
+    //action -> class/1/action
+    [self buildRouteToClass:[o class] remoteID:(ignoreID ? nil : o.remoteID) customMethod:method methodTemplate:methodTemplate];
     
     NSRRemoteObject *prefix = [o objectUsedToPrefixRequest:self];
     if (prefix)
@@ -102,10 +303,13 @@ NSString * const NSRNullRemoteIDException   = @"NSRNullRemoteIDException";
         }
         
         //if prefix, prepend the route to prefix: class/1/action -> prefixes/15/class/1/action (+ recursive)
-        [self routeToObject:prefix withCustomMethod:self.route];
+        [self buildRouteToObject:prefix withCustomMethod:self.route methodTemplate:self.routeTemplate ignoreID:NO];
     }
-    
-    return self;
+}
+
+- (id) routeToObject:(NSRRemoteObject *)o withCustomMethod:(NSString *)method ignoreID:(BOOL)ignoreID
+{
+    return [self routeToObject:o withCustomMethod:method methodTemplate:method ignoreID:ignoreID];
 }
 
 - (id) routeToObject:(NSRRemoteObject *)o withCustomMethod:(NSString *)method
@@ -125,12 +329,37 @@ NSString * const NSRNullRemoteIDException   = @"NSRNullRemoteIDException";
 
 - (void) setBodyToObject:(NSRRemoteObject *)obj
 {
-    self.body = [obj remoteDictionaryRepresentationWrapped:YES];
+    NSTimeInterval start = NSRNow();
+    NSDictionary *dictionary = [obj remoteDictionaryRepresentationWrapped:YES];
+    NSDictionary *attachments = [obj remoteFileAttachments];
+    
+    if (attachments.count > 0)
+    {
+        //files can't go in JSON - send everything as multipart/form-data instead, with the files nested under the model name like any other attribute
+        NSRMultipartBody *multipart = [[NSRMultipartBody alloc] init];
+        [multipart addFieldsFromDictionary:dictionary];
+        
+        NSString *modelName = [[obj.class config] remoteModelNameForClass:obj.class];
+        for (NSString *attribute in attachments)
+        {
+            NSError *error;
+            if (![multipart addFileAtURL:attachments[attribute] forName:[NSString stringWithFormat:@"%@[%@]", modelName, attribute] error:&error]) {
+                [NSException raise:NSInvalidArgumentException format:@"Couldn't attach file for '%@' on %@: %@", attribute, [obj class], error.localizedDescription];
+            }
+        }
+        
+        self.body = multipart;
+    }
+    else
+    {
+        self.body = dictionary;
+    }
+    self.bodyEncodingDuration = NSRNow() - start;
 }
 
 - (void) setBody:(id)body
 {
-    if (body && ![body isKindOfClass:[NSString class]] && ![NSJSONSerialization isValidJSONObject:body]) {
+    if (body && ![body isKindOfClass:[NSString class]] && ![body isKindOfClass:[NSRMultipartBody class]] && ![NSJSONSerialization isValidJSONObject:body]) {
         [NSException raise:NSInvalidArgumentException format:@"NSRRequest body is not a valid top-level JSON object (only array or dictionary allowed)."];
     }
     
@@ -184,7 +413,20 @@ NSString * const NSRNullRemoteIDException   = @"NSRNullRemoteIDException";
         [NSException raise:NSInvalidArgumentException format:@"Attempt to fetch remote %@ objectWithID but ID passed in was nil.", c];
     }
 
-    return [[NSRRequest GET] routeToClass:c withCustomMethod:rID.stringValue];
+    return [[NSRRequest GET] routeToClass:c remoteID:rID customMethod:nil methodTemplate:nil];
+}
+
++ (NSRRequest *) requestToFetchObjectsWithIDs:(NSArray *)rIDs ofClass:(Class)c
+{
+    if (rIDs.count == 0)
+    {
+        [NSException raise:NSInvalidArgumentException format:@"Attempt to fetch remote %@ objectsWithIDs but no IDs were passed in.", c];
+    }
+    
+    //asking for the same record twice just makes the query longer
+    NSRRequest *req = [[NSRRequest GET] routeToClass:c];
+    req.queryParameters = @{@"ids":[[NSOrderedSet orderedSetWithArray:rIDs] array]};
+    return req;
 }
 
 + (NSRRequest *) requestToFetchAllObjectsOfClass:(Class)c
@@ -203,7 +445,12 @@ NSString * const NSRNullRemoteIDException   = @"NSRNullRemoteIDException";
         [NSException raise:NSRNullRemoteIDException format:@"Attempt to fetch all %@s via object %@, but the object's remoteID was nil.",[self class],[obj class]];
     }
     
-    return [[NSRRequest GET] routeToObject:obj withCustomMethod:[c remoteControllerName]];
+    return [[NSRRequest GET] routeToObject:obj withCustomMethod:[[c config] remoteControllerNameForClass:c]];
+}
+
++ (NSRRequest *) requestToSubscribeToObjectsOfClass:(Class)c
+{
+    return [[NSRRequest GET] routeToClass:c withCustomMethod:@"stream"];
 }
 
 + (void) assertPresentRemoteID:(NSRRemoteObject *)obj forMethod:(NSString *)str
@@ -256,36 +503,100 @@ NSString * const NSRNullRemoteIDException   = @"NSRNullRemoteIDException";
 
 # pragma mark - Making the request
 
-- (NSURLRequest *) HTTPRequest
-{    
-    NSString *appendedRoute = (self.route ?: @"");
+//percent-escapes everything outside of RFC 3986's unreserved set, so keys and values can contain &, =, spaces, etc
+static NSString *NSREscapedQueryComponent(id component)
+{
+    NSString *string = ([component isKindOfClass:[NSString class]] ? component : [component description]);
+    return CFBridgingRelease(CFURLCreateStringByAddingPercentEscapes(kCFAllocatorDefault,
+                                                                     (__bridge CFStringRef)string,
+                                                                     NULL,
+                                                                     CFSTR("!*'();:@&=+$,/?%#[]"),
+                                                                     kCFStringEncodingUTF8));
+}
+
+- (NSURL *) URL
+{
+    return [self URLForEndpoint:nil];
+}
+
+- (NSURL *) URLForEndpoint:(NSREndpoint *)endpoint
+{
+    if (!self.config.rootURL)
+    {
+        [NSException raise:NSRMissingURLException format:@"No server root URL specified. Set your rails app's root with [[NSRConfig defaultConfig] setRootURL:] somewhere in your app setup."];
+    }
+    
+    //one of several rootURLs, or the only one
+    NSURL *rootURL = (endpoint ? endpoint.URL : self.config.rootURL);
+    
+    NSString *route = self.route ?: @"";
+    NSString *base = (endpoint ? endpoint.routeBaseString : self.config.routeBaseString);
+    
+    //absolute routes ("/x", "http://...") or a root URL with its own query still need NSURL's relative resolution
+    BOOL resolvesRelatively = (!base || [route hasPrefix:@"/"] || [route rangeOfString:@"://"].location != NSNotFound);
+    
+    NSMutableString *url = [NSMutableString stringWithCapacity:base.length + route.length + 16 * self.queryParameters.count];
+    if (resolvesRelatively) {
+        [url appendString:route];
+    }
+    else if (route.length == 0) {
+        [url appendString:rootURL.absoluteString];
+    }
+    else {
+        [url appendString:base];
+        [url appendString:route];
+    }
+    
     if (self.queryParameters.count > 0)
     {
-        NSMutableArray *params = [NSMutableArray arrayWithCapacity:self.queryParameters.count];
+        __block BOOL first = YES;
         [self.queryParameters enumerateKeysAndObjectsUsingBlock:
          ^(id key, id obj, BOOL *stop) 
          {
-             //TODO: Escape to be RFC 1808 compliant
-             [params addObject:[NSString stringWithFormat:@"%@=%@",key,obj]];
+             //arrays go out Rails-style - key[]=a&key[]=b
+             BOOL array = [obj isKindOfClass:[NSArray class]];
+             NSString *escapedKey = NSREscapedQueryComponent(array ? [key stringByAppendingString:@"[]"] : key);
+             
+             for (id value in (array ? obj : @[obj]))
+             {
+                 [url appendString:(first ? @"?" : @"&")];
+                 [url appendString:escapedKey];
+                 [url appendString:@"="];
+                 [url appendString:NSREscapedQueryComponent(value)];
+                 first = NO;
+             }
          }];
-        appendedRoute = [appendedRoute stringByAppendingFormat:@"?%@",[params componentsJoinedByString:@"&"]];
     }
     
-    if (!self.config.rootURL)
-    {
-        [NSException raise:NSRMissingURLException format:@"No server root URL specified. Set your rails app's root with [[NSRConfig defaultConfig] setRootURL:] somewhere in your app setup."];
+    if (resolvesRelatively) {
+        return [NSURL URLWithString:url relativeToURL:rootURL];
     }
-
     
-    NSURL *url = [NSURL URLWithString:appendedRoute relativeToURL:self.config.rootURL];
+    return [NSURL URLWithString:url];
+}
+
+- (NSURLRequest *) HTTPRequest
+{
+    return [self HTTPRequestToEndpoint:nil];
+}
+
+- (NSURLRequest *) HTTPRequestToEndpoint:(NSREndpoint *)endpoint
+{
+    NSURL *url = [self URLForEndpoint:endpoint];
     
     NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:url
                                                            cachePolicy:NSURLRequestReloadIgnoringLocalCacheData 
-                                                       timeoutInterval:self.config.timeoutInterval];
+                                                       timeoutInterval:[self timeoutInterval]];
     
     [request setHTTPMethod:self.httpMethod];
     [request setHTTPShouldHandleCookies:NO];
-    [request setValue:@"application/json" forHTTPHeaderField:@"Accept"];
+    
+    //JSON is always acceptable, so actions that can only render JSON keep working with another codec
+    NSString *contentType = [self.config.codec contentType];
+    if (![self codecIsJSON]) {
+        contentType = [contentType stringByAppendingString:@", application/json;q=0.9"];
+    }
+    [request setValue:contentType forHTTPHeaderField:@"Accept"];
     
     [self.additionalHTTPHeaders enumerateKeysAndObjectsUsingBlock:
      ^(id key, id obj, BOOL *stop) {
@@ -297,22 +608,23 @@ NSString * const NSRNullRemoteIDException   = @"NSRNullRemoteIDException";
          [request setValue:obj forHTTPHeaderField:key];
      }];
     
-    if (self.config.basicAuthUsername && self.config.basicAuthPassword)
+    //precomputed by the config whenever its credentials change
+    NSString *authHeader = self.config.authorizationHeader;
+    if (authHeader)
     {
-        //add auth header encoded in base64
-        NSString *authStr = [NSString stringWithFormat:@"%@:%@", self.config.basicAuthUsername, self.config.basicAuthPassword];
-        NSData *authData = [authStr dataUsingEncoding:NSUTF8StringEncoding];
-        NSString *authHeader = [NSString stringWithFormat:@"Basic %@", [NSRRequest base64EncodingOfData:authData]];
-        
-        [request setValue:authHeader forHTTPHeaderField:@"Authorization"]; 
-    }
-    else if (self.config.oAuthToken)
-    {
-        NSString *authHeader = [NSString stringWithFormat:@"OAuth %@", self.config.oAuthToken];
         [request setValue:authHeader forHTTPHeaderField:@"Authorization"];
     }
     
-    if (self.body)
+    if ([self.body isKindOfClass:[NSRMultipartBody class]])
+    {
+        NSRMultipartBody *multipart = self.body;
+        
+        //streamed from disk as the connection reads it - never held in memory
+        [request setHTTPBodyStream:[multipart inputStream]];
+        [request setValue:multipart.contentType forHTTPHeaderField:@"Content-Type"];
+        [request setValue:@(multipart.contentLength).stringValue forHTTPHeaderField:@"Content-Length"];
+    }
+    else if (self.body)
     {
         NSData *data;
       
@@ -327,12 +639,19 @@ NSString * const NSRNullRemoteIDException   = @"NSRNullRemoteIDException";
         }
         else
         {
-            data = [NSJSONSerialization dataWithJSONObject:self.body options:0 error:nil];
+            uint64_t trace = NSRTraceBegin();
+            NSRMemoryMark memory;
+            BOOL profiling = NSRMemoryPhaseBegin(&memory);
+            NSTimeInterval start = NSRNow();
+            data = [self.config.codec dataWithObject:self.body error:nil];
+            self.serializingDuration = NSRNow() - start;
+            NSRMemoryPhaseEnd("encode", profiling, memory);
+            NSRTraceEnd("encode", "nsrails", trace, nil);
         }
       
         if (data)
         {
-            [request setValue:@"application/json" forHTTPHeaderField:@"Content-Type"];
+            [request setValue:[self.config.codec contentType] forHTTPHeaderField:@"Content-Type"];
             [request setHTTPBody:data];
             [request setValue:@(data.length).stringValue forHTTPHeaderField:@"Content-Length"];
         }
@@ -388,26 +707,70 @@ NSString * const NSRNullRemoteIDException   = @"NSRNullRemoteIDException";
     return [NSError errorWithDomain:NSRRemoteErrorDomain code:statusCode userInfo:userInfo];
 }
 
+- (BOOL) codecIsJSON
+{
+    return [self.config.codec isKindOfClass:[NSRJSONCodec class]];
+}
+
+//a fresh table per response (nil if the config doesn't intern)
+- (NSRStringInterner *) stringInterner
+{
+    NSRConfig *config = self.config;
+    if (!config.internsResponseStrings) {
+        return nil;
+    }
+    return [[NSRStringInterner alloc] initWithLimit:config.internedStringLimit maximumLength:config.maximumInternedStringLength];
+}
+
 - (id) jsonResponseFromData:(NSData *)data
+{
+    return [self responseObjectFromData:data MIMEType:nil];
+}
+
+- (id) responseObjectFromData:(NSData *)data MIMEType:(NSString *)MIMEType
 {
     if (!data) {
         return nil;
     }
     
-    id jsonResponse = [NSJSONSerialization JSONObjectWithData:data
-                                                      options:NSJSONReadingAllowFragments | NSJSONReadingMutableContainers
-                                                        error:nil];
+    static NSRJSONCodec *jsonCodec;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        jsonCodec = [[NSRJSONCodec alloc] init];
+    });
+    
+    //we always accept JSON, so go by what the server says it sent. anything else (an HTML error page, say) is left to the codec to reject
+    id<NSRWireCodec> codec = self.config.codec;
+    if ([MIMEType isEqualToString:@"application/json"]) {
+        codec = jsonCodec;
+    }
+    
+    NSRMemoryMark memory;
+    BOOL profiling = NSRMemoryPhaseBegin(&memory);
+    
+    //immutable containers by default - cheaper to build, and nothing internal mutates them
+    id response = [codec objectWithData:data mutableContainers:self.config.returnsMutableContainers error:nil];
     
-    //TODO - workaround for bug with NSJSONReadingMutableContainers. it simply... doesn't work???
-    if ([jsonResponse isKindOfClass:[NSArray class]] && ![jsonResponse isKindOfClass:[NSMutableArray class]]) {
-        jsonResponse = [NSMutableArray arrayWithArray:jsonResponse];
+    NSRStringInterner *interner = (response ? [self stringInterner] : nil);
+    if (interner) {
+        response = [interner internObject:response mutableContainers:self.config.returnsMutableContainers];
     }
     
-    if (!jsonResponse) {
-        jsonResponse = [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
+    NSRMemoryPhaseEnd("parse", profiling, memory);
+    
+    if (!response) {
+        response = [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
     }
 
-    return jsonResponse;
+    return response;
+}
+
+- (NSError *) errorForResponse:(id)jsonResponse existingError:(NSError *)existing statusCode:(NSInteger)statusCode bodyStream:(NSInputStream *)bodyStream
+{
+    //the server only got part of the upload, so whatever it said isn't about what was meant to be sent.
+    //looked up on the stream that was actually sent - the same body may be going out on other requests at the same time
+    NSError *uploadError = [NSRMultipartBody errorForStream:bodyStream];
+    return [self errorForResponse:jsonResponse existingError:(uploadError ?: existing) statusCode:statusCode];
 }
 
 - (NSError *) errorForResponse:(id)jsonResponse existingError:(NSError *)existing statusCode:(NSInteger)statusCode
@@ -433,195 +796,1104 @@ NSString * const NSRNullRemoteIDException   = @"NSRNullRemoteIDException";
     return [NSError errorWithDomain:existing.domain code:existing.code userInfo:userInfo];
 }
 
-- (id) sendSynchronous:(NSError **)errorOut
+#pragma mark - Deadlines
+
+- (NSError *) deadlineError
 {
-    NSURLRequest *request = [self HTTPRequest];
-    
-    NSError *appleError = nil;
-    NSHTTPURLResponse *response = nil;
-    
-    [self logOut:request];
-    NSData *data = [NSURLConnection sendSynchronousRequest:request returningResponse:&response error:&appleError];
-    
-    id jsonResponse = [self jsonResponseFromData:data];
-    NSError *error = [self errorForResponse:jsonResponse existingError:appleError statusCode:response.statusCode];
-    
-    [self logIn:jsonResponse response:response error:error];
-    
-    if (errorOut) {
-        *errorOut = error;
-    }
+    return [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorTimedOut userInfo:@{NSLocalizedDescriptionKey:@"The request's deadline passed."}];
+}
 
-    return (error ? nil : jsonResponse);
+- (NSTimeInterval) timeoutInterval
+{
+    NSTimeInterval timeout = self.config.timeoutInterval;
+    if (self.deadline) {
+        timeout = MIN(timeout, [self.deadline timeIntervalSinceNow]);
+    }
+    return timeout;
 }
 
-- (void) sendAsynchronous:(NSRHTTPCompletionBlock)block
+- (void) scheduleDeadlineForHandle:(NSRRequestHandle *)handle
 {
-#if TARGET_OS_IPHONE
-    static int networkActivityRequests = 0;
+    if (!self.deadline) {
+        return;
+    }
     
-    if (self.config.managesNetworkActivityIndicator)
+    //NSURLRequest's timeout only covers idle time, so a slow trickle could otherwise run past the deadline
+    __weak NSRRequestHandle *weakHandle = handle;
+    NSError *error = [self deadlineError];
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)([self.deadline timeIntervalSinceNow] * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^
     {
-        networkActivityRequests++;
-        [[UIApplication sharedApplication] setNetworkActivityIndicatorVisible:YES];
-    }
-#endif
-
-    static NSOperationQueue *asyncOperationQueue;
-    static dispatch_once_t onceToken;
-    dispatch_once(&onceToken, ^{
-        asyncOperationQueue = [[NSOperationQueue alloc] init];
+        [weakHandle cancelWithError:error];
     });
-    
-    NSURLRequest *request = [self HTTPRequest];
-    [self logOut:request];
-
-    [NSURLConnection sendAsynchronousRequest:request queue:asyncOperationQueue completionHandler:
-     ^(NSURLResponse *response, NSData *data, NSError *appleError) 
-     {
-#if TARGET_OS_IPHONE
-         if (self.config.managesNetworkActivityIndicator)
-         {
-             networkActivityRequests--;
-             if (networkActivityRequests == 0)
-             {
-                 [[UIApplication sharedApplication] setNetworkActivityIndicatorVisible:NO];
-             }
-         }
-#endif
-         id jsonResponse = [self jsonResponseFromData:data];
-         NSError *error = [self errorForResponse:jsonResponse existingError:appleError statusCode:[(NSHTTPURLResponse *)response statusCode]];
-         
-         [self logIn:jsonResponse response:(NSHTTPURLResponse *)response error:error];
-         
-         if (error) {
-             jsonResponse = nil;
-         }
-         
-         if (block) {
-             if (self.config.performsCompletionBlocksOnMainThread) {
-                 dispatch_async(dispatch_get_main_queue(), ^{ block(jsonResponse, error); });
-             }
-             else {
-                 block(jsonResponse, error);
-             }
-         }
-     }];
 }
 
-#pragma mark - Logging
+#pragma mark - Rate limiting
 
-- (NSString *) prettyPrintedJSONFromObject:(id)object
+//reserves this request's turn with every limit that applies, and returns how long until the last of them comes up
+- (NSTimeInterval) rateLimitDelay
 {
-    if (object) {
-        if ([object isKindOfClass:[NSString class]]) {
-            return object;
-        }
-        else {
-            NSData *jsonData = [NSJSONSerialization dataWithJSONObject:object options:NSJSONWritingPrettyPrinted error:nil];
-            return [[NSString alloc] initWithData:jsonData encoding:NSUTF8StringEncoding];
-        }
+    NSTimeInterval delay = 0;
+    for (NSRRateLimiter *limiter in [self.config rateLimitersForRoute:self.routeTemplate]) {
+        delay = MAX(delay, [limiter reserve]);
     }
-    return nil;
+    return delay;
 }
 
-- (void) logOut:(NSURLRequest *)request
+- (NSTimeInterval) rateLimitHold
 {
-    if (self.config.networkLogging) {
-        NSString *json = [self prettyPrintedJSONFromObject:self.body];
-        NSLog(@"[NSRails][OUT] ===> %@ to %@ %@", self.httpMethod, [request.URL absoluteString], json ?: @"");
+    NSTimeInterval hold = 0;
+    for (NSRRateLimiter *limiter in [self.config rateLimitersForRoute:self.routeTemplate]) {
+        hold = MAX(hold, [limiter remainingHold]);
     }
+    return hold;
 }
 
-- (void) logIn:(id)jsonObj response:(NSHTTPURLResponse *)response error:(NSError *)error
+- (void) afterRateLimitDelay:(NSTimeInterval)delay perform:(void (^)(void))block
 {
-    if (self.config.networkLogging) {
-        NSString *json = [self prettyPrintedJSONFromObject:jsonObj];
-        NSLog(@"[NSRails][IN] <=== Code %d %@", (int)response.statusCode, error ?: json ?: @"");
+    if (delay <= 0)
+    {
+        block();
+        return;
     }
+    
+    //a 429 may come in while this waits, so check for a hold again before going
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^
+    {
+        [self afterRateLimitDelay:[self rateLimitHold] perform:block];
+    });
 }
 
-#pragma mark - NSCoding
-
-- (id) initWithCoder:(NSCoder *)aDecoder
+//returns YES if this was a 429 the limiters were told about (and so is worth retrying)
+- (BOOL) recordRateLimitResponse:(NSHTTPURLResponse *)response
 {
-    if ((self = [self initWithHTTPMethod:[aDecoder decodeObjectForKey:@"httpMethod"]]))
+    NSArray *limiters = [self.config rateLimitersForRoute:self.routeTemplate];
+    if (limiters.count == 0 || !response) {
+        return NO;
+    }
+    
+    if (response.statusCode == 429)
     {
-        _route = [aDecoder decodeObjectForKey:@"route"];
-        self.body = [aDecoder decodeObjectForKey:@"body"];
-        self.config = [aDecoder decodeObjectForKey:@"config"];
-        self.queryParameters = [aDecoder decodeObjectForKey:@"queryParameters"];
-        self.additionalHTTPHeaders = [aDecoder decodeObjectForKey:@"additionalHTTPHeaders"];
+        [limiters[0] throttleWithRetryAfter:[NSRRateLimiter retryAfterFromResponse:response]];
+        return YES;
     }
-    return self;
+    
+    if (response.statusCode < 400) {
+        [limiters makeObjectsPerformSelector:@selector(recordSuccess)];
+    }
+    return NO;
 }
 
-- (void) encodeWithCoder:(NSCoder *)aCoder
+#pragma mark - Endpoints
+
+//nil unless the config has several rootURLs. a retry after a failure goes to another one if it can.
+//trial says whether it's an ejected endpoint's trial request, and goes back in with it
+- (NSREndpoint *) checkOutEndpointAvoiding:(NSREndpoint *)failedEndpoint trial:(BOOL *)trial
 {
-    [aCoder encodeObject:self.route forKey:@"route"];
-    [aCoder encodeObject:self.httpMethod forKey:@"httpMethod"];
-    [aCoder encodeObject:self.body forKey:@"body"];
-    [aCoder encodeObject:self.config forKey:@"config"];
-    [aCoder encodeObject:self.queryParameters forKey:@"queryParameters"];
-    [aCoder encodeObject:self.additionalHTTPHeaders forKey:@"additionalHTTPHeaders"];
+    if (trial) {
+        *trial = NO;
+    }
+    return [[self.config endpointPool] checkOutExcluding:failedEndpoint trial:trial];
 }
 
-#pragma mark - Base64 Helper
-
-+ (NSString *) base64EncodingOfData:(NSData *)data
+//tells the pool how the endpoint did (pass a negative latency if it's not a round trip worth averaging in), and returns
+//YES if the request should be tried again on another endpoint. a cancel leaves the endpoint's health alone, but a deadline
+//running out (a cancel with deadlineError) counts against it like any other timeout
+- (BOOL) checkInEndpoint:(NSREndpoint *)endpoint trial:(BOOL)trial response:(NSHTTPURLResponse *)response error:(NSError *)error latency:(NSTimeInterval)latency
 {
-    static char encodingTable[64] = {
-        'A','B','C','D','E','F','G','H','I','J','K','L','M','N','O','P',
-        'Q','R','S','T','U','V','W','X','Y','Z','a','b','c','d','e','f',
-        'g','h','i','j','k','l','m','n','o','p','q','r','s','t','u','v',
-        'w','x','y','z','0','1','2','3','4','5','6','7','8','9','+','/' };
-
-    const unsigned char *bytes = [data bytes];
-    NSMutableString *result = [NSMutableString stringWithCapacity:[data length]];
-    unsigned long ixtext = 0;
-    unsigned long lentext = [data length];
-    long ctremaining = 0;
-    unsigned char inbuf[3], outbuf[4];
-    unsigned short i = 0;
-    unsigned short charsonline = 0, ctcopy = 0;
-    unsigned long ix = 0;
-    
-    while( YES ) {
-        ctremaining = lentext - ixtext;
-        if( ctremaining <= 0 ) break;
-        
-        for( i = 0; i < 3; i++ ) {
-            ix = ixtext + i;
-            if( ix < lentext ) inbuf[i] = bytes[ix];
-            else inbuf [i] = 0;
-        }
-        
-        outbuf [0] = (inbuf [0] & 0xFC) >> 2;
-        outbuf [1] = ((inbuf [0] & 0x03) << 4) | ((inbuf [1] & 0xF0) >> 4);
-        outbuf [2] = ((inbuf [1] & 0x0F) << 2) | ((inbuf [2] & 0xC0) >> 6);
-        outbuf [3] = inbuf [2] & 0x3F;
-        ctcopy = 4;
+    if (!endpoint) {
+        return NO;
+    }
+    
+    BOOL urlError = [error.domain isEqualToString:NSURLErrorDomain];
+    if (urlError && error.code == NSURLErrorCancelled)
+    {
+        [[self.config endpointPool] checkIn:endpoint trial:trial latency:-1 outcome:NSREndpointAbandoned];
+        return NO;
+    }
+    
+    BOOL failed = (error || response.statusCode >= 500);
+    [[self.config endpointPool] checkIn:endpoint trial:trial latency:(failed ? -1 : latency) outcome:(failed ? NSREndpointFailed : NSREndpointSucceeded)];
+    
+    if (!failed) {
+        return NO;
+    }
+    
+    //never got there, so it's safe to send anywhere else
+    if (urlError && (error.code == NSURLErrorCannotConnectToHost || error.code == NSURLErrorCannotFindHost || error.code == NSURLErrorDNSLookupFailed)) {
+        return YES;
+    }
+    
+    //might have got there - only worth repeating if doing it twice is harmless
+    NSInteger status = response.statusCode;
+    BOOL idempotent = ([self.httpMethod isEqualToString:@"GET"] || [self.httpMethod isEqualToString:@"HEAD"] ||
+                       [self.httpMethod isEqualToString:@"PUT"] || [self.httpMethod isEqualToString:@"DELETE"]);
+    BOOL lost = (urlError && (error.code == NSURLErrorTimedOut || error.code == NSURLErrorNetworkConnectionLost));
+    
+    return (idempotent && (lost || status == 502 || status == 503 || status == 504));
+}
+
+//each endpoint gets one go - 429 retries don't count against it
+- (BOOL) canFailOverAfter:(NSUInteger)failovers
+{
+    return (failovers + 1 < [[self.config endpointPool] URLs].count);
+}
+
+#pragma mark - Sending
+
+//decoding happens wherever the response ends up (usually the main thread), outside any use/end the request was made in -
+//so the request's own config is put back in context for it
+- (id) decodeResponse:(id)response with:(id (^)(id jsonRep))decoder
+{
+    NSRConfig *config = self.config;
+    [config use];
+    
+    NSRMemoryMark memory;
+    BOOL profiling = NSRMemoryPhaseBegin(&memory);
+    @try {
+        return decoder(response);
+    }
+    @finally {
+        NSRMemoryPhaseEnd("decode", profiling, memory);
+        [config end];
+    }
+}
+
+- (id) sendSynchronous:(NSError **)errorOut
+{
+    return [self sendSynchronous:errorOut decodingWith:nil];
+}
+
+- (id) sendSynchronous:(NSError **)errorOut decodingWith:(id (^)(id jsonRep))decoder
+{
+    if (self.deadline && [self timeoutInterval] <= 0)
+    {
+        if (errorOut) {
+            *errorOut = [self deadlineError];
+        }
+        return nil;
+    }
+    
+    uint64_t traceRequest = NSRTraceBegin();
+    
+    NSRRequestMetrics *metrics = [self beginMetrics];
+    NSTimeInterval start = (metrics ? NSRNow() : 0);
+    
+    NSURLRequest *request;
+    NSData *data;
+    NSError *appleError;
+    NSHTTPURLResponse *response;
+    NSTimeInterval queued, sent, received;
+    NSREndpoint *endpoint = nil;
+    BOOL trial = NO;
+    
+    //a failover moves on to another endpoint, while a 429 retry goes back to any of them (the limits aren't per endpoint)
+    NSREndpoint *failedEndpoint = nil;
+    NSUInteger failovers = 0, rateLimitRetries = 0;
+    
+    while (YES)
+    {
+        queued = (metrics ? NSRNow() : 0);
         
-        switch( ctremaining ) {
-            case 1:
-                ctcopy = 2;
-                break;
-            case 2:
-                ctcopy = 3;
-                break;
+        //paced by the config's rate limits, if any - and held back for as long as a 429 asked
+        NSTimeInterval delay = [self rateLimitDelay];
+        while (delay > 0)
+        {
+            [NSThread sleepForTimeInterval:delay];
+            delay = [self rateLimitHold];
         }
         
-        for( i = 0; i < ctcopy; i++ )
-            [result appendFormat:@"%c", encodingTable[outbuf[i]]];
+        if (self.deadline && [self timeoutInterval] <= 0)
+        {
+            if (errorOut) {
+                *errorOut = [self deadlineError];
+            }
+            return nil;
+        }
         
-        for( i = ctcopy; i < 4; i++ )
-            [result appendString:@"="];
+        endpoint = [self checkOutEndpointAvoiding:failedEndpoint trial:&trial];
+        request = [self HTTPRequestToEndpoint:endpoint];
+        appleError = nil;
+        response = nil;
         
-        ixtext += 3;
-        charsonline += 4;
+        [self logOut:request];
+        
+        uint64_t traceNetwork = NSRTraceBegin();
+        sent = ((metrics || endpoint) ? NSRNow() : 0);
+        data = [self sendSynchronousRequest:request returningResponse:&response error:&appleError];
+        received = ((metrics || endpoint) ? NSRNow() : 0);
+        NSRTraceEnd("network", "nsrails", traceNetwork, nil);
+        
+        //the endpoint's down - try another before giving up
+        if ([self checkInEndpoint:endpoint trial:trial response:response error:appleError latency:received - sent] && [self canFailOverAfter:failovers])
+        {
+            [self logIn:data response:response error:(appleError ?: [self serverErrorForResponse:nil statusCode:response.statusCode])];
+            failedEndpoint = endpoint;
+            failovers++;
+            continue;
+        }
+        
+        failedEndpoint = nil;
+        if (![self recordRateLimitResponse:response] || rateLimitRetries >= self.config.maximumRateLimitRetries) {
+            break;
+        }
+        rateLimitRetries++;
+        
+        [self logIn:data response:response error:[self serverErrorForResponse:nil statusCode:response.statusCode]];
+    }
+    
+    uint64_t traceParse = NSRTraceBegin();
+    id jsonResponse = [self responseObjectFromData:data MIMEType:response.MIMEType];
+    NSError *error = [self errorForResponse:jsonResponse existingError:appleError statusCode:response.statusCode bodyStream:request.HTTPBodyStream];
+    NSTimeInterval parsed = (metrics ? NSRNow() : 0);
+    NSRTraceEnd("parse", "nsrails", traceParse, @(data.length));
+    
+    [self logIn:data response:response error:error];
+    
+    if (errorOut) {
+        *errorOut = error;
+    }
+    
+    id result = (error ? nil : jsonResponse);
+    
+    uint64_t traceDecode = NSRTraceBegin();
+    NSTimeInterval decodeStart = (metrics ? NSRNow() : 0);
+    if (result && decoder) {
+        result = [self decodeResponse:result with:decoder];
+    }
+    NSRTraceEnd("decode", "nsrails", traceDecode, nil);
+    
+    if (metrics)
+    {
+        NSTimeInterval end = NSRNow();
+        
+        metrics.bytesSent = NSRBodyLength(request);
+        metrics.bytesReceived = data.length;
+        metrics.statusCode = response.statusCode;
+        metrics.error = error;
+        
+        metrics.queueWaitDuration = sent - queued;
+        metrics.networkDuration = received - sent;
+        metrics.parsingDuration = parsed - received;
+        metrics.decodingDuration = end - decodeStart;
+        metrics.totalDuration = end - start;
+        
+        [self finishMetrics:metrics];
+    }
+    
+    NSRTraceEnd("request", "nsrails", traceRequest, [NSString stringWithFormat:@"%@ %@", self.httpMethod, self.route]);
+    
+    return result;
+}
+
+- (NSRRequestHandle *) sendAsynchronous:(NSRHTTPCompletionBlock)block
+{
+    return [self sendAsynchronous:block decodingWith:nil];
+}
+
+- (NSRRequestHandle *) sendAsynchronous:(NSRHTTPCompletionBlock)block decodingWith:(id (^)(id jsonRep))decoder
+{
+    NSRRequestHandle *handle = [[NSRRequestHandle alloc] initWithRequest:self];
+    [self sendAsynchronous:block decodingWith:decoder handle:handle failovers:0 rateLimitRetries:0 avoiding:nil];
+    [self scheduleDeadlineForHandle:handle];
+    return handle;
+}
+
+//a request that comes back 429, or fails over to another endpoint, is sent again from here with the same handle
+- (void) sendAsynchronous:(NSRHTTPCompletionBlock)block decodingWith:(id (^)(id jsonRep))decoder handle:(NSRRequestHandle *)handle failovers:(NSUInteger)failovers rateLimitRetries:(NSUInteger)rateLimitRetries avoiding:(NSREndpoint *)failedEndpoint
+{
+    //a retry may have been cancelled while it waited
+    NSError *earlyError = [handle cancellationError];
+    if (!earlyError && self.deadline && [self timeoutInterval] <= 0)
+    {
+        //out of time before it even went out
+        earlyError = [self deadlineError];
+        [handle cancelWithError:earlyError];
+    }
+    
+    if (earlyError)
+    {
+        [self performCompletion:^
+         {
+             [handle finish];
+             if (block) {
+                 block(nil, earlyError);
+             }
+         }];
+        return;
+    }
+    
+#if TARGET_OS_IPHONE
+    static int networkActivityRequests = 0;
+    
+    if (self.config.managesNetworkActivityIndicator)
+    {
+        networkActivityRequests++;
+        [[UIApplication sharedApplication] setNetworkActivityIndicatorVisible:YES];
+    }
+#endif
+
+    static NSOperationQueue *asyncOperationQueue;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        asyncOperationQueue = [[NSOperationQueue alloc] init];
+    });
+    
+    //the request and network spans start here and end on other threads, so they're tied together by the request's address
+    const void *traceID = (__bridge const void *)self;
+    NSRTraceAsyncBegin("request", "nsrails", traceID, [NSString stringWithFormat:@"%@ %@", self.httpMethod, self.route]);
+    
+    NSRRequestMetrics *metrics = [self beginMetrics];
+    NSTimeInterval start = (metrics ? NSRNow() : 0);
+    
+    BOOL trial;
+    NSREndpoint *endpoint = [self checkOutEndpointAvoiding:failedEndpoint trial:&trial];
+    NSURLRequest *request = [self HTTPRequestToEndpoint:endpoint];
+    __block NSTimeInterval queued = 0, sent = 0;
+
+    NSRBufferingReceiver *receiver = [[NSRBufferingReceiver alloc] init];
+    if ([self.body isKindOfClass:[NSRMultipartBody class]]) {
+        receiver.uploadBody = self.body;
     }
+    receiver.bodyStream = request.HTTPBodyStream;
+    __weak NSRBufferingReceiver *weakReceiver = receiver;
+    receiver.completionHandler =
+     ^(NSURLResponse *response, NSData *data, NSError *appleError) 
+     {
+         NSTimeInterval received = ((metrics || endpoint) ? NSRNow() : 0);
+         NSTimeInterval responded = weakReceiver.responded;
+         NSRTraceAsyncEnd("network", "nsrails", traceID);
+         
+#if TARGET_OS_IPHONE
+         if (self.config.managesNetworkActivityIndicator)
+         {
+             networkActivityRequests--;
+             if (networkActivityRequests == 0)
+             {
+                 [[UIApplication sharedApplication] setNetworkActivityIndicatorVisible:NO];
+             }
+         }
+#endif
+         //a cancelled request's body (if any of it came in) isn't worth parsing
+         NSError *cancellation = [handle cancellationError];
+         
+         uint64_t traceParse = NSRTraceBegin();
+         id jsonResponse = (cancellation ? nil : [self responseObjectFromData:data MIMEType:response.MIMEType]);
+         NSInteger statusCode = [(NSHTTPURLResponse *)response statusCode];
+         NSError *error = (cancellation ?: [self errorForResponse:jsonResponse existingError:appleError statusCode:statusCode bodyStream:weakReceiver.bodyStream]);
+         NSTimeInterval parsed = (metrics ? NSRNow() : 0);
+         NSRTraceEnd("parse", "nsrails", traceParse, @(data.length));
+         
+         [self logIn:data response:(NSHTTPURLResponse *)response error:error];
+         
+         //the endpoint's down - try another before giving up
+         BOOL failOver = [self checkInEndpoint:endpoint trial:trial response:(NSHTTPURLResponse *)response error:(cancellation ?: appleError) latency:(cancellation ? -1 : received - sent)];
+         if (!cancellation && failOver && [self canFailOverAfter:failovers])
+         {
+             NSRTraceAsyncEnd("request", "nsrails", traceID);
+             [self sendAsynchronous:block decodingWith:decoder handle:handle failovers:failovers + 1 rateLimitRetries:rateLimitRetries avoiding:endpoint];
+             return;
+         }
+         
+         //too many requests - the limiter has slowed down, so go back in line instead of failing
+         if (!cancellation && [self recordRateLimitResponse:(NSHTTPURLResponse *)response] && rateLimitRetries < self.config.maximumRateLimitRetries)
+         {
+             NSRTraceAsyncEnd("request", "nsrails", traceID);
+             [self sendAsynchronous:block decodingWith:decoder handle:handle failovers:failovers rateLimitRetries:rateLimitRetries + 1 avoiding:nil];
+             return;
+         }
+         
+         if (error) {
+             jsonResponse = nil;
+         }
+         
+         if (!block && !decoder && !metrics)
+         {
+             [handle finish];
+             NSRTraceAsyncEnd("request", "nsrails", traceID);
+             return;
+         }
+         
+         NSTimeInterval handedOff = (metrics ? NSRNow() : 0);
+         
+         void (^complete)(void) = ^
+         {
+             NSRTraceAsyncEnd("dispatch", "nsrails", traceID);
+             
+             //cancelled while on its way to this thread - no point decoding
+             NSError *finalError = error;
+             id result = jsonResponse;
+             if (!finalError && [handle cancellationError])
+             {
+                 finalError = [handle cancellationError];
+                 result = nil;
+             }
+             [handle finish];
+             
+             uint64_t traceDecode = NSRTraceBegin();
+             NSTimeInterval decodeStart = (metrics ? NSRNow() : 0);
+             if (result && decoder) {
+                 result = [self decodeResponse:result with:decoder];
+             }
+             NSTimeInterval decoded = (metrics ? NSRNow() : 0);
+             NSRTraceEnd("decode", "nsrails", traceDecode, nil);
+             
+             uint64_t traceCompletion = NSRTraceBegin();
+             if (block) {
+                 block(result, finalError);
+             }
+             NSRTraceEnd("completion", "nsrails", traceCompletion, nil);
+             
+             if (metrics)
+             {
+                 NSTimeInterval end = NSRNow();
+                 
+                 metrics.bytesSent = NSRBodyLength(request);
+                 metrics.bytesReceived = data.length;
+                 metrics.statusCode = statusCode;
+                 metrics.error = finalError;
+                 
+                 metrics.queueWaitDuration = sent - queued;
+                 metrics.networkDuration = received - sent;
+                 metrics.timeToFirstByte = (responded ? responded - sent : 0);
+                 metrics.transferDuration = (responded ? received - responded : 0);
+                 metrics.parsingDuration = parsed - received;
+                 metrics.completionDispatchDuration = decodeStart - handedOff;
+                 metrics.decodingDuration = decoded - decodeStart;
+                 metrics.completionDuration = end - decoded;
+                 metrics.totalDuration = end - start;
+                 
+                 [self finishMetrics:metrics];
+             }
+             
+             NSRTraceAsyncEnd("request", "nsrails", traceID);
+         };
+         
+         NSRTraceAsyncBegin("dispatch", "nsrails", traceID, nil);
+         [self performCompletion:complete];
+     };
+    
+    //the connection keeps the receiver (and so this request) alive until it's done
+    id connection = [self connectionWithRequest:request delegate:receiver];
+    [connection setDelegateQueue:asyncOperationQueue];
+    
+    [handle setCancelHandler:^(NSError *error)
+     {
+         [asyncOperationQueue addOperationWithBlock:^
+          {
+              [connection cancel];
+              [receiver finishWithError:error];
+          }];
+     }];
     
-    return [NSString stringWithString:result];
+    queued = (metrics ? NSRNow() : 0);
+    [self afterRateLimitDelay:[self rateLimitDelay] perform:^
+     {
+         if (handle.isCancelled) {
+             return;
+         }
+         
+         [self logOut:request];
+         sent = ((metrics || endpoint) ? NSRNow() : 0);
+         NSRTraceAsyncBegin("network", "nsrails", traceID, nil);
+         [connection start];
+     }];
+}
+
+- (void) performCompletion:(void (^)(void))completion
+{
+    NSOperationQueue *queue = (self.completionQueue ?: self.config.completionQueue);
+    if (queue) {
+        [queue addOperationWithBlock:completion];
+    }
+    else if (self.config.performsCompletionBlocksOnMainThread && self.config.coalescesCompletionBlocks) {
+        [NSRCompletionBatcher performOnMainThread:completion window:self.config.completionCoalescingWindow];
+    }
+    else if (self.config.performsCompletionBlocksOnMainThread) {
+        dispatch_async(dispatch_get_main_queue(), completion);
+    }
+    else {
+        completion();
+    }
+}
+
+- (NSRRequestHandle *) sendAsynchronousStreamingElements:(void (^)(id element))elementBlock completion:(NSRHTTPCompletionBlock)completionBlock
+{
+    //separate from asyncOperationQueue: delegate callbacks for one connection arrive in order here, and elements are handed off as they're cut out
+    static NSOperationQueue *streamingOperationQueue;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        streamingOperationQueue = [[NSOperationQueue alloc] init];
+    });
+    
+    NSRTraceAsyncBegin("request", "nsrails", (__bridge const void *)self, [NSString stringWithFormat:@"%@ %@ (streaming)", self.httpMethod, self.route]);
+    
+    NSRRequestHandle *handle = [[NSRRequestHandle alloc] initWithRequest:self];
+    
+    NSRStreamingReceiver *receiver = [[NSRStreamingReceiver alloc] init];
+    if ([self.body isKindOfClass:[NSRMultipartBody class]]) {
+        receiver.uploadBody = self.body;
+    }
+    receiver.request = self;
+    receiver.handle = handle;
+    receiver.completionBlock = completionBlock;
+    receiver.metrics = [self beginMetrics];
+    receiver.start = (receiver.metrics ? NSRNow() : 0);
+    
+    //elements are handed off on the streaming queue, outside any use/end the request was made in - like decodeResponse:with:,
+    //the request's config is put back in context for each
+    NSRConfig *config = self.config;
+    void (^configuredElementBlock)(id) = (!elementBlock ? nil : ^(id element)
+    {
+        [config use];
+        @try {
+            elementBlock(element);
+        }
+        @finally {
+            [config end];
+        }
+    });
+    
+    //elements can only be cut out of JSON as it comes in - other codecs get the whole response decoded, then split up
+    if ([self codecIsJSON])
+    {
+        NSJSONReadingOptions options = (self.config.returnsMutableContainers ? NSJSONReadingMutableContainers : 0);
+        receiver.stream = [[NSRJSONElementStream alloc] initWithReadingOptions:options spoolThreshold:self.config.streamingSpoolThreshold elementHandler:configuredElementBlock];
+        receiver.stream.interner = [self stringInterner];
+    }
+    else
+    {
+        receiver.elementHandler = configuredElementBlock;
+    }
+    
+    BOOL trial;
+    receiver.endpoint = [self checkOutEndpointAvoiding:nil trial:&trial];
+    receiver.endpointIsTrial = trial;
+    NSURLRequest *request = [self HTTPRequestToEndpoint:receiver.endpoint];
+    receiver.bytesSent = NSRBodyLength(request);
+    receiver.bodyStream = request.HTTPBodyStream;
+    
+    //the connection keeps the receiver (and so this request) alive until it's done
+    id connection = [self connectionWithRequest:request delegate:receiver];
+    [connection setDelegateQueue:streamingOperationQueue];
+    
+    [handle setCancelHandler:^(NSError *error)
+     {
+         [streamingOperationQueue addOperationWithBlock:^
+          {
+              [connection cancel];
+              [receiver finishWithError:error];
+          }];
+     }];
+    [self scheduleDeadlineForHandle:handle];
+    
+    if (self.deadline && [self timeoutInterval] <= 0)
+    {
+        //out of time before it even went out
+        [handle cancelWithError:[self deadlineError]];
+        return handle;
+    }
+    
+    //paced like sendAsynchronous:, but a 429 only slows the limiter down - the elements block may have already seen part of a response, so it isn't retried
+    //(or failed over to another endpoint)
+    receiver.queued = (receiver.metrics ? NSRNow() : 0);
+    [self afterRateLimitDelay:[self rateLimitDelay] perform:^
+     {
+         if (handle.isCancelled) {
+             return;
+         }
+         
+         [self logOut:request];
+         receiver.sent = ((receiver.metrics || receiver.endpoint) ? NSRNow() : 0);
+         [connection start];
+     }];
+    return handle;
+}
+
+#pragma mark - Transport
+
+//where requests hand off to the network - unless the config has a cassette, which records or replays them instead
+
+- (NSData *) sendSynchronousRequest:(NSURLRequest *)request returningResponse:(NSHTTPURLResponse **)response error:(NSError **)error
+{
+    NSURLResponse *urlResponse = nil;
+    NSRCassette *cassette = self.config.cassette;
+    
+    //a recording cassette reads its own copy of a streamed body to keep
+    NSRMultipartBody *uploadBody = ([self.body isKindOfClass:[NSRMultipartBody class]] ? self.body : nil);
+    
+    NSData *data = (cassette ? [cassette sendSynchronousRequest:request uploadBody:uploadBody returningResponse:&urlResponse error:error] :
+                               [NSURLConnection sendSynchronousRequest:request returningResponse:&urlResponse error:error]);
+    
+    if (response) {
+        *response = (NSHTTPURLResponse *)urlResponse;
+    }
+    return data;
+}
+
+- (id) connectionWithRequest:(NSURLRequest *)request delegate:(id<NSURLConnectionDataDelegate>)delegate
+{
+    NSRCassette *cassette = self.config.cassette;
+    if (cassette) {
+        return [cassette connectionWithRequest:request uploadBody:([self.body isKindOfClass:[NSRMultipartBody class]] ? self.body : nil) delegate:delegate];
+    }
+    return [[NSURLConnection alloc] initWithRequest:request delegate:delegate startImmediately:NO];
+}
+
+#pragma mark - Metrics
+
+//nil unless someone's listening - in which case the send methods above skip all their timing
+- (NSRRequestMetrics *) beginMetrics
+{
+    if (!self.config.collectsRequestMetrics && !self.config.metricsObserver) {
+        return nil;
+    }
+    
+    NSRRequestMetrics *metrics = [[NSRRequestMetrics alloc] init];
+    metrics.httpMethod = self.httpMethod;
+    metrics.routeTemplate = self.routeTemplate;
+    metrics.routingDuration = self.routingDuration;
+    
+    //the peak so far - finishMetrics turns it into how much this request raised it
+    if (NSRMemoryProfilingActive) {
+        metrics.peakResidentBytes = NSRMemoryPeakResidentBytes();
+    }
+    return metrics;
+}
+
+- (void) finishMetrics:(NSRRequestMetrics *)metrics
+{
+    metrics.encodingDuration = self.bodyEncodingDuration + self.serializingDuration;
+    
+    if (metrics.peakResidentBytes > 0)
+    {
+        long long peak = NSRMemoryPeakResidentBytes();
+        metrics.peakResidentGrowth = peak - metrics.peakResidentBytes;
+        metrics.peakResidentBytes = peak;
+    }
+    _metrics = metrics;
+    
+    if (self.config.collectsRequestMetrics) {
+        [self.config recordRequestMetrics:metrics];
+    }
+    [self.config.metricsObserver request:self didFinishWithMetrics:metrics];
+}
+
+#pragma mark - Logging
+
+//the cheap checks (level, sampling) happen here on the request path; everything else is deferred to NSRNetworkLog's consumer
+
+- (NSRNetworkLogEvent *) logEventIncludingBody:(NSData *)body contentType:(NSString *)contentType
+{
+    NSRNetworkLogEvent *event = [[NSRNetworkLogEvent alloc] init];
+    event.handler = self.config.networkLogHandler;
+    if (self.config.networkLogLevel >= NSRNetworkLogLevelBody)
+    {
+        event.body = body;
+        event.maxBodyBytes = self.config.networkLogMaxBodyBytes;
+        
+        if (![self codecIsJSON] && [contentType isEqualToString:[self.config.codec contentType]]) {
+            event.codec = self.config.codec;
+        }
+    }
+    return event;
+}
+
+- (void) logOut:(NSURLRequest *)request
+{
+    NSRNetworkLogLevel level = self.config.networkLogLevel;
+    if (level == NSRNetworkLogLevelNone) {
+        return;
+    }
+    
+    float sampleRate = self.config.networkLogSampleRate;
+    self.logSampled = (sampleRate >= 1.0f || (sampleRate > 0.0f && arc4random_uniform(1 << 24) < sampleRate * (1 << 24)));
+    
+    if (level >= NSRNetworkLogLevelInfo && self.logSampled)
+    {
+        NSRNetworkLogEvent *event = [self logEventIncludingBody:request.HTTPBody contentType:[request valueForHTTPHeaderField:@"Content-Type"]];
+        event.outgoing = YES;
+        event.httpMethod = self.httpMethod;
+        event.URL = request.URL;
+        [NSRNetworkLog enqueueEvent:event];
+    }
+}
+
+- (void) logIn:(NSData *)data response:(NSHTTPURLResponse *)response error:(NSError *)error
+{
+    NSRNetworkLogLevel level = self.config.networkLogLevel;
+    if (level == NSRNetworkLogLevelNone) {
+        return;
+    }
+    
+    //errors are always logged if the level allows for it, sampled or not
+    BOOL shouldLog = (error ? (level >= NSRNetworkLogLevelError) : (level >= NSRNetworkLogLevelInfo && self.logSampled));
+    
+    if (shouldLog)
+    {
+        NSRNetworkLogEvent *event = [self logEventIncludingBody:data contentType:response.MIMEType];
+        event.statusCode = response.statusCode;
+        event.error = error;
+        [NSRNetworkLog enqueueEvent:event];
+    }
+}
+
+#pragma mark - NSCoding
+
+- (id) initWithCoder:(NSCoder *)aDecoder
+{
+    if ((self = [self initWithHTTPMethod:[aDecoder decodeObjectForKey:@"httpMethod"]]))
+    {
+        _route = [aDecoder decodeObjectForKey:@"route"];
+        _routeTemplate = [aDecoder decodeObjectForKey:@"routeTemplate"];
+        self.body = [aDecoder decodeObjectForKey:@"body"];
+        self.config = [aDecoder decodeObjectForKey:@"config"];
+        self.queryParameters = [aDecoder decodeObjectForKey:@"queryParameters"];
+        self.additionalHTTPHeaders = [aDecoder decodeObjectForKey:@"additionalHTTPHeaders"];
+        self.deadline = [aDecoder decodeObjectForKey:@"deadline"];
+    }
+    return self;
+}
+
+- (void) encodeWithCoder:(NSCoder *)aCoder
+{
+    [aCoder encodeObject:self.route forKey:@"route"];
+    [aCoder encodeObject:self.routeTemplate forKey:@"routeTemplate"];
+    [aCoder encodeObject:self.httpMethod forKey:@"httpMethod"];
+    [aCoder encodeObject:self.body forKey:@"body"];
+    [aCoder encodeObject:self.config forKey:@"config"];
+    [aCoder encodeObject:self.queryParameters forKey:@"queryParameters"];
+    [aCoder encodeObject:self.additionalHTTPHeaders forKey:@"additionalHTTPHeaders"];
+    [aCoder encodeObject:self.deadline forKey:@"deadline"];
+}
+
+#pragma mark - Base64 Helper
+
+static const char NSRBase64EncodingTable[64] = {
+    'A','B','C','D','E','F','G','H','I','J','K','L','M','N','O','P',
+    'Q','R','S','T','U','V','W','X','Y','Z','a','b','c','d','e','f',
+    'g','h','i','j','k','l','m','n','o','p','q','r','s','t','u','v',
+    'w','x','y','z','0','1','2','3','4','5','6','7','8','9','+','/' };
+
++ (NSString *) base64EncodingOfData:(NSData *)data
+{
+    NSUInteger length = data.length;
+    if (length == 0) {
+        return @"";
+    }
+    
+    //every 3 bytes in becomes 4 chars out (last group padded with '='), so the output size is known up front
+    NSUInteger outLength = ((length + 2) / 3) * 4;
+    char *output = malloc(outLength);
+    if (!output) {
+        return nil;
+    }
+    
+    const unsigned char *bytes = data.bytes;
+    char *out = output;
+    NSUInteger i = 0;
+    
+    for (; i + 2 < length; i += 3)
+    {
+        uint32_t triple = ((uint32_t)bytes[i] << 16) | ((uint32_t)bytes[i+1] << 8) | bytes[i+2];
+        *out++ = NSRBase64EncodingTable[(triple >> 18) & 0x3F];
+        *out++ = NSRBase64EncodingTable[(triple >> 12) & 0x3F];
+        *out++ = NSRBase64EncodingTable[(triple >> 6) & 0x3F];
+        *out++ = NSRBase64EncodingTable[triple & 0x3F];
+    }
+    
+    NSUInteger remaining = length - i;
+    if (remaining > 0)
+    {
+        uint32_t triple = (uint32_t)bytes[i] << 16;
+        if (remaining == 2) {
+            triple |= (uint32_t)bytes[i+1] << 8;
+        }
+        
+        *out++ = NSRBase64EncodingTable[(triple >> 18) & 0x3F];
+        *out++ = NSRBase64EncodingTable[(triple >> 12) & 0x3F];
+        *out++ = (remaining == 2 ? NSRBase64EncodingTable[(triple >> 6) & 0x3F] : '=');
+        *out++ = '=';
+    }
+    
+    return [[NSString alloc] initWithBytesNoCopy:output length:outLength encoding:NSASCIIStringEncoding freeWhenDone:YES];
+}
+
++ (NSData *) dataByDecodingBase64String:(NSString *)string
+{
+    //0xFF marks characters that aren't part of the alphabet
+    static unsigned char decodingTable[256];
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        memset(decodingTable, 0xFF, sizeof(decodingTable));
+        for (unsigned char i = 0; i < 64; i++) {
+            decodingTable[(unsigned char)NSRBase64EncodingTable[i]] = i;
+        }
+    });
+    
+    NSData *ascii = [string dataUsingEncoding:NSASCIIStringEncoding];
+    if (!ascii) {
+        return nil;
+    }
+    
+    const unsigned char *chars = ascii.bytes;
+    NSUInteger length = ascii.length;
+    
+    unsigned char *output = malloc((length / 4 + 1) * 3);
+    if (!output) {
+        return nil;
+    }
+    
+    NSUInteger outLength = 0;
+    uint32_t accumulator = 0;
+    int bits = 0;
+    BOOL padded = NO;
+    
+    for (NSUInteger i = 0; i < length; i++)
+    {
+        unsigned char c = chars[i];
+        if (c == '\r' || c == '\n' || c == ' ' || c == '\t') {
+            continue;
+        }
+        if (c == '=') {
+            padded = YES;
+            continue;
+        }
+        
+        unsigned char value = decodingTable[c];
+        if (value == 0xFF || padded)
+        {
+            //invalid character, or data after padding
+            free(output);
+            return nil;
+        }
+        
+        accumulator = (accumulator << 6) | value;
+        bits += 6;
+        if (bits >= 8)
+        {
+            bits -= 8;
+            output[outLength++] = (accumulator >> bits) & 0xFF;
+        }
+    }
+    
+    //a single character left over can't make a byte, and the bits left after the last byte are always zero from a real
+    //encoder - either way the string was cut short or isn't Base64
+    if (bits >= 6 || (accumulator & ((1u << bits) - 1)) != 0)
+    {
+        free(output);
+        return nil;
+    }
+    
+    return [NSData dataWithBytesNoCopy:output length:outLength freeWhenDone:YES];
+}
+
+@end
+
+@implementation NSRStreamingReceiver
+
+- (NSInputStream *) connection:(NSURLConnection *)connection needNewBodyStream:(NSURLRequest *)request
+{
+    self.bodyStream = [self.uploadBody inputStream];
+    return self.bodyStream;
+}
+
+- (void) connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response
+{
+    self.response = (NSHTTPURLResponse *)response;
+    self.responded = (self.metrics ? NSRNow() : 0);
+    
+    //error bodies are small, and errorForResponse: wants the whole thing
+    //without a stream (the codec isn't JSON), the body is buffered and split into elements once it's all in
+    if (self.response.statusCode >= 400 || !self.stream)
+    {
+        self.bufferedBody = [NSMutableData data];
+        self.stream = nil;
+    }
+}
+
+- (void) connection:(NSURLConnection *)connection didReceiveData:(NSData *)data
+{
+    //cancelled while this was on its way in - don't hand off any more elements
+    if (self.handle.isCancelled) {
+        return;
+    }
+    
+    if (self.bufferedBody)
+    {
+        [self.bufferedBody appendData:data];
+        return;
+    }
+    
+    NSError *error = nil;
+    if (![self.stream appendData:data error:&error])
+    {
+        [connection cancel];
+        self.streamError = error;
+        [self finishWithError:nil];
+    }
+}
+
+- (void) connectionDidFinishLoading:(NSURLConnection *)connection
+{
+    [self finishWithError:nil];
+}
+
+- (void) connection:(NSURLConnection *)connection didFailWithError:(NSError *)error
+{
+    [self finishWithError:error];
+}
+
+- (void) finishWithError:(NSError *)connectionError
+{
+    //a cancel can race the connection's own finish
+    @synchronized(self)
+    {
+        if (self.finished) {
+            return;
+        }
+        self.finished = YES;
+    }
+    
+    NSRRequest *request = self.request;
+    NSRRequestMetrics *metrics = self.metrics;
+    NSTimeInterval received = ((metrics || self.endpoint) ? NSRNow() : 0);
+    
+    NSRTraceAsyncEnd("request", "nsrails", (__bridge const void *)request);
+    
+    NSRRequestHandle *handle = self.handle;
+    NSError *cancellation = [handle cancellationError];
+    
+    [request checkInEndpoint:self.endpoint trial:self.endpointIsTrial response:self.response error:(cancellation ?: connectionError) latency:(cancellation || !self.sent ? -1 : received - self.sent)];
+    
+    //a response can end cleanly and still be missing the end of the array
+    NSError *truncation = nil;
+    if (!cancellation && !connectionError && !self.streamError && !self.bufferedBody && ![self.stream finishWithError:&truncation]) {
+        self.streamError = truncation;
+    }
+    
+    //only the parts that weren't streamed get logged - a streamed array is never held in one piece
+    //if cancelled, whatever came in is dropped unparsed
+    NSData *body = (cancellation ? nil : (self.bufferedBody ?: [self.stream finishDocument]));
+    
+    id jsonResponse = [request responseObjectFromData:body MIMEType:self.response.MIMEType];
+    if (!cancellation) {
+        [request recordRateLimitResponse:self.response];
+    }
+    NSError *error = (cancellation ?: self.streamError);
+    if (!error) {
+        error = [request errorForResponse:jsonResponse existingError:connectionError statusCode:self.response.statusCode bodyStream:self.bodyStream];
+    }
+    
+    if (!error && self.elementHandler && [jsonResponse isKindOfClass:[NSArray class]])
+    {
+        for (id element in jsonResponse)
+        {
+            if (handle.isCancelled) {
+                break;
+            }
+            self.elementHandler(element);
+        }
+        jsonResponse = nil;
+    }
+    NSTimeInterval parsed = (metrics ? NSRNow() : 0);
+    
+    [request logIn:body response:self.response error:error];
+    
+    if (error) {
+        jsonResponse = nil;
+    }
+    
+    if (metrics)
+    {
+        metrics.bytesSent = self.bytesSent;
+        metrics.bytesReceived = (self.bufferedBody ? self.bufferedBody.length : (NSUInteger)self.stream.byteCount);
+        metrics.statusCode = self.response.statusCode;
+        metrics.error = error;
+        metrics.queueWaitDuration = (self.sent ? self.sent - self.queued : 0);
+        metrics.networkDuration = received - self.sent;
+        metrics.timeToFirstByte = (self.responded ? self.responded - self.sent : 0);
+        metrics.transferDuration = (self.responded ? received - self.responded : 0);
+        metrics.parsingDuration = parsed - received;
+    }
+    
+    NSRHTTPCompletionBlock completionBlock = self.completionBlock;
+    NSTimeInterval start = self.start;
+    
+    [request performCompletion:^
+     {
+         NSTimeInterval dispatched = (metrics ? NSRNow() : 0);
+         
+         [handle finish];
+         if (completionBlock) {
+             completionBlock(jsonResponse, error);
+         }
+         
+         if (metrics)
+         {
+             NSTimeInterval end = NSRNow();
+             metrics.completionDispatchDuration = dispatched - parsed;
+             metrics.completionDuration = end - dispatched;
+             metrics.totalDuration = end - start;
+             [request finishMetrics:metrics];
+         }
+     }];
+    
+    //break the receiver -> request link now that the connection's done with us
+    self.request = nil;
+    self.handle = nil;
+    self.completionBlock = nil;
+    self.stream = nil;
+}
+
+@end
+
+@implementation NSRBufferingReceiver
+
+//a redirect or auth challenge partway through an upload - the body has to start over
+- (NSInputStream *) connection:(NSURLConnection *)connection needNewBodyStream:(NSURLRequest *)request
+{
+    self.bodyStream = [self.uploadBody inputStream];
+    return self.bodyStream;
+}
+
+- (void) connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response
+{
+    self.response = response;
+    self.responded = NSRNow();
+    
+    long long expected = response.expectedContentLength;
+    self.data = [NSMutableData dataWithCapacity:(expected > 0 ? (NSUInteger)MIN(expected, 1024 * 1024) : 0)];
+}
+
+- (void) connection:(NSURLConnection *)connection didReceiveData:(NSData *)data
+{
+    [self.data appendData:data];
+}
+
+- (void) connectionDidFinishLoading:(NSURLConnection *)connection
+{
+    [self finishWithError:nil];
+}
+
+- (void) connection:(NSURLConnection *)connection didFailWithError:(NSError *)error
+{
+    [self finishWithError:error];
+}
+
+- (void) finishWithError:(NSError *)error
+{
+    void (^handler)(NSURLResponse *, NSData *, NSError *);
+    
+    //whichever of the connection finishing and a cancel gets here first wins
+    @synchronized(self)
+    {
+        handler = self.completionHandler;
+        self.completionHandler = nil;
+    }
+    
+    if (handler) {
+        handler(self.response, (error ? nil : self.data), error);
+    }
 }
 
 @end
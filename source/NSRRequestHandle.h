@@ -0,0 +1,80 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRRequestHandle.h
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import <Foundation/Foundation.h>
+
+@class NSRRequest;
+
+/**
+ A handle on an asynchronous request, returned by <NSRRequest>'s `sendAsynchronous` methods and NSRRemoteObject's `async` methods.
+ 
+ Keep it around if you might not need the result after all - when its screen is dismissed, for instance:
+ 
+    self.fetch = [Post remoteAllAsync:^(NSArray *allRemote, NSError *error) {
+        if (error.code == NSURLErrorCancelled) {
+            return;
+        }
+        ...
+    }];
+ 
+    - (void) viewWillDisappear:(BOOL)animated
+    {
+        [self.fetch cancel];
+    }
+ 
+ Ignoring it is fine too - the request doesn't need the handle to stay alive.
+ */
+@interface NSRRequestHandle : NSObject
+
+/**
+ The request this is a handle on. (read-only)
+ */
+@property (nonatomic, strong, readonly) NSRRequest *request;
+
+/**
+ Whether or not the request was cancelled (by <cancel> or its <NSRRequest deadline>) before it finished. (read-only)
+ */
+@property (readonly, getter = isCancelled) BOOL cancelled;
+
+/**
+ Whether or not the request has finished, either normally or by being cancelled. (read-only)
+ */
+@property (readonly, getter = isFinished) BOOL finished;
+
+/**
+ Cancels the request.
+ 
+ Stops the transfer if it's still going, and skips parsing the response and decoding any objects from it. The completion block is still called (in the usual thread), with `nil` and an error in `NSURLErrorDomain` with code `NSURLErrorCancelled`.
+ 
+ Does nothing if the request has already finished. Safe to call from any thread.
+ */
+- (void) cancel;
+
+@end
@@ -0,0 +1,127 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRRequestHandle.m
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import "NSRRequestHandle.h"
+
+@interface NSRRequestHandle ()
+
+@property (nonatomic, strong) NSError *cancellationError;
+@property (nonatomic, copy) void (^cancelHandler)(NSError *error);
+
+@end
+
+@implementation NSRRequestHandle
+@synthesize cancelled=_cancelled, finished=_finished;
+
+- (id) initWithRequest:(NSRRequest *)request
+{
+    if ((self = [super init]))
+    {
+        _request = request;
+    }
+    return self;
+}
+
+- (BOOL) isCancelled
+{
+    @synchronized(self) {
+        return _cancelled;
+    }
+}
+
+- (BOOL) isFinished
+{
+    @synchronized(self) {
+        return _finished;
+    }
+}
+
+- (NSError *) cancellationError
+{
+    @synchronized(self) {
+        return _cancellationError;
+    }
+}
+
+- (void) cancel
+{
+    [self cancelWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:@{NSLocalizedDescriptionKey:@"The request was cancelled."}]];
+}
+
+- (BOOL) cancelWithError:(NSError *)error
+{
+    void (^handler)(NSError *);
+    
+    @synchronized(self)
+    {
+        if (_finished || _cancelled) {
+            return NO;
+        }
+        
+        _cancelled = YES;
+        _cancellationError = error;
+        handler = self.cancelHandler;
+    }
+    
+    //outside the lock - the handler ends up calling -finish
+    if (handler) {
+        handler(error);
+    }
+    return YES;
+}
+
+- (void) setCancelHandler:(void (^)(NSError *))cancelHandler
+{
+    NSError *error;
+    
+    @synchronized(self)
+    {
+        _cancelHandler = [cancelHandler copy];
+        error = (_finished ? nil : _cancellationError);
+    }
+    
+    //cancelled while the handler was being swapped (a request going back in line after a 429) - the new one still has to run
+    if (error && cancelHandler) {
+        cancelHandler(error);
+    }
+}
+
+- (void) finish
+{
+    @synchronized(self)
+    {
+        _finished = YES;
+        
+        //the handler usually holds the connection, which holds whatever's waiting on it
+        _cancelHandler = nil;
+    }
+}
+
+@end
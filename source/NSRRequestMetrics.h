@@ -0,0 +1,225 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRRequestMetrics.h
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import <Foundation/Foundation.h>
+
+@class NSRRequest;
+
+/**
+ Timings, byte counts and outcome of a single request, from the moment it started being routed to the moment its completion block returned.
+ 
+ Delivered to an NSRConfig's <NSRConfig metricsObserver>, and rolled up into <NSRRouteMetrics> when <NSRConfig collectsRequestMetrics> is on.
+ 
+ Durations are in seconds, measured with a monotonic clock. A phase that didn't happen for a request (no body to encode, a synchronous request that never hopped threads) is `0`.
+ 
+ `NSURLConnection` doesn't report DNS or connect times separately, so these are part of <timeToFirstByte>.
+ */
+@interface NSRRequestMetrics : NSObject
+
+/**
+ The request's HTTP method.
+ */
+@property (nonatomic, strong) NSString *httpMethod;
+
+/**
+ The request's <NSRRequest routeTemplate>, which is what per-route metrics are grouped by.
+ */
+@property (nonatomic, strong) NSString *routeTemplate;
+
+/**
+ HTTP status code of the response, or `0` if none was received.
+ */
+@property (nonatomic) NSInteger statusCode;
+
+/**
+ The error the request finished with, if any.
+ */
+@property (nonatomic, strong) NSError *error;
+
+/**
+ Size of the HTTP body sent.
+ */
+@property (nonatomic) NSUInteger bytesSent;
+
+/**
+ Size of the HTTP body received.
+ */
+@property (nonatomic) NSUInteger bytesReceived;
+
+/**
+ Time spent building the route (including any prefix objects).
+ */
+@property (nonatomic) NSTimeInterval routingDuration;
+
+/**
+ Time spent turning the body into JSON - both the object into a dictionary (<NSRRequest setBodyToObject:>) and the dictionary into bytes.
+ */
+@property (nonatomic) NSTimeInterval encodingDuration;
+
+/**
+ Time between the request being queued to go out and it actually going out - held back by <NSRConfig requestsPerSecond> or a 429's `Retry-After`.
+ */
+@property (nonatomic) NSTimeInterval queueWaitDuration;
+
+/**
+ Time from handing the request to `NSURLConnection` to having the whole response.
+ 
+ Made up of <timeToFirstByte> and <transferDuration> for asynchronous requests.
+ */
+@property (nonatomic) NSTimeInterval networkDuration;
+
+/**
+ Time from handing the request to `NSURLConnection` to the response's status and headers coming in - DNS, connecting, sending the body and the server's own time.
+ 
+ Only recorded for asynchronous requests (synchronous `NSURLConnection` doesn't say when the headers arrived), `0` otherwise.
+ */
+@property (nonatomic) NSTimeInterval timeToFirstByte;
+
+/**
+ Time from the response's headers coming in to having the whole body.
+ 
+ Only recorded for asynchronous requests, `0` otherwise.
+ */
+@property (nonatomic) NSTimeInterval transferDuration;
+
+/**
+ Time spent parsing the response bytes.
+ */
+@property (nonatomic) NSTimeInterval parsingDuration;
+
+/**
+ Time spent turning the parsed response into NSRRemoteObjects (for `remoteX` methods that do so).
+ */
+@property (nonatomic) NSTimeInterval decodingDuration;
+
+/**
+ Time spent waiting for the main queue when <NSRConfig performsCompletionBlocksOnMainThread> is on (including any <NSRConfig completionCoalescingWindow>), or for the <NSRConfig completionQueue>.
+ */
+@property (nonatomic) NSTimeInterval completionDispatchDuration;
+
+/**
+ Time spent in the completion block (for asynchronous requests).
+ */
+@property (nonatomic) NSTimeInterval completionDuration;
+
+/**
+ Time from the request being sent to its completion block returning (routing not included).
+ */
+@property (nonatomic) NSTimeInterval totalDuration;
+
+/**
+ The process' peak resident size once the request had finished, in bytes.
+ 
+ Only recorded while <NSRMemoryProfiler> is profiling, `0` otherwise.
+ */
+@property (nonatomic) long long peakResidentBytes;
+
+/**
+ How much the process' peak resident size went up while the request was running (`0` if it didn't set a new high-water mark, or isn't being profiled).
+ 
+ Concurrent requests can each be blamed for the same rise.
+ */
+@property (nonatomic) long long peakResidentGrowth;
+
+@end
+
+/**
+ Aggregate counters and latency histogram for one HTTP method + route template, as returned by <NSRConfig requestMetricsByRoute>.
+ 
+ Latencies are <NSRRequestMetrics totalDuration>, bucketed with roughly 6% resolution.
+ */
+@interface NSRRouteMetrics : NSObject <NSCopying>
+
+/**
+ Number of requests recorded.
+ */
+@property (nonatomic, readonly) NSUInteger requestCount;
+
+/**
+ Number of requests that finished with an error.
+ */
+@property (nonatomic, readonly) NSUInteger failureCount;
+
+/**
+ Total HTTP body bytes sent.
+ */
+@property (nonatomic, readonly) unsigned long long bytesSent;
+
+/**
+ Total HTTP body bytes received.
+ */
+@property (nonatomic, readonly) unsigned long long bytesReceived;
+
+/**
+ Mean latency.
+ */
+@property (nonatomic, readonly) NSTimeInterval meanLatency;
+
+/**
+ Median latency.
+ */
+@property (nonatomic, readonly) NSTimeInterval p50;
+
+/**
+ 95th percentile latency.
+ */
+@property (nonatomic, readonly) NSTimeInterval p95;
+
+/**
+ 99th percentile latency.
+ */
+@property (nonatomic, readonly) NSTimeInterval p99;
+
+/**
+ Latency at any percentile.
+ 
+ @param percentile From `0` to `100`.
+ @return Latency in seconds, or `0` if nothing has been recorded.
+ */
+- (NSTimeInterval) latencyAtPercentile:(double)percentile;
+
+@end
+
+/**
+ Implement this protocol and set it as an NSRConfig's <NSRConfig metricsObserver> to receive metrics for each request made with that config.
+ */
+@protocol NSRRequestMetricsObserver <NSObject>
+
+/**
+ Called once a request has finished, after its completion block (if any) has returned.
+ 
+ Called on the thread the completion block ran on (or the thread that called <NSRRequest sendSynchronous:>), so keep it cheap.
+ 
+ @param request The request that finished.
+ @param metrics Its metrics.
+ */
+- (void) request:(NSRRequest *)request didFinishWithMetrics:(NSRRequestMetrics *)metrics;
+
+@end
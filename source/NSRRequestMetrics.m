@@ -0,0 +1,163 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRRequestMetrics.m
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import "NSRRequestMetrics.h"
+
+@implementation NSRRequestMetrics
+
+- (NSString *) description
+{
+    return [NSString stringWithFormat:@"<%@ %@ %@: %d in %.1fms (route %.2fms, encode %.2fms, queue %.1fms, network %.1fms (first byte %.1fms, transfer %.1fms), parse %.2fms, decode %.2fms, dispatch %.2fms), %lu bytes out, %lu in>",
+            NSStringFromClass([self class]), self.httpMethod, self.routeTemplate, (int)self.statusCode, self.totalDuration * 1000,
+            self.routingDuration * 1000, self.encodingDuration * 1000, self.queueWaitDuration * 1000,
+            self.networkDuration * 1000, self.timeToFirstByte * 1000, self.transferDuration * 1000, self.parsingDuration * 1000,
+            self.decodingDuration * 1000, self.completionDispatchDuration * 1000,
+            (unsigned long)self.bytesSent, (unsigned long)self.bytesReceived];
+}
+
+@end
+
+//latency histogram, in microseconds: values under 8 get their own bucket, and every power of two above that is split into 8 linear sub-buckets
+//(so a bucket is never wider than 1/8 of its lower bound). 40 octaves covers well past any timeout
+#define NSRHistogramSubBuckets  8
+#define NSRHistogramOctaves     40
+#define NSRHistogramBucketCount (NSRHistogramSubBuckets + (NSRHistogramOctaves - 3) * NSRHistogramSubBuckets)
+
+static NSUInteger NSRHistogramBucketForValue(uint64_t value)
+{
+    if (value < NSRHistogramSubBuckets) {
+        return (NSUInteger)value;
+    }
+    
+    int octave = 63 - __builtin_clzll(value);
+    if (octave >= NSRHistogramOctaves) {
+        return NSRHistogramBucketCount - 1;
+    }
+    
+    NSUInteger sub = (NSUInteger)(value >> (octave - 3)) & (NSRHistogramSubBuckets - 1);
+    return NSRHistogramSubBuckets + (octave - 3) * NSRHistogramSubBuckets + sub;
+}
+
+static double NSRHistogramMidpointOfBucket(NSUInteger bucket)
+{
+    if (bucket < NSRHistogramSubBuckets) {
+        return bucket;
+    }
+    
+    NSUInteger octave = (bucket - NSRHistogramSubBuckets) / NSRHistogramSubBuckets + 3;
+    NSUInteger sub = (bucket - NSRHistogramSubBuckets) % NSRHistogramSubBuckets;
+    
+    double lower = (double)((NSRHistogramSubBuckets + sub) << (octave - 3));
+    double width = (double)(1ULL << (octave - 3));
+    return lower + width / 2;
+}
+
+@implementation NSRRouteMetrics
+{
+    uint32_t histogram[NSRHistogramBucketCount];
+    NSTimeInterval totalLatency;
+}
+
+- (void) recordMetrics:(NSRRequestMetrics *)metrics
+{
+    _requestCount++;
+    if (metrics.error) {
+        _failureCount++;
+    }
+    _bytesSent += metrics.bytesSent;
+    _bytesReceived += metrics.bytesReceived;
+    
+    NSTimeInterval latency = MAX(metrics.totalDuration, 0);
+    totalLatency += latency;
+    histogram[NSRHistogramBucketForValue((uint64_t)(latency * 1e6))]++;
+}
+
+- (NSTimeInterval) meanLatency
+{
+    return (_requestCount > 0 ? totalLatency / _requestCount : 0);
+}
+
+- (NSTimeInterval) latencyAtPercentile:(double)percentile
+{
+    if (_requestCount == 0) {
+        return 0;
+    }
+    
+    //rank of the value we want, 1-based (nearest-rank method)
+    uint64_t rank = (uint64_t)ceil(MIN(MAX(percentile, 0), 100) / 100.0 * _requestCount);
+    rank = MAX(rank, 1);
+    
+    uint64_t seen = 0;
+    for (NSUInteger i = 0; i < NSRHistogramBucketCount; i++)
+    {
+        seen += histogram[i];
+        if (seen >= rank) {
+            return NSRHistogramMidpointOfBucket(i) / 1e6;
+        }
+    }
+    
+    return NSRHistogramMidpointOfBucket(NSRHistogramBucketCount - 1) / 1e6;
+}
+
+- (NSTimeInterval) p50
+{
+    return [self latencyAtPercentile:50];
+}
+
+- (NSTimeInterval) p95
+{
+    return [self latencyAtPercentile:95];
+}
+
+- (NSTimeInterval) p99
+{
+    return [self latencyAtPercentile:99];
+}
+
+- (id) copyWithZone:(NSZone *)zone
+{
+    NSRRouteMetrics *copy = [[[self class] allocWithZone:zone] init];
+    copy->_requestCount = _requestCount;
+    copy->_failureCount = _failureCount;
+    copy->_bytesSent = _bytesSent;
+    copy->_bytesReceived = _bytesReceived;
+    copy->totalLatency = totalLatency;
+    memcpy(copy->histogram, histogram, sizeof(histogram));
+    return copy;
+}
+
+- (NSString *) description
+{
+    return [NSString stringWithFormat:@"<%@ %lu requests (%lu failed), p50 %.1fms, p95 %.1fms, p99 %.1fms>",
+            NSStringFromClass([self class]), (unsigned long)self.requestCount, (unsigned long)self.failureCount,
+            self.p50 * 1000, self.p95 * 1000, self.p99 * 1000];
+}
+
+@end
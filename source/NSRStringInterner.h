@@ -0,0 +1,55 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRStringInterner.h
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import <Foundation/Foundation.h>
+
+//internal to NSRails - the machinery behind NSRConfig's internsResponseStrings
+
+//a 10k element response repeats its keys (and usually a lot of its values - statuses, types, tags) in every element, and
+//remoteAttributes keeps every copy alive. one of these lives for a single response and swaps each of them for one shared instance
+
+@interface NSRStringInterner : NSObject
+
+//strings longer than maximumLength are never interned (keys always are). once `limit` distinct strings are in, new ones are left alone
+- (id) initWithLimit:(NSUInteger)limit maximumLength:(NSUInteger)maximumLength;
+
+//the shared instance equal to `string` - `string` itself if it's the first one seen (or too long, or the table's full)
+- (NSString *) internString:(NSString *)string;
+- (NSString *) internKey:(NSString *)key;
+
+//a copy of a parsed response with its keys and short strings interned. dictionaries and arrays are rebuilt (mutable if asked to),
+//unless nothing in them changed. anything else is returned as is
+- (id) internObject:(id)object mutableContainers:(BOOL)mutableContainers;
+
+//distinct strings in the table, and how many duplicates have been swapped for them
+@property (nonatomic, readonly) NSUInteger count;
+@property (nonatomic, readonly) NSUInteger hits;
+
+@end
@@ -0,0 +1,171 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRStringInterner.m
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import "NSRStringInterner.h"
+
+@interface NSRStringInterner (private)
+
+- (NSString *) internString:(NSString *)string maximumLength:(NSUInteger)maximumLength;
+- (id) internObject:(id)object mutableContainers:(BOOL)mutableContainers changed:(BOOL *)changed;
+
+@end
+
+@implementation NSRStringInterner
+{
+    NSMutableSet *strings;
+    NSUInteger limit;
+    NSUInteger maximumLength;
+}
+
+- (id) initWithLimit:(NSUInteger)aLimit maximumLength:(NSUInteger)aMaximumLength
+{
+    if ((self = [super init]))
+    {
+        strings = [[NSMutableSet alloc] init];
+        limit = aLimit;
+        maximumLength = aMaximumLength;
+    }
+    return self;
+}
+
+- (NSUInteger) count
+{
+    return strings.count;
+}
+
+- (NSString *) internString:(NSString *)string maximumLength:(NSUInteger)length
+{
+    if (string.length > length) {
+        return string;
+    }
+    
+    NSString *existing = [strings member:string];
+    if (existing)
+    {
+        if (existing != string) {
+            _hits++;
+        }
+        return existing;
+    }
+    
+    if (strings.count < limit)
+    {
+        //a mutable string (NSJSONReadingMutableLeaves) can't be shared
+        string = [string copy];
+        [strings addObject:string];
+    }
+    return string;
+}
+
+- (NSString *) internString:(NSString *)string
+{
+    return [self internString:string maximumLength:maximumLength];
+}
+
+- (NSString *) internKey:(NSString *)key
+{
+    return [self internString:key maximumLength:NSUIntegerMax];
+}
+
+- (id) internObject:(id)object mutableContainers:(BOOL)mutableContainers
+{
+    BOOL changed = NO;
+    return [self internObject:object mutableContainers:mutableContainers changed:&changed];
+}
+
+- (id) internObject:(id)object mutableContainers:(BOOL)mutableContainers changed:(BOOL *)changed
+{
+    if ([object isKindOfClass:[NSString class]])
+    {
+        NSString *interned = [self internString:object];
+        *changed = (interned != object);
+        return interned;
+    }
+    
+    if ([object isKindOfClass:[NSDictionary class]])
+    {
+        NSUInteger count = [object count];
+        NSMutableArray *keys = [NSMutableArray arrayWithCapacity:count];
+        NSMutableArray *values = [NSMutableArray arrayWithCapacity:count];
+        
+        BOOL anyChanged = NO;
+        for (id key in object)
+        {
+            BOOL valueChanged = NO;
+            id internedKey = ([key isKindOfClass:[NSString class]] ? [self internKey:key] : key);
+            id internedValue = [self internObject:[object objectForKey:key] mutableContainers:mutableContainers changed:&valueChanged];
+            
+            [keys addObject:internedKey];
+            [values addObject:internedValue];
+            anyChanged = (anyChanged || valueChanged || internedKey != key);
+        }
+        
+        //containers are only rebuilt if something in them was swapped (or they have to become mutable)
+        id result = object;
+        if (anyChanged || (mutableContainers && ![object isKindOfClass:[NSMutableDictionary class]]))
+        {
+            Class class = (mutableContainers ? [NSMutableDictionary class] : [NSDictionary class]);
+            result = [[class alloc] initWithObjects:values forKeys:keys];
+        }
+        
+        *changed = (result != object);
+        return result;
+    }
+    
+    if ([object isKindOfClass:[NSArray class]])
+    {
+        NSUInteger count = [object count];
+        NSMutableArray *elements = [NSMutableArray arrayWithCapacity:count];
+        
+        BOOL anyChanged = NO;
+        for (id element in object)
+        {
+            BOOL elementChanged = NO;
+            [elements addObject:[self internObject:element mutableContainers:mutableContainers changed:&elementChanged]];
+            anyChanged = (anyChanged || elementChanged);
+        }
+        
+        id result = object;
+        if (mutableContainers) {
+            result = (anyChanged || ![object isKindOfClass:[NSMutableArray class]] ? elements : object);
+        }
+        else if (anyChanged) {
+            result = [elements copy];
+        }
+        
+        *changed = (result != object);
+        return result;
+    }
+    
+    *changed = NO;
+    return object;
+}
+
+@end
@@ -0,0 +1,174 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRSubscription.h
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import <Foundation/Foundation.h>
+
+@class NSRRequest;
+
+typedef NS_ENUM(NSInteger, NSRSubscriptionAction) {
+    NSRSubscriptionActionNone,
+    NSRSubscriptionActionCreate,
+    NSRSubscriptionActionUpdate,
+    NSRSubscriptionActionDestroy
+};
+
+/**
+ One event pushed to an <NSRSubscription>.
+ */
+@interface NSRSubscriptionEvent : NSObject
+
+/**
+ Type of the event (its `event:` field), or `@"message"` if it didn't have one.
+ */
+@property (nonatomic, strong) NSString *name;
+
+/**
+ ID of the event (its `id:` field, or the last one sent before it), or `nil` if the server doesn't send IDs.
+ */
+@property (nonatomic, strong) NSString *eventID;
+
+/**
+ The event's data, parsed as JSON. If it isn't JSON, this is the data as a string.
+ */
+@property (nonatomic, strong) id data;
+
+/**
+ What the event did to the subscription's objects.
+ 
+ `NSRSubscriptionActionNone` for events that aren't about a record - they're passed on to the <NSRSubscription eventHandler> as they are.
+ */
+@property (nonatomic) NSRSubscriptionAction action;
+
+/**
+ The object the event was applied to - created, updated or removed from <NSRSubscription objects>. `nil` if the action is `NSRSubscriptionActionNone`, or a destroyed record wasn't in the subscription's objects.
+ */
+@property (nonatomic, strong) id object;
+
+@end
+
+/**
+ Keeps a collection of remote objects up to date with changes pushed by the server, instead of polling for them.
+ 
+ A subscription opens its <request> and reads the response as a [Server-Sent Events](https://html.spec.whatwg.org/multipage/server-sent-events.html) stream (`text/event-stream`), for as long as the server keeps it open. Each event that creates, updates or destroys a record is decoded with the usual property mapping and applied to <objects>, matching records by `remoteID`:
+ 
+    event: update
+    id: 1042
+    data: {"id":3, "content":"Edited", "updated_at":"2013-06-01T10:00:00.000+0000"}
+ 
+ The action is the event's type (`create`, `update` or `destroy` - `created`, `updated`, `destroyed` and `delete` work too). Events without a type can instead carry it in an `action` key, which is how ActionCable broadcasts usually look once relayed over SSE:
+ 
+    data: {"action":"destroy", "post":{"id":3}}
+ 
+ A record can be sent bare or wrapped in its model name, like any other response. Creating a record that's already in <objects> updates it, as does updating one that isn't (which adds it).
+ 
+ When the stream ends or the connection drops, the subscription reconnects after <NSRConfig subscriptionRetryInterval> (or the server's `retry:`), backing off on repeated failures, and sends the last event ID it saw in a `Last-Event-ID` header, so the server can resume from there. The server should send a comment (a line starting with `:`) more often than <NSRConfig timeoutInterval> to keep an idle stream from timing out. It should also send `X-Content-Type-Options: nosniff`, or the first few hundred bytes of the stream can be held back while the content type is guessed. Responding with `204 No Content` stops the subscription.
+ 
+ Events are applied on the subscription's own background queue, one at a time and in the request's config, so updates to <objects> never overlap. The <eventHandler> is then called on the main thread, unless <NSRConfig performsCompletionBlocksOnMainThread> is off - in which case it's a background queue. A request or config `completionQueue` takes precedence over both. If the config <NSRConfig coalescesChangeNotifications>, updates only set the properties that changed and post the usual change notifications (on the background queue).
+ 
+    self.posts = [Post remoteAll:nil];
+    self.subscription = [Post remoteSubscribeWithObjects:self.posts handler:^(NSRSubscriptionEvent *event) {
+        self.posts = self.subscription.objects;
+        [self.tableView reloadData];
+    }];
+ 
+ A started subscription keeps itself alive until it's stopped.
+ 
+ WebSocket transports (ActionCable's own protocol included) aren't supported - relay them to an SSE endpoint.
+ */
+@interface NSRSubscription : NSObject
+
+/**
+ Creates a subscription, without starting it.
+ 
+ @param request Request to open the event stream with. Usually from <NSRRequest requestToSubscribeToObjectsOfClass:>, but a request to any route that responds with an event stream works.
+ @param objectClass Class of the records the events are about. Must be an NSRRemoteObject subclass.
+ @return A new subscription.
+ */
+- (id) initWithRequest:(NSRRequest *)request objectClass:(Class)objectClass;
+
+/**
+ The request the event stream is opened with (again each time it reconnects). (read-only)
+ */
+@property (nonatomic, strong, readonly) NSRRequest *request;
+
+/**
+ Class of the records the events are about. (read-only)
+ */
+@property (nonatomic, readonly) Class objectClass;
+
+/**
+ The live objects events are applied to.
+ 
+ Set it to the collection you already have (from <NSRRemoteObject remoteAll:>, say) before starting. Created records are added at the end, and destroyed ones removed. Updates are applied to the objects in place, so anything else holding on to them sees the changes too.
+ 
+ Safe to read or set from any thread. Events are applied to it on a background queue, so by the time the <eventHandler> is called for one, later events may have been applied as well.
+ */
+@property (nonatomic, copy) NSArray *objects;
+
+/**
+ Block called with every event, after it's been applied to <objects>.
+ */
+@property (nonatomic, copy) void (^eventHandler)(NSRSubscriptionEvent *event);
+
+/**
+ Block called when the connection fails or the server responds with an error, before the subscription tries to reconnect. Called on the same thread as <eventHandler>.
+ */
+@property (nonatomic, copy) void (^errorHandler)(NSError *error);
+
+/**
+ ID of the last event received, sent as `Last-Event-ID` when reconnecting.
+ 
+ Set it before starting to resume from an ID saved from an earlier subscription.
+ */
+@property (copy) NSString *lastEventID;
+
+/**
+ Whether the subscription has been started and not stopped. (read-only)
+ */
+@property (readonly, getter = isActive) BOOL active;
+
+/**
+ Whether the event stream is currently open. (read-only)
+ */
+@property (readonly, getter = isConnected) BOOL connected;
+
+/**
+ Opens the event stream. Does nothing if the subscription is already active.
+ */
+- (void) start;
+
+/**
+ Closes the event stream and stops reconnecting. Events already received but not yet delivered are dropped.
+ 
+ Safe to call from any thread.
+ */
+- (void) stop;
+
+@end
@@ -0,0 +1,466 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRSubscription.m
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import "NSRSubscription.h"
+#import "NSREventStreamParser.h"
+#import "NSREndpointPool.h"
+#import "NSRRemoteObject.h"
+#import "NSRRequest.h"
+#import "NSRConfig.h"
+
+@interface NSRRequest (private)
+
+- (NSURLRequest *) HTTPRequestToEndpoint:(NSREndpoint *)endpoint;
+- (NSREndpoint *) checkOutEndpointAvoiding:(NSREndpoint *)failedEndpoint trial:(BOOL *)trial;
+- (BOOL) checkInEndpoint:(NSREndpoint *)endpoint trial:(BOOL)trial response:(NSHTTPURLResponse *)response error:(NSError *)error latency:(NSTimeInterval)latency;
+- (id) connectionWithRequest:(NSURLRequest *)request delegate:(id<NSURLConnectionDataDelegate>)delegate;
+- (void) logOut:(NSURLRequest *)request;
+- (void) performCompletion:(void (^)(void))completion;
+
+@end
+
+@interface NSRSubscription () <NSURLConnectionDataDelegate>
+
+@property (readwrite, getter = isActive) BOOL active;
+@property (readwrite, getter = isConnected) BOOL connected;
+
+@end
+
+@interface NSRSubscription (private)
+
+- (NSURLRequest *) streamRequestToEndpoint:(NSREndpoint *)anEndpoint;
+- (void) openStream:(NSURLRequest *)streamRequest toEndpoint:(NSREndpoint *)anEndpoint trial:(BOOL)trial;
+- (void) checkInEndpointWithResponse:(NSHTTPURLResponse *)response error:(NSError *)error;
+- (void) streamFailedWithError:(NSError *)error;
+- (void) scheduleReconnect;
+
+- (void) receiveEvent:(NSString *)name data:(NSString *)data eventID:(NSString *)eventID;
+- (void) applyEvent:(NSRSubscriptionEvent *)event;
+
+@end
+
+@implementation NSRSubscriptionEvent
+@end
+
+static NSRSubscriptionAction NSRSubscriptionActionNamed(NSString *name)
+{
+    name = [name lowercaseString];
+    
+    if ([name isEqualToString:@"create"] || [name isEqualToString:@"created"]) {
+        return NSRSubscriptionActionCreate;
+    }
+    if ([name isEqualToString:@"update"] || [name isEqualToString:@"updated"]) {
+        return NSRSubscriptionActionUpdate;
+    }
+    if ([name isEqualToString:@"destroy"] || [name isEqualToString:@"destroyed"] || [name isEqualToString:@"delete"] || [name isEqualToString:@"deleted"]) {
+        return NSRSubscriptionActionDestroy;
+    }
+    return NSRSubscriptionActionNone;
+}
+
+//remoteID of a record as sent, whether it's bare or wrapped in its model name ({"post":{"id":3}})
+static NSString *NSRSubscriptionRecordID(NSDictionary *record)
+{
+    id remoteID = record[@"id"];
+    if (!remoteID && record.count == 1)
+    {
+        id inner = [[record allValues] lastObject];
+        if ([inner isKindOfClass:[NSDictionary class]]) {
+            remoteID = inner[@"id"];
+        }
+    }
+    return (remoteID && remoteID != [NSNull null] ? [remoteID description] : nil);
+}
+
+@implementation NSRSubscription
+{
+    //everything about the connection is only touched on this (serial) queue - it's also the connection's delegate queue
+    NSOperationQueue *queue;
+    NSREventStreamParser *parser;
+    id connection;
+    NSUInteger failures;
+    
+    //with several rootURLs: where the connection went (until its response comes back), and where the last one failed
+    NSREndpoint *endpoint, *failedEndpoint;
+    BOOL endpointIsTrial;
+    
+    //changed on the queue as events are applied, but readable (and settable) from anywhere - guarded by objectsByID
+    NSMutableArray *liveObjects;
+    NSMutableDictionary *objectsByID;
+}
+@synthesize request, objectClass;
+
+- (id) initWithRequest:(NSRRequest *)aRequest objectClass:(Class)aClass
+{
+    if ((self = [super init]))
+    {
+        request = aRequest;
+        objectClass = aClass;
+        
+        queue = [[NSOperationQueue alloc] init];
+        queue.maxConcurrentOperationCount = 1;
+        
+        __weak NSRSubscription *weakSelf = self;
+        parser = [[NSREventStreamParser alloc] initWithEventHandler:^(NSString *name, NSString *data, NSString *eventID) {
+            [weakSelf receiveEvent:name data:data eventID:eventID];
+        }];
+        
+        liveObjects = [[NSMutableArray alloc] init];
+        objectsByID = [[NSMutableDictionary alloc] init];
+    }
+    return self;
+}
+
+- (NSString *) lastEventID
+{
+    return parser.lastEventID;
+}
+
+- (void) setLastEventID:(NSString *)eventID
+{
+    parser.lastEventID = eventID;
+}
+
+- (NSArray *) objects
+{
+    @synchronized(objectsByID) {
+        return [liveObjects copy];
+    }
+}
+
+- (void) setObjects:(NSArray *)objects
+{
+    @synchronized(objectsByID)
+    {
+        liveObjects = [objects mutableCopy] ?: [[NSMutableArray alloc] init];
+        
+        [objectsByID removeAllObjects];
+        for (NSRRemoteObject *obj in liveObjects)
+        {
+            if (obj.remoteID) {
+                objectsByID[[obj.remoteID description]] = obj;
+            }
+        }
+    }
+}
+
+#pragma mark - Connection
+
+- (void) start
+{
+    @synchronized(self)
+    {
+        if (self.active) {
+            return;
+        }
+        self.active = YES;
+    }
+    
+    //built here so a misconfigured request (no rootURL, say) raises in the caller, not on the queue
+    BOOL trial;
+    NSREndpoint *firstEndpoint = [request checkOutEndpointAvoiding:nil trial:&trial];
+    NSURLRequest *streamRequest = [self streamRequestToEndpoint:firstEndpoint];
+    [queue addOperationWithBlock:^
+     {
+         failures = 0;
+         [self openStream:streamRequest toEndpoint:firstEndpoint trial:trial];
+     }];
+}
+
+- (void) stop
+{
+    @synchronized(self)
+    {
+        if (!self.active) {
+            return;
+        }
+        self.active = NO;
+    }
+    
+    [queue addOperationWithBlock:^
+     {
+         [connection cancel];
+         connection = nil;
+         self.connected = NO;
+         [parser reset];
+         //stopped before the stream answered - the endpoint's no better or worse for it
+         [self checkInEndpointWithResponse:nil error:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:nil]];
+     }];
+}
+
+- (NSURLRequest *) streamRequestToEndpoint:(NSREndpoint *)anEndpoint
+{
+    //built again for every connection, so headers (auth, say) are always current
+    NSMutableURLRequest *streamRequest = [[request HTTPRequestToEndpoint:anEndpoint] mutableCopy];
+    [streamRequest setValue:@"text/event-stream" forHTTPHeaderField:@"Accept"];
+    [streamRequest setValue:@"no-cache" forHTTPHeaderField:@"Cache-Control"];
+    
+    NSString *eventID = parser.lastEventID;
+    if (eventID.length > 0) {
+        [streamRequest setValue:eventID forHTTPHeaderField:@"Last-Event-ID"];
+    }
+    return streamRequest;
+}
+
+- (void) openStream:(NSURLRequest *)streamRequest toEndpoint:(NSREndpoint *)anEndpoint trial:(BOOL)trial
+{
+    //a reconnect that was already scheduled when the subscription was stopped (or restarted)
+    if (!self.active || connection)
+    {
+        [request checkInEndpoint:anEndpoint trial:trial response:nil error:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:nil] latency:-1];
+        return;
+    }
+    
+    endpoint = anEndpoint;
+    endpointIsTrial = trial;
+    [parser reset];
+    [request logOut:streamRequest];
+    
+    connection = [request connectionWithRequest:streamRequest delegate:self];
+    [connection setDelegateQueue:queue];
+    [connection start];
+}
+
+//a stream's open for as long as the subscription is, so only how it started (not how long it took) says anything about the endpoint
+- (void) checkInEndpointWithResponse:(NSHTTPURLResponse *)response error:(NSError *)error
+{
+    if (!endpoint) {
+        return;
+    }
+    
+    BOOL failedOver = [request checkInEndpoint:endpoint trial:endpointIsTrial response:response error:error latency:-1];
+    failedEndpoint = (failedOver ? endpoint : nil);
+    endpoint = nil;
+}
+
+- (void) streamFailedWithError:(NSError *)error
+{
+    connection = nil;
+    self.connected = NO;
+    failures++;
+    
+    void (^errorHandler)(NSError *error) = self.errorHandler;
+    if (errorHandler)
+    {
+        [request performCompletion:^
+         {
+             if (self.active) {
+                 errorHandler(error);
+             }
+         }];
+    }
+    
+    [self scheduleReconnect];
+}
+
+- (void) scheduleReconnect
+{
+    if (!self.active) {
+        return;
+    }
+    
+    //the server's retry: wins over the config. failures in a row double it each time
+    NSTimeInterval delay = (parser.retryInterval > 0 ? parser.retryInterval : request.config.subscriptionRetryInterval);
+    if (failures > 1) {
+        delay = MIN(delay * pow(2, failures - 1), request.config.maximumSubscriptionRetryInterval);
+    }
+    
+    //keeps the subscription alive until it's reconnected - the connection does while it's open
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^
+                   {
+                       if (!self.active) {
+                           return;
+                       }
+                       
+                       [queue addOperationWithBlock:^
+                        {
+                            BOOL trial;
+                            NSREndpoint *nextEndpoint = [request checkOutEndpointAvoiding:failedEndpoint trial:&trial];
+                            [self openStream:[self streamRequestToEndpoint:nextEndpoint] toEndpoint:nextEndpoint trial:trial];
+                        }];
+                   });
+}
+
+- (void) connection:(NSURLConnection *)aConnection didReceiveResponse:(NSURLResponse *)response
+{
+    if (aConnection != connection) {
+        return;
+    }
+    
+    [self checkInEndpointWithResponse:(NSHTTPURLResponse *)response error:nil];
+    
+    NSInteger status = [(NSHTTPURLResponse *)response statusCode];
+    
+    //the server's way of saying don't come back
+    if (status == 204)
+    {
+        [self stop];
+        return;
+    }
+    
+    if (status < 200 || status >= 300)
+    {
+        [connection cancel];
+        [self streamFailedWithError:[NSError errorWithDomain:NSRRemoteErrorDomain
+                                                        code:status
+                                                    userInfo:@{NSLocalizedDescriptionKey: [NSHTTPURLResponse localizedStringForStatusCode:status]}]];
+        return;
+    }
+    
+    failures = 0;
+    self.connected = YES;
+}
+
+- (void) connection:(NSURLConnection *)aConnection didReceiveData:(NSData *)data
+{
+    if (aConnection == connection) {
+        [parser appendData:data];
+    }
+}
+
+- (void) connectionDidFinishLoading:(NSURLConnection *)aConnection
+{
+    if (aConnection != connection) {
+        return;
+    }
+    
+    //the server closed the stream - come back after the usual wait
+    connection = nil;
+    self.connected = NO;
+    [self scheduleReconnect];
+}
+
+- (void) connection:(NSURLConnection *)aConnection didFailWithError:(NSError *)error
+{
+    if (aConnection == connection)
+    {
+        [self checkInEndpointWithResponse:nil error:error];
+        [self streamFailedWithError:error];
+    }
+}
+
+#pragma mark - Events
+
+- (void) receiveEvent:(NSString *)name data:(NSString *)data eventID:(NSString *)eventID
+{
+    NSRSubscriptionEvent *event = [[NSRSubscriptionEvent alloc] init];
+    event.name = name;
+    event.eventID = eventID;
+    
+    NSJSONReadingOptions options = NSJSONReadingAllowFragments | (request.config.returnsMutableContainers ? NSJSONReadingMutableContainers : 0);
+    event.data = [NSJSONSerialization JSONObjectWithData:[data dataUsingEncoding:NSUTF8StringEncoding] options:options error:nil] ?: data;
+    
+    //applied here, on the (serial) queue, so events can't touch objects at the same time however the handler's delivered -
+    //and in the request's config, like any response is decoded
+    NSRConfig *config = request.config;
+    [config use];
+    @try {
+        [self applyEvent:event];
+    }
+    @finally {
+        [config end];
+    }
+    
+    void (^eventHandler)(NSRSubscriptionEvent *event) = self.eventHandler;
+    if (eventHandler)
+    {
+        [request performCompletion:^
+         {
+             //stopped while this was on its way
+             if (self.active) {
+                 eventHandler(event);
+             }
+         }];
+    }
+}
+
+- (void) applyEvent:(NSRSubscriptionEvent *)event
+{
+    if (!self.active) {
+        return;
+    }
+    
+    NSRSubscriptionAction action = NSRSubscriptionActionNamed(event.name);
+    id record = event.data;
+    
+    //{"action":"update", "post":{...}}
+    if (action == NSRSubscriptionActionNone && [record isKindOfClass:[NSDictionary class]] && [record[@"action"] isKindOfClass:[NSString class]])
+    {
+        action = NSRSubscriptionActionNamed(record[@"action"]);
+        
+        NSMutableDictionary *rest = [record mutableCopy];
+        [rest removeObjectForKey:@"action"];
+        record = rest;
+    }
+    
+    if (action != NSRSubscriptionActionNone && [record isKindOfClass:[NSDictionary class]])
+    {
+        event.action = action;
+        
+        NSString *remoteID = NSRSubscriptionRecordID(record);
+        NSRRemoteObject *existing;
+        @synchronized(objectsByID) {
+            existing = (remoteID ? objectsByID[remoteID] : nil);
+        }
+        
+        if (action == NSRSubscriptionActionDestroy)
+        {
+            if (existing)
+            {
+                @synchronized(objectsByID)
+                {
+                    [liveObjects removeObjectIdenticalTo:existing];
+                    [objectsByID removeObjectForKey:remoteID];
+                }
+            }
+            event.object = existing;
+        }
+        else if (existing)
+        {
+            [existing setPropertiesUsingRemoteDictionary:record];
+            event.object = existing;
+        }
+        else
+        {
+            //also an update to something we never saw created. decoded outside the lock, so reading objects isn't held up by it
+            NSRRemoteObject *obj = [objectClass objectWithRemoteDictionary:record];
+            @synchronized(objectsByID)
+            {
+                [liveObjects addObject:obj];
+                if (obj.remoteID) {
+                    objectsByID[[obj.remoteID description]] = obj;
+                }
+            }
+            event.object = obj;
+        }
+    }
+}
+
+@end
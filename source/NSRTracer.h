@@ -0,0 +1,89 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRTracer.h
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ Records what NSRails is doing, on which threads and for how long, and exports it as a Chrome trace-event file you can open in `chrome://tracing` or [Perfetto](https://ui.perfetto.dev).
+ 
+    [NSRTracer startTracing];
+    
+    //...reproduce the stall...
+    
+    [NSRTracer stopTracing];
+    [NSRTracer writeTraceToFile:@"/tmp/nsrails.json" error:&e];
+ 
+ Spans recorded:
+ 
+ - `request` - from sending a request until its completion block returns, with its method and route
+ - `encode` and `parse` - serializing the request body, parsing the response
+ - `network` - waiting for `NSURLConnection` (an async span, since it starts and ends on different threads)
+ - `dispatch` - waiting for the main queue before running a completion block
+ - `decode` and `completion` - turning the response into objects, running the completion block
+ - `objectsWithRemoteDictionaries` - decoding collections, with the number of objects
+ 
+ While tracing is off, each of these costs a single check of a global flag.
+ */
+@interface NSRTracer : NSObject
+
+/**
+ Starts recording spans, discarding anything recorded before.
+ */
++ (void) startTracing;
+
+/**
+ Stops recording spans. What's been recorded so far is kept until the next <startTracing>.
+ */
++ (void) stopTracing;
+
+/**
+ Whether spans are currently being recorded.
+ 
+ @return `YES` between <startTracing> and <stopTracing>.
+ */
++ (BOOL) isTracing;
+
+/**
+ The recorded spans, as Chrome trace-event JSON.
+ 
+ @return JSON data in the trace-event object format (`{"traceEvents":[...]}`).
+ */
++ (NSData *) traceData;
+
+/**
+ Writes <traceData> to a file.
+ 
+ @param path Path of the file to write.
+ @param error Out parameter set if the file couldn't be written. May be `NULL`.
+ @return `YES` if the file was written.
+ */
++ (BOOL) writeTraceToFile:(NSString *)path error:(NSError **)error;
+
+@end
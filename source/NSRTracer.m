@@ -0,0 +1,252 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRTracer.m
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import "NSRTracer.h"
+#import "NSRTracing.h"
+
+#import <pthread.h>
+
+#if __APPLE__
+#import <mach/mach_time.h>
+#else
+#import <time.h>
+#import <unistd.h>
+#import <sys/syscall.h>
+#endif
+
+atomic_bool NSRTracingActive = false;
+
+typedef struct {
+    const char *name;
+    const char *category;
+    char phase;
+    uint64_t start;
+    uint64_t end;
+    uint64_t threadID;
+    const void *identifier;
+    CFTypeRef detail;
+} NSRTraceEvent;
+
+//events go into one growable array behind a mutex - only ever touched while tracing is on
+static pthread_mutex_t eventsLock = PTHREAD_MUTEX_INITIALIZER;
+static NSRTraceEvent *events = NULL;
+static NSUInteger eventCount = 0;
+static NSUInteger eventCapacity = 0;
+static uint64_t mainThreadID = 0;
+static uint64_t traceStart = 0;
+
+uint64_t NSRTraceTimestamp(void)
+{
+    //never 0, since 0 means "not tracing" to NSRTraceEnd
+#if __APPLE__
+    return mach_absolute_time() | 1;
+#else
+    //nanoseconds
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec) | 1;
+#endif
+}
+
+static uint64_t NSRTraceCurrentThreadID(void)
+{
+#if __APPLE__
+    uint64_t threadID = 0;
+    pthread_threadid_np(NULL, &threadID);
+    return threadID;
+#elif defined(__linux__)
+    return (uint64_t)syscall(SYS_gettid);
+#else
+    return (uint64_t)(uintptr_t)pthread_self();
+#endif
+}
+
+static BOOL NSRTraceIsMainThread(uint64_t threadID)
+{
+#if __APPLE__
+    return (pthread_main_np() != 0);
+#elif defined(__linux__)
+    //the main thread's id is the process'
+    return (threadID == (uint64_t)getpid());
+#else
+    return [NSThread isMainThread];
+#endif
+}
+
+static void NSRTraceAppend(NSRTraceEvent event)
+{
+    if (NSRTraceIsMainThread(event.threadID)) {
+        mainThreadID = event.threadID;
+    }
+    
+    pthread_mutex_lock(&eventsLock);
+    
+    if (eventCount == eventCapacity)
+    {
+        NSUInteger newCapacity = MAX(eventCapacity * 2, 1024);
+        NSRTraceEvent *grown = realloc(events, newCapacity * sizeof(NSRTraceEvent));
+        if (!grown)
+        {
+            pthread_mutex_unlock(&eventsLock);
+            if (event.detail) {
+                CFRelease(event.detail);
+            }
+            return;
+        }
+        events = grown;
+        eventCapacity = newCapacity;
+    }
+    events[eventCount++] = event;
+    
+    pthread_mutex_unlock(&eventsLock);
+}
+
+void NSRTraceRecordSpan(const char *name, const char *category, uint64_t start, id detail)
+{
+    NSRTraceEvent event = {
+        .name = name,
+        .category = category,
+        .phase = 'X',
+        .start = start,
+        .end = NSRTraceTimestamp(),
+        .threadID = NSRTraceCurrentThreadID(),
+        .detail = (detail ? CFBridgingRetain(detail) : NULL)
+    };
+    NSRTraceAppend(event);
+}
+
+void NSRTraceRecordAsync(const char *name, const char *category, BOOL begin, const void *identifier, id detail)
+{
+    NSRTraceEvent event = {
+        .name = name,
+        .category = category,
+        .phase = (begin ? 'b' : 'e'),
+        .start = NSRTraceTimestamp(),
+        .threadID = NSRTraceCurrentThreadID(),
+        .identifier = identifier,
+        .detail = (detail ? CFBridgingRetain(detail) : NULL)
+    };
+    NSRTraceAppend(event);
+}
+
+static void NSRTraceClear(void)
+{
+    for (NSUInteger i = 0; i < eventCount; i++)
+    {
+        if (events[i].detail) {
+            CFRelease(events[i].detail);
+        }
+    }
+    eventCount = 0;
+}
+
+@implementation NSRTracer
+
++ (void) startTracing
+{
+    pthread_mutex_lock(&eventsLock);
+    NSRTraceClear();
+    traceStart = NSRTraceTimestamp();
+    pthread_mutex_unlock(&eventsLock);
+    
+    atomic_store(&NSRTracingActive, true);
+}
+
++ (void) stopTracing
+{
+    atomic_store(&NSRTracingActive, false);
+}
+
++ (BOOL) isTracing
+{
+    return NSRTracingIsActive();
+}
+
++ (NSData *) traceData
+{
+    //trace-event timestamps are in microseconds
+#if __APPLE__
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0) {
+        mach_timebase_info(&timebase);
+    }
+    double ticksToMicroseconds = (double)timebase.numer / timebase.denom / 1000.0;
+#else
+    double ticksToMicroseconds = 1 / 1000.0;
+#endif
+    int pid = [NSProcessInfo processInfo].processIdentifier;
+    
+    NSMutableArray *traceEvents = [NSMutableArray array];
+    
+    pthread_mutex_lock(&eventsLock);
+    
+    if (mainThreadID != 0)
+    {
+        [traceEvents addObject:@{@"name":@"thread_name", @"ph":@"M", @"pid":@(pid), @"tid":@(mainThreadID),
+                                 @"args":@{@"name":@"main"}}];
+    }
+    
+    for (NSUInteger i = 0; i < eventCount; i++)
+    {
+        NSRTraceEvent *e = &events[i];
+        
+        NSMutableDictionary *event = [NSMutableDictionary dictionary];
+        event[@"name"] = @(e->name);
+        event[@"cat"] = @(e->category);
+        event[@"ph"] = [NSString stringWithFormat:@"%c", e->phase];
+        event[@"pid"] = @(pid);
+        event[@"tid"] = @(e->threadID);
+        event[@"ts"] = @((double)(e->start - MIN(e->start, traceStart)) * ticksToMicroseconds);
+        
+        if (e->phase == 'X') {
+            event[@"dur"] = @((double)(e->end - e->start) * ticksToMicroseconds);
+        }
+        else {
+            event[@"id"] = [NSString stringWithFormat:@"%p", e->identifier];
+        }
+        
+        if (e->detail) {
+            event[@"args"] = @{@"detail":[(__bridge id)e->detail description]};
+        }
+        
+        [traceEvents addObject:event];
+    }
+    
+    pthread_mutex_unlock(&eventsLock);
+    
+    return [NSJSONSerialization dataWithJSONObject:@{@"traceEvents":traceEvents, @"displayTimeUnit":@"ms"} options:0 error:nil];
+}
+
++ (BOOL) writeTraceToFile:(NSString *)path error:(NSError **)error
+{
+    return [[self traceData] writeToFile:path options:NSDataWritingAtomic error:error];
+}
+
+@end
@@ -0,0 +1,68 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRTracing.h
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import <Foundation/Foundation.h>
+#import <stdatomic.h>
+
+//internal to NSRails - the hooks NSRRequest and NSRRemoteObject call to record spans for NSRTracer
+
+//everything here bails out on a single read of this flag when tracing is off
+extern atomic_bool NSRTracingActive;
+
+//relaxed - the events themselves are behind a lock, this only decides whether to bother
+static inline BOOL NSRTracingIsActive(void)
+{
+    return atomic_load_explicit(&NSRTracingActive, memory_order_relaxed);
+}
+
+//a span's start time, or 0 if tracing is off (in which case ending it does nothing)
+uint64_t NSRTraceTimestamp(void);
+
+//records a complete span from `start` until now on the current thread. `name` and `category` must be string literals, `detail` (if any) shows up as the span's args
+void NSRTraceRecordSpan(const char *name, const char *category, uint64_t start, id detail);
+
+//records the start/end of a span that begins and ends on different threads. `identifier` ties the two together
+void NSRTraceRecordAsync(const char *name, const char *category, BOOL begin, const void *identifier, id detail);
+
+static inline uint64_t NSRTraceBegin(void)
+{
+    return (NSRTracingIsActive() ? NSRTraceTimestamp() : 0);
+}
+
+//macros rather than inline functions so `detail` isn't even evaluated when tracing is off
+
+#define NSRTraceEnd(name, category, start, detail) \
+    do { if ((start) != 0) { NSRTraceRecordSpan((name), (category), (start), (detail)); } } while (0)
+
+#define NSRTraceAsyncBegin(name, category, identifier, detail) \
+    do { if (NSRTracingIsActive()) { NSRTraceRecordAsync((name), (category), YES, (identifier), (detail)); } } while (0)
+
+#define NSRTraceAsyncEnd(name, category, identifier) \
+    do { if (NSRTracingIsActive()) { NSRTraceRecordAsync((name), (category), NO, (identifier), nil); } } while (0)
@@ -0,0 +1,52 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRUpdateCoalescer.h
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "NSRRemoteObject.h"
+
+@class NSRRequestHandle;
+
+//internal to NSRails - the machinery behind NSRConfig's coalescesRemoteUpdates
+
+//requests are keyed by the (class, remoteID) they update. for each key at most one request is in flight, and at most one more waits
+//behind it - a newer update replaces the waiting one instead of queuing up. every caller's completion is held until the key goes idle,
+//then all of them get the result of the last request sent (the one that carried the latest state)
+
+@interface NSRUpdateCoalescer : NSObject
+
++ (NSString *) keyForObject:(NSRRemoteObject *)object;
+
+//request should already have its body set, so the object's state is captured on the caller's thread
+//cancelling the returned handle calls this caller's completion right away with the cancellation error. the shared update still
+//goes out (or carries on) if anyone else is waiting on it - otherwise it's dropped, or cancelled if it's already in flight
++ (NSRRequestHandle *) sendRequest:(NSRRequest *)request forKey:(NSString *)key window:(NSTimeInterval)window completion:(NSRBasicCompletionBlock)completion;
+
+@end
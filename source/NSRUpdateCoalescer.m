@@ -0,0 +1,204 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRUpdateCoalescer.m
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import "NSRUpdateCoalescer.h"
+#import "NSRRequest.h"
+#import "NSRRequestHandle.h"
+
+@interface NSRRequestHandle (private)
+
+- (id) initWithRequest:(NSRRequest *)request;
+- (void) finish;
+- (NSError *) cancellationError;
+- (void) setCancelHandler:(void (^)(NSError *error))handler;
+
+@end
+
+@interface NSRRequest (private)
+
+- (void) performCompletion:(void (^)(void))completion;
+
+@end
+
+@interface NSRCoalescedUpdate : NSObject
+
+@property (nonatomic, strong) NSRRequest *waitingRequest;
+@property (nonatomic, strong) NSRRequestHandle *inFlightHandle;
+@property (nonatomic, strong) NSMutableArray *completions;
+@property (nonatomic) BOOL inFlight;
+@property (nonatomic) BOOL scheduled;
+
+@end
+
+@implementation NSRCoalescedUpdate
+@end
+
+@implementation NSRUpdateCoalescer
+
+//all bookkeeping happens on this queue - requests themselves are sent from (and complete on) wherever NSRRequest puts them
+static dispatch_queue_t coalescingQueue;
+static NSMutableDictionary *updates;
+
++ (void) initialize
+{
+    if (self == [NSRUpdateCoalescer class])
+    {
+        coalescingQueue = dispatch_queue_create("com.nsrails.coalescing", DISPATCH_QUEUE_SERIAL);
+        updates = [[NSMutableDictionary alloc] init];
+    }
+}
+
++ (NSString *) keyForObject:(NSRRemoteObject *)object
+{
+    return [NSString stringWithFormat:@"%@#%@", NSStringFromClass(object.class), object.remoteID];
+}
+
+//must be called on coalescingQueue
++ (void) sendWaitingRequestForKey:(NSString *)key
+{
+    NSRCoalescedUpdate *update = updates[key];
+    NSRRequest *request = update.waitingRequest;
+    
+    update.waitingRequest = nil;
+    update.scheduled = NO;
+    update.inFlight = YES;
+    
+    update.inFlightHandle = [request sendAsynchronous:
+     ^(id result, NSError *error)
+     {
+         //decide on the coalescing queue, but call back on this thread so completions land where the config says they should
+         __block NSArray *completions = nil;
+         dispatch_sync(coalescingQueue, ^
+         {
+             update.inFlight = NO;
+             update.inFlightHandle = nil;
+             
+             if (update.waitingRequest)
+             {
+                 //state changed while this one was out - send the latest now; everyone waits for that result instead
+                 [self sendWaitingRequestForKey:key];
+             }
+             else
+             {
+                 completions = update.completions;
+                 [updates removeObjectForKey:key];
+             }
+         });
+         
+         for (NSRBasicCompletionBlock completion in completions) {
+             completion(error);
+         }
+     }];
+}
+
++ (NSRRequestHandle *) sendRequest:(NSRRequest *)request forKey:(NSString *)key window:(NSTimeInterval)window completion:(NSRBasicCompletionBlock)completion
+{
+    NSRRequestHandle *handle = [[NSRRequestHandle alloc] initWithRequest:request];
+    NSRBasicCompletionBlock block = [^(NSError *error)
+    {
+        NSError *cancellation = [handle cancellationError];
+        [handle finish];
+        
+        if (completion) {
+            completion(cancellation ?: error);
+        }
+    } copy];
+    
+    //this caller stops waiting right away. the shared update only goes on if someone else is still waiting on it
+    [handle setCancelHandler:^(NSError *cancellation)
+     {
+         dispatch_async(coalescingQueue, ^
+         {
+             NSRCoalescedUpdate *update = updates[key];
+             
+             //already being called back with the result
+             if (![update.completions containsObject:block]) {
+                 return;
+             }
+             [update.completions removeObjectIdenticalTo:block];
+             
+             if (update.completions.count == 0)
+             {
+                 update.waitingRequest = nil;
+                 if (update.inFlight) {
+                     //its completion tidies up
+                     [update.inFlightHandle cancel];
+                 }
+                 else {
+                     [updates removeObjectForKey:key];
+                 }
+             }
+             
+             [request performCompletion:^{
+                 block(cancellation);
+             }];
+         });
+     }];
+    
+    dispatch_async(coalescingQueue, ^
+    {
+        NSRCoalescedUpdate *update = updates[key];
+        if (!update)
+        {
+            update = [[NSRCoalescedUpdate alloc] init];
+            update.completions = [[NSMutableArray alloc] init];
+            updates[key] = update;
+        }
+        
+        update.waitingRequest = request;
+        [update.completions addObject:block];
+        
+        //if one's in flight, its completion picks up the waiting request
+        if (!update.inFlight && !update.scheduled)
+        {
+            update.scheduled = YES;
+            
+            void (^send)(void) = ^
+            {
+                //everyone waiting on it cancelled
+                if (updates[key] != update || !update.waitingRequest) {
+                    return;
+                }
+                [self sendWaitingRequestForKey:key];
+            };
+            
+            if (window > 0) {
+                dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(window * NSEC_PER_SEC)), coalescingQueue, send);
+            }
+            else {
+                dispatch_async(coalescingQueue, send);
+            }
+        }
+    });
+    
+    return handle;
+}
+
+@end
@@ -0,0 +1,75 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRWireCodec.h
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ A wire format that request bodies are encoded in and responses are decoded from.
+ 
+ NSRails speaks JSON (<NSRJSONCodec>) out of the box, and also comes with <NSRMessagePackCodec>. To use another format, set an object conforming to this protocol as your config's <NSRConfig codec>.
+ 
+ Codecs are used from whichever thread a request happens to be sent or completed on, so they should be stateless (or thread-safe).
+ */
+@protocol NSRWireCodec <NSObject>
+
+/**
+ MIME type of the format (eg, `application/json`).
+ 
+ Sent as the `Content-Type` of request bodies, and asked for in the `Accept` header of every request.
+ */
+@property (nonatomic, readonly) NSString *contentType;
+
+/**
+ Encodes a request body.
+ 
+ @param object Dictionary or array to encode. Contains only objects that are valid in JSON.
+ @param error Out parameter set if the object couldn't be encoded.
+ @return The encoded body, or `nil` if there was an error.
+ */
+- (NSData *) dataWithObject:(id)object error:(NSError **)error;
+
+/**
+ Decodes a response body.
+ 
+ @param data Body of the response.
+ @param mutableContainers Whether arrays and dictionaries should be mutable. Reflects the config's <NSRConfig returnsMutableContainers>.
+ @param error Out parameter set if the data isn't in this format.
+ @return The decoded object, or `nil` if there was an error.
+ */
+- (id) objectWithData:(NSData *)data mutableContainers:(BOOL)mutableContainers error:(NSError **)error;
+
+@end
+
+/**
+ The default codec, backed by NSJSONSerialization.
+ */
+@interface NSRJSONCodec : NSObject <NSRWireCodec, NSCoding>
+
+@end
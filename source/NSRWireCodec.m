@@ -0,0 +1,73 @@
+/*
+ 
+ _|_|_|    _|_|  _|_|  _|_|  _|  _|      _|_|           
+ _|  _|  _|_|    _|    _|_|  _|  _|_|  _|_| 
+ 
+ NSRWireCodec.m
+ 
+ Copyright (c) 2012 Dan Hassin.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining
+ a copy of this software and associated documentation files (the
+ "Software"), to deal in the Software without restriction, including
+ without limitation the rights to use, copy, modify, merge, publish,
+ distribute, sublicense, and/or sell copies of the Software, and to
+ permit persons to whom the Software is furnished to do so, subject to
+ the following conditions:
+ 
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ */
+
+#import "NSRWireCodec.h"
+
+@implementation NSRJSONCodec
+
+- (NSString *) contentType
+{
+    return @"application/json";
+}
+
+- (NSData *) dataWithObject:(id)object error:(NSError **)error
+{
+    return [NSJSONSerialization dataWithJSONObject:object options:0 error:error];
+}
+
+- (id) objectWithData:(NSData *)data mutableContainers:(BOOL)mutableContainers error:(NSError **)error
+{
+    NSJSONReadingOptions options = NSJSONReadingAllowFragments;
+    if (mutableContainers) {
+        options |= NSJSONReadingMutableContainers;
+    }
+    
+    id object = [NSJSONSerialization JSONObjectWithData:data options:options error:error];
+    
+    //workaround for bug with NSJSONReadingMutableContainers, where a top-level array comes back immutable
+    if (mutableContainers && [object isKindOfClass:[NSArray class]] && ![object isKindOfClass:[NSMutableArray class]]) {
+        object = [NSMutableArray arrayWithArray:object];
+    }
+    
+    return object;
+}
+
+#pragma mark - NSCoding
+
+- (id) initWithCoder:(NSCoder *)aDecoder
+{
+    return [self init];
+}
+
+- (void) encodeWithCoder:(NSCoder *)aCoder
+{
+}
+
+@end
@@ -27,9 +27,18 @@
  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#import <NSRails/NSRCassette.h>
 #import <NSRails/NSRConfig.h>
+#import <NSRails/NSRMemoryProfiler.h>
+#import <NSRails/NSRMessagePackCodec.h>
+#import <NSRails/NSRMultipartBody.h>
 #import <NSRails/NSRRemoteObject.h>
 #import <NSRails/NSRRequest.h>
+#import <NSRails/NSRRequestHandle.h>
+#import <NSRails/NSRRequestMetrics.h>
+#import <NSRails/NSRSubscription.h>
+#import <NSRails/NSRTracer.h>
+#import <NSRails/NSRWireCodec.h>
 
 #ifdef NSR_USE_COREDATA
 #import <NSRails/NSRRemoteManagedObject.h>
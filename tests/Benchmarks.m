@@ -0,0 +1,659 @@
+//
+//  Benchmarks.m
+//  NSRails
+//
+//  Copyright (c) 2012 InContext LLC. All rights reserved.
+//
+
+#import "NSRAsserts.h"
+#import "Benchmark.h"
+#import "LoadGenerator.h"
+#import "StubServer.h"
+
+//these only run when NSR_BENCHMARK is set (to 1, or to part of a benchmark name to only run matching ones)
+//the report goes to NSR_BENCHMARK_REPORT (or the temp directory), and if NSR_BENCHMARK_BASELINE points to an
+//earlier report, the test fails on anything that got worse by more than NSR_BENCHMARK_TOLERANCE (default 0.15)
+//the memory profile (filter "memory") decodes 10k wide records through a real request with NSRMemoryProfiler on, and is compared too
+//the load test (filter "load") is tuned with NSR_LOAD_RPS, NSR_LOAD_DURATION and NSR_LOAD_LATENCY (the stub server's, in seconds)
+//from xcodebuild, prefix them with TEST_RUNNER_ so they reach the test process
+
+@interface NSRRequest (private)
+
++ (NSString *) base64EncodingOfData:(NSData *)data;
+- (NSURLRequest *) HTTPRequest;
+- (id) jsonResponseFromData:(NSData *)data;
+
+@end
+
+@interface NSRRemoteObject (inflection)
+
++ (NSString *) stringByUnderscoringString:(NSString *)string ignoringPrefix:(BOOL)ignorePrefix;
++ (NSString *) stringByCamelizingString:(NSString *)string;
+
+@end
+
+#pragma mark - Fixture classes
+
+@interface BenchmarkNarrow : NSRRemoteObject
+
+@property (nonatomic, strong) NSString *title;
+@property (nonatomic, strong) NSNumber *weight;
+@property (nonatomic, strong) NSDate *publishedAt;
+
+@end
+
+@implementation BenchmarkNarrow
+@end
+
+@interface BenchmarkWide : NSRRemoteObject
+
+@property (nonatomic, strong) NSString *firstName, *lastName, *emailAddress, *streetAddress, *cityName, *postalCode, *countryCode, *phoneNumber;
+@property (nonatomic, strong) NSNumber *loginCount, *followerCount, *followingCount, *postCount, *accountBalance, *creditLimit, *latitude, *longitude;
+@property (nonatomic, strong) NSDate *lastLoginAt, *confirmedAt, *birthDate, *expiresAt;
+@property (nonatomic) BOOL isAdmin, isConfirmed, receivesNewsletter, hasAvatar;
+
+@end
+
+@implementation BenchmarkWide
+@end
+
+@interface BenchmarkNode : NSRRemoteObject
+
+@property (nonatomic, strong) NSString *title;
+@property (nonatomic, strong) NSNumber *weight;
+@property (nonatomic, strong) NSDate *publishedAt;
+@property (nonatomic, strong) NSMutableArray *children;
+
+@end
+
+@implementation BenchmarkNode
+
+- (Class) nestedClassForProperty:(NSString *)property
+{
+    if ([property isEqualToString:@"children"]) {
+        return [BenchmarkNode class];
+    }
+    return [super nestedClassForProperty:property];
+}
+
+- (BOOL) shouldSendProperty:(NSString *)property whenNested:(BOOL)nested
+{
+    //trees can't loop back on themselves, so let encoding go all the way down like decoding does
+    if ([property isEqualToString:@"children"]) {
+        return self.children.count > 0;
+    }
+    return [super shouldSendProperty:property whenNested:nested];
+}
+
+@end
+
+#pragma mark - Fixtures
+
+static NSArray *BenchmarkSizes(void)
+{
+    return @[@1, @100, @10000];
+}
+
+static NSDictionary *BenchmarkNarrowDictionary(NSUInteger i, NSString *date)
+{
+    return @{@"id": @(i + 1),
+             @"title": [NSString stringWithFormat:@"Record number %lu", (unsigned long)i],
+             @"weight": @(i * 0.25),
+             @"published_at": date};
+}
+
+static NSDictionary *BenchmarkWideDictionary(NSUInteger i, NSString *date)
+{
+    return @{@"id": @(i + 1),
+             @"first_name": [NSString stringWithFormat:@"First%lu", (unsigned long)i],
+             @"last_name": [NSString stringWithFormat:@"Last%lu", (unsigned long)i],
+             @"email_address": [NSString stringWithFormat:@"user%lu@example.com", (unsigned long)i],
+             @"street_address": [NSString stringWithFormat:@"%lu Main Street", (unsigned long)i],
+             @"city_name": @"Springfield",
+             @"postal_code": [NSString stringWithFormat:@"%05lu", (unsigned long)(i % 100000)],
+             @"country_code": @"US",
+             @"phone_number": [NSString stringWithFormat:@"555-%04lu", (unsigned long)(i % 10000)],
+             @"login_count": @(i * 3),
+             @"follower_count": @(i * 7),
+             @"following_count": @(i * 5),
+             @"post_count": @(i),
+             @"account_balance": @(i * 1.5),
+             @"credit_limit": @(5000),
+             @"latitude": @(40.0 + i * 0.0001),
+             @"longitude": @(-73.0 - i * 0.0001),
+             @"last_login_at": date,
+             @"confirmed_at": date,
+             @"birth_date": date,
+             @"expires_at": date,
+             @"is_admin": @(i % 50 == 0),
+             @"is_confirmed": @YES,
+             @"receives_newsletter": @(i % 2 == 0),
+             @"has_avatar": @(i % 3 == 0)};
+}
+
+static NSDictionary *BenchmarkNodeDictionary(NSUInteger *nextID, NSUInteger depth, NSString *date)
+{
+    NSUInteger i = (*nextID)++;
+    
+    NSMutableArray *children = [NSMutableArray array];
+    if (depth > 0)
+    {
+        for (int c = 0; c < 2; c++) {
+            [children addObject:BenchmarkNodeDictionary(nextID, depth - 1, date)];
+        }
+    }
+    
+    return @{@"id": @(i + 1),
+             @"title": [NSString stringWithFormat:@"Node %lu", (unsigned long)i],
+             @"weight": @(i * 0.25),
+             @"published_at": date,
+             @"children": children};
+}
+
+#pragma mark - Benchmarks
+
+@interface Benchmarks : XCTestCase <NSRRequestMetricsObserver>
+
+@end
+
+@implementation Benchmarks
+{
+    Benchmark *benchmark;
+    NSString *filter;
+    NSString *date;
+    NSRRequestMetrics *lastMetrics;
+}
+
+- (void) setUp
+{
+    [super setUp];
+    
+    [NSRConfig resetConfigs];
+    [[NSRConfig defaultConfig] setRootURL:[NSURL URLWithString:@"http://localhost:3000"]];
+    
+    date = [[NSRConfig defaultConfig] stringFromDate:[NSDate dateWithTimeIntervalSince1970:1350000000]];
+}
+
+- (void) run:(NSString *)name batch:(NSUInteger)batch block:(void (^)(void))block
+{
+    if (filter && [name rangeOfString:filter].location == NSNotFound) {
+        return;
+    }
+    [benchmark run:name batch:batch block:block];
+}
+
+- (void) run:(NSString *)name block:(void (^)(void))block
+{
+    [self run:name batch:1 block:block];
+}
+
+- (void) runMappingBenchmarksForClass:(Class)class kind:(NSString *)kind fixtures:(NSArray *)fixtures size:(NSUInteger)size
+{
+    NSArray *objects = [class objectsWithRemoteDictionaries:fixtures];
+    
+    [self run:[NSString stringWithFormat:@"decode/%@/%lu", kind, (unsigned long)size] block:^{
+        [class objectsWithRemoteDictionaries:fixtures];
+    }];
+    
+    [self run:[NSString stringWithFormat:@"encode/%@/%lu", kind, (unsigned long)size] block:^{
+        for (NSRRemoteObject *object in objects) {
+            [object remoteDictionaryRepresentationWrapped:YES];
+        }
+    }];
+}
+
+- (void) runMappingBenchmarks
+{
+    for (NSNumber *size in BenchmarkSizes())
+    {
+        NSUInteger count = size.unsignedIntegerValue;
+        
+        NSMutableArray *narrow = [NSMutableArray arrayWithCapacity:count];
+        NSMutableArray *wide = [NSMutableArray arrayWithCapacity:count];
+        for (NSUInteger i = 0; i < count; i++)
+        {
+            [narrow addObject:BenchmarkNarrowDictionary(i, date)];
+            [wide addObject:BenchmarkWideDictionary(i, date)];
+        }
+        
+        [self runMappingBenchmarksForClass:[BenchmarkNarrow class] kind:@"narrow" fixtures:narrow size:count];
+        [self runMappingBenchmarksForClass:[BenchmarkWide class] kind:@"wide" fixtures:wide size:count];
+        
+        //binary trees, with about `count` nodes in total across all of them
+        for (NSUInteger depth = 1; depth <= 3; depth += 2)
+        {
+            NSUInteger perTree = (1 << (depth + 1)) - 1;
+            NSUInteger nextID = 0;
+            
+            NSMutableArray *trees = [NSMutableArray array];
+            for (NSUInteger t = 0; t < MAX(1, count / perTree); t++) {
+                [trees addObject:BenchmarkNodeDictionary(&nextID, depth, date)];
+            }
+            
+            [self runMappingBenchmarksForClass:[BenchmarkNode class] kind:[NSString stringWithFormat:@"nested-depth%lu", (unsigned long)depth] fixtures:trees size:count];
+        }
+    }
+    
+    //updating an object that already exists, rather than making a new one
+    BenchmarkWide *existing = [BenchmarkWide objectWithRemoteDictionary:BenchmarkWideDictionary(0, date)];
+    NSDictionary *update = BenchmarkWideDictionary(1, date);
+    [self run:@"setProperties/wide" block:^{
+        [existing setPropertiesUsingRemoteDictionary:update];
+    }];
+}
+
+- (void) runInflectionBenchmarks
+{
+    NSArray *camelized = @[@"firstName", @"lastName", @"emailAddress", @"streetAddress", @"cityName", @"postalCode", @"countryCode", @"phoneNumber",
+                           @"loginCount", @"followerCount", @"lastLoginAt", @"isAdmin", @"remoteID", @"publishedAt", @"title", @"URLString"];
+    
+    NSMutableArray *underscored = [NSMutableArray array];
+    for (NSString *property in camelized) {
+        [underscored addObject:[NSRRemoteObject stringByUnderscoringString:property ignoringPrefix:NO]];
+    }
+    
+    [self run:@"inflection/underscore" batch:camelized.count block:^{
+        for (NSString *property in camelized) {
+            [NSRRemoteObject stringByUnderscoringString:property ignoringPrefix:NO];
+        }
+    }];
+    
+    [self run:@"inflection/underscore-class" batch:3 block:^{
+        [NSRRemoteObject stringByUnderscoringString:@"NSRBenchmarkWide" ignoringPrefix:YES];
+        [NSRRemoteObject stringByUnderscoringString:@"DHPostComment" ignoringPrefix:YES];
+        [NSRRemoteObject stringByUnderscoringString:@"Post" ignoringPrefix:YES];
+    }];
+    
+    [self run:@"inflection/camelize" batch:underscored.count block:^{
+        for (NSString *key in underscored) {
+            [NSRRemoteObject stringByCamelizingString:key];
+        }
+    }];
+}
+
+- (void) runDateBenchmarks
+{
+    NSRConfig *config = [NSRConfig defaultConfig];
+    NSDate *now = [NSDate dateWithTimeIntervalSince1970:1350000000];
+    NSString *string = date;
+    
+    [self run:@"date/stringFromDate" block:^{
+        [config stringFromDate:now];
+    }];
+    
+    [self run:@"date/dateFromString" block:^{
+        [config dateFromString:string];
+    }];
+}
+
+- (void) runBase64Benchmarks
+{
+    for (NSNumber *length in @[@64, @4096, @(1024 * 1024)])
+    {
+        NSMutableData *data = [NSMutableData dataWithLength:length.unsignedIntegerValue];
+        
+        //not all zeros, in case that ever gets a fast path
+        unsigned char *bytes = data.mutableBytes;
+        for (NSUInteger i = 0; i < data.length; i++) {
+            bytes[i] = (unsigned char)(i * 31 + 7);
+        }
+        
+        [self run:[NSString stringWithFormat:@"base64/%@", length] block:^{
+            [NSRRequest base64EncodingOfData:data];
+        }];
+    }
+}
+
+- (void) runParseBenchmarks
+{
+    NSMutableArray *wide = [NSMutableArray array];
+    for (NSUInteger i = 0; i < 10000; i++) {
+        [wide addObject:BenchmarkWideDictionary(i, date)];
+    }
+    NSData *data = [NSJSONSerialization dataWithJSONObject:wide options:0 error:nil];
+    
+    NSRConfig *config = [NSRConfig defaultConfig];
+    NSRRequest *request = [NSRRequest GET];
+    
+    [self run:@"parse/wide/10000" block:^{
+        [request jsonResponseFromData:data];
+    }];
+    
+    config.internsResponseStrings = YES;
+    [self run:@"parse/wide-interned/10000" block:^{
+        [request jsonResponseFromData:data];
+    }];
+    config.internsResponseStrings = NO;
+}
+
+- (void) runRequestBenchmarks
+{
+    BenchmarkWide *wide = [BenchmarkWide objectWithRemoteDictionary:BenchmarkWideDictionary(0, date)];
+    
+    [self run:@"HTTPRequest/get" block:^{
+        [[[NSRRequest GET] routeToClass:[BenchmarkWide class]] HTTPRequest];
+    }];
+    
+    [self run:@"HTTPRequest/update-wide" block:^{
+        [[NSRRequest requestToUpdateObject:wide] HTTPRequest];
+    }];
+    
+    NSMutableArray *body = [NSMutableArray array];
+    for (NSUInteger i = 0; i < 100; i++) {
+        [body addObject:BenchmarkWideDictionary(i, date)];
+    }
+    
+    [self run:@"HTTPRequest/post-100" block:^{
+        NSRRequest *request = [[NSRRequest POST] routeTo:@"benchmark_wides/bulk"];
+        request.body = body;
+        [request HTTPRequest];
+    }];
+}
+
+- (void) request:(NSRRequest *)request didFinishWithMetrics:(NSRRequestMetrics *)metrics
+{
+    lastMetrics = metrics;
+}
+
+//serves `count` wide records from a stub server and fetches them with the profiler on
+- (NSArray *) profileFetchingWideRecords:(NSUInteger)count
+{
+    NSMutableArray *records = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        [records addObject:BenchmarkWideDictionary(i, date)];
+    }
+    
+    StubServer *server = [StubServer server];
+    [server route:@"GET" path:@"benchmark_wides" status:200 JSON:records];
+    
+    NSRConfig *config = [NSRConfig defaultConfig];
+    config.rootURL = server.baseURL;
+    config.metricsObserver = self;
+    
+    NSError *error;
+    [NSRMemoryProfiler startProfiling];
+    NSArray *objects = [BenchmarkWide remoteAll:&error];
+    [NSRMemoryProfiler stopProfiling];
+    
+    [server stop];
+    config.metricsObserver = nil;
+    
+    XCTAssertNil(error);
+    return objects;
+}
+
+- (void) runMemoryProfile
+{
+    if (filter && [@"memory" rangeOfString:filter].location == NSNotFound) {
+        return;
+    }
+    
+    NSArray *objects = [self profileFetchingWideRecords:10000];
+    XCTAssertEqual(objects.count, (NSUInteger)10000);
+    
+    NSMutableDictionary *profile = [[NSRMemoryProfiler dictionaryRepresentation] mutableCopy];
+    profile[@"request_peak_resident_growth"] = @(lastMetrics.peakResidentGrowth);
+    
+    NSLog(@"[NSRails] Memory: %@", profile);
+    [benchmark setReportValue:profile forKey:@"memory"];
+}
+
+- (LoadGenerator *) loadGeneratorAgainstServer:(StubServer *)server seededPosts:(NSUInteger)seeded
+{
+    [server addPostsAndResponsesRoutes];
+    [[NSRConfig defaultConfig] setRootURL:server.baseURL];
+    
+    //posts for the fetches/updates/destroys to work on. creates add to it, destroys take from it
+    NSMutableArray *pool = [NSMutableArray array];
+    for (NSUInteger i = 0; i < seeded; i++)
+    {
+        Post *post = [[Post alloc] init];
+        post.author = @"load";
+        post.content = [NSString stringWithFormat:@"Seeded post %lu", (unsigned long)i];
+        if ([post remoteCreate:nil]) {
+            [pool addObject:post];
+        }
+    }
+    
+    Post *(^anyPost)(BOOL) = ^Post *(BOOL take) {
+        @synchronized(pool)
+        {
+            if (pool.count == 0) {
+                return nil;
+            }
+            Post *post = pool[random() % pool.count];
+            if (take) {
+                [pool removeObject:post];
+            }
+            return post;
+        }
+    };
+    
+    LoadGenerator *load = [[LoadGenerator alloc] init];
+    
+    [load addOperation:@"remoteAllAsync" weight:1 block:^(LoadCompletion done) {
+        [Post remoteAllAsync:^(NSArray *allRemote, NSError *error) {
+            done(error);
+        }];
+    }];
+    
+    [load addOperation:@"remoteObjectWithID" weight:5 block:^(LoadCompletion done) {
+        [Post remoteObjectWithID:anyPost(NO).remoteID ?: @1 async:^(id object, NSError *error) {
+            done(error);
+        }];
+    }];
+    
+    [load addOperation:@"create" weight:2 block:^(LoadCompletion done) {
+        Post *post = [[Post alloc] init];
+        post.author = @"load";
+        post.content = @"Created under load";
+        [post remoteCreateAsync:^(NSError *error) {
+            if (!error)
+            {
+                @synchronized(pool) {
+                    [pool addObject:post];
+                }
+            }
+            done(error);
+        }];
+    }];
+    
+    [load addOperation:@"update" weight:2 block:^(LoadCompletion done) {
+        Post *post = anyPost(NO);
+        post.content = @"Updated under load";
+        [post remoteUpdateAsync:^(NSError *error) {
+            done(error);
+        }];
+        if (!post) {
+            done(nil);
+        }
+    }];
+    
+    [load addOperation:@"destroy" weight:1 block:^(LoadCompletion done) {
+        Post *post = anyPost(YES);
+        [post remoteDestroyAsync:^(NSError *error) {
+            done(error);
+        }];
+        if (!post) {
+            done(nil);
+        }
+    }];
+    
+    return load;
+}
+
+- (void) runLoadBenchmarks
+{
+    if (filter && [@"load" rangeOfString:filter].location == NSNotFound) {
+        return;
+    }
+    
+    NSDictionary *environment = [[NSProcessInfo processInfo] environment];
+    
+    StubServer *server = [StubServer server];
+    server.latency = environment[@"NSR_LOAD_LATENCY"] ? [environment[@"NSR_LOAD_LATENCY"] doubleValue] : 0.005;
+    
+    LoadGenerator *load = [self loadGeneratorAgainstServer:server seededPosts:200];
+    load.requestsPerSecond = environment[@"NSR_LOAD_RPS"] ? [environment[@"NSR_LOAD_RPS"] doubleValue] : 200;
+    load.duration = environment[@"NSR_LOAD_DURATION"] ? [environment[@"NSR_LOAD_DURATION"] doubleValue] : 5;
+    
+    NSDictionary *report = [load run];
+    [server stop];
+    
+    NSLog(@"[NSRails] Load: %@", report);
+    [benchmark setReportValue:report forKey:@"load"];
+    
+    XCTAssertEqualObjects(report[@"timed_out"], @0, @"Everything sent should have come back");
+}
+
+- (void) test_benchmarks
+{
+    NSDictionary *environment = [[NSProcessInfo processInfo] environment];
+    
+    NSString *enabled = environment[@"NSR_BENCHMARK"];
+    if (enabled.length == 0) {
+        return;
+    }
+    
+    filter = ([enabled isEqualToString:@"1"] || [enabled isEqualToString:@"YES"]) ? nil : enabled;
+    benchmark = [[Benchmark alloc] init];
+    
+    [self runMappingBenchmarks];
+    [self runInflectionBenchmarks];
+    [self runDateBenchmarks];
+    [self runBase64Benchmarks];
+    [self runParseBenchmarks];
+    [self runRequestBenchmarks];
+    [self runMemoryProfile];
+    [self runLoadBenchmarks];
+    
+    NSString *reportPath = environment[@"NSR_BENCHMARK_REPORT"] ?: [NSTemporaryDirectory() stringByAppendingPathComponent:@"nsrails-benchmarks.json"];
+    XCTAssertTrue([[benchmark reportJSON] writeToFile:reportPath atomically:YES], @"Should've written the report to %@", reportPath);
+    NSLog(@"[NSRails] Benchmark report written to %@", reportPath);
+    
+    NSString *baselinePath = environment[@"NSR_BENCHMARK_BASELINE"];
+    if (baselinePath)
+    {
+        NSData *data = [NSData dataWithContentsOfFile:baselinePath];
+        NSDictionary *baseline = data ? [NSJSONSerialization JSONObjectWithData:data options:0 error:nil] : nil;
+        XCTAssertNotNil(baseline, @"Couldn't read a baseline report from %@", baselinePath);
+        
+        NSString *tolerance = environment[@"NSR_BENCHMARK_TOLERANCE"];
+        for (NSString *regression in [benchmark regressionsAgainstBaseline:baseline tolerance:(tolerance ? tolerance.doubleValue : 0.15)]) {
+            XCTFail(@"Regression: %@", regression);
+        }
+    }
+}
+
+- (void) test_memory_profiler
+{
+    NSArray *objects = [self profileFetchingWideRecords:100];
+    XCTAssertEqual(objects.count, (NSUInteger)100);
+    XCTAssertFalse([NSRMemoryProfiler isProfiling]);
+    
+    NSDictionary *phases = [NSRMemoryProfiler phaseStatistics];
+    for (NSString *phase in @[@"parse", @"decode", @"objectsWithRemoteDictionaries", @"inflection"]) {
+        XCTAssertTrue([phases[phase] calls] > 0, @"Should have recorded %@", phase);
+    }
+    XCTAssertEqual([phases[@"objectsWithRemoteDictionaries"] calls], (NSUInteger)1);
+    XCTAssertNil(phases[@"encode"], @"A GET has nothing to encode");
+    
+    //one per record, each holding at least its keys
+    XCTAssertEqual([NSRMemoryProfiler remoteAttributesCount], (NSUInteger)100);
+    XCTAssertTrue([NSRMemoryProfiler remoteAttributesBytes] > 100 * 25 * 8);
+    
+    XCTAssertTrue([NSRMemoryProfiler peakResidentBytes] > 0);
+    XCTAssertTrue(lastMetrics.peakResidentBytes > 0, @"Requests get their peak while profiling");
+    XCTAssertTrue(lastMetrics.peakResidentGrowth >= 0);
+    
+    if ([NSRMemoryProfiler countsAllocations])
+    {
+        NSRMemoryPhaseStatistics *decode = phases[@"decode"], *collection = phases[@"objectsWithRemoteDictionaries"];
+        XCTAssertTrue(collection.allocations > 100, @"Each object takes at least one allocation");
+        XCTAssertTrue(decode.allocations >= collection.allocations, @"Phases include what they run");
+        XCTAssertTrue(decode.allocatedBytes >= collection.allocatedBytes);
+    }
+    else
+    {
+        XCTAssertEqual([phases[@"decode"] allocations], -1LL);
+    }
+    
+    //nested objects' remoteAttributes are their parent's, so only the outermost count
+    NSUInteger nextID = 0;
+    NSDictionary *tree = BenchmarkNodeDictionary(&nextID, 2, date);
+    [NSRMemoryProfiler startProfiling];
+    [BenchmarkNode objectWithRemoteDictionary:tree];
+    [NSRMemoryProfiler stopProfiling];
+    XCTAssertEqual([NSRMemoryProfiler remoteAttributesCount], (NSUInteger)1);
+    
+    //nothing's recorded while it's off
+    [BenchmarkNode objectWithRemoteDictionary:tree];
+    XCTAssertEqual([NSRMemoryProfiler remoteAttributesCount], (NSUInteger)1);
+    
+    NSRMemoryPhaseStatistics *measured = [NSRMemoryProfiler measure:^{
+        [BenchmarkNode objectWithRemoteDictionary:tree];
+    }];
+    XCTAssertEqual(measured.calls, (NSUInteger)1);
+    XCTAssertNil(measured.name);
+    if ([NSRMemoryProfiler countsAllocations]) {
+        XCTAssertTrue(measured.allocations > 0);
+    }
+    
+    NSDictionary *report = [NSRMemoryProfiler dictionaryRepresentation];
+    XCTAssertNotNil([NSJSONSerialization dataWithJSONObject:report options:0 error:nil], @"Should be JSON-able for the benchmark report");
+}
+
+- (void) test_load_generator
+{
+    XCTAssertEqual([LoadGenerator percentile:50 ofValues:@[@3, @1, @2, @4]], 2.0);
+    XCTAssertEqual([LoadGenerator percentile:99 ofValues:@[@3, @1, @2, @4]], 4.0);
+    XCTAssertEqual([LoadGenerator percentile:0 ofValues:@[@3, @1, @2, @4]], 1.0);
+    
+    StubServer *server = [StubServer server];
+    server.latency = 0.05;
+    
+    LoadGenerator *load = [self loadGeneratorAgainstServer:server seededPosts:10];
+    load.requestsPerSecond = 100;
+    load.duration = 0.5;
+    
+    NSDictionary *report = [load run];
+    [server stop];
+    
+    XCTAssertEqualObjects(report[@"sent"], @50);
+    XCTAssertEqualObjects(report[@"completed"], @50);
+    XCTAssertEqualObjects(report[@"errors"], @0, @"%@", report);
+    XCTAssertTrue([report[@"latency_ms"][@"p50"] doubleValue] >= 50, @"Should include the server's latency");
+    XCTAssertTrue([report[@"latency_ms"][@"max"] doubleValue] >= [report[@"latency_ms"][@"p99"] doubleValue]);
+    XCTAssertTrue([report[@"max_in_flight"] unsignedIntegerValue] > 1, @"Requests should have overlapped");
+    XCTAssertEqual([report[@"operations"] count], (NSUInteger)5);
+}
+
+- (void) test_baseline_comparison
+{
+    Benchmark *bench = [[Benchmark alloc] init];
+    bench.minimumTime = 0.001;
+    
+    BenchmarkResult *result = [bench run:@"noop" block:^{ }];
+    XCTAssertTrue(result.iterations > 0, @"Should've run at least once");
+    
+    NSDictionary *report = [NSJSONSerialization JSONObjectWithData:[bench reportJSON] options:0 error:nil];
+    XCTAssertEqualObjects([report[@"benchmarks"] valueForKey:@"name"], @[@"noop"]);
+    
+    XCTAssertEqual([bench regressionsAgainstBaseline:report tolerance:0.1].count, (NSUInteger)0, @"Shouldn't regress against itself");
+    XCTAssertEqual([bench regressionsAgainstBaseline:@{} tolerance:0.1].count, (NSUInteger)0, @"Missing baselines are ignored");
+    
+    NSDictionary *faster = @{@"benchmarks": @[@{@"name": @"noop", @"ns_per_op": @(result.nsPerOp / 2), @"allocs_per_op": [NSNull null]}]};
+    NSArray *regressions = [bench regressionsAgainstBaseline:faster tolerance:0.1];
+    XCTAssertEqual(regressions.count, (NSUInteger)1, @"Twice as slow as the baseline should be a regression");
+    XCTAssertTrue([regressions.firstObject rangeOfString:@"ns_per_op"].location != NSNotFound);
+    
+    [bench setReportValue:@{@"phases": @{@"decode": @{@"allocations": @1000, @"heap_growth": @500}},
+                            @"remote_attributes": @{@"bytes": @100}} forKey:@"memory"];
+    NSDictionary *leaner = @{@"memory": @{@"phases": @{@"decode": @{@"allocations": @500, @"heap_growth": @500}},
+                                          @"remote_attributes": @{@"bytes": @100}}};
+    regressions = [bench regressionsAgainstBaseline:leaner tolerance:0.1];
+    XCTAssertEqual(regressions.count, (NSUInteger)1, @"Twice the allocations should be a regression");
+    XCTAssertTrue([regressions.firstObject rangeOfString:@"memory/decode: allocations"].location != NSNotFound);
+}
+
+@end
@@ -15,6 +15,22 @@ extern NSString * const NSRRails4DateFormat;
 
 @end
 
+static int configLookups = 0;
+
+@interface ConfigCountingPost : Post
+
+@end
+
+@implementation ConfigCountingPost
+
++ (NSRConfig *) config
+{
+    configLookups++;
+    return [super config];
+}
+
+@end
+
 #define NSRURL(string) [NSURL URLWithString:[@"http://" stringByAppendingString:string]]
 
 #define NSRAssertRelevantConfigURL(string) \
@@ -71,6 +87,123 @@ XCTAssertEqualObjects([@"http://" stringByAppendingString:string], [NSRConfig co
     NSRAssertRelevantConfigURL(@"Default");
 }
 
+- (void) test_contexts_are_per_thread
+{
+    NSRConfig *c = [[NSRConfig alloc] init];
+    c.rootURL = NSRURL(@"Main");
+    [c use];
+    
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+    dispatch_semaphore_t checked = dispatch_semaphore_create(0);
+    __block NSRConfig *seenInBackground, *seenAfterOwnUse;
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^
+    {
+        seenInBackground = [NSRConfig contextuallyRelevantConfig];
+        
+        NSRConfig *background = [[NSRConfig alloc] init];
+        background.rootURL = NSRURL(@"Background");
+        [background use];
+        seenAfterOwnUse = [NSRConfig contextuallyRelevantConfig];
+        
+        //wait for the main thread to check it isn't affected before ending
+        dispatch_semaphore_signal(semaphore);
+        dispatch_semaphore_wait(checked, DISPATCH_TIME_FOREVER);
+        [background end];
+        dispatch_semaphore_signal(semaphore);
+    });
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    
+    XCTAssertEqual(seenInBackground, [NSRConfig defaultConfig], @"Another thread shouldn't see this thread's context");
+    XCTAssertEqualObjects(seenAfterOwnUse.rootURL, NSRURL(@"Background"));
+    NSRAssertRelevantConfigURL(@"Main");
+    
+    dispatch_semaphore_signal(checked);
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    
+    [c end];
+    XCTAssertEqual([NSRConfig contextuallyRelevantConfig], [NSRConfig defaultConfig]);
+    
+    //an exception in the block shouldn't leave the context stuck
+    XCTAssertThrows([c useIn:^{ [NSException raise:@"Test" format:@"test"]; }]);
+    XCTAssertEqual([NSRConfig contextuallyRelevantConfig], [NSRConfig defaultConfig]);
+}
+
+- (void) test_reset_configs_is_per_thread
+{
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+    dispatch_semaphore_t reset = dispatch_semaphore_create(0);
+    __block NSRConfig *seenAfterReset;
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^
+    {
+        NSRConfig *background = [[NSRConfig alloc] init];
+        background.rootURL = NSRURL(@"Background");
+        [background use];
+        
+        //let the main thread reset, then make sure this thread's context survived it
+        dispatch_semaphore_signal(semaphore);
+        dispatch_semaphore_wait(reset, DISPATCH_TIME_FOREVER);
+        seenAfterReset = [NSRConfig contextuallyRelevantConfig];
+        [background end];
+        dispatch_semaphore_signal(semaphore);
+    });
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    
+    NSRConfig *c = [[NSRConfig alloc] init];
+    c.rootURL = NSRURL(@"Main");
+    [c use];
+    
+    [NSRConfig resetConfigs];
+    XCTAssertEqual([NSRConfig contextuallyRelevantConfig], [NSRConfig defaultConfig], @"Resetting should clear this thread's stack");
+    
+    dispatch_semaphore_signal(reset);
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    
+    XCTAssertEqualObjects(seenAfterReset.rootURL, NSRURL(@"Background"), @"Resetting shouldn't touch another thread's stack");
+}
+
+- (void) test_config_resolved_once_per_object
+{
+    ConfigCountingPost *post = [[ConfigCountingPost alloc] init];
+    post.author = @"dan";
+    post.content = @"hi";
+    post.updatedAt = [NSDate date];
+    
+    configLookups = 0;
+    NSDictionary *dict = [post remoteDictionaryRepresentationWrapped:YES];
+    XCTAssertEqual(configLookups, 1, @"Should only ask for the config once while encoding");
+    
+    configLookups = 0;
+    ConfigCountingPost *decoded = [ConfigCountingPost objectWithRemoteDictionary:dict];
+    XCTAssertEqual(configLookups, 1, @"Should only ask for the config once while decoding");
+    XCTAssertEqualObjects(decoded.author, @"dan");
+    
+    configLookups = 0;
+    NSArray *all = [ConfigCountingPost objectsWithRemoteDictionaries:@[dict[@"config_counting_post"], dict[@"config_counting_post"], dict[@"config_counting_post"]]];
+    XCTAssertEqual(all.count, 3);
+    XCTAssertEqual(configLookups, 1, @"Should only ask for the config once for the whole batch");
+    
+    //outside of an encode/decode it's asked every time, so changes are picked up
+    configLookups = 0;
+    [post remoteDictionaryRepresentationWrapped:NO];
+    [post remoteDictionaryRepresentationWrapped:NO];
+    XCTAssertEqual(configLookups, 2);
+}
+
+- (void) test_cached_route_names_follow_config_changes
+{
+    [NSRConfig defaultConfig].rootURL = NSRURL(@"Default");
+    
+    NSRRequest *req = [[NSRRequest GET] routeToClass:[CustomCoder class]];
+    XCTAssertEqualObjects(req.route, @"custom_coders");
+    
+    [NSRConfig defaultConfig].autoinflectsClassNames = NO;
+    [req routeToClass:[CustomCoder class]];
+    XCTAssertEqualObjects(req.route, @"CustomCoders", @"Changing inflection settings should clear cached controller names");
+    
+    CustomCoder *coder = [[CustomCoder alloc] init];
+    XCTAssertNotNil([coder remoteDictionaryRepresentationWrapped:YES][@"CustomCoder"], @"Changing inflection settings should clear cached model names");
+}
+
 - (void) test_date_conversion
 {
     [[NSRConfig defaultConfig] configureToRailsVersion:NSRRailsVersion3];
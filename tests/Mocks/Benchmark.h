@@ -0,0 +1,49 @@
+//
+//  Benchmark.h
+//  NSRails
+//
+//  Copyright (c) 2012 InContext LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+//one measured operation. allocation figures are negative when the platform has no allocation hook
+
+@interface BenchmarkResult : NSObject
+
+@property (nonatomic, copy) NSString *name;
+@property (nonatomic) NSUInteger iterations;
+
+@property (nonatomic) double nsPerOp;
+@property (nonatomic) double allocationsPerOp;
+@property (nonatomic) double bytesPerOp;
+
+- (NSDictionary *) dictionaryRepresentation;
+
+@end
+
+@interface Benchmark : NSObject
+
+//how long each benchmark is run for once warmed up (defaults to 0.25s, or NSR_BENCHMARK_TIME)
+@property (nonatomic) NSTimeInterval minimumTime;
+
+@property (nonatomic, readonly) NSArray *results;
+
+//block is one iteration. `batch` is how many operations it does, so results come out per operation
+- (BenchmarkResult *) run:(NSString *)name batch:(NSUInteger)batch block:(void (^)(void))block;
+- (BenchmarkResult *) run:(NSString *)name block:(void (^)(void))block;
+
+//anything else worth keeping with the results (load test numbers, say) - goes in the report as is
+- (void) setReportValue:(id)value forKey:(NSString *)key;
+
+- (NSDictionary *) report;
+- (NSData *) reportJSON;
+
+//compares against a report written by an earlier run. returns a description of each metric that got worse than
+//the baseline by more than `tolerance` (0.1 == 10%), including the phases of a memory profile stored under "memory".
+//benchmarks missing from either side are ignored
+- (NSArray *) regressionsAgainstBaseline:(NSDictionary *)baseline tolerance:(double)tolerance;
+
++ (BOOL) countsAllocations;
+
+@end
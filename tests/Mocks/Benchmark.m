@@ -0,0 +1,239 @@
+//
+//  Benchmark.m
+//  NSRails
+//
+//  Copyright (c) 2012 InContext LLC. All rights reserved.
+//
+
+#import "Benchmark.h"
+
+#import <NSRails/NSRails.h>
+
+#include <time.h>
+
+#if __APPLE__
+#include <mach/mach_time.h>
+#endif
+
+static uint64_t BenchmarkNanoseconds(void)
+{
+#if __APPLE__
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0) {
+        mach_timebase_info(&timebase);
+    }
+    return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+#endif
+}
+
+@implementation BenchmarkResult
+
+- (NSDictionary *) dictionaryRepresentation
+{
+    NSMutableDictionary *dict = [NSMutableDictionary dictionary];
+    dict[@"name"] = self.name;
+    dict[@"iterations"] = @(self.iterations);
+    dict[@"ns_per_op"] = @(self.nsPerOp);
+    
+    //null rather than a made up number when we couldn't count
+    dict[@"allocs_per_op"] = (self.allocationsPerOp < 0) ? [NSNull null] : @(self.allocationsPerOp);
+    dict[@"bytes_per_op"] = (self.bytesPerOp < 0) ? [NSNull null] : @(self.bytesPerOp);
+    
+    return dict;
+}
+
+- (NSString *) description
+{
+    return [NSString stringWithFormat:@"%@: %lu iterations, %.1f ns/op, %.1f allocs/op, %.1f B/op", self.name, (unsigned long)self.iterations, self.nsPerOp, self.allocationsPerOp, self.bytesPerOp];
+}
+
+@end
+
+@interface Benchmark (private)
+
+- (uint64_t) timeIterations:(NSUInteger)iterations block:(void (^)(void))block;
+- (void) addRegressionsOf:(NSString *)name from:(NSDictionary *)before to:(NSDictionary *)after metrics:(NSArray *)metrics tolerance:(double)tolerance into:(NSMutableArray *)regressions;
+
+@end
+
+@implementation Benchmark
+{
+    NSMutableArray *results;
+    NSMutableDictionary *extras;
+}
+
+- (id) init
+{
+    if ((self = [super init]))
+    {
+        results = [[NSMutableArray alloc] init];
+        extras = [[NSMutableDictionary alloc] init];
+        
+        NSString *time = [[[NSProcessInfo processInfo] environment] objectForKey:@"NSR_BENCHMARK_TIME"];
+        self.minimumTime = (time.doubleValue > 0) ? time.doubleValue : 0.25;
+    }
+    return self;
+}
+
+- (NSArray *) results
+{
+    return results;
+}
+
++ (BOOL) countsAllocations
+{
+    return [NSRMemoryProfiler countsAllocations];
+}
+
+- (uint64_t) timeIterations:(NSUInteger)iterations block:(void (^)(void))block
+{
+    uint64_t start = BenchmarkNanoseconds();
+    for (NSUInteger i = 0; i < iterations; i++)
+    {
+        //without a pool per iteration, a 10k object decode run a few hundred times would be measuring the VM system
+        @autoreleasepool {
+            block();
+        }
+    }
+    return BenchmarkNanoseconds() - start;
+}
+
+- (BenchmarkResult *) run:(NSString *)name block:(void (^)(void))block
+{
+    return [self run:name batch:1 block:block];
+}
+
+- (BenchmarkResult *) run:(NSString *)name batch:(NSUInteger)batch block:(void (^)(void))block
+{
+    //warm up (caches, lazily built property lists, etc), then grow the iteration count until a run is long enough to trust
+    [self timeIterations:1 block:block];
+    
+    uint64_t minimum = (uint64_t)(self.minimumTime * NSEC_PER_SEC);
+    NSUInteger iterations = 1;
+    uint64_t elapsed;
+    
+    for (;;)
+    {
+        elapsed = [self timeIterations:iterations block:block];
+        if (elapsed >= minimum || iterations >= 1000000000) {
+            break;
+        }
+        
+        double perIteration = (double)MAX(elapsed, 1) / iterations;
+        NSUInteger predicted = (NSUInteger)(minimum / perIteration * 1.2);
+        iterations = MAX(MIN(predicted, iterations * 100), iterations + 1);
+    }
+    
+    BenchmarkResult *result = [[BenchmarkResult alloc] init];
+    result.name = name;
+    result.iterations = iterations;
+    result.nsPerOp = (double)elapsed / iterations / batch;
+    result.allocationsPerOp = -1;
+    result.bytesPerOp = -1;
+
+    if ([Benchmark countsAllocations])
+    {
+        //separate pass, so the hook's overhead doesn't show up in the timing
+        NSUInteger counted = MIN(iterations, 1000);
+        
+        NSRMemoryPhaseStatistics *allocated = [NSRMemoryProfiler measure:^{
+            [self timeIterations:counted block:block];
+        }];
+        
+        result.allocationsPerOp = (double)allocated.allocations / counted / batch;
+        result.bytesPerOp = (double)allocated.allocatedBytes / counted / batch;
+    }
+    
+    [results addObject:result];
+    NSLog(@"%@", result);
+    
+    return result;
+}
+
+#pragma mark - Report
+
+- (void) setReportValue:(id)value forKey:(NSString *)key
+{
+    extras[key] = value;
+}
+
+- (NSDictionary *) report
+{
+    NSProcessInfo *process = [NSProcessInfo processInfo];
+    
+    NSDateFormatter *formatter = [[NSDateFormatter alloc] init];
+    formatter.locale = [[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"];
+    formatter.timeZone = [NSTimeZone timeZoneWithAbbreviation:@"UTC"];
+    formatter.dateFormat = @"yyyy-MM-dd'T'HH:mm:ss'Z'";
+    
+    NSMutableDictionary *report = [extras mutableCopy];
+    report[@"suite"] = @"NSRails";
+    report[@"date"] = [formatter stringFromDate:[NSDate date]];
+    report[@"host"] = @{@"os": process.operatingSystemVersionString,
+                        @"processors": @(process.activeProcessorCount)};
+    report[@"benchmarks"] = [results valueForKey:@"dictionaryRepresentation"];
+    
+    return report;
+}
+
+- (NSData *) reportJSON
+{
+    return [NSJSONSerialization dataWithJSONObject:[self report] options:NSJSONWritingPrettyPrinted error:nil];
+}
+
+- (NSArray *) regressionsAgainstBaseline:(NSDictionary *)baseline tolerance:(double)tolerance
+{
+    NSMutableDictionary *baselineByName = [NSMutableDictionary dictionary];
+    for (NSDictionary *benchmark in baseline[@"benchmarks"])
+    {
+        if (benchmark[@"name"]) {
+            baselineByName[benchmark[@"name"]] = benchmark;
+        }
+    }
+    
+    NSMutableArray *regressions = [NSMutableArray array];
+    for (BenchmarkResult *result in results)
+    {
+        [self addRegressionsOf:result.name from:baselineByName[result.name] to:[result dictionaryRepresentation]
+                       metrics:@[@"ns_per_op", @"allocs_per_op", @"bytes_per_op"] tolerance:tolerance into:regressions];
+    }
+    
+    //the memory profile, if both runs made one (phases are totals over the same workload, so compare as is)
+    NSDictionary *beforeMemory = baseline[@"memory"], *afterMemory = extras[@"memory"];
+    [afterMemory[@"phases"] enumerateKeysAndObjectsUsingBlock:^(NSString *phase, NSDictionary *after, BOOL *stop) {
+        [self addRegressionsOf:[@"memory/" stringByAppendingString:phase] from:beforeMemory[@"phases"][phase] to:after
+                       metrics:@[@"allocations", @"allocated_bytes", @"heap_growth"] tolerance:tolerance into:regressions];
+    }];
+    [self addRegressionsOf:@"memory/remote_attributes" from:beforeMemory[@"remote_attributes"] to:afterMemory[@"remote_attributes"]
+                   metrics:@[@"bytes"] tolerance:tolerance into:regressions];
+    
+    return regressions;
+}
+
+- (void) addRegressionsOf:(NSString *)name from:(NSDictionary *)before to:(NSDictionary *)after metrics:(NSArray *)metrics tolerance:(double)tolerance into:(NSMutableArray *)regressions
+{
+    if (!before || !after) {
+        return;
+    }
+    
+    for (NSString *metric in metrics)
+    {
+        id previous = before[metric], current = after[metric];
+        if (![previous isKindOfClass:[NSNumber class]] || ![current isKindOfClass:[NSNumber class]]) {
+            continue;
+        }
+        
+        double oldValue = [previous doubleValue], newValue = [current doubleValue];
+        if (newValue > oldValue * (1 + tolerance) && newValue > 0)
+        {
+            [regressions addObject:[NSString stringWithFormat:@"%@: %@ went from %.1f to %.1f (+%.0f%%)", name, metric, oldValue, newValue,
+                                    (oldValue > 0) ? (newValue / oldValue - 1) * 100 : 100.0]];
+        }
+    }
+}
+
+@end
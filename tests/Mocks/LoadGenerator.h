@@ -0,0 +1,36 @@
+//
+//  LoadGenerator.h
+//  NSRails
+//
+//  Copyright (c) 2012 InContext LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+//fires a weighted mix of async operations at a fixed arrival rate (open loop - a slow response doesn't hold
+//back the next request), and reports throughput, latency percentiles and errors per operation and overall
+
+//latency is measured from when a request was *scheduled* to go out, so time spent queued up behind
+//other requests (or behind a busy main thread, for completion blocks) counts against it
+
+typedef void (^LoadCompletion)(NSError *error);
+typedef void (^LoadOperation)(LoadCompletion done);
+
+@interface LoadGenerator : NSObject
+
+@property (nonatomic) double requestsPerSecond;
+@property (nonatomic) NSTimeInterval duration;
+
+//how long to wait for stragglers once everything's been sent (default 30s). anything still out is counted as timed out
+@property (nonatomic) NSTimeInterval timeout;
+
+//the operation has to call `done` exactly once, from any thread
+- (void) addOperation:(NSString *)name weight:(NSUInteger)weight block:(LoadOperation)block;
+
+//blocks until done. if called on the main thread, it keeps the run loop going so completion blocks can run
+- (NSDictionary *) run;
+
+//nearest-rank percentile (0-100) of an array of NSNumbers
++ (double) percentile:(double)p ofValues:(NSArray *)values;
+
+@end
@@ -0,0 +1,223 @@
+//
+//  LoadGenerator.m
+//  NSRails
+//
+//  Copyright (c) 2012 InContext LLC. All rights reserved.
+//
+
+#import "LoadGenerator.h"
+
+static inline NSTimeInterval LoadNow(void)
+{
+    return [NSProcessInfo processInfo].systemUptime;
+}
+
+@interface LoadOperationStats : NSObject
+
+@property (nonatomic, strong) NSString *name;
+@property (nonatomic) NSUInteger weight;
+@property (nonatomic, copy) LoadOperation block;
+
+@property (nonatomic) NSUInteger sent;
+@property (nonatomic) NSUInteger errors;
+@property (nonatomic, strong) NSMutableArray *latencies;
+
+@end
+
+@implementation LoadOperationStats
+@end
+
+@interface LoadGenerator (private)
+
+- (NSDictionary *) summaryOfLatencies:(NSArray *)latencies;
+
+@end
+
+@implementation LoadGenerator
+{
+    NSMutableArray *operations;
+    NSUInteger totalWeight;
+}
+
+- (id) init
+{
+    if ((self = [super init]))
+    {
+        operations = [[NSMutableArray alloc] init];
+        self.requestsPerSecond = 100;
+        self.duration = 5;
+        self.timeout = 30;
+    }
+    return self;
+}
+
+- (void) addOperation:(NSString *)name weight:(NSUInteger)weight block:(LoadOperation)block
+{
+    LoadOperationStats *op = [[LoadOperationStats alloc] init];
+    op.name = name;
+    op.weight = weight;
+    op.block = block;
+    op.latencies = [NSMutableArray array];
+    
+    [operations addObject:op];
+    totalWeight += weight;
+}
+
++ (double) percentile:(double)p ofValues:(NSArray *)values
+{
+    if (values.count == 0) {
+        return 0;
+    }
+    
+    NSArray *sorted = [values sortedArrayUsingSelector:@selector(compare:)];
+    NSUInteger rank = (NSUInteger)ceil(p / 100.0 * sorted.count);
+    return [sorted[MIN(MAX(rank, 1), sorted.count) - 1] doubleValue];
+}
+
+- (NSDictionary *) summaryOfLatencies:(NSArray *)latencies
+{
+    double total = 0;
+    for (NSNumber *latency in latencies) {
+        total += latency.doubleValue;
+    }
+    
+    //in milliseconds
+    Class c = [self class];
+    return @{@"p50": @([c percentile:50 ofValues:latencies] * 1000),
+             @"p95": @([c percentile:95 ofValues:latencies] * 1000),
+             @"p99": @([c percentile:99 ofValues:latencies] * 1000),
+             @"max": @([c percentile:100 ofValues:latencies] * 1000),
+             @"mean": @(latencies.count ? total / latencies.count * 1000 : 0)};
+}
+
+- (NSDictionary *) run
+{
+    NSAssert(totalWeight > 0, @"Add at least one operation first");
+    
+    NSUInteger total = (NSUInteger)(self.requestsPerSecond * self.duration);
+    
+    dispatch_queue_t sendQueue = dispatch_queue_create("com.nsrails.load.send", DISPATCH_QUEUE_SERIAL);
+    dispatch_queue_t samplerQueue = dispatch_queue_create("com.nsrails.load.sampler", DISPATCH_QUEUE_SERIAL);
+    dispatch_group_t outstanding = dispatch_group_create();
+    
+    __block NSUInteger inFlight = 0, maxInFlight = 0;
+    __block NSTimeInterval lastCompletion = 0;
+    NSMutableArray *allLatencies = [NSMutableArray arrayWithCapacity:total];
+    NSMutableArray *mainThreadLags = [NSMutableArray array];
+    NSObject *lock = [[NSObject alloc] init];
+    
+    //how far behind the main queue is, sampled every 10ms - completion blocks run there by default
+    dispatch_source_t sampler = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, samplerQueue);
+    dispatch_source_set_timer(sampler, DISPATCH_TIME_NOW, 10 * NSEC_PER_MSEC, NSEC_PER_MSEC);
+    dispatch_source_set_event_handler(sampler, ^{
+        NSTimeInterval posted = LoadNow();
+        dispatch_async(dispatch_get_main_queue(), ^{
+            NSTimeInterval lag = LoadNow() - posted;
+            @synchronized(lock) {
+                [mainThreadLags addObject:@(lag)];
+            }
+        });
+    });
+    dispatch_resume(sampler);
+    
+    //same mix every run
+    srandom(42);
+    
+    NSTimeInterval start = LoadNow();
+    dispatch_time_t startTime = dispatch_time(DISPATCH_TIME_NOW, 0);
+    
+    for (NSUInteger i = 0; i < total; i++)
+    {
+        long pick = random() % totalWeight;
+        LoadOperationStats *op = nil;
+        for (LoadOperationStats *candidate in operations)
+        {
+            op = candidate;
+            if (pick < (long)candidate.weight) {
+                break;
+            }
+            pick -= candidate.weight;
+        }
+        
+        NSTimeInterval offset = i / self.requestsPerSecond;
+        NSTimeInterval scheduled = start + offset;
+        
+        dispatch_group_enter(outstanding);
+        dispatch_after(dispatch_time(startTime, (int64_t)(offset * NSEC_PER_SEC)), sendQueue, ^{
+            @synchronized(lock)
+            {
+                op.sent++;
+                inFlight++;
+                maxInFlight = MAX(maxInFlight, inFlight);
+            }
+            
+            __block BOOL finished = NO;
+            op.block(^(NSError *error) {
+                NSTimeInterval latency = LoadNow() - scheduled;
+                @synchronized(lock)
+                {
+                    if (finished) {
+                        return;
+                    }
+                    finished = YES;
+                    inFlight--;
+                    lastCompletion = LoadNow();
+                    
+                    [op.latencies addObject:@(latency)];
+                    [allLatencies addObject:@(latency)];
+                    if (error) {
+                        op.errors++;
+                    }
+                }
+                dispatch_group_leave(outstanding);
+            });
+        });
+    }
+    
+    NSTimeInterval deadline = start + self.duration + self.timeout;
+    if ([NSThread isMainThread])
+    {
+        while (dispatch_group_wait(outstanding, DISPATCH_TIME_NOW) != 0 && LoadNow() < deadline) {
+            [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+        }
+    }
+    else
+    {
+        dispatch_group_wait(outstanding, dispatch_time(DISPATCH_TIME_NOW, (int64_t)((deadline - LoadNow()) * NSEC_PER_SEC)));
+    }
+    
+    dispatch_source_cancel(sampler);
+    
+    NSMutableDictionary *report = [NSMutableDictionary dictionary];
+    @synchronized(lock)
+    {
+        NSUInteger errors = 0;
+        NSMutableDictionary *byOperation = [NSMutableDictionary dictionary];
+        for (LoadOperationStats *op in operations)
+        {
+            errors += op.errors;
+            byOperation[op.name] = @{@"sent": @(op.sent),
+                                     @"completed": @(op.latencies.count),
+                                     @"errors": @(op.errors),
+                                     @"latency_ms": [self summaryOfLatencies:op.latencies]};
+        }
+        
+        NSTimeInterval elapsed = (lastCompletion ?: LoadNow()) - start;
+        
+        report[@"target_rps"] = @(self.requestsPerSecond);
+        report[@"duration"] = @(self.duration);
+        report[@"sent"] = @(total);
+        report[@"completed"] = @(allLatencies.count);
+        report[@"errors"] = @(errors);
+        report[@"timed_out"] = @(total - allLatencies.count);
+        report[@"throughput"] = @(elapsed > 0 ? allLatencies.count / elapsed : 0);
+        report[@"max_in_flight"] = @(maxInFlight);
+        report[@"latency_ms"] = [self summaryOfLatencies:allLatencies];
+        report[@"main_thread_lag_ms"] = [self summaryOfLatencies:mainThreadLags];
+        report[@"operations"] = byOperation;
+    }
+    
+    return report;
+}
+
+@end
@@ -13,6 +13,7 @@
 + (NSString *) datetime;
 
 + (NSString *) full404Error;
++ (NSString *) full500Error;
 + (NSString *) short404Error;
 
 + (NSString *) validation422Error;
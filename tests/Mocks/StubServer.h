@@ -0,0 +1,124 @@
+//
+//  StubServer.h
+//  NSRails
+//
+//  Copyright (c) 2012 InContext LLC. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+//an HTTP/1.1 server on 127.0.0.1 that runs inside the test process, so requests go through the real loopback
+//stack (NSURLConnection, sockets, keep-alive) without needing the rails app in tests/mock-server
+
+@interface StubRequest : NSObject
+
+@property (nonatomic, strong) NSString *method;
+@property (nonatomic, strong) NSString *path;
+@property (nonatomic, strong) NSDictionary *query;
+
+//header names are lowercased
+@property (nonatomic, strong) NSDictionary *headers;
+@property (nonatomic, strong) NSData *body;
+
+//values for the :placeholders in the route's path
+@property (nonatomic, strong) NSDictionary *parameters;
+
+- (id) JSONBody;
+
+@end
+
+@interface StubResponse : NSObject
+
+@property (nonatomic) NSInteger statusCode;
+@property (nonatomic, strong) NSDictionary *headers;
+@property (nonatomic, strong) NSData *body;
+
++ (instancetype) responseWithStatus:(NSInteger)status;
++ (instancetype) responseWithStatus:(NSInteger)status JSON:(id)object;
++ (instancetype) responseWithStatus:(NSInteger)status body:(NSString *)body contentType:(NSString *)contentType;
+
+//the same bodies the rails app gives for these (see MockServer) - 404, 422, 429 and 500 have their own, anything else is empty
++ (instancetype) errorResponseWithStatus:(NSInteger)status;
+
+@end
+
+typedef StubResponse *(^StubResponder)(StubRequest *request);
+
+@interface StubRoute : NSObject
+
+@property (nonatomic, readonly) NSString *method;
+@property (nonatomic, readonly) NSString *path;
+
+@property (nonatomic, copy) StubResponder responder;
+
+//network shaping. zero means use the server's setting
+//latency is time to first byte, bytesPerSecond caps how fast the response (headers included) is written,
+//and a chunkSize sends the body with Transfer-Encoding: chunked, in pieces that size
+@property (nonatomic) NSTimeInterval latency;
+@property (nonatomic) NSUInteger bytesPerSecond;
+@property (nonatomic) NSUInteger chunkSize;
+
+//sent as Retry-After with injected 429s (omitted if 0)
+@property (nonatomic) NSTimeInterval retryAfter;
+
+@property (nonatomic, readonly) NSUInteger hits;
+
+//the next `times` requests to this route get errorResponseWithStatus: instead. NSUIntegerMax keeps it up until cleared
+- (void) injectStatus:(NSInteger)status times:(NSUInteger)times;
+- (void) clearInjectedStatus;
+
+@end
+
+//a text/event-stream endpoint. GETs to its path are answered with a 200 and held open, and get every event sent while they're connected
+@interface StubEventStream : NSObject
+
+@property (nonatomic, readonly) NSString *path;
+
+//connections so far (open or not), how many are open now, and the Last-Event-ID each one came with (NSNull if none), in order
+@property (nonatomic, readonly) NSUInteger connectionCount;
+@property (nonatomic, readonly) NSUInteger openConnectionCount;
+@property (nonatomic, readonly) NSArray *lastEventIDs;
+
+//events are kept, so a client that reconnects with a Last-Event-ID is sent the ones after it first. a nil eventID sends no id: field
+- (void) sendEvent:(NSString *)event JSON:(id)object eventID:(NSString *)eventID;
+
+//written to every open connection as is, and not kept - for retry: fields, comments, events split across writes
+- (void) sendText:(NSString *)text;
+
+//ends every open stream (cleanly, with the last chunk), as a server that restarts would
+- (void) disconnectClients;
+
+@end
+
+@interface StubServer : NSObject
+
+//a started server, or nil if it couldn't bind
++ (instancetype) server;
+
+- (BOOL) start:(NSError **)error;
+- (void) stop;
+
+@property (nonatomic, readonly) NSURL *baseURL;
+@property (nonatomic, readonly) unsigned short port;
+
+//defaults for every route that doesn't set its own
+@property (nonatomic) NSTimeInterval latency;
+@property (nonatomic) NSUInteger bytesPerSecond;
+@property (nonatomic) NSUInteger chunkSize;
+
+@property (nonatomic, readonly) NSUInteger requestCount;
+
+//paths are matched segment by segment (without the query string or a trailing .json), and segments starting with
+//a colon match anything, eg "posts/:id". routes added later win. unmatched requests get a 404
+- (StubRoute *) route:(NSString *)method path:(NSString *)path responder:(StubResponder)responder;
+- (StubRoute *) route:(NSString *)method path:(NSString *)path status:(NSInteger)status JSON:(id)object;
+
+- (StubRoute *) routeForMethod:(NSString *)method path:(NSString *)path;
+
+//GETs to `path` (matched like a route's) get the event stream instead of a route's response
+- (StubEventStream *) eventStreamAtPath:(NSString *)path;
+
+//CRUD for posts and responses backed by dictionaries, behaving like the controllers in tests/mock-server
+- (void) addPostsAndResponsesRoutes;
+
+@end
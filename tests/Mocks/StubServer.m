@@ -0,0 +1,1057 @@
+//
+//  StubServer.m
+//  NSRails
+//
+//  Copyright (c) 2012 InContext LLC. All rights reserved.
+//
+
+#import "StubServer.h"
+#import "MockServer.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifdef MSG_NOSIGNAL
+#define StubSendFlags MSG_NOSIGNAL
+#else
+#define StubSendFlags 0
+#endif
+
+static NSString *StubReasonPhrase(NSInteger status)
+{
+    switch (status)
+    {
+        case 200: return @"OK";
+        case 201: return @"Created";
+        case 204: return @"No Content";
+        case 401: return @"Unauthorized";
+        case 404: return @"Not Found";
+        case 422: return @"Unprocessable Entity";
+        case 429: return @"Too Many Requests";
+        case 500: return @"Internal Server Error";
+        case 503: return @"Service Unavailable";
+        default:  return @"Status";
+    }
+}
+
+//writes everything, or returns NO if the other end went away. with a bandwidth cap, it goes out in 20ms slices
+static BOOL StubWrite(int fd, const char *bytes, size_t length, NSUInteger bytesPerSecond)
+{
+    size_t slice = bytesPerSecond ? MAX(1, bytesPerSecond / 50) : length;
+    
+    while (length > 0)
+    {
+        size_t n = MIN(slice, length);
+        size_t sent = 0;
+        while (sent < n)
+        {
+            ssize_t written = send(fd, bytes + sent, n - sent, StubSendFlags);
+            if (written < 0)
+            {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return NO;
+            }
+            sent += written;
+        }
+        
+        bytes += n;
+        length -= n;
+        
+        if (bytesPerSecond) {
+            usleep((useconds_t)(n * 1000000.0 / bytesPerSecond));
+        }
+    }
+    return YES;
+}
+
+//one piece of a Transfer-Encoding: chunked body
+static BOOL StubWriteChunk(int fd, const void *bytes, NSUInteger length, NSUInteger bytesPerSecond)
+{
+    NSMutableData *framed = [[[NSString stringWithFormat:@"%lx\r\n", (unsigned long)length] dataUsingEncoding:NSASCIIStringEncoding] mutableCopy];
+    [framed appendBytes:bytes length:length];
+    [framed appendBytes:"\r\n" length:2];
+    
+    return StubWrite(fd, framed.bytes, framed.length, bytesPerSecond);
+}
+
+static NSArray *StubPathSegments(NSString *path)
+{
+    if ([path hasSuffix:@".json"]) {
+        path = [path substringToIndex:path.length - 5];
+    }
+    
+    NSMutableArray *segments = [NSMutableArray array];
+    for (NSString *segment in [path componentsSeparatedByString:@"/"])
+    {
+        if (segment.length > 0) {
+            [segments addObject:segment];
+        }
+    }
+    return segments;
+}
+
+static NSString *StubTimestamp(void)
+{
+    static NSDateFormatter *formatter;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        formatter = [[NSDateFormatter alloc] init];
+        formatter.locale = [[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"];
+        formatter.timeZone = [NSTimeZone timeZoneWithAbbreviation:@"UTC"];
+        formatter.dateFormat = @"yyyy-MM-dd'T'HH:mm:ss'Z'";
+    });
+    
+    @synchronized(formatter) {
+        return [formatter stringFromDate:[NSDate date]];
+    }
+}
+
+@implementation StubRequest
+
+- (id) JSONBody
+{
+    if (self.body.length == 0) {
+        return nil;
+    }
+    return [NSJSONSerialization JSONObjectWithData:self.body options:NSJSONReadingMutableContainers error:nil];
+}
+
+@end
+
+@implementation StubResponse
+
++ (instancetype) responseWithStatus:(NSInteger)status
+{
+    StubResponse *response = [[self alloc] init];
+    response.statusCode = status;
+    response.headers = @{};
+    response.body = [NSData data];
+    return response;
+}
+
++ (instancetype) responseWithStatus:(NSInteger)status JSON:(id)object
+{
+    StubResponse *response = [self responseWithStatus:status];
+    response.headers = @{@"Content-Type": @"application/json; charset=utf-8"};
+    response.body = object ? [NSJSONSerialization dataWithJSONObject:object options:0 error:nil] : [NSData data];
+    return response;
+}
+
++ (instancetype) responseWithStatus:(NSInteger)status body:(NSString *)body contentType:(NSString *)contentType
+{
+    StubResponse *response = [self responseWithStatus:status];
+    response.headers = @{@"Content-Type": [contentType stringByAppendingString:@"; charset=utf-8"]};
+    response.body = [body dataUsingEncoding:NSUTF8StringEncoding];
+    return response;
+}
+
++ (instancetype) errorResponseWithStatus:(NSInteger)status
+{
+    switch (status)
+    {
+        case 404:
+            return [self responseWithStatus:status body:[MockServer full404Error] contentType:@"text/html"];
+        case 422:
+            return [self responseWithStatus:status body:[MockServer validation422Error] contentType:@"application/json"];
+        case 429:
+            return [self responseWithStatus:status body:@"Rate limit exceeded" contentType:@"text/plain"];
+        case 500:
+            return [self responseWithStatus:status body:[MockServer full500Error] contentType:@"text/html"];
+        default:
+            return [self responseWithStatus:status];
+    }
+}
+
+@end
+
+@interface StubRoute (private)
+
+- (id) initWithMethod:(NSString *)method path:(NSString *)path;
+- (NSDictionary *) parametersMatchingSegments:(NSArray *)requestSegments;
+- (StubResponse *) respondTo:(StubRequest *)request;
+
+@end
+
+@implementation StubRoute
+{
+    NSArray *segments;
+    
+    NSInteger injectedStatus;
+    NSUInteger injectedTimes;
+}
+@synthesize method, path, hits;
+
+- (id) initWithMethod:(NSString *)m path:(NSString *)p
+{
+    if ((self = [super init]))
+    {
+        method = [m uppercaseString];
+        path = p;
+        segments = StubPathSegments(p);
+    }
+    return self;
+}
+
+- (NSDictionary *) parametersMatchingSegments:(NSArray *)requestSegments
+{
+    if (requestSegments.count != segments.count) {
+        return nil;
+    }
+    
+    NSMutableDictionary *parameters = [NSMutableDictionary dictionary];
+    for (NSUInteger i = 0; i < segments.count; i++)
+    {
+        NSString *segment = segments[i];
+        if ([segment hasPrefix:@":"]) {
+            parameters[[segment substringFromIndex:1]] = requestSegments[i];
+        }
+        else if (![segment isEqualToString:requestSegments[i]]) {
+            return nil;
+        }
+    }
+    return parameters;
+}
+
+- (void) injectStatus:(NSInteger)status times:(NSUInteger)times
+{
+    @synchronized(self)
+    {
+        injectedStatus = status;
+        injectedTimes = times;
+    }
+}
+
+- (void) clearInjectedStatus
+{
+    [self injectStatus:0 times:0];
+}
+
+- (StubResponse *) respondTo:(StubRequest *)request
+{
+    StubResponse *injected = nil;
+    
+    @synchronized(self)
+    {
+        hits++;
+        
+        if (injectedTimes > 0)
+        {
+            if (injectedTimes != NSUIntegerMax) {
+                injectedTimes--;
+            }
+            
+            injected = [StubResponse errorResponseWithStatus:injectedStatus];
+            if (injectedStatus == 429 && self.retryAfter > 0)
+            {
+                NSMutableDictionary *headers = [injected.headers mutableCopy];
+                headers[@"Retry-After"] = [NSString stringWithFormat:@"%g", self.retryAfter];
+                injected.headers = headers;
+            }
+        }
+    }
+    
+    if (injected) {
+        return injected;
+    }
+    
+    return (self.responder ? self.responder(request) : nil) ?: [StubResponse responseWithStatus:200];
+}
+
+@end
+
+@interface StubEventStream (private)
+
+- (id) initWithPath:(NSString *)path;
+- (BOOL) matchesSegments:(NSArray *)requestSegments;
+- (void) serveClient:(int)fd request:(StubRequest *)request;
+- (void) writeToClients:(NSString *)text;
+
+@end
+
+@implementation StubEventStream
+{
+    NSArray *segments;
+    
+    //[eventID (or NSNull), text] for every event sent, in order
+    NSMutableArray *events;
+    NSMutableSet *clients;
+    NSMutableArray *lastEventIDs;
+}
+@synthesize path, connectionCount;
+
+- (id) initWithPath:(NSString *)p
+{
+    if ((self = [super init]))
+    {
+        path = p;
+        segments = StubPathSegments(p);
+        events = [[NSMutableArray alloc] init];
+        clients = [[NSMutableSet alloc] init];
+        lastEventIDs = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+- (BOOL) matchesSegments:(NSArray *)requestSegments
+{
+    return [segments isEqualToArray:requestSegments];
+}
+
+- (NSUInteger) openConnectionCount
+{
+    @synchronized(self) {
+        return clients.count;
+    }
+}
+
+- (NSArray *) lastEventIDs
+{
+    @synchronized(self) {
+        return [lastEventIDs copy];
+    }
+}
+
+- (void) sendEvent:(NSString *)event JSON:(id)object eventID:(NSString *)eventID
+{
+    NSMutableString *text = [NSMutableString string];
+    if (event) {
+        [text appendFormat:@"event: %@\n", event];
+    }
+    if (eventID) {
+        [text appendFormat:@"id: %@\n", eventID];
+    }
+    
+    NSData *json = [NSJSONSerialization dataWithJSONObject:object options:0 error:nil];
+    [text appendFormat:@"data: %@\n\n", [[NSString alloc] initWithData:json encoding:NSUTF8StringEncoding]];
+    
+    @synchronized(self)
+    {
+        [events addObject:@[eventID ?: [NSNull null], text]];
+        [self writeToClients:text];
+    }
+}
+
+- (void) sendText:(NSString *)text
+{
+    @synchronized(self) {
+        [self writeToClients:text];
+    }
+}
+
+- (void) writeToClients:(NSString *)text
+{
+    //each write is its own chunk, so the client gets it right away
+    NSData *data = [text dataUsingEncoding:NSUTF8StringEncoding];
+    for (NSNumber *fd in clients) {
+        StubWriteChunk(fd.intValue, data.bytes, data.length, 0);
+    }
+}
+
+- (void) disconnectClients
+{
+    @synchronized(self)
+    {
+        for (NSNumber *fd in clients)
+        {
+            StubWrite(fd.intValue, "0\r\n\r\n", 5, 0);
+            shutdown(fd.intValue, SHUT_RDWR);
+        }
+    }
+}
+
+- (void) serveClient:(int)fd request:(StubRequest *)request
+{
+    NSString *lastEventID = request.headers[@"last-event-id"];
+    
+    //nosniff, or the client holds back the first few hundred bytes to guess the content type
+    const char *head = "HTTP/1.1 200 OK\r\n"
+                       "Content-Type: text/event-stream; charset=utf-8\r\n"
+                       "Cache-Control: no-cache\r\n"
+                       "X-Content-Type-Options: nosniff\r\n"
+                       "Transfer-Encoding: chunked\r\n"
+                       "Connection: close\r\n\r\n";
+    
+    @synchronized(self)
+    {
+        connectionCount++;
+        [lastEventIDs addObject:lastEventID ?: [NSNull null]];
+        
+        if (!StubWrite(fd, head, strlen(head), 0)) {
+            return;
+        }
+        
+        //catch the client up on everything after the last event it saw
+        NSUInteger resumeFrom = events.count;
+        for (NSUInteger i = 0; lastEventID && i < events.count; i++)
+        {
+            if ([events[i][0] isEqual:lastEventID]) {
+                resumeFrom = i + 1;
+            }
+        }
+        for (NSUInteger i = resumeFrom; i < events.count; i++)
+        {
+            NSData *data = [events[i][1] dataUsingEncoding:NSUTF8StringEncoding];
+            StubWriteChunk(fd, data.bytes, data.length, 0);
+        }
+        
+        [clients addObject:@(fd)];
+    }
+    
+    //held open until the client goes away or the stream's disconnected - anything the client sends is ignored
+    char buffer[1024];
+    while (recv(fd, buffer, sizeof(buffer), 0) > 0);
+    
+    @synchronized(self) {
+        [clients removeObject:@(fd)];
+    }
+}
+
+@end
+
+@interface StubServer (private)
+
+- (void) acceptConnections;
+- (void) serveConnection:(NSNumber *)fd;
+
+- (StubRoute *) routeMatchingRequest:(StubRequest *)request;
+- (StubEventStream *) eventStreamMatchingRequest:(StubRequest *)request;
+
+- (StubRequest *) readRequestFrom:(int)fd buffer:(NSMutableData *)buffer;
+- (BOOL) writeResponse:(StubResponse *)response to:(int)fd forRequest:(StubRequest *)request route:(StubRoute *)route keepAlive:(BOOL)keepAlive;
+
+- (NSDictionary *) validationErrorsForRecord:(NSDictionary *)record;
+- (NSMutableDictionary *) recordWithID:(id)recordID inTable:(NSString *)table;
+- (NSDictionary *) representationOfRecord:(NSDictionary *)record inTable:(NSString *)table;
+- (NSMutableDictionary *) insertRecord:(NSDictionary *)attributes inTable:(NSString *)table;
+- (void) assignAttributes:(NSDictionary *)attributes toRecord:(NSMutableDictionary *)record inTable:(NSString *)table;
+- (void) addRoutesForTable:(NSString *)table parameterKey:(NSString *)parameterKey;
+
+@end
+
+@implementation StubServer
+{
+    int listener;
+    dispatch_source_t acceptSource;
+    
+    NSMutableArray *routes;
+    NSMutableArray *eventStreams;
+    NSMutableSet *connections;
+    
+    NSMutableDictionary *store;
+}
+@synthesize port, requestCount;
+
++ (instancetype) server
+{
+    StubServer *server = [[self alloc] init];
+    return [server start:nil] ? server : nil;
+}
+
+- (id) init
+{
+    if ((self = [super init]))
+    {
+        listener = -1;
+        routes = [[NSMutableArray alloc] init];
+        eventStreams = [[NSMutableArray alloc] init];
+        connections = [[NSMutableSet alloc] init];
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    [self stop];
+}
+
+- (NSURL *) baseURL
+{
+    return [NSURL URLWithString:[NSString stringWithFormat:@"http://127.0.0.1:%d", port]];
+}
+
+#pragma mark - Lifecycle
+
+- (BOOL) start:(NSError **)error
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    
+    struct sockaddr_in address;
+    socklen_t length = sizeof(address);
+    memset(&address, 0, sizeof(address));
+
+#if __APPLE__
+    address.sin_len = sizeof(address);
+#endif
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    
+    int yes = 1;
+    if (fd < 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) < 0 ||
+        bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(fd, SOMAXCONN) < 0 ||
+        getsockname(fd, (struct sockaddr *)&address, &length) < 0 ||
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0)
+    {
+        if (error) {
+            *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        return NO;
+    }
+    
+    listener = fd;
+    port = ntohs(address.sin_port);
+    
+    acceptSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, fd, 0, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0));
+    
+    __weak StubServer *weakSelf = self;
+    dispatch_source_set_event_handler(acceptSource, ^{
+        [weakSelf acceptConnections];
+    });
+    dispatch_source_set_cancel_handler(acceptSource, ^{
+        close(fd);
+    });
+    dispatch_resume(acceptSource);
+    
+    return YES;
+}
+
+- (void) stop
+{
+    if (acceptSource)
+    {
+        dispatch_source_cancel(acceptSource);
+        acceptSource = nil;
+        listener = -1;
+    }
+    
+    //wakes up connection threads blocked in recv - they close their own sockets on the way out
+    @synchronized(connections)
+    {
+        for (NSNumber *fd in connections) {
+            shutdown(fd.intValue, SHUT_RDWR);
+        }
+    }
+}
+
+- (void) acceptConnections
+{
+    for (;;)
+    {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0) {
+            return;
+        }
+        
+        //accepted sockets inherit O_NONBLOCK on some platforms - connection threads want to block
+        fcntl(client, F_SETFL, fcntl(client, F_GETFL) & ~O_NONBLOCK);
+        
+        int yes = 1;
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+#ifdef SO_NOSIGPIPE
+        setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &yes, sizeof(yes));
+#endif
+        
+        @synchronized(connections) {
+            [connections addObject:@(client)];
+        }
+        
+        //one thread per connection, so latency injected on one doesn't hold up the others
+        [NSThread detachNewThreadSelector:@selector(serveConnection:) toTarget:self withObject:@(client)];
+    }
+}
+
+#pragma mark - Routes
+
+- (StubRoute *) route:(NSString *)method path:(NSString *)path responder:(StubResponder)responder
+{
+    StubRoute *route = [[StubRoute alloc] initWithMethod:method path:path];
+    route.responder = responder;
+    
+    @synchronized(routes) {
+        [routes insertObject:route atIndex:0];
+    }
+    return route;
+}
+
+- (StubRoute *) route:(NSString *)method path:(NSString *)path status:(NSInteger)status JSON:(id)object
+{
+    return [self route:method path:path responder:^StubResponse *(StubRequest *request) {
+        return [StubResponse responseWithStatus:status JSON:object];
+    }];
+}
+
+- (StubRoute *) routeForMethod:(NSString *)method path:(NSString *)path
+{
+    @synchronized(routes)
+    {
+        for (StubRoute *route in routes)
+        {
+            if ([route.method isEqualToString:[method uppercaseString]] && [route.path isEqualToString:path]) {
+                return route;
+            }
+        }
+    }
+    return nil;
+}
+
+- (StubRoute *) routeMatchingRequest:(StubRequest *)request
+{
+    NSArray *segments = StubPathSegments(request.path);
+    
+    @synchronized(routes)
+    {
+        for (StubRoute *route in routes)
+        {
+            if (![route.method isEqualToString:request.method]) {
+                continue;
+            }
+            
+            NSDictionary *parameters = [route parametersMatchingSegments:segments];
+            if (parameters)
+            {
+                request.parameters = parameters;
+                return route;
+            }
+        }
+    }
+    return nil;
+}
+
+- (StubEventStream *) eventStreamAtPath:(NSString *)path
+{
+    StubEventStream *stream = [[StubEventStream alloc] initWithPath:path];
+    
+    @synchronized(eventStreams) {
+        [eventStreams insertObject:stream atIndex:0];
+    }
+    return stream;
+}
+
+- (StubEventStream *) eventStreamMatchingRequest:(StubRequest *)request
+{
+    if (![request.method isEqualToString:@"GET"]) {
+        return nil;
+    }
+    
+    NSArray *segments = StubPathSegments(request.path);
+    
+    @synchronized(eventStreams)
+    {
+        for (StubEventStream *stream in eventStreams)
+        {
+            if ([stream matchesSegments:segments]) {
+                return stream;
+            }
+        }
+    }
+    return nil;
+}
+
+#pragma mark - Connections
+
+- (void) serveConnection:(NSNumber *)fdNumber
+{
+    @autoreleasepool
+    {
+        int fd = fdNumber.intValue;
+        NSMutableData *buffer = [NSMutableData data];
+        
+        for (;;)
+        {
+            @autoreleasepool
+            {
+                StubRequest *request = [self readRequestFrom:fd buffer:buffer];
+                if (!request) {
+                    break;
+                }
+                
+                @synchronized(self) {
+                    requestCount++;
+                }
+                
+                //streams hold the connection until they're done with it
+                StubEventStream *stream = [self eventStreamMatchingRequest:request];
+                if (stream)
+                {
+                    [stream serveClient:fd request:request];
+                    break;
+                }
+                
+                StubRoute *route = [self routeMatchingRequest:request];
+                StubResponse *response = route ? [route respondTo:request] : [StubResponse errorResponseWithStatus:404];
+                
+                NSTimeInterval latency = route.latency ?: self.latency;
+                if (latency > 0) {
+                    [NSThread sleepForTimeInterval:latency];
+                }
+                
+                BOOL keepAlive = ![[request.headers[@"connection"] lowercaseString] isEqualToString:@"close"];
+                if (![self writeResponse:response to:fd forRequest:request route:route keepAlive:keepAlive] || !keepAlive) {
+                    break;
+                }
+            }
+        }
+        
+        @synchronized(connections) {
+            [connections removeObject:fdNumber];
+        }
+        close(fd);
+    }
+}
+
+- (StubRequest *) readRequestFrom:(int)fd buffer:(NSMutableData *)buffer
+{
+    char chunk[16 * 1024];
+    NSData *separator = [@"\r\n\r\n" dataUsingEncoding:NSASCIIStringEncoding];
+    
+    NSRange headerEnd;
+    while ((headerEnd = [buffer rangeOfData:separator options:0 range:NSMakeRange(0, buffer.length)]).location == NSNotFound)
+    {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) {
+            return nil;
+        }
+        [buffer appendBytes:chunk length:n];
+    }
+    
+    NSString *head = [[NSString alloc] initWithData:[buffer subdataWithRange:NSMakeRange(0, headerEnd.location)] encoding:NSISOLatin1StringEncoding];
+    NSArray *lines = [head componentsSeparatedByString:@"\r\n"];
+    NSArray *requestLine = [lines[0] componentsSeparatedByString:@" "];
+    if (requestLine.count < 2) {
+        return nil;
+    }
+    
+    StubRequest *request = [[StubRequest alloc] init];
+    request.method = [requestLine[0] uppercaseString];
+    
+    NSString *target = requestLine[1];
+    NSRange queryStart = [target rangeOfString:@"?"];
+    request.path = (queryStart.location == NSNotFound) ? target : [target substringToIndex:queryStart.location];
+    
+    NSMutableDictionary *query = [NSMutableDictionary dictionary];
+    if (queryStart.location != NSNotFound)
+    {
+        for (NSString *pair in [[target substringFromIndex:queryStart.location + 1] componentsSeparatedByString:@"&"])
+        {
+            NSArray *parts = [[pair stringByReplacingOccurrencesOfString:@"+" withString:@" "] componentsSeparatedByString:@"="];
+            NSString *key = CFBridgingRelease(CFURLCreateStringByReplacingPercentEscapes(NULL, (__bridge CFStringRef)parts[0], CFSTR("")));
+            NSString *value = (parts.count > 1) ? CFBridgingRelease(CFURLCreateStringByReplacingPercentEscapes(NULL, (__bridge CFStringRef)parts[1], CFSTR(""))) : @"";
+            if (key.length > 0) {
+                query[key] = value ?: @"";
+            }
+        }
+    }
+    request.query = query;
+    
+    NSMutableDictionary *headers = [NSMutableDictionary dictionary];
+    for (NSUInteger i = 1; i < lines.count; i++)
+    {
+        NSRange colon = [lines[i] rangeOfString:@":"];
+        if (colon.location != NSNotFound)
+        {
+            NSString *name = [[lines[i] substringToIndex:colon.location] lowercaseString];
+            headers[name] = [[lines[i] substringFromIndex:colon.location + 1] stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+        }
+    }
+    request.headers = headers;
+    
+    NSUInteger bodyStart = NSMaxRange(headerEnd);
+    NSUInteger contentLength = [headers[@"content-length"] integerValue];
+    while (buffer.length < bodyStart + contentLength)
+    {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) {
+            return nil;
+        }
+        [buffer appendBytes:chunk length:n];
+    }
+    
+    request.body = [buffer subdataWithRange:NSMakeRange(bodyStart, contentLength)];
+    
+    //whatever's left is the start of the next request on this connection
+    [buffer replaceBytesInRange:NSMakeRange(0, bodyStart + contentLength) withBytes:NULL length:0];
+    
+    return request;
+}
+
+- (BOOL) writeResponse:(StubResponse *)response to:(int)fd forRequest:(StubRequest *)request route:(StubRoute *)route keepAlive:(BOOL)keepAlive
+{
+    NSUInteger bytesPerSecond = route.bytesPerSecond ?: self.bytesPerSecond;
+    NSUInteger chunkSize = route.chunkSize ?: self.chunkSize;
+    
+    NSData *body = [request.method isEqualToString:@"HEAD"] ? [NSData data] : response.body;
+    
+    NSMutableString *head = [NSMutableString stringWithFormat:@"HTTP/1.1 %ld %@\r\n", (long)response.statusCode, StubReasonPhrase(response.statusCode)];
+    [response.headers enumerateKeysAndObjectsUsingBlock:^(NSString *name, NSString *value, BOOL *stop) {
+        [head appendFormat:@"%@: %@\r\n", name, value];
+    }];
+    
+    if (chunkSize > 0) {
+        [head appendString:@"Transfer-Encoding: chunked\r\n"];
+    }
+    else {
+        [head appendFormat:@"Content-Length: %lu\r\n", (unsigned long)response.body.length];
+    }
+    [head appendFormat:@"Connection: %@\r\n\r\n", keepAlive ? @"keep-alive" : @"close"];
+    
+    NSData *headData = [head dataUsingEncoding:NSISOLatin1StringEncoding];
+    if (!StubWrite(fd, headData.bytes, headData.length, bytesPerSecond)) {
+        return NO;
+    }
+    
+    if (chunkSize == 0) {
+        return StubWrite(fd, body.bytes, body.length, bytesPerSecond);
+    }
+    
+    //each chunk is its own write, so with TCP_NODELAY the client really does get them one by one
+    for (NSUInteger offset = 0; offset < body.length; offset += chunkSize)
+    {
+        NSUInteger length = MIN(chunkSize, body.length - offset);
+        if (!StubWriteChunk(fd, (const char *)body.bytes + offset, length, bytesPerSecond)) {
+            return NO;
+        }
+    }
+    return StubWrite(fd, "0\r\n\r\n", 5, bytesPerSecond);
+}
+
+#pragma mark - Posts and responses
+
+- (NSDictionary *) validationErrorsForRecord:(NSDictionary *)record
+{
+    NSMutableDictionary *errors = [NSMutableDictionary dictionary];
+    for (NSString *key in @[@"content", @"author"])
+    {
+        id value = record[key];
+        if (![value isKindOfClass:[NSString class]] || [value length] == 0) {
+            errors[key] = @[@"can't be blank"];
+        }
+    }
+    return errors.count ? errors : nil;
+}
+
+- (NSMutableDictionary *) recordWithID:(id)recordID inTable:(NSString *)table
+{
+    for (NSMutableDictionary *record in store[table])
+    {
+        if ([[record[@"id"] description] isEqualToString:[recordID description]]) {
+            return record;
+        }
+    }
+    return nil;
+}
+
+//same as rails' to_json(:include => ...) in the mock-server controllers
+- (NSDictionary *) representationOfRecord:(NSDictionary *)record inTable:(NSString *)table
+{
+    NSMutableDictionary *json = [record mutableCopy];
+    
+    if ([table isEqualToString:@"posts"])
+    {
+        NSMutableArray *responses = [NSMutableArray array];
+        for (NSDictionary *response in store[@"responses"])
+        {
+            if ([response[@"post_id"] isEqual:record[@"id"]]) {
+                [responses addObject:response];
+            }
+        }
+        json[@"responses"] = responses;
+    }
+    else
+    {
+        json[@"post"] = [self recordWithID:record[@"post_id"] inTable:@"posts"] ?: [NSNull null];
+    }
+    return json;
+}
+
+- (void) assignAttributes:(NSDictionary *)attributes toRecord:(NSMutableDictionary *)record inTable:(NSString *)table
+{
+    for (NSString *key in attributes)
+    {
+        if ([key isEqualToString:@"id"] || [key hasSuffix:@"_attributes"]) {
+            continue;
+        }
+        record[key] = attributes[key];
+    }
+    
+    if ([table isEqualToString:@"responses"])
+    {
+        NSDictionary *post = attributes[@"post_attributes"];
+        if ([post isKindOfClass:[NSDictionary class]])
+        {
+            NSMutableDictionary *existing = [self recordWithID:post[@"id"] inTable:@"posts"];
+            if (existing) {
+                [self assignAttributes:post toRecord:existing inTable:@"posts"];
+            }
+            else if (![self validationErrorsForRecord:post]) {
+                existing = [self insertRecord:post inTable:@"posts"];
+            }
+            record[@"post_id"] = existing[@"id"] ?: [NSNull null];
+        }
+    }
+    else
+    {
+        id nested = attributes[@"responses_attributes"];
+        NSArray *responses = [nested isKindOfClass:[NSDictionary class]] ? [nested allValues] : nested;
+        
+        for (NSDictionary *response in responses)
+        {
+            NSMutableDictionary *existing = [self recordWithID:response[@"id"] inTable:@"responses"];
+            if ([response[@"_destroy"] boolValue])
+            {
+                if (existing) {
+                    [store[@"responses"] removeObject:existing];
+                }
+            }
+            else if (existing) {
+                [self assignAttributes:response toRecord:existing inTable:@"responses"];
+            }
+            else
+            {
+                NSMutableDictionary *created = [response mutableCopy];
+                created[@"post_id"] = record[@"id"];
+                if (![self validationErrorsForRecord:created]) {
+                    [self insertRecord:created inTable:@"responses"];
+                }
+            }
+        }
+    }
+    
+    record[@"updated_at"] = StubTimestamp();
+}
+
+- (NSMutableDictionary *) insertRecord:(NSDictionary *)attributes inTable:(NSString *)table
+{
+    NSString *now = StubTimestamp();
+    
+    NSInteger nextID = [store[@"next_id"] integerValue] + 1;
+    store[@"next_id"] = @(nextID);
+    
+    NSMutableDictionary *record = [@{@"id": @(nextID), @"author": [NSNull null], @"content": [NSNull null], @"created_at": now} mutableCopy];
+    if ([table isEqualToString:@"responses"]) {
+        record[@"post_id"] = [NSNull null];
+    }
+    
+    [store[table] addObject:record];
+    [self assignAttributes:attributes toRecord:record inTable:table];
+    return record;
+}
+
+- (void) addRoutesForTable:(NSString *)table parameterKey:(NSString *)parameterKey
+{
+    __weak StubServer *weakSelf = self;
+    NSMutableDictionary *db = store;
+    
+    [self route:@"GET" path:table responder:^StubResponse *(StubRequest *request) {
+        @synchronized(db)
+        {
+            NSMutableArray *all = [NSMutableArray array];
+            for (NSDictionary *record in db[table]) {
+                [all addObject:[weakSelf representationOfRecord:record inTable:table]];
+            }
+            
+            //posts#index reverses
+            if ([table isEqualToString:@"posts"]) {
+                all = [[[all reverseObjectEnumerator] allObjects] mutableCopy];
+            }
+            return [StubResponse responseWithStatus:200 JSON:all];
+        }
+    }];
+    
+    [self route:@"GET" path:[table stringByAppendingString:@"/:id"] responder:^StubResponse *(StubRequest *request) {
+        @synchronized(db)
+        {
+            NSDictionary *record = [weakSelf recordWithID:request.parameters[@"id"] inTable:table];
+            if (!record) {
+                return [StubResponse errorResponseWithStatus:404];
+            }
+            return [StubResponse responseWithStatus:200 JSON:[weakSelf representationOfRecord:record inTable:table]];
+        }
+    }];
+    
+    [self route:@"POST" path:table responder:^StubResponse *(StubRequest *request) {
+        NSDictionary *attributes = [request JSONBody][parameterKey];
+        NSDictionary *errors = [weakSelf validationErrorsForRecord:attributes];
+        if (errors) {
+            return [StubResponse responseWithStatus:422 JSON:errors];
+        }
+        
+        @synchronized(db)
+        {
+            NSDictionary *record = [weakSelf insertRecord:attributes inTable:table];
+            return [StubResponse responseWithStatus:201 JSON:[weakSelf representationOfRecord:record inTable:table]];
+        }
+    }];
+    
+    StubResponder update = ^StubResponse *(StubRequest *request) {
+        @synchronized(db)
+        {
+            NSMutableDictionary *record = [weakSelf recordWithID:request.parameters[@"id"] inTable:table];
+            if (!record) {
+                return [StubResponse errorResponseWithStatus:404];
+            }
+            
+            NSMutableDictionary *merged = [record mutableCopy];
+            NSDictionary *attributes = [request JSONBody][parameterKey];
+            [merged addEntriesFromDictionary:attributes];
+            
+            NSDictionary *errors = [weakSelf validationErrorsForRecord:merged];
+            if (errors) {
+                return [StubResponse responseWithStatus:422 JSON:errors];
+            }
+            
+            [weakSelf assignAttributes:attributes toRecord:record inTable:table];
+            return [StubResponse responseWithStatus:200];
+        }
+    };
+    [self route:@"PUT" path:[table stringByAppendingString:@"/:id"] responder:update];
+    [self route:@"PATCH" path:[table stringByAppendingString:@"/:id"] responder:update];
+    
+    [self route:@"DELETE" path:[table stringByAppendingString:@"/:id"] responder:^StubResponse *(StubRequest *request) {
+        @synchronized(db)
+        {
+            NSDictionary *record = [weakSelf recordWithID:request.parameters[@"id"] inTable:table];
+            if (!record) {
+                return [StubResponse errorResponseWithStatus:404];
+            }
+            
+            [db[table] removeObject:record];
+            
+            //has_many :responses, :dependent => :destroy
+            if ([table isEqualToString:@"posts"])
+            {
+                for (NSDictionary *response in [db[@"responses"] copy])
+                {
+                    if ([response[@"post_id"] isEqual:record[@"id"]]) {
+                        [db[@"responses"] removeObject:response];
+                    }
+                }
+            }
+            return [StubResponse responseWithStatus:200];
+        }
+    }];
+}
+
+- (void) addPostsAndResponsesRoutes
+{
+    if (!store) {
+        store = [@{@"posts": [NSMutableArray array], @"responses": [NSMutableArray array], @"next_id": @0} mutableCopy];
+    }
+    
+    [self addRoutesForTable:@"posts" parameterKey:@"post"];
+    [self addRoutesForTable:@"responses" parameterKey:@"response"];
+}
+
+@end
@@ -15,6 +15,7 @@
 
 @interface NSRConfig (internal)
 
+//clears the calling thread's use/end stack only - other threads keep theirs
 + (void) resetConfigs;
 
 @end
@@ -11,6 +11,10 @@
 @interface NSRRemoteObject (private)
 
 + (NSString *) typeForProperty:(NSString *)prop;
++ (NSString *) remoteIncludeParameterForAssociations:(NSArray *)associations;
++ (NSDictionary *) objectsByRemoteIDFromObjects:(NSArray *)objects;
++ (NSRRequest *) requestToSyncCollection:(NSArray *)collection viaObject:(NSRRemoteObject *)obj markKey:(NSString **)markKey;
++ (NSArray *) mergeRemoteSync:(id)jsonRep intoCollection:(NSArray *)collection markKey:(NSString *)markKey;
 
 @end
 
@@ -214,6 +218,141 @@
     XCTAssertEqualObjects([array[0] author], @"dan");
 }
 
+- (void) test_sideloaded_associations
+{
+    id remoteJSON = @{@"eggs":@[@{@"id":@1, @"bird_id":@7}, @{@"id":@2, @"bird_id":@7}, @{@"id":@3, @"bird_id":@8}],
+                      @"birds":@[@{@"id":@7, @"name":@"tweety"}]};
+    NSArray *eggs = [Egg objectsWithRemoteDictionaries:remoteJSON];
+    
+    XCTAssertEqual(eggs.count, (NSUInteger)3);
+    XCTAssertEqualObjects([eggs[0] bird].name, @"tweety");
+    XCTAssertEqual([eggs[0] bird], [eggs[1] bird], @"Sideloaded record should only be decoded once");
+    XCTAssertNil([eggs[2] bird], @"Shouldn't make up records that weren't sideloaded");
+    
+    remoteJSON = @{@"birds":@[@{@"id":@7, @"egg_ids":@[@2, @1]}],
+                   @"eggs":@[@{@"id":@1}, @{@"id":@2}]};
+    Bird *bird = [[Bird objectsWithRemoteDictionaries:remoteJSON] lastObject];
+    
+    XCTAssertEqual(bird.eggs.count, (NSUInteger)2);
+    XCTAssertEqualObjects([bird.eggs[0] remoteID], @2, @"Should keep the order of the IDs");
+    
+    //embedded records win over IDs
+    remoteJSON = @{@"eggs":@[@{@"id":@1, @"bird_id":@7, @"bird":@{@"id":@7, @"name":@"embedded"}}],
+                   @"birds":@[@{@"id":@7, @"name":@"tweety"}]};
+    eggs = [Egg objectsWithRemoteDictionaries:remoteJSON];
+    XCTAssertEqualObjects([eggs[0] bird].name, @"embedded");
+    
+    NSDictionary *byID = [Egg objectsByRemoteIDFromObjects:[Egg objectsWithRemoteDictionaries:@[@{@"id":@1}, @{@"id":@5}]]];
+    XCTAssertEqualObjects([byID[@5] remoteID], @5);
+    XCTAssertEqual(byID.count, (NSUInteger)2);
+    
+    XCTAssertEqualObjects([Post remoteIncludeParameterForAssociations:@[@"responses", @"onlyIDResponses"]], @"responses,only_id_responses");
+}
+
+- (void) test_delta_sync
+{
+    [NSRConfig defaultConfig].rootURL = [NSURL URLWithString:@"http://myapp.com"];
+    [Post resetRemoteSyncMarks];
+    XCTAssertNil([Post remoteSyncMark]);
+    
+    NSString *markKey;
+    NSRRequest *request = [Post requestToSyncCollection:nil viaObject:nil markKey:&markKey];
+    XCTAssertNil(request.queryParameters, @"First sync should fetch everything");
+    
+    NSArray *collection = [Post mergeRemoteSync:@[@{@"id":@1, @"author":@"dan", @"updated_at":@"2013-01-01T10:00:00.000+0000"},
+                                                  @{@"id":@2, @"author":@"michael", @"updated_at":@"2013-01-02T10:00:00.000+0000"}]
+                                 intoCollection:nil markKey:markKey];
+    XCTAssertEqual(collection.count, (NSUInteger)2);
+    
+    NSDate *mark = [Post remoteSyncMark];
+    XCTAssertEqualObjects(mark, [[NSRConfig defaultConfig] dateFromString:@"2013-01-02T10:00:00.000+0000"], @"Mark should be the latest updated_at");
+    
+    request = [Post requestToSyncCollection:collection viaObject:nil markKey:&markKey];
+    XCTAssertEqualObjects(request.queryParameters[@"updated_since"], @"2013-01-02T10:00:00.000+0000", @"Should send the mark back as the server sent it");
+    
+    //the collection's gone (after a relaunch, say) but the mark's still saved
+    request = [Post requestToSyncCollection:nil viaObject:nil markKey:&markKey];
+    XCTAssertNil(request.queryParameters, @"Should fetch everything when there's nothing to bring up to date");
+    request = [Post requestToSyncCollection:@[] viaObject:nil markKey:&markKey];
+    XCTAssertNil(request.queryParameters);
+    
+    Post *first = collection[0];
+    NSArray *synced = [Post mergeRemoteSync:@{@"posts":@[@{@"id":@1, @"author":@"dan2", @"updated_at":@"2013-01-03T10:00:00.000+0000"},
+                                                        @{@"id":@3, @"author":@"new", @"updated_at":@"2013-01-03T11:00:00.000+0000"}],
+                                              @"deleted_ids":@[@2]}
+                             intoCollection:collection markKey:markKey];
+    
+    XCTAssertEqual(synced.count, (NSUInteger)2);
+    XCTAssertEqual(synced[0], first, @"Should update existing objects in place");
+    XCTAssertEqualObjects(first.author, @"dan2");
+    XCTAssertEqualObjects([synced[1] author], @"new");
+    
+    synced = [Post mergeRemoteSync:@[@{@"id":@3, @"_destroy":@YES, @"updated_at":@"2013-01-04T10:00:00.000+0000"}] intoCollection:synced markKey:markKey];
+    XCTAssertEqual(synced.count, (NSUInteger)1, @"Should drop _destroy tombstones");
+    XCTAssertEqualObjects([Post remoteSyncMark], [[NSRConfig defaultConfig] dateFromString:@"2013-01-04T10:00:00.000+0000"]);
+    
+    //parents have their own marks
+    NSString *parentKey;
+    [Response requestToSyncCollection:nil viaObject:first markKey:&parentKey];
+    XCTAssertNotEqualObjects(parentKey, markKey);
+    
+    [Post resetRemoteSyncMarks];
+    XCTAssertNil([Post remoteSyncMark]);
+}
+
+- (void) test_change_notifications
+{
+    [NSRConfig defaultConfig].coalescesChangeNotifications = YES;
+    
+    NSMutableArray *batches = [NSMutableArray array];
+    NSMutableArray *changes = [NSMutableArray array];
+    NSNotificationCenter *center = [NSNotificationCenter defaultCenter];
+    id batchObserver = [center addObserverForName:NSRRemoteObjectsDidChangeNotification object:[Post class] queue:nil usingBlock:^(NSNotification *note) {
+        [batches addObject:note];
+    }];
+    id changeObserver = [center addObserverForName:NSRRemoteObjectDidChangeNotification object:nil queue:nil usingBlock:^(NSNotification *note) {
+        [changes addObject:note];
+    }];
+    
+    NSArray *posts = [Post objectsWithRemoteDictionaries:@[@{@"id":@1, @"author":@"dan", @"content":@"hi"},
+                                                           @{@"id":@2, @"author":@"michael"}]];
+    XCTAssertEqual(batches.count, (NSUInteger)1, @"Should post once for the whole batch");
+    XCTAssertEqualObjects([batches[0] userInfo][NSRInsertedObjectsKey], posts);
+    XCTAssertEqual([[batches[0] userInfo][NSRChangedObjectsKey] count], (NSUInteger)0);
+    XCTAssertEqual(changes.count, (NSUInteger)0, @"New objects shouldn't get their own notifications");
+    
+    Post *post = posts[0];
+    [post setPropertiesUsingRemoteDictionary:@{@"id":@1, @"author":@"dan", @"content":@"hi"}];
+    XCTAssertEqual(changes.count, (NSUInteger)0, @"Nothing changed, so nothing should be posted");
+    
+    [post setPropertiesUsingRemoteDictionary:@{@"id":@1, @"author":@"dan", @"content":@"bye"}];
+    XCTAssertEqual(changes.count, (NSUInteger)1);
+    XCTAssertEqual([changes[0] object], post);
+    XCTAssertEqualObjects([changes[0] userInfo][NSRChangedPropertiesKey], [NSSet setWithObject:@"content"]);
+    XCTAssertEqualObjects(post.content, @"bye");
+    
+    //existing objects merged in a batch count as changed
+    [batches removeAllObjects];
+    [changes removeAllObjects];
+    [Post mergeRemoteSync:@[@{@"id":@1, @"author":@"dan2", @"content":@"bye"}, @{@"id":@2, @"author":@"michael"}] intoCollection:posts markKey:nil];
+    XCTAssertEqual(batches.count, (NSUInteger)1);
+    XCTAssertEqualObjects([batches[0] userInfo][NSRChangedObjectsKey], @[post], @"Unchanged objects shouldn't be included");
+    XCTAssertEqual(changes.count, (NSUInteger)1);
+    
+    //off by default - everything's set and nothing's posted
+    [NSRConfig defaultConfig].coalescesChangeNotifications = NO;
+    [batches removeAllObjects];
+    [changes removeAllObjects];
+    [post setPropertiesUsingRemoteDictionary:@{@"id":@1, @"author":@"dan3"}];
+    [Post objectsWithRemoteDictionaries:@[@{@"id":@3}]];
+    XCTAssertEqualObjects(post.author, @"dan3");
+    XCTAssertEqual(batches.count + changes.count, (NSUInteger)0);
+    
+    [center removeObserver:batchObserver];
+    [center removeObserver:changeObserver];
+    [NSRConfig resetConfigs];
+}
+
 /*************
    OVERRIDES
  *************/
@@ -652,4 +791,104 @@
 }
 
 
+
+/***************
+   COALESCING
+ **************/
+
+- (void) test_coalesced_updates
+{
+    NSRConfig *config = [NSRConfig defaultConfig];
+    config.rootURL = [NSURL URLWithString:@"http://ojeaoifjif"];
+    config.performsCompletionBlocksOnMainThread = NO;
+    config.collectsRequestMetrics = YES;
+    config.coalescesRemoteUpdates = YES;
+    config.remoteUpdateCoalescingWindow = 0.2;
+    
+    Post *post = [Post objectWithRemoteDictionary:@{@"id":@5}];
+    Post *other = [Post objectWithRemoteDictionary:@{@"id":@6}];
+    
+    NSMutableArray *errors = [NSMutableArray array];
+    XCTestExpectation *done = [self expectationWithDescription:@"all completions called"];
+    done.expectedFulfillmentCount = 4;
+    
+    for (int i = 0; i < 3; i++)
+    {
+        post.content = @(i).stringValue;
+        [post remoteUpdateAsync:^(NSError *error) {
+            @synchronized(errors) {
+                [errors addObject:error ?: [NSNull null]];
+            }
+            [done fulfill];
+        }];
+    }
+    [other remoteUpdateAsync:^(NSError *error) {
+        [done fulfill];
+    }];
+    
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+    
+    XCTAssertEqual(errors.count, 3, @"Every caller should get a completion");
+    XCTAssertTrue([errors[0] isKindOfClass:[NSError class]], @"Should get the (bogus host) error");
+    XCTAssertEqualObjects(errors[0], errors[2], @"Everyone should get the same final result");
+    
+    //metrics are recorded just after completions run
+    [self expectationForPredicate:[NSPredicate predicateWithBlock:^BOOL(id object, NSDictionary *bindings) {
+        return ([config requestMetricsByRoute][@"PATCH posts/:id"].requestCount >= 2);
+    }] evaluatedWithObject:nil handler:nil];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    
+    [NSThread sleepForTimeInterval:0.5];
+    XCTAssertEqual([config requestMetricsByRoute][@"PATCH posts/:id"].requestCount, 2, @"Should have sent one request per record");
+    
+    [NSRConfig resetConfigs];
+}
+
+- (void) test_coalesced_update_cancel
+{
+    NSRConfig *config = [NSRConfig defaultConfig];
+    config.rootURL = [NSURL URLWithString:@"http://ojeaoifjif"];
+    config.performsCompletionBlocksOnMainThread = NO;
+    config.collectsRequestMetrics = YES;
+    config.coalescesRemoteUpdates = YES;
+    config.remoteUpdateCoalescingWindow = 0.5;
+    
+    Post *post = [Post objectWithRemoteDictionary:@{@"id":@5}];
+    
+    NSMutableArray *errors = [NSMutableArray array];
+    XCTestExpectation *first = [self expectationWithDescription:@"first cancelled"];
+    __block XCTestExpectation *second = nil;
+    
+    post.content = @"a";
+    NSRRequestHandle *handleA = [post remoteUpdateAsync:^(NSError *error) {
+        @synchronized(errors) {
+            [errors addObject:error ?: [NSNull null]];
+        }
+        [first fulfill];
+    }];
+    post.content = @"b";
+    NSRRequestHandle *handleB = [post remoteUpdateAsync:^(NSError *error) {
+        @synchronized(errors) {
+            [errors addObject:error ?: [NSNull null]];
+        }
+        [second fulfill];
+    }];
+    
+    NSDate *start = [NSDate date];
+    [handleA cancel];
+    [self waitForExpectationsWithTimeout:0.3 handler:nil];
+    XCTAssertTrue([[NSDate date] timeIntervalSinceDate:start] < 0.3, @"Shouldn't have waited for the shared update");
+    XCTAssertEqual([errors[0] code], NSURLErrorCancelled);
+    
+    second = [self expectationWithDescription:@"second cancelled"];
+    [handleB cancel];
+    [self waitForExpectationsWithTimeout:0.3 handler:nil];
+    XCTAssertEqual([errors[1] code], NSURLErrorCancelled);
+    
+    [NSThread sleepForTimeInterval:0.8];
+    XCTAssertNil([config requestMetricsByRoute][@"PATCH posts/:id"], @"With no one left waiting, the update shouldn't have gone out");
+    
+    [NSRConfig resetConfigs];
+}
+
 @end
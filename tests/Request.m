@@ -7,18 +7,127 @@
 //
 
 #import "NSRAsserts.h"
+#import "StubServer.h"
+#import "Benchmark.h"
 
 @interface NSRRequest (private)
 
 + (NSString *) base64EncodingOfData:(NSData *)data;
++ (NSData *) dataByDecodingBase64String:(NSString *)string;
 
 + (NSRRequest *) requestWithHTTPMethod:(NSString *)method;
 
 - (NSURLRequest *) HTTPRequest;
 
+- (id) jsonResponseFromData:(NSData *)data;
+- (id) responseObjectFromData:(NSData *)data MIMEType:(NSString *)MIMEType;
 - (NSError *) errorForResponse:(id)jsonResponse existingError:(NSError *)existing statusCode:(NSInteger)statusCode;
 - (id) receiveResponse:(NSHTTPURLResponse *)response data:(NSData *)data error:(NSError **)error;
 
+- (void) logOut:(NSURLRequest *)request;
+- (void) logIn:(NSData *)data response:(NSHTTPURLResponse *)response error:(NSError *)error;
+
+- (void) performCompletion:(void (^)(void))completion;
+
+@end
+
+@interface NSRMultipartBody (private)
+
++ (NSError *) errorForStream:(NSInputStream *)stream;
+
+@end
+
+@interface NSRNetworkLog : NSObject
+
++ (void) flush;
+
+@end
+
+@interface NSRJSONElementStream : NSObject
+
+- (id) initWithReadingOptions:(NSJSONReadingOptions)options spoolThreshold:(NSUInteger)threshold elementHandler:(void (^)(id element))handler;
+- (BOOL) appendData:(NSData *)data error:(NSError **)error;
+- (NSData *) finishDocument;
+
+@property (nonatomic, readonly) BOOL isArray;
+@property (nonatomic, readonly) NSUInteger elementCount;
+
+@end
+
+@interface NSRRateLimiter : NSObject
+
+- (id) initWithRate:(double)rate burstSize:(NSUInteger)burstSize;
+- (NSTimeInterval) reserve;
+- (NSTimeInterval) remainingHold;
+- (void) throttleWithRetryAfter:(NSTimeInterval)retryAfter;
+- (void) recordSuccess;
++ (NSTimeInterval) retryAfterFromResponse:(NSHTTPURLResponse *)response;
+
+@property (nonatomic, readonly) double currentRate;
+
+@end
+
+@interface NSREndpoint : NSObject
+@end
+
+typedef NS_ENUM(NSInteger, NSREndpointOutcome) {
+    NSREndpointSucceeded,
+    NSREndpointFailed,
+    NSREndpointAbandoned
+};
+
+@interface NSREndpointPool : NSObject
+
+- (id) initWithURLs:(NSArray *)URLs;
+- (NSREndpoint *) checkOutExcluding:(NSREndpoint *)excluding trial:(BOOL *)trial;
+- (void) checkIn:(NSREndpoint *)endpoint trial:(BOOL)trial latency:(NSTimeInterval)latency outcome:(NSREndpointOutcome)outcome;
+- (NSArray *) healthyURLs;
+
+@property NSREndpointSelectionPolicy policy;
+@property NSUInteger failureThreshold;
+@property NSTimeInterval ejectionInterval;
+
+@end
+
+@interface NSREventStreamParser : NSObject
+
+- (id) initWithEventHandler:(void (^)(NSString *name, NSString *data, NSString *eventID))handler;
+- (void) appendData:(NSData *)data;
+- (void) reset;
+
+@property (copy) NSString *lastEventID;
+@property (nonatomic, readonly) NSTimeInterval retryInterval;
+
+@end
+
+@interface NSRConfig (private)
+
+- (NSArray *) rateLimitersForRoute:(NSString *)routeTemplate;
+
+@end
+
+@interface NSRRouteMetrics (private)
+
+- (void) recordMetrics:(NSRRequestMetrics *)metrics;
+
+@end
+
+@interface MetricsObserver : NSObject <NSRRequestMetricsObserver>
+
+@property (nonatomic, strong) NSMutableArray *received;
+
+@end
+
+@implementation MetricsObserver
+
+- (void) request:(NSRRequest *)request didFinishWithMetrics:(NSRRequestMetrics *)metrics
+{
+    if (!self.received) {
+        self.received = [NSMutableArray array];
+    }
+    [self.received addObject:metrics];
+}
+
 @end
 
 
@@ -65,6 +174,43 @@
     
     request = [req HTTPRequest];
     XCTAssertEqualObjects([request.URL description], @"http://myapp.com/test");
+    
+    req.queryParameters = @{@"q":@"a b&c=d/é"};
+    request = [req HTTPRequest];
+    XCTAssertEqualObjects(request.URL.query, @"q=a%20b%26c%3Dd%2F%C3%A9", @"Should percent-escape query params");
+    
+    req.queryParameters = @{@"page":@2};
+    request = [req HTTPRequest];
+    XCTAssertEqualObjects(request.URL.query, @"page=2", @"Should use description for non-string values");
+    
+    req.queryParameters = @{@"ids[]":@"1"};
+    request = [req HTTPRequest];
+    XCTAssertEqualObjects(request.URL.query, @"ids%5B%5D=1");
+    
+    req.queryParameters = @{@"ids":@[@1, @2]};
+    request = [req HTTPRequest];
+    XCTAssertEqualObjects(request.URL.query, @"ids%5B%5D=1&ids%5B%5D=2", @"Should send arrays as key[]");
+    
+    request = [[NSRRequest requestToFetchObjectsWithIDs:@[@3, @1, @3] ofClass:[Post class]] HTTPRequest];
+    XCTAssertEqualObjects([request.URL description], @"http://myapp.com/posts?ids%5B%5D=3&ids%5B%5D=1", @"Should drop duplicate IDs");
+    XCTAssertThrows([NSRRequest requestToFetchObjectsWithIDs:@[] ofClass:[Post class]]);
+}
+
+- (void) test_url_resolution
+{
+    NSRRequest *req = [[NSRRequest GET] routeTo:@"posts/1"];
+    
+    NSArray *roots = @[@"http://myapp.com", @"http://myapp.com/", @"http://myapp.com/api/", @"http://myapp.com/api", @"http://myapp.com:3000/api/v1/"];
+    for (NSString *root in roots)
+    {
+        [NSRConfig defaultConfig].rootURL = [NSURL URLWithString:root];
+        NSURL *expected = [NSURL URLWithString:@"posts/1" relativeToURL:[NSURL URLWithString:root]];
+        XCTAssertEqualObjects([req HTTPRequest].URL.absoluteString, expected.absoluteString, @"Should resolve the same as NSURL would for %@", root);
+    }
+    
+    [NSRConfig defaultConfig].rootURL = [NSURL URLWithString:@"http://myapp.com/api/"];
+    [req routeTo:@"/absolute"];
+    XCTAssertEqualObjects([req HTTPRequest].URL.absoluteString, @"http://myapp.com/absolute");
 }
 
 - (void) test_http_methods
@@ -120,6 +266,129 @@
     XCTAssertThrows([req HTTPRequest], @"Should throw exception because no Content-Type header was given when POST body was set as a string.");
 }
 
+- (void) test_json_response_mutability
+{
+    NSRRequest *req = [NSRRequest GET];
+    NSData *arrayData = [@"[{\"id\":1,\"tags\":[\"a\"]}]" dataUsingEncoding:NSUTF8StringEncoding];
+    
+    id json = [req jsonResponseFromData:arrayData];
+    XCTAssertTrue([json isKindOfClass:[NSArray class]]);
+    XCTAssertFalse([json isKindOfClass:[NSMutableArray class]], @"Should be immutable by default");
+    XCTAssertFalse([json[0] isKindOfClass:[NSMutableDictionary class]], @"Should be immutable by default");
+    XCTAssertEqualObjects(json[0][@"tags"], @[@"a"]);
+    
+    [NSRConfig defaultConfig].returnsMutableContainers = YES;
+    
+    json = [req jsonResponseFromData:arrayData];
+    XCTAssertTrue([json isKindOfClass:[NSMutableArray class]], @"Should be mutable if config asks for it");
+    XCTAssertTrue([json[0] isKindOfClass:[NSMutableDictionary class]], @"Should be mutable if config asks for it");
+    
+    XCTAssertNil([req jsonResponseFromData:nil]);
+    XCTAssertEqualObjects([req jsonResponseFromData:[@"<html>" dataUsingEncoding:NSUTF8StringEncoding]], @"<html>", @"Non-JSON should come back as a string");
+}
+
+- (void) test_string_interning
+{
+    NSString *status = @"awaiting_moderator_review";
+    NSString *essay = [@"" stringByPaddingToLength:100 withString:@"essay " startingAtIndex:0];
+    NSArray *rows = @[@{@"id":@1, @"review_status":status, @"body":essay},
+                      @{@"id":@2, @"review_status":status, @"body":essay}];
+    NSData *data = [NSJSONSerialization dataWithJSONObject:rows options:0 error:nil];
+    
+    NSRRequest *req = [NSRRequest GET];
+    NSArray *plain = [req jsonResponseFromData:data];
+    
+    [NSRConfig defaultConfig].internsResponseStrings = YES;
+    
+    NSArray *interned = [req jsonResponseFromData:data];
+    XCTAssertEqualObjects(interned, plain, @"Interning shouldn't change anything but identity");
+    XCTAssertFalse([interned isKindOfClass:[NSMutableArray class]], @"Should stay immutable");
+    XCTAssertFalse([interned[0] isKindOfClass:[NSMutableDictionary class]], @"Should stay immutable");
+    
+    XCTAssertTrue(interned[0][@"review_status"] == interned[1][@"review_status"], @"Short values should be shared");
+    XCTAssertTrue(interned[0][@"body"] != interned[1][@"body"], @"Values past maximumInternedStringLength shouldn't be");
+    
+    NSString *(^keyOf)(NSDictionary *) = ^NSString *(NSDictionary *row) {
+        return [[row allKeys] objectAtIndex:[[row allKeys] indexOfObject:@"review_status"]];
+    };
+    XCTAssertTrue(keyOf(interned[0]) == keyOf(interned[1]), @"Keys should be shared");
+    
+    //decoded objects keep the shared instances in their remoteAttributes
+    NSArray *posts = [Post objectsWithRemoteDictionaries:interned];
+    XCTAssertTrue([posts[0] remoteAttributes][@"review_status"] == [posts[1] remoteAttributes][@"review_status"]);
+    
+    [NSRConfig defaultConfig].maximumInternedStringLength = 1000;
+    interned = [req jsonResponseFromData:data];
+    XCTAssertTrue(interned[0][@"body"] == interned[1][@"body"]);
+    
+    [NSRConfig defaultConfig].returnsMutableContainers = YES;
+    interned = [req jsonResponseFromData:data];
+    XCTAssertTrue([interned isKindOfClass:[NSMutableArray class]], @"Should be mutable if config asks for it");
+    XCTAssertTrue([interned[0] isKindOfClass:[NSMutableDictionary class]], @"Should be mutable if config asks for it");
+    XCTAssertTrue(interned[0][@"review_status"] == interned[1][@"review_status"]);
+    
+    //a full table leaves new strings alone
+    [NSRConfig defaultConfig].internedStringLimit = 0;
+    interned = [req jsonResponseFromData:data];
+    XCTAssertEqualObjects(interned, plain);
+    XCTAssertTrue(interned[0][@"review_status"] != interned[1][@"review_status"]);
+    
+    XCTAssertEqualObjects([req jsonResponseFromData:[@"<html>" dataUsingEncoding:NSUTF8StringEncoding]], @"<html>", @"Non-JSON should come back as a string");
+}
+
+- (void) test_message_pack_codec
+{
+    NSRMessagePackCodec *codec = [[NSRMessagePackCodec alloc] init];
+    
+    NSDictionary *object = @{@"id":@12, @"negative":@(-40000), @"big":@(5000000000ULL), @"ratio":@(0.25),
+                             @"flag":@YES, @"nothing":[NSNull null], @"name":@"caf\u00e9",
+                             @"long":[@"" stringByPaddingToLength:300 withString:@"x" startingAtIndex:0],
+                             @"tags":@[@"a", @[], @{}], @"blob":[NSData dataWithBytes:"\x00\x01" length:2]};
+    NSData *data = [codec dataWithObject:object error:nil];
+    XCTAssertNotNil(data);
+    
+    NSError *error = nil;
+    NSDictionary *decoded = [codec objectWithData:data mutableContainers:NO error:&error];
+    XCTAssertNil(error);
+    XCTAssertEqualObjects(decoded, object, @"Should round trip");
+    XCTAssertTrue([decoded[@"flag"] isKindOfClass:[@YES class]], @"Booleans should stay booleans");
+    XCTAssertFalse([decoded isKindOfClass:[NSMutableDictionary class]], @"Should be immutable unless asked");
+    XCTAssertTrue([[codec objectWithData:data mutableContainers:YES error:nil] isKindOfClass:[NSMutableDictionary class]]);
+    
+    //known encodings from the spec
+    const uint8_t fixmap[] = {0x81, 0xa1, 'a', 0xcd, 0x01, 0x00};
+    const uint8_t fixarray[] = {0x92, 0x01, 0xff};
+    const uint8_t truncated[] = {0xdd, 0xff, 0xff, 0xff, 0xff};
+    XCTAssertEqualObjects([codec objectWithData:[NSData dataWithBytes:fixmap length:sizeof(fixmap)] mutableContainers:NO error:nil], @{@"a":@256});
+    XCTAssertEqualObjects([codec dataWithObject:@[@1, @(-1)] error:nil], [NSData dataWithBytes:fixarray length:sizeof(fixarray)]);
+    
+    XCTAssertNil([codec objectWithData:[@"<html>" dataUsingEncoding:NSUTF8StringEncoding] mutableContainers:NO error:&error], @"Trailing bytes should fail");
+    XCTAssertNotNil(error);
+    XCTAssertNil([codec objectWithData:[NSData dataWithBytes:truncated length:sizeof(truncated)] mutableContainers:NO error:nil], @"Truncated input should fail");
+    XCTAssertNil([codec dataWithObject:@[[NSDate date]] error:&error], @"Unsupported types should fail");
+    
+    //negotiation
+    [NSRConfig defaultConfig].rootURL = [NSURL URLWithString:@"http://myapp.com"];
+    [NSRConfig defaultConfig].codec = codec;
+    
+    NSRRequest *req = [[NSRRequest POST] routeTo:@"posts"];
+    req.body = @{@"post":@{@"title":@"hi"}};
+    NSURLRequest *request = [req HTTPRequest];
+    XCTAssertEqualObjects([request valueForHTTPHeaderField:@"Content-Type"], @"application/msgpack");
+    XCTAssertEqualObjects([request valueForHTTPHeaderField:@"Accept"], @"application/msgpack, application/json;q=0.9");
+    XCTAssertEqualObjects([codec objectWithData:request.HTTPBody mutableContainers:NO error:nil], req.body);
+    
+    XCTAssertEqualObjects([req responseObjectFromData:data MIMEType:@"application/msgpack"], object);
+    XCTAssertEqualObjects([req responseObjectFromData:[@"{\"a\":1}" dataUsingEncoding:NSUTF8StringEncoding] MIMEType:@"application/json"], @{@"a":@1}, @"Should parse JSON if that's what came back");
+    XCTAssertEqualObjects([req responseObjectFromData:[@"<html>" dataUsingEncoding:NSUTF8StringEncoding] MIMEType:@"text/html"], @"<html>");
+    
+    NSRConfig *unarchived = [NSKeyedUnarchiver unarchiveObjectWithData:[NSKeyedArchiver archivedDataWithRootObject:[NSRConfig defaultConfig]]];
+    XCTAssertTrue([unarchived.codec isKindOfClass:[NSRMessagePackCodec class]], @"Codec should be archived with the config");
+    
+    [NSRConfig defaultConfig].codec = [[NSRJSONCodec alloc] init];
+    XCTAssertEqualObjects([[req HTTPRequest] valueForHTTPHeaderField:@"Accept"], @"application/json");
+}
+
 /* With objects */
 
 - (void) test_set_object_body
@@ -144,6 +413,117 @@
     XCTAssertEqualObjects([request HTTPBody], [@"{\"super_class\":{\"super_string\":\"dan\"}}" dataUsingEncoding:NSUTF8StringEncoding]);
 }
 
+- (void) test_multipart_body
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"nsrails-upload.txt"];
+    NSMutableData *fileData = [NSMutableData data];
+    for (int i = 0; i < 20000; i++) {
+        [fileData appendBytes:"0123456789" length:10];
+    }
+    [fileData writeToFile:path atomically:YES];
+    
+    NSRMultipartBody *body = [[NSRMultipartBody alloc] init];
+    [body addFieldsFromDictionary:@{@"post":@{@"title":@"hi", @"tags":@[@"a", @"b"], @"empty":@[], @"draft":@YES, @"author":[NSNull null]}}];
+    
+    NSError *e;
+    XCTAssertFalse([body addFileAtURL:[NSURL fileURLWithPath:@"/not/a/file"] forName:@"post[photo]" error:&e]);
+    XCTAssertNotNil(e);
+    XCTAssertTrue([body addFileAtURL:[NSURL fileURLWithPath:path] forName:@"post[photo]" error:nil]);
+    
+    NSRRequest *req = [NSRRequest POST];
+    [NSRConfig defaultConfig].rootURL = [NSURL URLWithString:@"http://myapp.com"];
+    req.body = body;
+    
+    NSURLRequest *request = [req HTTPRequest];
+    XCTAssertNil(request.HTTPBody);
+    XCTAssertEqualObjects([request valueForHTTPHeaderField:@"Content-Type"], body.contentType);
+    XCTAssertEqualObjects([request valueForHTTPHeaderField:@"Content-Length"], @(body.contentLength).stringValue);
+    
+    //read it back twice - each stream should produce the same, complete body
+    for (int i = 0; i < 2; i++)
+    {
+        NSInputStream *stream = [body inputStream];
+        [stream open];
+        NSMutableData *sent = [NSMutableData data];
+        uint8_t buffer[4096];
+        NSInteger read;
+        while ((read = [stream read:buffer maxLength:sizeof(buffer)]) > 0) {
+            [sent appendBytes:buffer length:read];
+        }
+        [stream close];
+        
+        XCTAssertEqual((unsigned long long)sent.length, body.contentLength, @"Content-Length should match what's actually sent");
+        
+        NSString *string = [[NSString alloc] initWithData:sent encoding:NSUTF8StringEncoding];
+        XCTAssertTrue([string containsString:@"name=\"post[title]\"\r\n\r\nhi\r\n"]);
+        XCTAssertTrue([string containsString:@"name=\"post[tags][]\"\r\n\r\nb\r\n"]);
+        XCTAssertTrue([string containsString:@"name=\"post[draft]\"\r\n\r\ntrue\r\n"]);
+        XCTAssertTrue([string containsString:@"name=\"post[author]\"\r\n\r\n\r\n"]);
+        XCTAssertFalse([string containsString:@"post[empty]"]);
+        XCTAssertTrue([string containsString:@"name=\"post[photo]\"; filename=\"nsrails-upload.txt\"\r\nContent-Type: text/plain\r\n\r\n"]);
+        XCTAssertTrue([sent rangeOfData:fileData options:0 range:NSMakeRange(0, sent.length)].location != NSNotFound);
+        XCTAssertTrue([string hasSuffix:[NSString stringWithFormat:@"--%@--\r\n", body.boundary]]);
+    }
+    
+    //a redirect means the body has to be sent again from the start
+    StubServer *server = [StubServer server];
+    NSString *moved = [NSURL URLWithString:@"uploads/moved" relativeToURL:server.baseURL].absoluteString;
+    [server route:@"POST" path:@"uploads" responder:^StubResponse *(StubRequest *request) {
+        StubResponse *response = [StubResponse responseWithStatus:307];
+        response.headers = @{@"Location":moved};
+        return response;
+    }];
+    __block NSUInteger receivedLength = 0;
+    [server route:@"POST" path:@"uploads/moved" responder:^StubResponse *(StubRequest *request) {
+        receivedLength = request.body.length;
+        return [StubResponse responseWithStatus:201 JSON:@{@"id":@1}];
+    }];
+    [NSRConfig defaultConfig].rootURL = server.baseURL;
+    
+    req = [[NSRRequest POST] routeTo:@"uploads"];
+    req.body = body;
+    XCTestExpectation *redirected = [self expectationWithDescription:@"redirected"];
+    [req sendAsynchronous:^(id result, NSError *error) {
+        XCTAssertNil(error);
+        XCTAssertEqualObjects(result[@"id"], @1);
+        [redirected fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertEqual((unsigned long long)receivedLength, body.contentLength, @"Should have sent the whole body after the redirect");
+    
+    //the file shrank after it was added - the Content-Length can't be kept, so it's an error whatever the server says
+    [[fileData subdataWithRange:NSMakeRange(0, 100)] writeToFile:path atomically:YES];
+    [NSRConfig defaultConfig].timeoutInterval = 5;
+    req = [[NSRRequest POST] routeTo:@"uploads/moved"];
+    req.body = body;
+    e = nil;
+    XCTAssertNil([req sendSynchronous:&e]);
+    XCTAssertEqualObjects(e.domain, NSCocoaErrorDomain);
+    XCTAssertEqual(e.code, NSFileReadUnknownError);
+    
+    //the error belongs to the stream that was cut short - other sends of the same body don't see it
+    void (^drain)(NSInputStream *) = ^(NSInputStream *stream) {
+        [stream open];
+        uint8_t buffer[4096];
+        while ([stream read:buffer maxLength:sizeof(buffer)] > 0);
+        [stream close];
+    };
+    NSInputStream *shortStream = [body inputStream];
+    drain(shortStream);
+    [fileData writeToFile:path atomically:YES];
+    NSInputStream *fullStream = [body inputStream];
+    drain(fullStream);
+    XCTAssertNotNil([NSRMultipartBody errorForStream:shortStream]);
+    XCTAssertNil([NSRMultipartBody errorForStream:fullStream]);
+    XCTAssertNotNil([req sendSynchronous:&e], @"%@", e);
+    
+    [server stop];
+    
+    XCTAssertThrows(req.body = [NSDate date]);
+    
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
 - (void) test_routing
 {
     NSRRequest *request = [[NSRRequest alloc] init];
@@ -175,6 +555,7 @@
     
     [request routeToObject:[NestParent objectWithRemoteDictionary:idDict] withCustomMethod:@"action"];    
     XCTAssertEqualObjects(request.route, @"parents/1/action");
+    XCTAssertEqualObjects(request.routeTemplate, @"parents/:id/action");
     
     
     /* CUSTOM */
@@ -315,6 +696,7 @@
         
         [request routeToObject:smth2 withCustomMethod:@"action"];
         XCTAssertEqualObjects(request.route, @"parents/23/prefs/15/pref2s/1/action");
+        XCTAssertEqualObjects(request.routeTemplate, @"parents/:id/prefs/:id/pref2s/:id/action");
         
         //make sure class methods still work
         [request routeToClass:[NestChildPrefixedChild class]];    
@@ -413,6 +795,7 @@
     
     NSRRequest *findOne = [NSRRequest requestToFetchObjectWithID:@1 ofClass:[NestParent class]];
     XCTAssertEqualObjects(findOne.route, @"parents/1");
+    XCTAssertEqualObjects(findOne.routeTemplate, @"parents/:id");
     XCTAssertEqualObjects(findOne.httpMethod, @"GET");
     XCTAssertNil(findOne.body);
     
@@ -509,6 +892,73 @@
      }];
 }
 
+- (void) test_completion_coalescing
+{
+    NSRConfig *config = [NSRConfig defaultConfig];
+    config.performsCompletionBlocksOnMainThread = YES;
+    NSRRequest *request = [NSRRequest GET];
+    
+    //the main thread's busy (running this test) while these come in, and something else gets onto the main queue after the first one
+    NSArray *(^deliver)(void) = ^NSArray *
+    {
+        NSMutableArray *order = [NSMutableArray array];
+        XCTestExpectation *marker = [self expectationWithDescription:@"marker"];
+        dispatch_sync(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^
+        {
+            [request performCompletion:^{ [order addObject:@0]; }];
+            dispatch_async(dispatch_get_main_queue(), ^{ [order addObject:@"marker"]; [marker fulfill]; });
+            for (int i = 1; i < 50; i++) {
+                [request performCompletion:^{ [order addObject:@(i)]; }];
+            }
+        });
+        [self waitForExpectationsWithTimeout:1 handler:nil];
+        return order;
+    };
+    
+    NSArray *order = deliver();
+    XCTAssertEqualObjects(order[1], @"marker", @"Should dispatch each one separately by default");
+    
+    config.coalescesCompletionBlocks = YES;
+    order = deliver();
+    XCTAssertEqual(order.count, (NSUInteger)51);
+    XCTAssertEqualObjects(order[49], @49, @"Should call them in the order they came in");
+    XCTAssertEqualObjects([order lastObject], @"marker", @"Should call them all in one batch");
+    
+    //window
+    config.completionCoalescingWindow = 0.2;
+    XCTestExpectation *windowed = [self expectationWithDescription:@"window"];
+    NSDate *start = [NSDate date];
+    [request performCompletion:^{
+        XCTAssertTrue([NSThread isMainThread]);
+        XCTAssertTrue([[NSDate date] timeIntervalSinceDate:start] >= 0.19, @"Should wait out the window");
+        [windowed fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:1 handler:nil];
+    
+    NSRConfig *unarchived = [NSKeyedUnarchiver unarchiveObjectWithData:[NSKeyedArchiver archivedDataWithRootObject:config]];
+    XCTAssertTrue(unarchived.coalescesCompletionBlocks);
+    XCTAssertEqual(unarchived.completionCoalescingWindow, 0.2);
+    
+    //custom queues
+    NSOperationQueue *configQueue = [[NSOperationQueue alloc] init];
+    config.completionQueue = configQueue;
+    XCTestExpectation *onConfigQueue = [self expectationWithDescription:@"config queue"];
+    [request performCompletion:^{
+        XCTAssertEqual([NSOperationQueue currentQueue], configQueue, @"Config's queue should win over the main thread");
+        [onConfigQueue fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:1 handler:nil];
+    
+    NSOperationQueue *requestQueue = [[NSOperationQueue alloc] init];
+    request.completionQueue = requestQueue;
+    XCTestExpectation *onRequestQueue = [self expectationWithDescription:@"request queue"];
+    [request performCompletion:^{
+        XCTAssertEqual([NSOperationQueue currentQueue], requestQueue, @"Request's queue should win over the config's");
+        [onRequestQueue fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:1 handler:nil];
+}
+
 - (void) test_error_detection
 {
     NSURL *url = [NSURL URLWithString:@"http://localhost:3000"];
@@ -641,6 +1091,1078 @@
     XCTAssertEqualObjects([request valueForHTTPHeaderField:@"Authorization"], authHeader, @"Should send HTTP basic auth if given user/pass");
 }
 
+- (void) test_authorization_header_updates
+{
+    NSRConfig *config = [[NSRConfig alloc] init];
+    XCTAssertNil(config.authorizationHeader);
+    
+    config.oAuthToken = @"token123";
+    XCTAssertEqualObjects(config.authorizationHeader, @"OAuth token123");
+    
+    config.basicAuthUsername = @"Aladdin";
+    XCTAssertEqualObjects(config.authorizationHeader, @"OAuth token123", @"Basic auth needs both user and password");
+    
+    config.basicAuthPassword = @"open sesame";
+    XCTAssertEqualObjects(config.authorizationHeader, @"Basic QWxhZGRpbjpvcGVuIHNlc2FtZQ==", @"Basic auth should take precedence");
+    
+    config.basicAuthPassword = nil;
+    XCTAssertEqualObjects(config.authorizationHeader, @"OAuth token123");
+    
+    config.oAuthToken = nil;
+    XCTAssertNil(config.authorizationHeader);
+}
+
+- (void) test_network_logging
+{
+    [NSRConfig defaultConfig].rootURL = [NSURL URLWithString:@"http://myapp.com"];
+    
+    NSMutableArray *messages = [NSMutableArray array];
+    [NSRConfig defaultConfig].networkLogHandler = ^(NSString *message) {
+        @synchronized(messages) {
+            [messages addObject:message];
+        }
+    };
+    
+    NSRRequest *req = [[NSRRequest POST] routeTo:@"posts"];
+    req.body = @{@"title":@"héllo"};
+    NSURLRequest *request = [req HTTPRequest];
+    NSData *responseData = [@"{\"id\":1}" dataUsingEncoding:NSUTF8StringEncoding];
+    NSHTTPURLResponse *ok = [[NSHTTPURLResponse alloc] initWithURL:request.URL statusCode:201 HTTPVersion:@"HTTP/1.1" headerFields:nil];
+    NSHTTPURLResponse *fail = [[NSHTTPURLResponse alloc] initWithURL:request.URL statusCode:500 HTTPVersion:@"HTTP/1.1" headerFields:nil];
+    NSError *error = [NSError errorWithDomain:NSRRemoteErrorDomain code:500 userInfo:nil];
+    
+    [req logOut:request];
+    [req logIn:responseData response:ok error:nil];
+    [NSRNetworkLog flush];
+    
+    XCTAssertEqual(messages.count, 2);
+    XCTAssertTrue([messages[0] hasPrefix:@"[NSRails][OUT] ===> POST to http://myapp.com/posts"]);
+    XCTAssertTrue([messages[0] rangeOfString:@"héllo"].location != NSNotFound, @"Should log bodies by default");
+    XCTAssertTrue([messages[1] hasPrefix:@"[NSRails][IN] <=== Code 201"]);
+    
+    //info level leaves bodies out
+    [messages removeAllObjects];
+    [NSRConfig defaultConfig].networkLogLevel = NSRNetworkLogLevelInfo;
+    [req logOut:request];
+    [NSRNetworkLog flush];
+    XCTAssertEqualObjects(messages.lastObject, @"[NSRails][OUT] ===> POST to http://myapp.com/posts ");
+    
+    //body truncation
+    [messages removeAllObjects];
+    [NSRConfig defaultConfig].networkLogLevel = NSRNetworkLogLevelBody;
+    [NSRConfig defaultConfig].networkLogMaxBodyBytes = 3;
+    [req logIn:responseData response:ok error:nil];
+    [NSRNetworkLog flush];
+    XCTAssertEqualObjects(messages.lastObject, @"[NSRails][IN] <=== Code 201 {\"i... (5 more bytes)");
+    
+    //sampled out - only errors get through
+    [messages removeAllObjects];
+    [NSRConfig defaultConfig].networkLogSampleRate = 0;
+    [req logOut:request];
+    [req logIn:responseData response:ok error:nil];
+    [req logIn:responseData response:fail error:error];
+    [NSRNetworkLog flush];
+    XCTAssertEqual(messages.count, 1);
+    XCTAssertTrue([messages.lastObject hasPrefix:@"[NSRails][IN] <=== Code 500"]);
+    
+    //error level
+    [messages removeAllObjects];
+    [NSRConfig defaultConfig].networkLogSampleRate = 1;
+    [NSRConfig defaultConfig].networkLogLevel = NSRNetworkLogLevelError;
+    [req logOut:request];
+    [req logIn:responseData response:ok error:nil];
+    [NSRNetworkLog flush];
+    XCTAssertEqual(messages.count, 0);
+    
+    //networkLogging is shorthand for the level
+    [NSRConfig defaultConfig].networkLogging = NO;
+    XCTAssertEqual([NSRConfig defaultConfig].networkLogLevel, NSRNetworkLogLevelNone);
+    [req logIn:responseData response:fail error:error];
+    [NSRNetworkLog flush];
+    XCTAssertEqual(messages.count, 0);
+    
+    [NSRConfig defaultConfig].networkLogging = YES;
+    XCTAssertEqual([NSRConfig defaultConfig].networkLogLevel, NSRNetworkLogLevelBody);
+}
+
+- (void) test_request_metrics
+{
+    [NSRConfig defaultConfig].rootURL = [NSURL URLWithString:@"http://ojeaoifjif"];
+    
+    NSRRequest *req = [[NSRRequest GET] routeToObject:[Post objectWithRemoteDictionary:@{@"id":@5}]];
+    NSError *e;
+    [req sendSynchronous:&e];
+    XCTAssertNil(req.metrics, @"Shouldn't record metrics if no one's listening");
+    
+    MetricsObserver *observer = [[MetricsObserver alloc] init];
+    [NSRConfig defaultConfig].metricsObserver = observer;
+    [NSRConfig defaultConfig].collectsRequestMetrics = YES;
+    
+    req = [[NSRRequest POST] routeToObject:[Post objectWithRemoteDictionary:@{@"id":@5}]];
+    req.body = @{@"title":@"hello"};
+    [req sendSynchronous:&e];
+    XCTAssertNotNil(e, @"Should error with bogus hostname");
+    
+    XCTAssertEqual(observer.received.count, 1);
+    NSRRequestMetrics *metrics = observer.received.lastObject;
+    XCTAssertEqual(req.metrics, metrics);
+    XCTAssertEqualObjects(metrics.httpMethod, @"POST");
+    XCTAssertEqualObjects(metrics.routeTemplate, @"posts/:id");
+    XCTAssertEqualObjects(metrics.error, e);
+    XCTAssertEqual(metrics.bytesSent, [@"{\"title\":\"hello\"}" length]);
+    XCTAssertTrue(metrics.routingDuration > 0);
+    XCTAssertTrue(metrics.totalDuration >= metrics.networkDuration + metrics.parsingDuration);
+    
+    NSRRouteMetrics *route = [[NSRConfig defaultConfig] requestMetricsByRoute][@"POST posts/:id"];
+    XCTAssertEqual(route.requestCount, 1);
+    XCTAssertEqual(route.failureCount, 1);
+    XCTAssertEqual(route.bytesSent, metrics.bytesSent);
+    
+    [[NSRConfig defaultConfig] resetRequestMetrics];
+    XCTAssertEqual([[NSRConfig defaultConfig] requestMetricsByRoute].count, 0);
+    
+    //phases of an asynchronous request
+    StubServer *server = [StubServer server];
+    NSMutableString *big = [NSMutableString string];
+    for (int i = 0; i < 500; i++) {
+        [big appendString:@"abcdefgh"];
+    }
+    StubRoute *slow = [server route:@"GET" path:@"slow" status:200 JSON:@{@"data":big}];
+    slow.latency = 0.1;
+    slow.bytesPerSecond = 40000;
+    [NSRConfig defaultConfig].rootURL = server.baseURL;
+    [NSRConfig defaultConfig].requestsPerSecond = 5;
+    
+    [[[NSRRequest GET] routeTo:@"slow"] sendSynchronous:&e];
+    
+    XCTestExpectation *done = [self expectationWithDescription:@"async"];
+    req = [[NSRRequest GET] routeTo:@"slow"];
+    [req sendAsynchronous:^(id result, NSError *error) {
+        [done fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    
+    metrics = req.metrics;
+    XCTAssertTrue(metrics.queueWaitDuration >= 0.15, @"Should have waited for the rate limiter");
+    XCTAssertTrue(metrics.timeToFirstByte >= 0.1, @"Should include the server's latency");
+    XCTAssertTrue(metrics.transferDuration >= 0.05, @"Should include the capped body");
+    XCTAssertEqualWithAccuracy(metrics.networkDuration, metrics.timeToFirstByte + metrics.transferDuration, 0.001);
+    
+    [server stop];
+}
+
+- (void) test_route_metrics_percentiles
+{
+    NSRRouteMetrics *route = [[NSRRouteMetrics alloc] init];
+    XCTAssertEqual(route.p50, 0);
+    
+    //1ms..100ms
+    for (int i = 1; i <= 100; i++)
+    {
+        NSRRequestMetrics *metrics = [[NSRRequestMetrics alloc] init];
+        metrics.totalDuration = i / 1000.0;
+        [route recordMetrics:metrics];
+    }
+    
+    XCTAssertEqual(route.requestCount, 100);
+    XCTAssertEqualWithAccuracy(route.meanLatency, 0.0505, 0.0001);
+    XCTAssertEqualWithAccuracy(route.p50, 0.050, 0.050 * 0.07);
+    XCTAssertEqualWithAccuracy(route.p95, 0.095, 0.095 * 0.07);
+    XCTAssertEqualWithAccuracy(route.p99, 0.099, 0.099 * 0.07);
+    XCTAssertEqualWithAccuracy([route latencyAtPercentile:100], 0.100, 0.100 * 0.07);
+    
+    NSRRouteMetrics *copy = [route copy];
+    [route recordMetrics:[[NSRRequestMetrics alloc] init]];
+    XCTAssertEqual(copy.requestCount, 100, @"Copies should be snapshots");
+}
+
+- (void) test_tracing
+{
+    [NSRConfig defaultConfig].rootURL = [NSURL URLWithString:@"http://ojeaoifjif"];
+    
+    [[NSRRequest GET] sendSynchronous:nil];
+    [NSRTracer startTracing];
+    XCTAssertTrue([NSRTracer isTracing]);
+    
+    NSRRequest *req = [[NSRRequest POST] routeTo:@"posts"];
+    req.body = @{@"title":@"hello"};
+    [req sendSynchronous:nil];
+    [Post objectsWithRemoteDictionaries:@[@{@"id":@1}, @{@"id":@2}]];
+    
+    [NSRTracer stopTracing];
+    XCTAssertFalse([NSRTracer isTracing]);
+    [[NSRRequest GET] sendSynchronous:nil];
+    
+    NSDictionary *trace = [NSJSONSerialization JSONObjectWithData:[NSRTracer traceData] options:0 error:nil];
+    NSMutableDictionary *spans = [NSMutableDictionary dictionary];
+    for (NSDictionary *event in trace[@"traceEvents"])
+    {
+        if ([event[@"ph"] isEqualToString:@"X"]) {
+            spans[event[@"name"]] = event;
+        }
+    }
+    
+    NSArray *expected = @[@"request", @"encode", @"network", @"parse", @"decode", @"objectsWithRemoteDictionaries"];
+    XCTAssertEqualObjects([NSSet setWithArray:spans.allKeys], [NSSet setWithArray:expected]);
+    XCTAssertEqualObjects(spans[@"request"][@"args"][@"detail"], @"POST posts");
+    XCTAssertEqualObjects(spans[@"objectsWithRemoteDictionaries"][@"args"][@"detail"], @"2");
+    XCTAssertNotNil(spans[@"network"][@"tid"]);
+    XCTAssertTrue([spans[@"request"][@"dur"] doubleValue] >= [spans[@"network"][@"dur"] doubleValue]);
+    
+    NSUInteger requestSpans = [[trace[@"traceEvents"] filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"name == 'request'"]] count];
+    XCTAssertEqual(requestSpans, 1, @"Should only record while tracing");
+    
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"nsrails-trace.json"];
+    XCTAssertTrue([NSRTracer writeTraceToFile:path error:nil]);
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+- (void) test_cancel_and_deadline
+{
+    //non-routable, so the connection just hangs until something stops it
+    [NSRConfig defaultConfig].rootURL = [NSURL URLWithString:@"http://10.255.255.1"];
+    
+    NSRRequest *req = [[NSRRequest GET] routeTo:@"posts"];
+    XCTAssertEqual([req HTTPRequest].timeoutInterval, [NSRConfig defaultConfig].timeoutInterval);
+    
+    req.deadline = [NSDate dateWithTimeIntervalSinceNow:10];
+    XCTAssertTrue([req HTTPRequest].timeoutInterval <= 10, @"Should cap the timeout at the deadline");
+    
+    //deadline already passed - shouldn't go out at all
+    req.deadline = [NSDate dateWithTimeIntervalSinceNow:-1];
+    NSError *e;
+    XCTAssertNil([req sendSynchronous:&e]);
+    XCTAssertEqualObjects(e.domain, NSURLErrorDomain);
+    XCTAssertEqual(e.code, NSURLErrorTimedOut);
+    
+    XCTestExpectation *expired = [self expectationWithDescription:@"expired before sending"];
+    NSRRequestHandle *handle = [req sendAsynchronous:^(id jsonRep, NSError *error) {
+        XCTAssertNil(jsonRep);
+        XCTAssertEqual(error.code, NSURLErrorTimedOut);
+        [expired fulfill];
+    }];
+    XCTAssertTrue(handle.isCancelled);
+    XCTAssertEqual(handle.request, req);
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertTrue(handle.isFinished);
+    
+    //deadline passes mid-flight
+    req.deadline = [NSDate dateWithTimeIntervalSinceNow:0.3];
+    XCTestExpectation *timedOut = [self expectationWithDescription:@"timed out in flight"];
+    handle = [req sendAsynchronous:^(id jsonRep, NSError *error) {
+        XCTAssertEqual(error.code, NSURLErrorTimedOut);
+        [timedOut fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertTrue(handle.isCancelled);
+    
+    //explicit cancel - never decodes
+    req.deadline = nil;
+    __block BOOL decoded = NO;
+    XCTestExpectation *cancelled = [self expectationWithDescription:@"cancelled"];
+    handle = [Post remoteAllAsync:^(NSArray *allRemote, NSError *error) {
+        decoded = (allRemote != nil);
+        XCTAssertEqual(error.code, NSURLErrorCancelled);
+        [cancelled fulfill];
+    }];
+    XCTAssertFalse(handle.isCancelled);
+    [handle cancel];
+    XCTAssertTrue(handle.isCancelled);
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertFalse(decoded);
+    
+    //cancelling again after it's finished does nothing
+    [handle cancel];
+}
+
+- (void) test_rate_limiting
+{
+    NSRRateLimiter *limiter = [[NSRRateLimiter alloc] initWithRate:10 burstSize:2];
+    XCTAssertEqual([limiter reserve], 0, @"Burst should go out right away");
+    XCTAssertEqual([limiter reserve], 0, @"Burst should go out right away");
+    XCTAssertEqualWithAccuracy([limiter reserve], 0.1, 0.02, @"Should be paced once the burst is used up");
+    XCTAssertEqualWithAccuracy([limiter reserve], 0.2, 0.02, @"Waiting requests should be spaced out");
+    
+    [limiter throttleWithRetryAfter:2];
+    XCTAssertEqual(limiter.currentRate, 5, @"429 should halve the rate");
+    XCTAssertEqualWithAccuracy([limiter remainingHold], 2, 0.05, @"Should hold for Retry-After");
+    XCTAssertTrue([limiter reserve] >= 1.9, @"Should hold new requests back too");
+    
+    for (int i = 0; i < 10; i++) {
+        [limiter throttleWithRetryAfter:0];
+    }
+    XCTAssertEqual(limiter.currentRate, 10.0/8, @"Rate should have a floor");
+    
+    [limiter recordSuccess];
+    XCTAssertEqual(limiter.currentRate, 10.0/8 + 10.0/16, @"Should recover as requests get through");
+    
+    NSURL *url = [NSURL URLWithString:@"http://myapp.com"];
+    NSHTTPURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL:url statusCode:429 HTTPVersion:@"HTTP/1.1" headerFields:@{@"Retry-After":@"3"}];
+    XCTAssertEqual([NSRRateLimiter retryAfterFromResponse:response], 3);
+    response = [[NSHTTPURLResponse alloc] initWithURL:url statusCode:429 HTTPVersion:@"HTTP/1.1" headerFields:@{@"Retry-After":@"Wed, 21 Oct 2015 07:28:00 GMT"}];
+    XCTAssertEqual([NSRRateLimiter retryAfterFromResponse:response], 0, @"Dates in the past shouldn't hold anything back");
+    response = [[NSHTTPURLResponse alloc] initWithURL:url statusCode:429 HTTPVersion:@"HTTP/1.1" headerFields:@{}];
+    XCTAssertEqual([NSRRateLimiter retryAfterFromResponse:response], 0);
+    
+    //config
+    NSRConfig *config = [NSRConfig defaultConfig];
+    XCTAssertEqual([config rateLimitersForRoute:@"posts/:id"].count, 0, @"No limit by default");
+    
+    config.requestsPerSecond = 5;
+    [config setRequestsPerSecond:1 burstSize:1 forRoute:@"posts/:id"];
+    NSArray *limiters = [config rateLimitersForRoute:@"posts/:id"];
+    XCTAssertEqual(limiters.count, 2);
+    XCTAssertEqual([limiters[0] currentRate], 1, @"Route limit should come first");
+    XCTAssertEqual([config rateLimitersForRoute:@"posts"].count, 1);
+    
+    NSRConfig *unarchived = [NSKeyedUnarchiver unarchiveObjectWithData:[NSKeyedArchiver archivedDataWithRootObject:config]];
+    XCTAssertEqual(unarchived.requestsPerSecond, 5);
+    XCTAssertEqual(unarchived.maximumRateLimitRetries, 3);
+    XCTAssertEqual([unarchived rateLimitersForRoute:@"posts/:id"].count, 2);
+    
+    [config setRequestsPerSecond:0 burstSize:0 forRoute:@"posts/:id"];
+    XCTAssertEqual([config rateLimitersForRoute:@"posts/:id"].count, 1);
+    
+    //pacing
+    config.requestsPerSecond = 10;
+    config.rootURL = [NSURL URLWithString:@"http://ojeaoifjif"];
+    NSDate *start = [NSDate date];
+    for (int i = 0; i < 3; i++) {
+        [[[NSRRequest GET] routeTo:@"posts"] sendSynchronous:nil];
+    }
+    XCTAssertTrue([[NSDate date] timeIntervalSinceDate:start] >= 0.18, @"Requests should have been paced");
+}
+
+- (void) test_stub_server
+{
+    StubServer *server = [StubServer server];
+    XCTAssertNotNil(server, @"Should've been able to listen on loopback");
+    [server addPostsAndResponsesRoutes];
+    
+    [[NSRConfig defaultConfig] setRootURL:server.baseURL];
+    
+    NSError *e;
+    Post *post = [[Post alloc] init];
+    post.author = @"dan";
+    post.content = @"hello";
+    XCTAssertTrue([post remoteCreate:&e], @"%@", e);
+    XCTAssertNotNil(post.remoteID);
+    
+    Post *fetched = [Post remoteObjectWithID:post.remoteID error:&e];
+    XCTAssertEqualObjects(fetched.content, @"hello");
+    
+    post.content = nil;
+    XCTAssertFalse([post remoteUpdate:&e]);
+    XCTAssertEqual(e.code, 422, @"Should validate like the rails app");
+    
+    //status injection
+    StubRoute *index = [server routeForMethod:@"GET" path:@"posts"];
+    [index injectStatus:500 times:1];
+    XCTAssertNil([Post remoteAll:&e]);
+    XCTAssertEqual(e.code, 500);
+    XCTAssertEqual([Post remoteAll:&e].count, 1, @"Injection should only have lasted one request");
+    
+    //latency, and a chunked body
+    index.latency = 0.2;
+    index.chunkSize = 8;
+    NSDate *start = [NSDate date];
+    XCTAssertEqual([Post remoteAll:&e].count, 1, @"%@", e);
+    XCTAssertTrue([[NSDate date] timeIntervalSinceDate:start] >= 0.2, @"Latency should have been added");
+    
+    //bandwidth
+    NSMutableString *big = [NSMutableString string];
+    for (int i = 0; i < 500; i++) {
+        [big appendString:@"abcdefgh"];
+    }
+    StubRoute *slow = [server route:@"GET" path:@"slow" status:200 JSON:@{@"data":big}];
+    slow.bytesPerSecond = 20000;
+    start = [NSDate date];
+    XCTAssertEqualObjects([[[NSRRequest GET] routeTo:@"slow"] sendSynchronous:&e][@"data"], big);
+    XCTAssertTrue([[NSDate date] timeIntervalSinceDate:start] >= 0.15, @"Bandwidth should have been capped");
+    
+    //429s get retried once the rate limiter backs off
+    [[NSRConfig defaultConfig] setRequestsPerSecond:100];
+    [index injectStatus:429 times:1];
+    index.retryAfter = 0.1;
+    NSUInteger hits = index.hits;
+    XCTAssertEqual([Post remoteAll:&e].count, 1, @"%@", e);
+    XCTAssertEqual(index.hits, hits + 2);
+    
+    XCTAssertTrue(server.requestCount >= 9);
+    [server stop];
+}
+
+- (void) test_root_url_failover
+{
+    NSArray *URLs = @[[NSURL URLWithString:@"http://a.myapp.com"], [NSURL URLWithString:@"http://b.myapp.com"]];
+    NSREndpointPool *pool = [[NSREndpointPool alloc] initWithURLs:URLs];
+    pool.policy = NSREndpointSelectionLeastOutstandingRequests;
+    pool.failureThreshold = 2;
+    pool.ejectionInterval = 0.2;
+    
+    BOOL trial;
+    NSREndpoint *a = [pool checkOutExcluding:nil trial:&trial];
+    NSREndpoint *b = [pool checkOutExcluding:nil trial:&trial];
+    XCTAssertNotEqual(a, b, @"Should go to the idle endpoint");
+    XCTAssertFalse(trial);
+    [pool checkIn:b trial:NO latency:0.1 outcome:NSREndpointSucceeded];
+    XCTAssertEqual([pool checkOutExcluding:nil trial:&trial], b, @"Should go to the one with nothing outstanding");
+    [pool checkIn:b trial:NO latency:0.1 outcome:NSREndpointSucceeded];
+    
+    [pool checkIn:a trial:NO latency:-1 outcome:NSREndpointFailed];
+    XCTAssertEqual([pool healthyURLs].count, (NSUInteger)2, @"One failure shouldn't eject");
+    
+    //one still out when it's ejected
+    NSREndpoint *late = [pool checkOutExcluding:b trial:&trial];
+    XCTAssertEqual(late, a);
+    [pool checkIn:[pool checkOutExcluding:b trial:&trial] trial:NO latency:-1 outcome:NSREndpointFailed];
+    XCTAssertEqual([pool healthyURLs].count, (NSUInteger)1, @"Should eject after failureThreshold failures in a row");
+    XCTAssertEqual([pool checkOutExcluding:b trial:&trial], b, @"Shouldn't use an ejected endpoint while there's another");
+    [pool checkIn:b trial:NO latency:0.1 outcome:NSREndpointSucceeded];
+    
+    [NSThread sleepForTimeInterval:0.25];
+    XCTAssertEqual([pool checkOutExcluding:b trial:&trial], a, @"Should get a trial request once the ejection's up");
+    XCTAssertTrue(trial);
+    XCTAssertEqual([pool checkOutExcluding:b trial:&trial], b, @"Only one trial request at a time");
+    XCTAssertFalse(trial);
+    [pool checkIn:b trial:NO latency:0.1 outcome:NSREndpointSucceeded];
+    
+    //the one sent before the ejection failing late shouldn't let another trial out while the real one's still going
+    [pool checkIn:late trial:NO latency:-1 outcome:NSREndpointFailed];
+    [NSThread sleepForTimeInterval:0.25];
+    XCTAssertEqual([pool checkOutExcluding:b trial:&trial], b, @"Only the trial request should end the trial");
+    XCTAssertFalse(trial);
+    [pool checkIn:b trial:NO latency:0.1 outcome:NSREndpointSucceeded];
+    
+    //a trial that's cancelled says nothing either way - still ejected, but the next trial can go
+    [pool checkIn:a trial:YES latency:-1 outcome:NSREndpointAbandoned];
+    XCTAssertEqual([pool healthyURLs].count, (NSUInteger)1, @"A cancelled trial shouldn't put it back");
+    XCTAssertEqual([pool checkOutExcluding:b trial:&trial], a);
+    XCTAssertTrue(trial);
+    
+    [pool checkIn:a trial:YES latency:0.1 outcome:NSREndpointSucceeded];
+    XCTAssertEqual([pool healthyURLs].count, (NSUInteger)2, @"A successful trial should put it back");
+    
+    //through requests
+    StubServer *serverA = [StubServer server];
+    StubServer *serverB = [StubServer server];
+    StubRoute *pingA = [serverA route:@"GET" path:@"ping" status:200 JSON:@{@"from":@"a"}];
+    StubRoute *pingB = [serverB route:@"GET" path:@"ping" status:200 JSON:@{@"from":@"b"}];
+    
+    NSRConfig *config = [NSRConfig defaultConfig];
+    config.rootURLs = @[serverA.baseURL, serverB.baseURL];
+    config.endpointEjectionInterval = 0.3;
+    XCTAssertEqualObjects(config.rootURL, serverA.baseURL, @"rootURL should be the first one");
+    
+    NSError *e;
+    for (int i = 0; i < 4; i++) {
+        XCTAssertNotNil([[[NSRRequest GET] routeTo:@"ping"] sendSynchronous:&e], @"%@", e);
+    }
+    XCTAssertEqual(pingA.hits, (NSUInteger)2, @"Should take turns");
+    XCTAssertEqual(pingB.hits, (NSUInteger)2, @"Should take turns");
+    
+    //a GET can be sent again somewhere else, and after 3 failures the endpoint's taken out
+    [pingA injectStatus:503 times:3];
+    for (int i = 0; i < 4; i++) {
+        XCTAssertEqualObjects([[[NSRRequest GET] routeTo:@"ping"] sendSynchronous:&e][@"from"], @"b", @"%@", e);
+    }
+    XCTAssertEqual(pingA.hits, (NSUInteger)5);
+    XCTAssertEqualObjects(config.healthyRootURLs, @[serverB.baseURL]);
+    
+    [NSThread sleepForTimeInterval:0.4];
+    for (int i = 0; i < 2; i++) {
+        XCTAssertNotNil([[[NSRRequest GET] routeTo:@"ping"] sendSynchronous:&e], @"%@", e);
+    }
+    XCTAssertEqual(pingA.hits, (NSUInteger)6, @"Should have tried it again");
+    XCTAssertEqual(config.healthyRootURLs.count, (NSUInteger)2, @"Should be back in rotation");
+    
+    //failovers and 429 retries are counted separately, so neither uses up the other's
+    config.requestsPerSecond = 100;
+    config.maximumRateLimitRetries = 1;
+    [pingA injectStatus:503 times:1];
+    [pingB injectStatus:429 times:1];
+    XCTAssertNotNil([[[NSRRequest GET] routeTo:@"ping"] sendSynchronous:&e], @"%@", e);
+    config.requestsPerSecond = 0;
+    
+    //a cancel says nothing about the endpoint, but a deadline running out counts against it like any timeout
+    pingA.latency = 1;
+    for (int i = 0; i < 4; i++)
+    {
+        XCTestExpectation *cancelled = [self expectationWithDescription:@"cancelled"];
+        NSRRequestHandle *handle = [[[NSRRequest GET] routeTo:@"ping"] sendAsynchronous:^(id jsonRep, NSError *error) {
+            [cancelled fulfill];
+        }];
+        [handle cancel];
+        [self waitForExpectationsWithTimeout:5 handler:nil];
+    }
+    XCTAssertEqual(config.healthyRootURLs.count, (NSUInteger)2, @"Cancelling shouldn't eject anything");
+    
+    __block NSUInteger timedOut = 0;
+    for (int i = 0; i < 12 && timedOut < 3; i++)
+    {
+        NSRRequest *request = [[NSRRequest GET] routeTo:@"ping"];
+        request.deadline = [NSDate dateWithTimeIntervalSinceNow:0.1];
+        XCTestExpectation *done = [self expectationWithDescription:@"deadline"];
+        [request sendAsynchronous:^(id jsonRep, NSError *error) {
+            if (error.code == NSURLErrorTimedOut) {
+                timedOut++;
+            }
+            [done fulfill];
+        }];
+        [self waitForExpectationsWithTimeout:5 handler:nil];
+    }
+    XCTAssertEqualObjects(config.healthyRootURLs, @[serverB.baseURL], @"Should eject an endpoint that keeps running past deadlines");
+    pingA.latency = 0;
+    
+    //never got there - anything's safe to send elsewhere
+    [serverB route:@"POST" path:@"ping" status:201 JSON:@{@"from":@"b"}];
+    [serverA stop];
+    for (int i = 0; i < 2; i++) {
+        XCTAssertEqualObjects([[[NSRRequest POST] routeTo:@"ping"] sendSynchronous:&e][@"from"], @"b", @"%@", e);
+    }
+    
+    NSRConfig *unarchived = [NSKeyedUnarchiver unarchiveObjectWithData:[NSKeyedArchiver archivedDataWithRootObject:config]];
+    XCTAssertEqualObjects(unarchived.rootURLs, config.rootURLs);
+    XCTAssertEqual(unarchived.endpointEjectionInterval, 0.3);
+    
+    config.rootURL = serverB.baseURL;
+    XCTAssertEqualObjects(config.rootURLs, @[serverB.baseURL], @"Setting rootURL should replace them all");
+    
+    [serverB stop];
+}
+
+- (void) test_cassette
+{
+    StubServer *server = [StubServer server];
+    [server addPostsAndResponsesRoutes];
+    [server routeForMethod:@"GET" path:@"posts"].latency = 0.2;
+    
+    NSRConfig *config = [NSRConfig defaultConfig];
+    config.rootURL = server.baseURL;
+    config.cassette = [[NSRCassette alloc] init];
+    XCTAssertTrue(config.cassette.recording);
+    
+    //record
+    NSError *e;
+    Post *post = [[Post alloc] init];
+    post.author = @"dan";
+    post.content = @"hello";
+    XCTAssertTrue([post remoteCreate:&e], @"%@", e);
+    XCTAssertEqual([Post remoteAll:&e].count, 1);
+    
+    XCTestExpectation *recorded = [self expectationWithDescription:@"recorded async"];
+    [Post remoteAllAsync:^(NSArray *allRemote, NSError *error) {
+        XCTAssertEqual(allRemote.count, 1);
+        [recorded fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    
+    NSArray *interactions = config.cassette.interactions;
+    XCTAssertEqual(interactions.count, 3);
+    NSRCassetteInteraction *index = interactions[1];
+    XCTAssertEqualObjects(index.httpMethod, @"GET");
+    XCTAssertEqual(index.statusCode, 200);
+    XCTAssertTrue(index.duration >= 0.2, @"Should've recorded how long it took");
+    XCTAssertTrue([interactions[2] offset] >= index.offset);
+    
+    //save, and replay with the server gone
+    [server stop];
+    NSString *file = [NSTemporaryDirectory() stringByAppendingPathComponent:@"cassette.json"];
+    XCTAssertTrue([config.cassette writeToFile:file error:&e], @"%@", e);
+    
+    NSRCassette *cassette = [NSRCassette cassetteWithContentsOfFile:file error:&e];
+    XCTAssertNotNil(cassette, @"%@", e);
+    XCTAssertFalse(cassette.recording);
+    XCTAssertEqualObjects([cassette.interactions[1] responseBody], index.responseBody, @"Bodies should be byte for byte");
+    XCTAssertEqualObjects([cassette.interactions[0] requestBody], [interactions[0] requestBody]);
+    config.cassette = cassette;
+    
+    Post *replayed = [[Post alloc] init];
+    replayed.author = @"dan";
+    replayed.content = @"hello";
+    XCTAssertTrue([replayed remoteCreate:&e], @"%@", e);
+    XCTAssertEqualObjects(replayed.remoteID, post.remoteID);
+    
+    NSDate *start = [NSDate date];
+    NSArray *all = [Post remoteAll:&e];
+    XCTAssertEqual(all.count, 1, @"%@", e);
+    XCTAssertEqualObjects([all[0] content], @"hello");
+    XCTAssertTrue([[NSDate date] timeIntervalSinceDate:start] >= 0.2, @"Should replay with the original timing");
+    
+    //async, scaled down
+    cassette.timeScale = 0;
+    XCTestExpectation *replayedAsync = [self expectationWithDescription:@"replayed async"];
+    start = [NSDate date];
+    [Post remoteAllAsync:^(NSArray *allRemote, NSError *error) {
+        XCTAssertEqual(allRemote.count, 1, @"%@", error);
+        [replayedAsync fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertTrue([[NSDate date] timeIntervalSinceDate:start] < 0.2, @"Timing should have been scaled");
+    
+    //everything's been played
+    XCTAssertNil([Post remoteAll:&e]);
+    XCTAssertEqual(e.code, NSURLErrorResourceUnavailable);
+    
+    cassette.repeatsInteractions = YES;
+    XCTAssertEqual([Post remoteAll:&e].count, 1, @"Should repeat the last match");
+    
+    [cassette rewind];
+    cassette.repeatsInteractions = NO;
+    XCTAssertEqual([Post remoteAll:&e].count, 1, @"Should start over after rewinding");
+}
+
+- (void) test_streaming_elements
+{
+    NSArray *array = @[@{@"id":@1, @"title":@"a \"quoted\" ]}, string"}, @[@1, @[@2]], @"bare", @-12.5, @YES, [NSNull null], @{}, @{@"nested":@{@"deep":@[@{}]}}];
+    NSData *json = [NSJSONSerialization dataWithJSONObject:array options:NSJSONWritingPrettyPrinted error:nil];
+    
+    //fed one byte at a time, to split every token
+    NSMutableArray *elements = [NSMutableArray array];
+    NSRJSONElementStream *stream = [[NSRJSONElementStream alloc] initWithReadingOptions:0 spoolThreshold:NSUIntegerMax elementHandler:^(id element) {
+        [elements addObject:element];
+    }];
+    
+    const char *bytes = json.bytes;
+    for (NSUInteger i = 0; i < json.length; i++) {
+        XCTAssertTrue([stream appendData:[NSData dataWithBytes:bytes + i length:1] error:nil]);
+    }
+    
+    XCTAssertTrue(stream.isArray);
+    XCTAssertTrue([stream finishWithError:nil]);
+    XCTAssertNil([stream finishDocument], @"Arrays shouldn't be kept around");
+    XCTAssertEqual(stream.elementCount, array.count);
+    XCTAssertEqualObjects(elements, array);
+    
+    //malformed element
+    stream = [[NSRJSONElementStream alloc] initWithReadingOptions:0 spoolThreshold:NSUIntegerMax elementHandler:nil];
+    NSError *e = nil;
+    XCTAssertFalse([stream appendData:[@"[{\"a\":}]" dataUsingEncoding:NSUTF8StringEncoding] error:&e]);
+    XCTAssertNotNil(e);
+    
+    //cut off before the closing ]
+    for (NSString *truncated in @[@"[1,2", @"[1,2,", @"[1,{\"a\":\"b", @"[1,2,3"])
+    {
+        stream = [[NSRJSONElementStream alloc] initWithReadingOptions:0 spoolThreshold:NSUIntegerMax elementHandler:nil];
+        XCTAssertTrue([stream appendData:[truncated dataUsingEncoding:NSUTF8StringEncoding] error:nil]);
+        e = nil;
+        XCTAssertFalse([stream finishWithError:&e], @"%@ should be incomplete", truncated);
+        XCTAssertEqual(e.code, NSPropertyListReadCorruptError);
+    }
+    
+    //through a request whose (chunked) response ends cleanly without its ]
+    StubServer *server = [StubServer server];
+    StubRoute *route = [server route:@"GET" path:@"posts" responder:^StubResponse *(StubRequest *request) {
+        return [StubResponse responseWithStatus:200 body:@"[{\"id\":1},{\"id\":2},{\"id\"" contentType:@"application/json"];
+    }];
+    route.chunkSize = 4;
+    [NSRConfig defaultConfig].rootURL = server.baseURL;
+    
+    [elements removeAllObjects];
+    __block NSError *error = nil;
+    XCTestExpectation *done = [self expectationWithDescription:@"streamed"];
+    [[[NSRRequest GET] routeTo:@"posts"] sendAsynchronousStreamingElements:^(id element) {
+        @synchronized(elements) {
+            [elements addObject:element];
+        }
+    } completion:^(id result, NSError *err) {
+        error = err;
+        [done fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    
+    XCTAssertEqual(elements.count, (NSUInteger)2, @"Complete elements should still have been handed off");
+    XCTAssertEqualObjects(error.domain, NSCocoaErrorDomain, @"Shouldn't be reported as a success");
+    XCTAssertEqual(error.code, NSPropertyListReadCorruptError);
+    
+    //elements are handed off on another thread, but still in the config the request was made in
+    NSRConfig *config = [[NSRConfig alloc] init];
+    config.rootURL = server.baseURL;
+    NSMutableArray *configs = [NSMutableArray array];
+    done = [self expectationWithDescription:@"streamed in config"];
+    [config useIn:^
+     {
+         [[[NSRRequest GET] routeTo:@"posts"] sendAsynchronousStreamingElements:^(id element) {
+             @synchronized(configs) {
+                 [configs addObject:[NSRConfig contextuallyRelevantConfig]];
+             }
+         } completion:^(id result, NSError *err) {
+             [done fulfill];
+         }];
+     }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    
+    XCTAssertEqual(configs.count, (NSUInteger)2);
+    for (NSRConfig *c in configs) {
+        XCTAssertEqual(c, config);
+    }
+    
+    [server stop];
+}
+
+- (void) test_streaming_document_spool
+{
+    NSMutableDictionary *dict = [NSMutableDictionary dictionary];
+    for (int i = 0; i < 1000; i++) {
+        dict[@(i).stringValue] = @"some value";
+    }
+    NSData *json = [NSJSONSerialization dataWithJSONObject:@{@"posts":dict} options:0 error:nil];
+    
+    for (NSNumber *threshold in @[@(NSUIntegerMax), @100])
+    {
+        NSRJSONElementStream *stream = [[NSRJSONElementStream alloc] initWithReadingOptions:0 spoolThreshold:threshold.unsignedIntegerValue elementHandler:nil];
+        for (NSUInteger i = 0; i < json.length; i += 500) {
+            XCTAssertTrue([stream appendData:[json subdataWithRange:NSMakeRange(i, MIN(500, json.length - i))] error:nil]);
+        }
+        
+        XCTAssertFalse(stream.isArray);
+        XCTAssertEqualObjects([stream finishDocument], json, @"Should get back the whole document, spooled (threshold %@) or not", threshold);
+    }
+}
+
+- (void) test_event_stream_parser
+{
+    NSMutableArray *events = [NSMutableArray array];
+    NSREventStreamParser *parser = [[NSREventStreamParser alloc] initWithEventHandler:^(NSString *name, NSString *data, NSString *eventID) {
+        [events addObject:@[name, data, eventID ?: [NSNull null]]];
+    }];
+    
+    NSMutableData *stream = [NSMutableData dataWithBytes:"\xEF\xBB\xBF" length:3];
+    [stream appendData:[@":heartbeat\r\n"
+                        @"data: first\n\n"
+                        @"event: update\r\nid: 7\r\ndata: {\"a\":1}\rdata:two\r\n\r\n"
+                        @"retry: 1500\n"
+                        @"id: 8\n\n"
+                        @"data\n\n"
+                        @"retry: soon\n"
+                        @"data: partial" dataUsingEncoding:NSUTF8StringEncoding]];
+    
+    //fed one byte at a time, to split every CRLF
+    const char *bytes = stream.bytes;
+    for (NSUInteger i = 0; i < stream.length; i++) {
+        [parser appendData:[NSData dataWithBytes:bytes + i length:1]];
+    }
+    
+    NSArray *expected = @[@[@"message", @"first", [NSNull null]],
+                          @[@"update", @"{\"a\":1}\ntwo", @"7"],
+                          @[@"message", @"", @"8"]];
+    XCTAssertEqualObjects(events, expected, @"Events without data shouldn't be dispatched, but their ids should count");
+    XCTAssertEqualObjects(parser.lastEventID, @"8");
+    XCTAssertEqual(parser.retryInterval, 1.5, @"Should ignore retry: values that aren't numbers");
+    
+    //a dropped connection loses the partial event
+    [parser reset];
+    [parser appendData:[@"\n\n" dataUsingEncoding:NSUTF8StringEncoding]];
+    XCTAssertEqual(events.count, (NSUInteger)3);
+    XCTAssertEqualObjects(parser.lastEventID, @"8", @"Should keep the last id across reconnects");
+}
+
+- (void) test_subscription
+{
+    StubServer *server = [StubServer server];
+    StubEventStream *stream = [server eventStreamAtPath:@"posts/stream"];
+    
+    NSRConfig *config = [NSRConfig defaultConfig];
+    config.rootURL = server.baseURL;
+    config.performsCompletionBlocksOnMainThread = NO;
+    config.subscriptionRetryInterval = 0.1;
+    
+    void (^waitUntil)(BOOL (^)(void)) = ^(BOOL (^condition)(void)) {
+        [self expectationForPredicate:[NSPredicate predicateWithBlock:^BOOL(id object, NSDictionary *bindings) {
+            return condition();
+        }] evaluatedWithObject:nil handler:nil];
+        [self waitForExpectationsWithTimeout:5 handler:nil];
+    };
+    
+    Post *existing = [Post objectWithRemoteDictionary:@{@"id":@1, @"author":@"dan", @"content":@"hi"}];
+    
+    NSMutableArray *events = [NSMutableArray array];
+    NSRSubscription *subscription = [Post remoteSubscribeWithObjects:@[existing] handler:^(NSRSubscriptionEvent *event) {
+        @synchronized(events) {
+            [events addObject:event];
+        }
+    }];
+    XCTAssertTrue(subscription.isActive);
+    
+    waitUntil(^BOOL { return subscription.isConnected && stream.openConnectionCount == 1; });
+    XCTAssertEqualObjects(stream.lastEventIDs, @[[NSNull null]]);
+    
+    [stream sendEvent:@"update" JSON:@{@"id":@1, @"content":@"edited"} eventID:@"1"];
+    [stream sendEvent:@"create" JSON:@{@"post":@{@"id":@2, @"author":@"michael"}} eventID:@"2"];
+    [stream sendText:@": heartbeat\n\n"];
+    [stream sendEvent:nil JSON:@{@"action":@"destroy", @"post":@{@"id":@1}} eventID:@"3"];
+    [stream sendEvent:@"ping" JSON:@{} eventID:nil];
+    
+    waitUntil(^BOOL { @synchronized(events) { return (events.count == 4); } });
+    
+    NSRSubscriptionEvent *update = events[0];
+    XCTAssertEqual(update.action, NSRSubscriptionActionUpdate);
+    XCTAssertEqual(update.object, existing, @"Should update live objects in place");
+    XCTAssertEqualObjects(existing.content, @"edited");
+    XCTAssertEqualObjects(existing.author, @"dan");
+    XCTAssertEqualObjects(update.eventID, @"1");
+    
+    NSRSubscriptionEvent *create = events[1];
+    XCTAssertEqual(create.action, NSRSubscriptionActionCreate);
+    XCTAssertEqualObjects([create.object remoteID], @2);
+    XCTAssertEqualObjects([create.object author], @"michael", @"Should unwrap the model name like any response");
+    
+    NSRSubscriptionEvent *destroy = events[2];
+    XCTAssertEqual(destroy.action, NSRSubscriptionActionDestroy, @"Should take the action from the data if the event has no type");
+    XCTAssertEqual(destroy.object, existing);
+    
+    NSRSubscriptionEvent *ping = events[3];
+    XCTAssertEqual(ping.action, NSRSubscriptionActionNone);
+    XCTAssertEqualObjects(ping.name, @"ping");
+    XCTAssertNil(ping.object);
+    XCTAssertEqualObjects(ping.eventID, @"3");
+    
+    XCTAssertEqualObjects(subscription.objects, @[create.object]);
+    XCTAssertEqualObjects(subscription.lastEventID, @"3");
+    
+    //server goes away - whatever's sent before the subscription's back should be resumed
+    [stream disconnectClients];
+    [stream sendEvent:@"update" JSON:@{@"id":@2, @"content":@"missed"} eventID:@"4"];
+    
+    waitUntil(^BOOL { @synchronized(events) { return (events.count == 5); } });
+    XCTAssertEqual(stream.connectionCount, (NSUInteger)2);
+    XCTAssertEqualObjects(stream.lastEventIDs[1], @"3");
+    XCTAssertEqualObjects([create.object content], @"missed");
+    
+    //handlers on a concurrent queue shouldn't mean events are applied concurrently
+    config.completionQueue = [[NSOperationQueue alloc] init];
+    for (int i = 10; i < 60; i++)
+    {
+        [stream sendEvent:@"create" JSON:@{@"post":@{@"id":@(i)}} eventID:[@(i) stringValue]];
+    }
+    waitUntil(^BOOL { @synchronized(events) { return (events.count == 55); } });
+    XCTAssertEqual(subscription.objects.count, (NSUInteger)51);
+    XCTAssertEqualObjects([subscription.objects.lastObject remoteID], @59, @"Should apply events in order");
+    
+    [subscription stop];
+    XCTAssertFalse(subscription.isActive);
+    waitUntil(^BOOL { return stream.openConnectionCount == 0; });
+    
+    [server stop];
+    [NSRConfig resetConfigs];
+}
+
+- (void) test_subscription_while_recording
+{
+    StubServer *server = [StubServer server];
+    StubEventStream *stream = [server eventStreamAtPath:@"posts/stream"];
+    [server addPostsAndResponsesRoutes];
+    
+    NSRConfig *config = [NSRConfig defaultConfig];
+    config.rootURL = server.baseURL;
+    config.performsCompletionBlocksOnMainThread = NO;
+    config.subscriptionRetryInterval = 0.1;
+    config.cassette = [[NSRCassette alloc] init];
+    
+    void (^waitUntil)(BOOL (^)(void)) = ^(BOOL (^condition)(void)) {
+        [self expectationForPredicate:[NSPredicate predicateWithBlock:^BOOL(id object, NSDictionary *bindings) {
+            return condition();
+        }] evaluatedWithObject:nil handler:nil];
+        [self waitForExpectationsWithTimeout:5 handler:nil];
+    };
+    
+    NSMutableArray *events = [NSMutableArray array];
+    NSRSubscription *subscription = [Post remoteSubscribeWithObjects:@[] handler:^(NSRSubscriptionEvent *event) {
+        @synchronized(events) {
+            [events addObject:event];
+        }
+    }];
+    
+    //the recording cassette sits between the subscription and its connection - callbacks should still get through
+    waitUntil(^BOOL { return subscription.isConnected && stream.openConnectionCount == 1; });
+    [stream sendEvent:@"create" JSON:@{@"post":@{@"id":@2, @"author":@"michael"}} eventID:@"1"];
+    waitUntil(^BOOL { @synchronized(events) { return (events.count == 1); } });
+    XCTAssertEqualObjects([[events[0] object] author], @"michael");
+    
+    [stream disconnectClients];
+    waitUntil(^BOOL { return subscription.isConnected && stream.connectionCount == 2; });
+    
+    [subscription stop];
+    waitUntil(^BOOL { return stream.openConnectionCount == 0; });
+    
+    NSRCassetteInteraction *recorded = config.cassette.interactions[0];
+    XCTAssertEqual(recorded.statusCode, 200);
+    XCTAssertNil(recorded.responseBody, @"Shouldn't hold on to an event stream");
+    
+    XCTAssertFalse(recorded.responseBodyDropped);
+    
+    //streamed bodies are read from a copy of the stream
+    NSError *e;
+    NSRMultipartBody *multipart = [[NSRMultipartBody alloc] init];
+    [multipart addValue:@"dan" forName:@"post[author]"];
+    NSRRequest *upload = [[NSRRequest POST] routeTo:@"posts"];
+    upload.body = multipart;
+    [upload sendSynchronous:&e];
+    
+    NSData *uploaded = [[config.cassette.interactions lastObject] requestBody];
+    XCTAssertEqual(uploaded.length, (NSUInteger)multipart.contentLength);
+    XCTAssertTrue([[[NSString alloc] initWithData:uploaded encoding:NSUTF8StringEncoding] rangeOfString:@"dan"].location != NSNotFound);
+    
+    //bodies past the limit are passed along, just not kept
+    Post *post = [[Post alloc] init];
+    post.author = @"dan";
+    post.content = @"a post that's longer than the limit";
+    XCTAssertTrue([post remoteCreate:&e], @"%@", e);
+    
+    config.cassette.maximumRecordedBodyLength = 16;
+    XCTAssertEqual([Post remoteAll:&e].count, 1, @"%@", e);
+    XCTAssertNil([[config.cassette.interactions lastObject] responseBody]);
+    XCTAssertTrue([[config.cassette.interactions lastObject] responseBodyDropped]);
+    
+    NSData *data = [config.cassette dataRepresentation];
+    NSRCassette *loaded = [NSRCassette cassetteWithData:data error:&e];
+    XCTAssertNotNil(loaded, @"%@", e);
+    XCTAssertNil([[loaded.interactions lastObject] responseBody], @"A dropped body should stay dropped when saved");
+    XCTAssertTrue([[loaded.interactions lastObject] responseBodyDropped]);
+    
+    //...and can't be replayed as an empty response
+    config.cassette = loaded;
+    loaded.timeScale = 0;
+    loaded.repeatsInteractions = YES;
+    e = nil;
+    XCTAssertNil([Post remoteAll:&e]);
+    XCTAssertEqual(e.code, NSURLErrorResourceUnavailable);
+    
+    __block NSError *asyncError = nil;
+    XCTestExpectation *replayed = [self expectationWithDescription:@"replayed"];
+    [Post remoteAllAsync:^(NSArray *objects, NSError *error) {
+        asyncError = error;
+        [replayed fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertEqual(asyncError.code, NSURLErrorResourceUnavailable);
+    
+    [server stop];
+    [NSRConfig resetConfigs];
+}
+
+- (void) test_base64
+{
+    //RFC 4648 test vectors
+    NSDictionary *vectors = @{@"":@"", @"f":@"Zg==", @"fo":@"Zm8=", @"foo":@"Zm9v", @"foob":@"Zm9vYg==", @"fooba":@"Zm9vYmE=", @"foobar":@"Zm9vYmFy"};
+    
+    for (NSString *plain in vectors)
+    {
+        NSData *data = [plain dataUsingEncoding:NSUTF8StringEncoding];
+        XCTAssertEqualObjects([NSRRequest base64EncodingOfData:data], vectors[plain]);
+        XCTAssertEqualObjects([NSRRequest dataByDecodingBase64String:vectors[plain]], data);
+    }
+    
+    //every byte value, at every padding length
+    NSMutableData *bytes = [NSMutableData dataWithCapacity:258];
+    for (int i = 0; i < 258; i++)
+    {
+        unsigned char c = i % 256;
+        [bytes appendBytes:&c length:1];
+    }
+    
+    for (NSUInteger length = 255; length <= 258; length++)
+    {
+        NSData *data = [bytes subdataWithRange:NSMakeRange(0, length)];
+        NSString *encoded = [NSRRequest base64EncodingOfData:data];
+        XCTAssertEqual(encoded.length, ((length + 2) / 3) * 4);
+        XCTAssertEqualObjects([NSRRequest dataByDecodingBase64String:encoded], data);
+    }
+    
+    XCTAssertEqualObjects([NSRRequest dataByDecodingBase64String:@"Zm9v\r\nYmFy"], [@"foobar" dataUsingEncoding:NSUTF8StringEncoding], @"Should skip line breaks");
+    XCTAssertNil([NSRRequest dataByDecodingBase64String:@"Zm9v!"], @"Should fail on characters outside the alphabet");
+    XCTAssertNil([NSRRequest dataByDecodingBase64String:@"Zg==Zg=="], @"Should fail on data after padding");
+    XCTAssertNil([NSRRequest dataByDecodingBase64String:@"Zm9vY"], @"Should fail on a dangling character");
+    XCTAssertNil([NSRRequest dataByDecodingBase64String:@"Zm9vY==="], @"Should fail on a dangling character, padded or not");
+    XCTAssertNil([NSRRequest dataByDecodingBase64String:@"Zh=="], @"Should fail on non-zero leftover bits");
+    XCTAssertNil([NSRRequest dataByDecodingBase64String:@"Zm9="], @"Should fail on non-zero leftover bits");
+    XCTAssertEqualObjects([NSRRequest dataByDecodingBase64String:@"Zm8"], [@"fo" dataUsingEncoding:NSUTF8StringEncoding], @"Padding is optional");
+}
+
+//the encoder as it was before it was rewritten, to compare against
+static NSString *NSRLegacyBase64Encoding(NSData *data)
+{
+    static char encodingTable[64] = {
+        'A','B','C','D','E','F','G','H','I','J','K','L','M','N','O','P',
+        'Q','R','S','T','U','V','W','X','Y','Z','a','b','c','d','e','f',
+        'g','h','i','j','k','l','m','n','o','p','q','r','s','t','u','v',
+        'w','x','y','z','0','1','2','3','4','5','6','7','8','9','+','/' };
+    
+    const unsigned char *bytes = [data bytes];
+    NSMutableString *result = [NSMutableString stringWithCapacity:[data length]];
+    unsigned long ixtext = 0;
+    unsigned long lentext = [data length];
+    long ctremaining = 0;
+    unsigned char inbuf[3], outbuf[4];
+    unsigned short i = 0;
+    unsigned short ctcopy = 0;
+    unsigned long ix = 0;
+    
+    while( YES ) {
+        ctremaining = lentext - ixtext;
+        if( ctremaining <= 0 ) break;
+        
+        for( i = 0; i < 3; i++ ) {
+            ix = ixtext + i;
+            if( ix < lentext ) inbuf[i] = bytes[ix];
+            else inbuf [i] = 0;
+        }
+        
+        outbuf [0] = (inbuf [0] & 0xFC) >> 2;
+        outbuf [1] = ((inbuf [0] & 0x03) << 4) | ((inbuf [1] & 0xF0) >> 4);
+        outbuf [2] = ((inbuf [1] & 0x0F) << 2) | ((inbuf [2] & 0xC0) >> 6);
+        outbuf [3] = inbuf [2] & 0x3F;
+        ctcopy = 4;
+        
+        switch( ctremaining ) {
+            case 1:
+                ctcopy = 2;
+                break;
+            case 2:
+                ctcopy = 3;
+                break;
+        }
+        
+        for( i = 0; i < ctcopy; i++ )
+            [result appendFormat:@"%c", encodingTable[outbuf[i]]];
+        
+        for( i = ctcopy; i < 4; i++ )
+            [result appendString:@"="];
+        
+        ixtext += 3;
+    }
+    
+    return [NSString stringWithString:result];
+}
+
+- (void) test_base64_performance
+{
+    NSMutableData *data = [NSMutableData dataWithLength:1024 * 1024];
+    
+    //64 KB is plenty to tell them apart - the old one formats a string per character
+    NSMutableData *sample = [NSMutableData dataWithLength:64 * 1024];
+    unsigned char *sampleBytes = sample.mutableBytes;
+    for (NSUInteger i = 0; i < sample.length; i++) {
+        sampleBytes[i] = (unsigned char)(i * 31 + 7);
+    }
+    XCTAssertEqualObjects([NSRRequest base64EncodingOfData:sample], NSRLegacyBase64Encoding(sample), @"Should encode exactly like the old encoder");
+    
+    Benchmark *bench = [[Benchmark alloc] init];
+    BenchmarkResult *legacy = [bench run:@"base64_encode_legacy" block:^{
+        NSRLegacyBase64Encoding(sample);
+    }];
+    BenchmarkResult *current = [bench run:@"base64_encode" block:^{
+        [NSRRequest base64EncodingOfData:sample];
+    }];
+    NSLog(@"[NSRails] Base64 encoding 64 KB: %.0f ns (was %.0f ns, %.1fx)", current.nsPerOp, legacy.nsPerOp, legacy.nsPerOp / current.nsPerOp);
+    XCTAssertTrue(current.nsPerOp < legacy.nsPerOp, @"Shouldn't be slower than the encoder it replaced");
+    
+    [self measureBlock:^{
+        NSString *encoded = [NSRRequest base64EncodingOfData:data];
+        [NSRRequest dataByDecodingBase64String:encoded];
+    }];
+}
+
 - (void) test_serialization
 {
     NSString *file = [NSHomeDirectory() stringByAppendingPathComponent:@"test.dat"];
@@ -660,6 +2182,7 @@
     NSRRequest *req2 = [NSKeyedUnarchiver unarchiveObjectWithFile:file];
     XCTAssertEqualObjects(req.httpMethod, req2.httpMethod, @"Should've carried over");    
     XCTAssertEqualObjects(req.route, req2.route, @"Should've carried over");    
+    XCTAssertEqualObjects(req.routeTemplate, req2.routeTemplate, @"Should've carried over, so metrics and rate limits still go by route");
     XCTAssertEqualObjects(req.queryParameters, req2.queryParameters, @"Should've carried over");    
     XCTAssertEqualObjects(req.additionalHTTPHeaders, req2.additionalHTTPHeaders, @"Should've carried over");    
     XCTAssertEqualObjects(req.config.rootURL, req2.config.rootURL, @"Should've carried over");